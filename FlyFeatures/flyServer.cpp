@@ -2124,6 +2124,13 @@ bool CFlyServerJSON::pushStatistic(const bool p_is_sync_run)
             l_stat_info["SizeTTHCache"] = CFlylinkDBManager::get_tth_cache_size();
             l_stat_info["SizeNotExistsCache"] = ShareManager::get_cache_size_file_not_exists_set();
             l_stat_info["SizeSearchFileCache"] = ShareManager::get_cache_file_map();
+            {
+                const auto l_cache_stat = ShareManager::getSearchCacheStat();
+                l_stat_info["SearchCacheBytes"] = Util::toString(l_cache_stat.m_bytes);
+                l_stat_info["SearchCacheHits"] = Util::toString(l_cache_stat.m_hits + l_cache_stat.m_negative_hits);
+                l_stat_info["SearchCacheMisses"] = Util::toString(l_cache_stat.m_misses);
+                l_stat_info["SearchCacheHitRate"] = l_cache_stat.getHitRatePercent();
+            }
 			l_stat_info["Size"] = ShareManager::getShareSizeString();
 			// TODO -       Clients
 			l_stat_info["Users"] = Util::toString(ClientManager::getTotalUsers());
@@ -3280,6 +3287,13 @@ bool getMediaInfo(const string& p_name, CFlyMediaInfo& p_media, int64_t p_size,
 	try
 	{
 		static MediaInfoLib::MediaInfo g_media_info_lib;
+		static bool g_is_init_media_info_lib = false;
+		if (!g_is_init_media_info_lib)
+		{
+			g_is_init_media_info_lib = true;
+			// Only the headers of the container - the tags we need are there, the whole file is not scanned
+			g_media_info_lib.Option(_T("ParseSpeed"), _T("0"));
+		}
 		if (p_size < SETTING(MIN_MEDIAINFO_SIZE) * 1024 * 1024) // TODO: p_size?
 			return false;
 		const string l_file_ext = Text::toLower(Util::getFileExtWithoutDot(p_name));
@@ -37,7 +37,9 @@ ADLSearch::ADLSearch() :
 	destDir("ADLSearch"),
 	ddIndex(0),
 	isForbidden(false),
-	raw(0)
+	raw(0),
+	m_min_size_bytes(-1),
+	m_max_size_bytes(-1)
 {
 }
 
@@ -190,30 +192,25 @@ int64_t ADLSearch::GetSizeBase() const
 
 void ADLSearch::prepare(StringMap& params)
 {
-	// Prepare quick search of substrings
-	stringSearches.clear();
-	
 	// Replace parameters such as %[nick]
 	const string s = Util::formatParams(searchString, params, false);
 	
-	// Split into substrings
-	const StringTokenizer<string> st(s, ' ');
-	for (auto i = st.getTokens().cbegin(), iend = st.getTokens().cend(); i != iend; ++i)
-	{
-		if (!i->empty())
-		{
-			// Add substring search
-			stringSearches.push_back(StringSearch(*i));
-		}
-	}
+	// Split into substrings (used if searchString is not a valid regular expression)
+	const StringTokenizer<string> st(Text::toLower(s), ' ');
+	
+	// The regular expression is compiled once here, not for every file of the list
+	m_rule.compile(searchString, Text::toLower(searchString), st.getTokens());
+	
+	m_min_size_bytes = minFileSize >= 0 ? minFileSize * GetSizeBase() : -1;
+	m_max_size_bytes = maxFileSize >= 0 ? maxFileSize * GetSizeBase() : -1;
 }
 
 inline void ADLSearch::unprepare()
 {
-	stringSearches.clear();
+	m_rule.clear();
 }
 
-bool ADLSearch::matchesFile(const string& f, const string& fp, int64_t size) const
+bool ADLSearch::matchesFile(const string& f, const string& p_low_f, const string& fp, const string& p_low_fp, int64_t size) const
 {
 	// Check status
 	if (!isActive)
@@ -224,12 +221,12 @@ bool ADLSearch::matchesFile(const string& f, const string& fp, int64_t size) con
 	// Check size for files
 	if (size >= 0 && (sourceType == OnlyFile || sourceType == FullPath))
 	{
-		if (minFileSize >= 0 && size < minFileSize * GetSizeBase())
+		if (m_min_size_bytes >= 0 && size < m_min_size_bytes)
 		{
 			// Too small
 			return false;
 		}
-		if (maxFileSize >= 0 && size > maxFileSize * GetSizeBase())
+		if (m_max_size_bytes >= 0 && size > m_max_size_bytes)
 		{
 			// Too large
 			return false;
@@ -243,13 +240,13 @@ bool ADLSearch::matchesFile(const string& f, const string& fp, int64_t size) con
 		case OnlyDirectory:
 			return false;
 		case OnlyFile:
-			return searchAll(f);
+			return searchAll(f, p_low_f);
 		case FullPath:
-			return searchAll(fp);
+			return searchAll(fp, p_low_fp);
 	}
 }
 
-bool ADLSearch::matchesDirectory(const string& d) const
+bool ADLSearch::matchesDirectory(const string& d, const string& p_low_d) const
 {
 	// Check status
 	if (!isActive)
@@ -262,30 +259,10 @@ bool ADLSearch::matchesDirectory(const string& d) const
 	}
 	
 	// Do search
-	return searchAll(d);
-}
-
-bool ADLSearch::searchAll(const string& s) const
-{
-	try
-	{
-		std::regex reg(searchString, std::regex_constants::icase);
-		return std::regex_search(s, reg);
-	}
-	catch (...) {}
-	
-	// Match all substrings
-	for (auto i = stringSearches.cbegin(), iend = stringSearches.cend(); i != iend; ++i)
-	{
-		if (!i->match(s))
-		{
-			return false;
-		}
-	}
-	return !stringSearches.empty();
+	return searchAll(d, p_low_d);
 }
 
-ADLSearchManager::ADLSearchManager() : breakOnFirst(false), sentRaw(false)
+ADLSearchManager::ADLSearchManager() : breakOnFirst(false), sentRaw(false), m_is_full_path_search(false)
 {
 	load();
 }
@@ -459,15 +436,28 @@ void ADLSearchManager::matchesFile(DestDirList& destDirVector, DirectoryListing:
 		return;
 	}
 	
-	string filePath = fullPath + "\\" + currentFile->getName();// TODO Crash
+	if (m_file_searches.empty())
+	{
+		return;
+	}
+	// Names are lower-cased once for all the searches
+	const string l_low_name = Text::toLower(currentFile->getName());
+	string filePath;
+	string l_low_file_path;
+	if (m_is_full_path_search)
+	{
+		filePath = fullPath + "\\" + currentFile->getName();// TODO Crash
+		l_low_file_path = Text::toLower(filePath);
+	}
 	// Match searches
-	for (auto is = collection.cbegin(); is != collection.cend(); ++is)
+	for (auto i = m_file_searches.cbegin(); i != m_file_searches.cend(); ++i)
 	{
+		const auto is = collection.cbegin() + *i;
 		if (destDirVector[is->ddIndex].fileAdded)
 		{
 			continue;
 		}
-		if (is->matchesFile(currentFile->getName(), filePath, currentFile->getSize()))
+		if (is->matchesFile(currentFile->getName(), l_low_name, filePath, l_low_file_path, currentFile->getSize()))
 		{
 			auto copyFile = new DirectoryListing::File(*currentFile, true);
 			copyFile->setFlags(currentFile->getFlags());
@@ -523,19 +513,21 @@ void ADLSearchManager::matchesDirectory(DestDirList& destDirVector, DirectoryLis
 	}
 	
 	// Prepare to match searches
-	if (currentDir->getName().size() < 1)
+	if (currentDir->getName().size() < 1 || m_directory_searches.empty())
 	{
 		return;
 	}
+	const string l_low_name = Text::toLower(currentDir->getName());
 	
 	// Match searches
-	for (auto is = collection.cbegin(); is != collection.cend(); ++is)
+	for (auto i = m_directory_searches.cbegin(); i != m_directory_searches.cend(); ++i)
 	{
+		const auto is = collection.cbegin() + *i;
 		if (destDirVector[is->ddIndex].subdir != NULL)
 		{
 			continue;
 		}
-		if (is->matchesDirectory(currentDir->getName()))
+		if (is->matchesDirectory(currentDir->getName(), l_low_name))
 		{
 			destDirVector[is->ddIndex].subdir =
 			    new DirectoryListing::AdlDirectory(fullPath, destDirVector[is->ddIndex].dir, currentDir->getName());
@@ -607,9 +599,28 @@ void ADLSearchManager::prepareDestinationDirectories(DestDirList& destDirVector,
 		}
 	}
 	// Prepare all searches
+	m_file_searches.clear();
+	m_directory_searches.clear();
+	m_is_full_path_search = false;
 	for (auto ip = collection.begin(); ip != collection.end(); ++ip)
 	{
 		ip->prepare(params);
+		if (!ip->isActive)
+		{
+			continue;
+		}
+		if (ip->sourceType == ADLSearch::OnlyDirectory)
+		{
+			m_directory_searches.push_back(ip - collection.begin());
+		}
+		else
+		{
+			m_file_searches.push_back(ip - collection.begin());
+			if (ip->sourceType == ADLSearch::FullPath)
+			{
+				m_is_full_path_search = true;
+			}
+		}
 	}
 }
 
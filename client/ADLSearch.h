@@ -28,6 +28,7 @@
 #include "SettingsManager.h"
 #include "StringSearch.h"
 #include "DirectoryListing.h"
+#include "CFlyADLRule.h"
 
 class AdlSearchManager;
 
@@ -94,14 +95,20 @@ class ADLSearch
 		void prepare(StringMap& params);
 		void unprepare();
 		
-		/// Search for file match
-		bool matchesFile(const string& f, const string& fp, int64_t size) const;
+		/// Search for file match (p_low_* - the same names lower-cased)
+		bool matchesFile(const string& f, const string& p_low_f, const string& fp, const string& p_low_fp, int64_t size) const;
 		/// Search for directory match
-		bool matchesDirectory(const string& d) const;
-		
-		/// Substring searches
-		StringSearch::List stringSearches;
-		bool searchAll(const string& s) const;
+		bool matchesDirectory(const string& d, const string& p_low_d) const;
+		
+		/// Compiled search string
+		CFlyADLRule m_rule;
+		/// Size limits in bytes (-1 - do not check), calculated in prepare
+		int64_t m_min_size_bytes;
+		int64_t m_max_size_bytes;
+		bool searchAll(const string& s, const string& p_low_s) const
+		{
+			return m_rule.match(s, p_low_s);
+		}
 };
 
 /// Class that holds all active searches
@@ -154,6 +161,11 @@ class ADLSearchManager : public Singleton<ADLSearchManager>
 		void finalizeDestinationDirectories(DestDirList& destDirVector, DirectoryListing::Directory* root);
 		
 		static string getConfigFile();
+		
+		/// Indexes of the active searches in collection (filled in prepareDestinationDirectories)
+		vector<size_t> m_file_searches;
+		vector<size_t> m_directory_searches;
+		bool m_is_full_path_search;
 };
 
 #endif // !defined(ADL_SEARCH_H)
@@ -20,6 +20,7 @@
 #include "AdcCommand.h"
 
 #include "ClientManager.h"
+#include "CFlyAdcCommandView.h"
 
 AdcCommand::AdcCommand(uint32_t aCmd, char aType /* = TYPE_CLIENT */) : m_cmdInt(aCmd), m_from(0), m_type(aType), m_to(0)
 {
@@ -39,282 +40,151 @@ AdcCommand::AdcCommand(Severity sev, Error err, const string& desc, char aType /
 	m_cmd[3] = 0;
 }
 
-AdcCommand::AdcCommand(const string& aLine, bool nmdc /* = false */) : m_cmdInt(0), m_type(TYPE_CLIENT)
+AdcCommand::AdcCommand(const string& aLine, bool nmdc /* = false */) : m_cmdInt(0), m_from(0), m_to(0), m_type(TYPE_CLIENT)
 {
 	parse(aLine, nmdc);
 	dcassert(m_cmd[3] == 0);
 	m_cmd[3] = 0;
 }
 
-void AdcCommand::parse(const string& aLine, bool nmdc /* = false */)
+AdcCommand::AdcCommand(const char* p_line, size_t p_len, bool nmdc /* = false */) : m_cmdInt(0), m_from(0), m_to(0), m_type(TYPE_CLIENT)
 {
-	string::size_type i = 5;
-	//m_CID.init();
-	if (nmdc)
-	{
-		// "$ADCxxx ..."
-		if (aLine.length() < 7)
-			throw ParseException("Too short");
-		m_type = TYPE_CLIENT;
-		m_cmd[0] = aLine[4];
-		m_cmd[1] = aLine[5];
-		m_cmd[2] = aLine[6];
-		i += 3;
-	}
-	else
-	{
-		// "yxxx ..."
-		if (aLine.length() < 4)
-			throw ParseException("Too short");
-		m_type = aLine[0];
-		m_cmd[0] = aLine[1];
-		m_cmd[1] = aLine[2];
-		m_cmd[2] = aLine[3];
-	}
-	
-	if (m_type != TYPE_BROADCAST && m_type != TYPE_CLIENT && m_type != TYPE_DIRECT && m_type != TYPE_ECHO && m_type != TYPE_FEATURE && m_type != TYPE_INFO && m_type != TYPE_HUB && m_type != TYPE_UDP)
-	{
-		throw ParseException("Invalid type");
-	}
-	
-	if (m_type == TYPE_INFO)
-	{
-		m_from = HUB_SID;
-	}
-	
-	string::size_type len = aLine.length();
-	const char* buf = aLine.c_str();
-	string cur;
-	cur.reserve(128);
-	
-	bool toSet = false;
-	bool featureSet = false;
-	bool fromSet = nmdc; // $ADCxxx never have a from CID...
-	
-	while (i < len)
+	parse(p_line, p_len, nmdc);
+	dcassert(m_cmd[3] == 0);
+	m_cmd[3] = 0;
+}
+
+void AdcCommand::parse(const char* p_line, size_t p_len, bool nmdc /* = false */)
+{
+	CFlyAdcCommandView l_view;
+	if (const char* l_error = l_view.parse(p_line, p_len, nmdc))
 	{
-		switch (buf[i])
-		{
-			case '\\':
-				++i;
-				if (i == len)
-					throw ParseException("Escape at eol");
-				if (buf[i] == 's')
-					cur += ' ';
-				else if (buf[i] == 'n')
-					cur += '\n';
-				else if (buf[i] == '\\')
-					cur += '\\';
-				else if (buf[i] == ' ' && nmdc) // $ADCGET escaping, leftover from old specs
-					cur += ' ';
-				else
-					throw ParseException("Unknown escape");
-				break;
-			case ' ':
-				// New parameter...
-			{
-				if ((m_type == TYPE_BROADCAST || m_type == TYPE_DIRECT || m_type == TYPE_ECHO || m_type == TYPE_FEATURE) && !fromSet)
-				{
-					if (cur.length() != 4)
-					{
-						throw ParseException("Invalid SID length");
-					}
-					m_from = toSID(cur);
-					fromSet = true;
-				}
-				else if ((m_type == TYPE_DIRECT || m_type == TYPE_ECHO) && !toSet)
-				{
-					if (cur.length() != 4)
-					{
-						throw ParseException("Invalid SID length");
-					}
-					m_to = toSID(cur);
-					toSet = true;
-				}
-				else if (m_type == TYPE_FEATURE && !featureSet)
-				{
-					if (cur.length() % 5 != 0)
-					{
-						throw ParseException("Invalid feature length");
-					}
-					// Skip...
-					featureSet = true;
-				}
-				else
-				{
-					parameters.push_back(cur);
-					/*
-					if (cur.size() > 2 && cur[0] == 'I' && cur[1] == 'D')
-					{
-					    if (cur.size() == 41)
-					    {
-					        m_CID = CID(cur.substr(2));
-					    }
-					}
-					*/
-				}
-				cur.clear();
-			}
-			break;
-			default:
-				cur += buf[i];
-		}
-		++i;
+		throw ParseException(l_error);
 	}
-	if (!cur.empty())
+	m_type = l_view.getType();
+	m_cmdInt = l_view.getCommand();
+	if (m_type == TYPE_INFO || m_type == TYPE_BROADCAST || m_type == TYPE_DIRECT || m_type == TYPE_ECHO || m_type == TYPE_FEATURE)
 	{
-		if ((m_type == TYPE_BROADCAST || m_type == TYPE_DIRECT || m_type == TYPE_ECHO || m_type == TYPE_FEATURE) && !fromSet)
-		{
-			if (cur.length() != 4)
-			{
-				throw ParseException("Invalid SID length");
-			}
-			m_from = toSID(cur);
-			fromSet = true;
-		}
-		else if ((m_type == TYPE_DIRECT || m_type == TYPE_ECHO) && !toSet)
-		{
-			if (cur.length() != 4)
-			{
-				throw ParseException("Invalid SID length");
-			}
-			m_to = toSID(cur);
-			toSet = true;
-		}
-		else if (m_type == TYPE_FEATURE && !featureSet)
-		{
-			if (cur.length() % 5 != 0)
-			{
-				throw ParseException("Invalid feature length");
-			}
-			// Skip...
-			featureSet = true;
-		}
-		else
-		{
-			parameters.push_back(cur);
-		}
+		m_from = l_view.getFrom();
 	}
-	
-	if ((m_type == TYPE_BROADCAST || m_type == TYPE_DIRECT || m_type == TYPE_ECHO || m_type == TYPE_FEATURE) && !fromSet)
-	{
-		throw ParseException("Missing from_sid");
-	}
-	
-	if (m_type == TYPE_FEATURE && !featureSet)
+	if (m_type == TYPE_DIRECT || m_type == TYPE_ECHO)
 	{
-		throw ParseException("Missing feature");
+		m_to = l_view.getTo();
 	}
-	
-	if ((m_type == TYPE_DIRECT || m_type == TYPE_ECHO) && !toSet)
+	parameters.reserve(parameters.size() + l_view.getParamCount());
+	for (size_t i = 0; i < l_view.getParamCount(); ++i)
 	{
-		throw ParseException("Missing to_sid");
+		parameters.push_back(string());
+		parameters.back().reserve(l_view.getParamInfo(i).size());
+		l_view.appendParam(i, parameters.back());
 	}
 }
 
 string AdcCommand::toString(const CID& aCID, bool nmdc /* = false */) const
 {
-	return getHeaderString(aCID) + getParamString(nmdc);
+	string l_result;
+	l_result.reserve(5 + 39 + getParamStringSize());
+	appendHeaderString(aCID, l_result);
+	appendParamString(nmdc, l_result);
+	return l_result;
 }
 
 string AdcCommand::toString(uint32_t sid /* = 0 */, bool nmdc /* = false */) const
 {
-	return getHeaderString(sid, nmdc) + getParamString(nmdc);
+	string l_result;
+	toString(sid, nmdc, l_result);
+	return l_result;
+}
+
+void AdcCommand::toString(uint32_t sid, bool nmdc, string& p_out) const
+{
+	p_out.clear();
+	p_out.reserve(8 + 10 + features.size() + getParamStringSize());
+	appendHeaderString(sid, nmdc, p_out);
+	appendParamString(nmdc, p_out);
 }
 
 string AdcCommand::escape(const string& str, bool old)
 {
-	string tmp = str;
-	string::size_type i = 0;
-	while ((i = tmp.find_first_of(" \n\\", i)) != string::npos)
-	{
-		if (old)
-		{
-			tmp.insert(i, "\\");
-		}
-		else
-		{
-			switch (tmp[i])
-			{
-				case ' ':
-					tmp.replace(i, 1, "\\s");
-					break;
-				case '\n':
-					tmp.replace(i, 1, "\\n");
-					break;
-				case '\\':
-					tmp.replace(i, 1, "\\\\");
-					break;
-			}
-		}
-		i += 2;
-	}
+	string tmp;
+	tmp.reserve(CFlyAdcCommandView::getEscapedSize(str.c_str(), str.length()));
+	CFlyAdcCommandView::appendEscaped(tmp, str.c_str(), str.length(), old);
 	return tmp;
 }
 
-string AdcCommand::getHeaderString(uint32_t sid, bool nmdc) const
+void AdcCommand::appendHeaderString(uint32_t sid, bool nmdc, string& p_out) const
 {
-	string tmp;
 	if (nmdc)
 	{
-		tmp += "$ADC";
+		p_out += "$ADC";
 	}
 	else
 	{
-		tmp += getType();
+		p_out += getType();
 	}
 	
-	tmp += m_cmdChar;
+	p_out += m_cmdChar;
 	
 	if (m_type == TYPE_BROADCAST || m_type == TYPE_DIRECT || m_type == TYPE_ECHO || m_type == TYPE_FEATURE)
 	{
-		tmp += ' ';
-		tmp += fromSID(sid);
+		p_out += ' ';
+		p_out.append(reinterpret_cast<const char*>(&sid), sizeof(sid));
 	}
 	
 	if (m_type == TYPE_DIRECT || m_type == TYPE_ECHO)
 	{
-		tmp += ' ';
-		tmp += fromSID(m_to);
+		p_out += ' ';
+		p_out.append(reinterpret_cast<const char*>(&m_to), sizeof(m_to));
 	}
 	
 	if (m_type == TYPE_FEATURE)
 	{
-		tmp += ' ';
-		tmp += features;
+		p_out += ' ';
+		p_out += features;
 	}
-	return tmp;
 }
 
-string AdcCommand::getHeaderString(const CID& cid) const
+void AdcCommand::appendHeaderString(const CID& cid, string& p_out) const
 {
 	dcassert(m_type == TYPE_UDP);
-	string tmp;
-	tmp.reserve(44);
-	tmp += getType();
-	tmp += m_cmdChar;
-	tmp += ' ';
-	tmp += cid.toBase32();
-	return tmp;
+	p_out += getType();
+	p_out += m_cmdChar;
+	p_out += ' ';
+	p_out += cid.toBase32();
 }
 
-string AdcCommand::getParamString(bool nmdc) const
+size_t AdcCommand::getParamStringSize() const
 {
-	string tmp;
-	tmp.reserve(65);
+	size_t l_size = 1;
 	for (auto i = getParameters().cbegin(); i != getParameters().cend(); ++i)
 	{
-		tmp += ' ';
-		tmp += escape(*i, nmdc);
+		l_size += 1 + CFlyAdcCommandView::getEscapedSize(i->c_str(), i->length());
+	}
+	return l_size;
+}
+
+void AdcCommand::appendParamString(bool nmdc, string& p_out) const
+{
+	for (auto i = getParameters().cbegin(); i != getParameters().cend(); ++i)
+	{
+		p_out += ' ';
+		CFlyAdcCommandView::appendEscaped(p_out, i->c_str(), i->length(), nmdc);
 	}
 	if (nmdc)
 	{
-		tmp += '|';
+		p_out += '|';
 	}
 	else
 	{
-		tmp += '\n';
+		p_out += '\n';
 	}
+}
+
+string AdcCommand::getParamString(bool nmdc) const
+{
+	string tmp;
+	tmp.reserve(getParamStringSize());
+	appendParamString(nmdc, tmp);
 	return tmp;
 }
 
@@ -324,7 +194,7 @@ bool AdcCommand::getParam(const char* name, size_t start, string& ret) const
 	{
 		if (toCode(name) == toCode(getParameters()[i].c_str()))
 		{
-			ret = getParameters()[i].substr(2);
+			ret.assign(getParameters()[i], 2, string::npos);
 			return true;
 		}
 	}
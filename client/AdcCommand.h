@@ -130,7 +130,13 @@ class AdcCommand
 		explicit AdcCommand(uint32_t aCmd, const uint32_t aTarget, char aType);
 		explicit AdcCommand(Severity sev, Error err, const string& desc, char aType = TYPE_CLIENT);
 		explicit AdcCommand(const string& aLine, bool nmdc = false);
-		void parse(const string& aLine, bool nmdc = false);
+		AdcCommand(const char* p_line, size_t p_len, bool nmdc = false);
+		void parse(const string& aLine, bool nmdc = false)
+		{
+			parse(aLine.c_str(), aLine.length(), nmdc);
+		}
+		/** p_line - without the separator; split by CFlyAdcCommandView, a parameter is copied (unescaped) once */
+		void parse(const char* p_line, size_t p_len, bool nmdc = false);
 		
 		uint32_t getCommand() const
 		{
@@ -176,6 +182,8 @@ class AdcCommand
 		
 		string toString(const CID& aCID, bool nmdc = false) const;
 		string toString(uint32_t sid, bool nmdc = false) const;
+		/** Serializes into p_out (cleared, the capacity is reused) */
+		void toString(uint32_t sid, bool nmdc, string& p_out) const;
 		
 		AdcCommand& addParam(const string& name, const string& value)
 		{
@@ -245,8 +253,10 @@ class AdcCommand
 		string getParamString(bool nmdc) const;
 		
 	private:
-		string getHeaderString(const CID& cid) const;
-		string getHeaderString(uint32_t sid, bool nmdc) const;
+		void appendHeaderString(const CID& cid, string& p_out) const;
+		void appendHeaderString(uint32_t sid, bool nmdc, string& p_out) const;
+		void appendParamString(bool nmdc, string& p_out) const;
+		size_t getParamStringSize() const;
 		StringList parameters;
 		string features;
 		union
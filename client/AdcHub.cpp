@@ -201,11 +201,13 @@ void AdcHub::putUser(const uint32_t aSID, bool p_is_disconnect)
 		ClientManager::getInstance()->putOffline(ou, p_is_disconnect);
 	}
 	
+	removeUserUpdate(ou);
 	fly_fire2(ClientListener::UserRemoved(), this, ou);
 }
 
 void AdcHub::clearUsers()
 {
+	clearUserUpdates();
 	if (ClientManager::isBeforeShutdown())
 	{
 		CFlyWriteLock(*m_cs);
@@ -221,13 +223,16 @@ void AdcHub::clearUsers()
 			clearAvailableBytesL();
 		}
 		
+		OnlineUserList l_users;
+		l_users.reserve(tmp.size());
 		for (auto i = tmp.cbegin(); i != tmp.cend(); ++i)
 		{
 			if (i->first != AdcCommand::HUB_SID)
 			{
-				ClientManager::getInstance()->putOffline(i->second);
+				l_users.push_back(i->second);
 			}
 		}
+		ClientManager::getInstance()->putOffline(l_users);
 	}
 }
 
@@ -1713,7 +1718,10 @@ void AdcHub::send(const AdcCommand& cmd)
 	{
 		if (cmd.getType() == AdcCommand::TYPE_UDP)
 			sendUDP(cmd);
-		send(cmd.toString(m_sid));
+		// sent from the socket, search and UI threads - the buffer of the thread is reused
+		static thread_local string g_buffer;
+		cmd.toString(m_sid, false, g_buffer);
+		send(g_buffer.c_str(), g_buffer.size());
 	}
 }
 
@@ -422,7 +422,7 @@ bool BufferedSocket::all_search_parser(const string::size_type p_pos_next_separa
 					COMMAND_DEBUG("[File][SearchBot-BAN]" + l_line_item, DebugTask::HUB_IN, getServerAndPort());
 					return true;
 				}
-				if (ShareManager::isUnknownFile(l_item.getRAWQuery()))
+				if (ShareManager::isUnknownFile(l_item))
 				{
 #ifdef _DEBUG
 					static unsigned g_count_skip = 0;
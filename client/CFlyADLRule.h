@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2017 FlylinkDC++ Team http://flylinkdc.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#pragma once
+
+#ifndef CFLY_ADL_RULE_H
+#define CFLY_ADL_RULE_H
+
+#include <string>
+#include <vector>
+#include <regex>
+#include <memory>
+
+/**
+ * Compiled search string of ADLSearch.
+ * The search string is a case insensitive regular expression, if it can't be compiled
+ * all space separated substrings must be found in the name.
+ * Compiled once (ADLSearch::prepare) and used for all the names of the list:
+ * - search string without regex special chars - plain substring search in the lower-cased name
+ * - regular expression - precompiled std::regex
+ * - invalid expression - substrings in the lower-cased name
+ * Header only - used by the benchmark in test-console.
+ */
+class CFlyADLRule
+{
+	public:
+		enum Kind
+		{
+			KIND_NONE,
+			KIND_LITERAL,
+			KIND_REGEX,
+			KIND_SUBSTRINGS
+		};
+		CFlyADLRule() : m_kind(KIND_NONE)
+		{
+		}
+		/**
+		 * p_pattern - search string as is (for regex)
+		 * p_low_pattern - lower-cased search string
+		 * p_low_terms - lower-cased space separated parts of the (formatted) search string
+		 */
+		void compile(const std::string& p_pattern, const std::string& p_low_pattern, const std::vector<std::string>& p_low_terms)
+		{
+			clear();
+			if (isLiteral(p_pattern))
+			{
+				m_kind = KIND_LITERAL;
+				m_literal = p_low_pattern;
+				return;
+			}
+			try
+			{
+				m_regex = std::make_shared<std::regex>(p_pattern, std::regex_constants::icase | std::regex_constants::optimize);
+				m_kind = KIND_REGEX;
+				return;
+			}
+			catch (const std::regex_error&)
+			{
+			}
+			m_kind = KIND_SUBSTRINGS;
+			for (auto i = p_low_terms.cbegin(); i != p_low_terms.cend(); ++i)
+			{
+				if (!i->empty())
+				{
+					m_terms.push_back(*i);
+				}
+			}
+		}
+		void clear()
+		{
+			m_kind = KIND_NONE;
+			m_regex.reset();
+			m_literal.clear();
+			m_terms.clear();
+		}
+		Kind getKind() const
+		{
+			return m_kind;
+		}
+		/** p_text - name as is, p_low_text - the same name lower-cased (done once for all the rules) */
+		bool match(const std::string& p_text, const std::string& p_low_text) const
+		{
+			switch (m_kind)
+			{
+				case KIND_LITERAL:
+					return p_low_text.find(m_literal) != std::string::npos;
+				case KIND_REGEX:
+					return std::regex_search(p_text, *m_regex);
+				case KIND_SUBSTRINGS:
+				{
+					for (auto i = m_terms.cbegin(); i != m_terms.cend(); ++i)
+					{
+						if (p_low_text.find(*i) == std::string::npos)
+						{
+							return false;
+						}
+					}
+					return !m_terms.empty();
+				}
+				default:
+					return false;
+			}
+		}
+		static bool isLiteral(const std::string& p_pattern)
+		{
+			return !p_pattern.empty() && p_pattern.find_first_of("\\^$.|?*+()[]{}") == std::string::npos;
+		}
+	private:
+		Kind m_kind;
+		std::shared_ptr<const std::regex> m_regex; // shared - ADLSearch is copied around by value
+		std::string m_literal;
+		std::vector<std::string> m_terms;
+};
+
+#endif // CFLY_ADL_RULE_H
@@ -0,0 +1,343 @@
+/*
+ * Copyright (C) 2017 FlylinkDC++ Team http://flylinkdc.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+#pragma once
+
+#ifndef CFLY_ADC_COMMAND_VIEW_H
+#define CFLY_ADC_COMMAND_VIEW_H
+
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <boost/container/small_vector.hpp>
+
+/**
+ * ADC command parsed in place.
+ * The line is not copied: the parameters are indexed by offset/length in a small inline array,
+ * the escape sequences are only validated and counted, a value is unescaped when it is read
+ * (and copied as is if it has no escapes).
+ * Parsing rules and errors are the same as of AdcCommand::parse (AdcCommand is built on it).
+ * Also has the escaping helpers used to serialize AdcCommand into a single (reusable) buffer.
+ * Header only - used by the benchmark in test-console.
+ */
+class CFlyAdcCommandView
+{
+	public:
+		struct Param
+		{
+			uint32_t m_pos; // offset in the line
+			uint32_t m_len; // escaped length
+			uint32_t m_escapes; // count of the escape sequences
+			size_t size() const
+			{
+				return m_len - m_escapes;
+			}
+		};
+		typedef boost::container::small_vector<Param, 32> ParamIndex;
+		
+		static const uint32_t HUB_SID = 0xFFFFFFFF; // AdcCommand::HUB_SID
+		
+		CFlyAdcCommandView() : m_line(nullptr), m_cmd(0), m_from(0), m_to(0), m_type(0)
+		{
+		}
+		/**
+		 * p_line - command without the trailing separator, must live while the view is used
+		 * @return nullptr or the error text
+		 */
+		const char* parse(const char* p_line, size_t p_len, bool p_is_nmdc = false)
+		{
+			m_line = p_line;
+			m_params.clear();
+			m_cmd = 0;
+			m_from = 0;
+			m_to = 0;
+			size_t i = 5;
+			if (p_is_nmdc)
+			{
+				// "$ADCxxx ..."
+				if (p_len < 7)
+					return "Too short";
+				m_type = 'C';
+				memcpy(&m_cmd, p_line + 4, 3);
+				i += 3;
+			}
+			else
+			{
+				// "yxxx ..."
+				if (p_len < 4)
+					return "Too short";
+				m_type = p_line[0];
+				memcpy(&m_cmd, p_line + 1, 3);
+			}
+			if (m_type == 0 || strchr("BCDEFIHU", m_type) == nullptr)
+			{
+				return "Invalid type";
+			}
+			if (m_type == 'I')
+			{
+				m_from = HUB_SID;
+			}
+			const bool l_is_need_from = m_type == 'B' || m_type == 'D' || m_type == 'E' || m_type == 'F';
+			const bool l_is_need_to = m_type == 'D' || m_type == 'E';
+			const bool l_is_need_feature = m_type == 'F';
+			bool l_is_from_set = p_is_nmdc; // $ADCxxx never have a from CID...
+			bool l_is_to_set = false;
+			bool l_is_feature_set = false;
+			
+			Param l_cur = { uint32_t(i), 0, 0 };
+			for (; i < p_len; ++i)
+			{
+				const char c = p_line[i];
+				if (c == '\\')
+				{
+					if (++i == p_len)
+						return "Escape at eol";
+					const char e = p_line[i];
+					if (!(e == 's' || e == 'n' || e == '\\' || (e == ' ' && p_is_nmdc))) // $ADCGET escaping, leftover from old specs
+						return "Unknown escape";
+					++l_cur.m_escapes;
+				}
+				else if (c == ' ')
+				{
+					// New parameter...
+					l_cur.m_len = uint32_t(i - l_cur.m_pos);
+					if (const char* l_error = addToken(l_cur, l_is_need_from, l_is_need_to, l_is_need_feature, l_is_from_set, l_is_to_set, l_is_feature_set))
+						return l_error;
+					l_cur.m_pos = uint32_t(i + 1);
+					l_cur.m_escapes = 0;
+				}
+			}
+			if (i > l_cur.m_pos)
+			{
+				l_cur.m_len = uint32_t(i - l_cur.m_pos);
+				if (const char* l_error = addToken(l_cur, l_is_need_from, l_is_need_to, l_is_need_feature, l_is_from_set, l_is_to_set, l_is_feature_set))
+					return l_error;
+			}
+			if (l_is_need_from && !l_is_from_set)
+				return "Missing from_sid";
+			if (l_is_need_feature && !l_is_feature_set)
+				return "Missing feature";
+			if (l_is_need_to && !l_is_to_set)
+				return "Missing to_sid";
+			return nullptr;
+		}
+		
+		char getType() const
+		{
+			return m_type;
+		}
+		/** Same value as AdcCommand::getCommand() */
+		uint32_t getCommand() const
+		{
+			return m_cmd;
+		}
+		uint32_t getFrom() const
+		{
+			return m_from;
+		}
+		uint32_t getTo() const
+		{
+			return m_to;
+		}
+		size_t getParamCount() const
+		{
+			return m_params.size();
+		}
+		const Param& getParamInfo(size_t n) const
+		{
+			return m_params[n];
+		}
+		/** Escaped text of the parameter (not null terminated) */
+		const char* getRaw(size_t n) const
+		{
+			return m_line + m_params[n].m_pos;
+		}
+		/** Unescaped value appended to p_out, p_skip - count of the first (unescaped) chars to skip */
+		void appendParam(size_t n, std::string& p_out, size_t p_skip = 0) const
+		{
+			const Param& l_param = m_params[n];
+			const char* l_text = m_line + l_param.m_pos;
+			size_t i = 0;
+			if (l_param.m_escapes == 0)
+			{
+				i = p_skip < l_param.m_len ? p_skip : l_param.m_len;
+				p_out.append(l_text + i, l_param.m_len - i);
+				return;
+			}
+			for (; p_skip && i < l_param.m_len; --p_skip)
+			{
+				i += l_text[i] == '\\' && i + 1 < l_param.m_len ? 2 : 1;
+			}
+			unescape(l_text + i, l_param.m_len - i, p_out);
+		}
+		std::string getParam(size_t n) const
+		{
+			std::string l_result;
+			l_result.reserve(m_params[n].size());
+			appendParam(n, l_result);
+			return l_result;
+		}
+		/** Index of the named parameter (two-letter code) or -1 */
+		int findParam(const char* p_name, size_t p_start) const
+		{
+			for (size_t i = p_start; i < m_params.size(); ++i)
+			{
+				if (isCode(i, p_name))
+					return int(i);
+			}
+			return -1;
+		}
+		/** Named parameter where the name is a two-letter code, p_out - value without the code */
+		bool getParam(const char* p_name, size_t p_start, std::string& p_out) const
+		{
+			const int l_index = findParam(p_name, p_start);
+			if (l_index < 0)
+				return false;
+			p_out.clear();
+			appendParam(l_index, p_out, 2);
+			return true;
+		}
+		bool hasFlag(const char* p_name, size_t p_start) const
+		{
+			for (size_t i = p_start; i < m_params.size(); ++i)
+			{
+				if (m_params[i].size() == 3 && isCode(i, p_name))
+				{
+					const char l_flag = m_params[i].m_escapes == 0 ? getRaw(i)[2] : getParam(i)[2];
+					if (l_flag == '1')
+						return true;
+				}
+			}
+			return false;
+		}
+		
+		static void unescape(const char* p_text, size_t p_len, std::string& p_out)
+		{
+			for (size_t i = 0; i < p_len; ++i)
+			{
+				char c = p_text[i];
+				if (c == '\\' && i + 1 < p_len)
+				{
+					c = p_text[++i];
+					if (c == 's')
+						c = ' ';
+					else if (c == 'n')
+						c = '\n';
+				}
+				p_out += c;
+			}
+		}
+		static size_t getEscapedSize(const char* p_text, size_t p_len)
+		{
+			size_t l_size = p_len;
+			for (size_t i = 0; i < p_len; ++i)
+			{
+				const char c = p_text[i];
+				if (c == ' ' || c == '\n' || c == '\\')
+					++l_size;
+			}
+			return l_size;
+		}
+		/** p_is_old - $ADCxxx escaping (backslash before the special char) */
+		static void appendEscaped(std::string& p_out, const char* p_text, size_t p_len, bool p_is_old)
+		{
+			const char* l_end = p_text + p_len;
+			while (p_text != l_end)
+			{
+				const char* l_special = p_text;
+				while (l_special != l_end && *l_special != ' ' && *l_special != '\n' && *l_special != '\\')
+					++l_special;
+				p_out.append(p_text, l_special);
+				if (l_special == l_end)
+					break;
+				p_out += '\\';
+				p_out += p_is_old ? *l_special : *l_special == ' ' ? 's' : *l_special == '\n' ? 'n' : '\\';
+				p_text = l_special + 1;
+			}
+		}
+		
+	private:
+		/** Compares the first two unescaped chars of the parameter with the code */
+		bool isCode(size_t n, const char* p_name) const
+		{
+			const Param& l_param = m_params[n];
+			if (l_param.size() < 2)
+				return false;
+			const char* l_raw = m_line + l_param.m_pos;
+			if (l_param.m_escapes == 0 || (l_raw[0] != '\\' && l_raw[1] != '\\'))
+				return l_raw[0] == p_name[0] && l_raw[1] == p_name[1];
+			std::string l_value;
+			appendParam(n, l_value);
+			return l_value[0] == p_name[0] && l_value[1] == p_name[1];
+		}
+		/** SID (from/to) of the header - 4 unescaped chars */
+		bool getSID(const Param& p_param, uint32_t& p_sid) const
+		{
+			if (p_param.size() != 4)
+				return false;
+			if (p_param.m_escapes == 0)
+			{
+				memcpy(&p_sid, m_line + p_param.m_pos, 4);
+			}
+			else
+			{
+				std::string l_sid;
+				unescape(m_line + p_param.m_pos, p_param.m_len, l_sid);
+				memcpy(&p_sid, l_sid.data(), 4);
+			}
+			return true;
+		}
+		const char* addToken(const Param& p_param, bool p_is_need_from, bool p_is_need_to, bool p_is_need_feature,
+		                     bool& p_is_from_set, bool& p_is_to_set, bool& p_is_feature_set)
+		{
+			if (p_is_need_from && !p_is_from_set)
+			{
+				if (!getSID(p_param, m_from))
+					return "Invalid SID length";
+				p_is_from_set = true;
+			}
+			else if (p_is_need_to && !p_is_to_set)
+			{
+				if (!getSID(p_param, m_to))
+					return "Invalid SID length";
+				p_is_to_set = true;
+			}
+			else if (p_is_need_feature && !p_is_feature_set)
+			{
+				if (p_param.size() % 5 != 0)
+					return "Invalid feature length";
+				// Skip...
+				p_is_feature_set = true;
+			}
+			else
+			{
+				m_params.push_back(p_param);
+			}
+			return nullptr;
+		}
+		
+		const char* m_line;
+		ParamIndex m_params;
+		uint32_t m_cmd;
+		uint32_t m_from;
+		uint32_t m_to;
+		char m_type;
+};
+
+#endif // CFLY_ADC_COMMAND_VIEW_H
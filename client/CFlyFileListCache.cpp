@@ -0,0 +1,225 @@
+/*
+ * Copyright (C) 2017 FlylinkDC++ Team http://flylinkdc.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "stdinc.h"
+#include "CFlyFileListCache.h"
+#include "DirectoryListing.h"
+#include "File.h"
+
+FastCriticalSection CFlyFileListCache::g_cs;
+CFlyFileListCache::EntryMap CFlyFileListCache::g_entries;
+size_t CFlyFileListCache::g_count_items = 0;
+uint64_t CFlyFileListCache::g_access_counter = 0;
+
+static const size_t g_max_cache_items = 2 * 1024 * 1024; // ~64 Mb
+
+static void collectItems(const DirectoryListing::Directory* p_dir, CFlyFileListCache::Index& p_index)
+{
+	for (auto i = p_dir->directories.cbegin(); i != p_dir->directories.cend(); ++i)
+	{
+		if (!(*i)->getAdls())
+		{
+			collectItems(*i, p_index);
+		}
+	}
+	for (auto i = p_dir->m_files.cbegin(); i != p_dir->m_files.cend(); ++i)
+	{
+		const CFlyFileListCache::Item l_item = { (*i)->getTTH(), (*i)->getSize() };
+		p_index.push_back(l_item);
+	}
+}
+
+CFlyFileListCache::IndexPtr CFlyFileListCache::makeIndex(const DirectoryListing& p_list)
+{
+	auto l_index = std::make_shared<Index>();
+	l_index->reserve(p_list.getRoot()->getTotalFileCount());
+	collectItems(p_list.getRoot(), *l_index);
+	// The first file with the same TTH wins (as in the old TTHMap)
+	std::stable_sort(l_index->begin(), l_index->end());
+	l_index->erase(std::unique(l_index->begin(), l_index->end(), [](const Item & a, const Item & b)
+	{
+		return a.m_tth == b.m_tth;
+	}), l_index->end());
+	l_index->shrink_to_fit();
+	return l_index;
+}
+
+const CFlyFileListCache::Item* CFlyFileListCache::findTTH(const Index& p_index, const TTHValue& p_tth)
+{
+	const Item l_key = { p_tth, 0 };
+	const auto i = std::lower_bound(p_index.cbegin(), p_index.cend(), l_key);
+	if (i != p_index.cend() && i->m_tth == p_tth)
+	{
+		return &*i;
+	}
+	return nullptr;
+}
+
+bool CFlyFileListCache::getBz2Crc(const string& p_file, int64_t p_file_size, uint32_t& p_crc)
+{
+	// bzip2 stream ends with the 48 bit end of stream magic and the 32 bit CRC of the whole uncompressed data,
+	// written from the high bit and padded to the byte with 0-7 bits
+	uint8_t l_tail[11];
+	if (p_file_size < int64_t(sizeof(l_tail)))
+		return false;
+	try
+	{
+		File l_file(p_file, File::READ, File::OPEN);
+		l_file.setPos(p_file_size - sizeof(l_tail));
+		size_t l_len = sizeof(l_tail);
+		if (l_file.read(l_tail, l_len) != sizeof(l_tail))
+			return false;
+	}
+	catch (const FileException&)
+	{
+		return false;
+	}
+	// bit i - from the end of the file
+	const auto getBit = [&](unsigned i)
+	{
+		return unsigned(l_tail[sizeof(l_tail) - 1 - i / 8] >> (i % 8)) & 1;
+	};
+	for (unsigned l_pad = 0; l_pad < 8; ++l_pad)
+	{
+		uint64_t l_magic = 0;
+		for (unsigned i = 0; i < 48; ++i)
+		{
+			l_magic |= uint64_t(getBit(l_pad + 32 + i)) << i;
+		}
+		if (l_magic == 0x177245385090ULL)
+		{
+			p_crc = 0;
+			for (unsigned i = 0; i < 32; ++i)
+			{
+				p_crc |= getBit(l_pad + i) << i;
+			}
+			return true;
+		}
+	}
+	return false;
+}
+
+bool CFlyFileListCache::calcContentId(const string& p_file, int64_t p_file_size, ContentId& p_id)
+{
+	p_id.m_is_crc = getBz2Crc(p_file, p_file_size, p_id.m_crc);
+	if (p_id.m_is_crc)
+		return true;
+	// not compressed list - the full file TTH
+	std::unique_ptr<TigerTree> l_tree;
+	if (!Util::getTTH_MD5(p_file, 512 * 1024, &l_tree))
+		return false;
+	p_id.m_root = l_tree->getRoot();
+	return true;
+}
+
+CFlyFileListCache::IndexPtr CFlyFileListCache::find(const CID& p_cid, const string& p_file)
+{
+	const int64_t l_file_size = File::getSize(p_file);
+	if (l_file_size <= 0)
+		return nullptr;
+	const int64_t l_time_stamp = File::getSafeTimeStamp(p_file);
+	ContentId l_content;
+	{
+		CFlyFastLock(g_cs);
+		const auto i = g_entries.find(p_cid);
+		if (i == g_entries.end() || i->second.m_file_size != l_file_size)
+			return nullptr;
+		if (i->second.m_file == p_file && i->second.m_time_stamp == l_time_stamp)
+		{
+			i->second.m_last_access = ++g_access_counter;
+			return i->second.m_index;
+		}
+		l_content = i->second.m_content;
+	}
+	// The list was downloaded again (or renamed) - the same content is detected by the CRC of the list
+	ContentId l_new_content;
+	if (!calcContentId(p_file, l_file_size, l_new_content) || l_new_content != l_content)
+		return nullptr;
+	CFlyFastLock(g_cs);
+	const auto i = g_entries.find(p_cid);
+	if (i == g_entries.end() || i->second.m_content != l_content)
+		return nullptr;
+	i->second.m_file = p_file;
+	i->second.m_time_stamp = l_time_stamp;
+	i->second.m_last_access = ++g_access_counter;
+	return i->second.m_index;
+}
+
+CFlyFileListCache::IndexPtr CFlyFileListCache::add(const CID& p_cid, const string& p_file, const DirectoryListing& p_list)
+{
+	const auto l_index = makeIndex(p_list);
+	if (l_index->size() > g_max_cache_items / 2)
+		return l_index;
+	Entry l_entry;
+	l_entry.m_file = p_file;
+	l_entry.m_file_size = File::getSize(p_file);
+	l_entry.m_time_stamp = File::getSafeTimeStamp(p_file);
+	if (l_entry.m_file_size <= 0)
+		return l_index;
+	bool l_is_known = false;
+	{
+		// The same list file is loaded again - its content id is known
+		CFlyFastLock(g_cs);
+		const auto i = g_entries.find(p_cid);
+		if (i != g_entries.end() && i->second.m_file == p_file &&
+		        i->second.m_file_size == l_entry.m_file_size && i->second.m_time_stamp == l_entry.m_time_stamp)
+		{
+			l_entry.m_content = i->second.m_content;
+			l_is_known = true;
+		}
+	}
+	if (!l_is_known && !calcContentId(p_file, l_entry.m_file_size, l_entry.m_content))
+		return l_index;
+	l_entry.m_index = l_index;
+
+	CFlyFastLock(g_cs);
+	auto& l_cur = g_entries[p_cid];
+	if (l_cur.m_index)
+	{
+		g_count_items -= l_cur.m_index->size();
+	}
+	l_entry.m_last_access = ++g_access_counter;
+	l_cur = std::move(l_entry);
+	g_count_items += l_index->size();
+	shrinkL();
+	return l_index;
+}
+
+void CFlyFileListCache::shrinkL()
+{
+	while (g_count_items > g_max_cache_items && !g_entries.empty())
+	{
+		auto l_oldest = g_entries.begin();
+		for (auto i = g_entries.begin(); i != g_entries.end(); ++i)
+		{
+			if (i->second.m_last_access < l_oldest->second.m_last_access)
+			{
+				l_oldest = i;
+			}
+		}
+		g_count_items -= l_oldest->second.m_index->size();
+		g_entries.erase(l_oldest);
+	}
+}
+
+void CFlyFileListCache::clear()
+{
+	CFlyFastLock(g_cs);
+	g_entries.clear();
+	g_count_items = 0;
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2017 FlylinkDC++ Team http://flylinkdc.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#pragma once
+
+#ifndef CFLY_FILE_LIST_CACHE_H
+#define CFLY_FILE_LIST_CACHE_H
+
+#include "CID.h"
+#include "MerkleTree.h"
+#include "CFlyThread.h"
+
+class DirectoryListing;
+
+/**
+ * Per user (CID) cache of the downloaded file lists for queue matching.
+ * Keeps a compact sorted TTH -> size index of the last list of the user
+ * and the content id of the list file it was built from: the CRC of the uncompressed list
+ * stored at the end of the bzip2 stream (the TTH of the file only for a list without it).
+ * If the same list file is matched again (or the user sends the same list again)
+ * the index is used without decompressing and parsing the list.
+ */
+class CFlyFileListCache
+{
+	public:
+		struct Item
+		{
+			TTHValue m_tth;
+			int64_t m_size;
+			bool operator<(const Item& p_item) const
+			{
+				return m_tth < p_item.m_tth;
+			}
+		};
+		typedef std::vector<Item> Index;
+		typedef std::shared_ptr<const Index> IndexPtr;
+
+		/** Index built from the loaded list (ADLSearch directories are skipped) */
+		static IndexPtr makeIndex(const DirectoryListing& p_list);
+		/** Returns nullptr if the list file is not known or was changed */
+		static IndexPtr find(const CID& p_cid, const string& p_file);
+		static IndexPtr add(const CID& p_cid, const string& p_file, const DirectoryListing& p_list);
+		static void clear();
+
+		static const Item* findTTH(const Index& p_index, const TTHValue& p_tth);
+
+	private:
+		struct ContentId
+		{
+			ContentId() : m_is_crc(false), m_crc(0)
+			{
+			}
+			bool m_is_crc;
+			uint32_t m_crc;
+			TTHValue m_root;
+			bool operator==(const ContentId& p_id) const
+			{
+				return m_is_crc == p_id.m_is_crc && (m_is_crc ? m_crc == p_id.m_crc : m_root == p_id.m_root);
+			}
+			bool operator!=(const ContentId& p_id) const
+			{
+				return !(*this == p_id);
+			}
+		};
+		struct Entry
+		{
+			Entry() : m_file_size(0), m_time_stamp(0), m_last_access(0)
+			{
+			}
+			string m_file;
+			int64_t m_file_size;
+			int64_t m_time_stamp;
+			ContentId m_content;
+			IndexPtr m_index;
+			uint64_t m_last_access;
+		};
+		typedef boost::unordered_map<CID, Entry> EntryMap;
+
+		static bool getBz2Crc(const string& p_file, int64_t p_file_size, uint32_t& p_crc);
+		static bool calcContentId(const string& p_file, int64_t p_file_size, ContentId& p_id);
+		static void shrinkL();
+
+		static FastCriticalSection g_cs;
+		static EntryMap g_entries;
+		static size_t g_count_items;
+		static uint64_t g_access_counter;
+};
+
+#endif // CFLY_FILE_LIST_CACHE_H
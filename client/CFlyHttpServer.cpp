@@ -0,0 +1,642 @@
+/*
+ * Copyright (C) 2017 FlylinkDC++ Team http://flylinkdc.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+#include "stdinc.h"
+#include "CFlyHttpServer.h"
+#include "TimerManager.h"
+#include "Text.h"
+
+CFlyHttpServer::CFlyHttpServer(const Handler& p_handler) : m_handler(p_handler), m_next_id(0), m_notify_mask(0),
+	m_wait_mask(0), m_wakeup_sock(INVALID_SOCKET), m_is_stop(false), m_is_started(false)
+{
+}
+
+CFlyHttpServer::~CFlyHttpServer()
+{
+	stop();
+}
+
+SOCKET CFlyHttpServer::createWakeupSocket()
+{
+	// UDP socket connected to itself - a datagram from wakeup() interrupts select
+	SOCKET l_sock = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (l_sock == INVALID_SOCKET)
+		return l_sock;
+	sockaddr_in l_addr;
+	memzero(&l_addr, sizeof(l_addr));
+	l_addr.sin_family = AF_INET;
+	l_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	int l_len = sizeof(l_addr);
+	if (::bind(l_sock, (sockaddr*) &l_addr, sizeof(l_addr)) == SOCKET_ERROR ||
+	        ::getsockname(l_sock, (sockaddr*) &l_addr, &l_len) == SOCKET_ERROR ||
+	        ::connect(l_sock, (sockaddr*) &l_addr, sizeof(l_addr)) == SOCKET_ERROR)
+	{
+		::closesocket(l_sock);
+		return INVALID_SOCKET;
+	}
+	u_long b = 1;
+	ioctlsocket(l_sock, FIONBIO, &b);
+	return l_sock;
+}
+
+void CFlyHttpServer::start()
+{
+	if (m_is_started)
+		return;
+	m_is_stop = false;
+	m_wakeup_sock = createWakeupSocket();
+	m_pool.start(2, "CFlyHttpServer::Worker");
+	try
+	{
+		Thread::start(128, "CFlyHttpServer");
+		m_is_started = true;
+	}
+	catch (const ThreadException& e)
+	{
+		dcdebug("CFlyHttpServer::start: %s\n", e.getError().c_str());
+		m_pool.stop();
+		if (m_wakeup_sock != INVALID_SOCKET)
+		{
+			::closesocket(m_wakeup_sock);
+			m_wakeup_sock = INVALID_SOCKET;
+		}
+	}
+}
+
+void CFlyHttpServer::stop()
+{
+	if (!m_is_started)
+		return;
+	m_is_stop = true;
+	wakeup();
+	join();
+	m_pool.stop(); // the handlers in progress put their results to m_results
+	m_is_started = false;
+	for (auto i = m_connections.cbegin(); i != m_connections.cend(); ++i)
+	{
+		::closesocket(i->second.m_sock);
+	}
+	m_connections.clear();
+	{
+		CFlyFastLock(m_cs);
+		for (auto i = m_new_connections.cbegin(); i != m_new_connections.cend(); ++i)
+		{
+			::closesocket(i->first);
+		}
+		m_new_connections.clear();
+		m_results.clear();
+		m_notify_mask = 0;
+	}
+	m_wait_mask = 0;
+	if (m_wakeup_sock != INVALID_SOCKET)
+	{
+		::closesocket(m_wakeup_sock);
+		m_wakeup_sock = INVALID_SOCKET;
+	}
+}
+
+void CFlyHttpServer::wakeup()
+{
+	if (m_wakeup_sock != INVALID_SOCKET)
+	{
+		const char l_byte = 0;
+		::send(m_wakeup_sock, &l_byte, 1, 0);
+	}
+}
+
+void CFlyHttpServer::addConnection(SOCKET p_sock, const string& p_ip)
+{
+	if (p_sock == INVALID_SOCKET)
+		return;
+	if (!m_is_started || m_is_stop)
+	{
+		::closesocket(p_sock);
+		return;
+	}
+	u_long b = 1;
+	ioctlsocket(p_sock, FIONBIO, &b);
+	{
+		CFlyFastLock(m_cs);
+		m_new_connections.push_back(std::make_pair(p_sock, p_ip));
+	}
+	wakeup();
+}
+
+void CFlyHttpServer::notify(uint32_t p_mask)
+{
+	{
+		CFlyFastLock(m_cs);
+		m_notify_mask |= p_mask;
+	}
+	wakeup();
+}
+
+int CFlyHttpServer::run()
+{
+	std::vector<std::pair<SOCKET, string>> l_new_connections;
+	std::vector<Result> l_results;
+	while (!m_is_stop)
+	{
+		uint32_t l_notify_mask;
+		{
+			CFlyFastLock(m_cs);
+			l_new_connections.swap(m_new_connections);
+			l_results.swap(m_results);
+			l_notify_mask = m_notify_mask;
+			m_notify_mask = 0;
+		}
+		const uint64_t l_now = GET_TICK();
+		for (auto i = l_new_connections.cbegin(); i != l_new_connections.cend(); ++i)
+		{
+			if (m_connections.size() >= MAX_CONNECTIONS)
+			{
+				static const char g_busy[] = "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+				::send(i->first, g_busy, sizeof(g_busy) - 1, 0);
+				::closesocket(i->first);
+				continue;
+			}
+			Connection& l_conn = m_connections[++m_next_id];
+			l_conn.m_sock = i->first;
+			l_conn.m_request.m_ip = i->second;
+			l_conn.m_last_activity = l_now;
+		}
+		l_new_connections.clear();
+		for (auto i = l_results.begin(); i != l_results.end(); ++i)
+		{
+			processResult(*i);
+		}
+		l_results.clear();
+		if (l_notify_mask)
+		{
+			processNotify(l_notify_mask);
+		}
+		processTimeouts(l_now);
+
+		uint32_t l_wait_mask = 0;
+		fd_set l_read_set;
+		fd_set l_write_set;
+		FD_ZERO(&l_read_set);
+		FD_ZERO(&l_write_set);
+		if (m_wakeup_sock != INVALID_SOCKET)
+		{
+			FD_SET(m_wakeup_sock, &l_read_set);
+		}
+		for (auto i = m_connections.cbegin(); i != m_connections.cend(); ++i)
+		{
+			const Connection& l_conn = i->second;
+			if (l_conn.m_state == STATE_WAIT || l_conn.m_state == STATE_STREAM)
+			{
+				l_wait_mask |= l_conn.m_wait_mask;
+			}
+			// The input of a busy connection is kept for the next (pipelined) request
+			if (l_conn.m_in.size() < MAX_HEADER_SIZE)
+			{
+				FD_SET(l_conn.m_sock, &l_read_set);
+			}
+			if (l_conn.m_out_pos < l_conn.m_out.size())
+			{
+				FD_SET(l_conn.m_sock, &l_write_set);
+			}
+		}
+		m_wait_mask = l_wait_mask;
+		if (l_read_set.fd_count == 0 && l_write_set.fd_count == 0)
+		{
+			sleep(100); // no wakeup socket and no connections
+			continue;
+		}
+		timeval l_tv = { 1, 0 };
+		const int l_result = ::select(0, &l_read_set, &l_write_set, nullptr, &l_tv);
+		if (l_result <= 0 || m_is_stop)
+			continue;
+		if (m_wakeup_sock != INVALID_SOCKET && FD_ISSET(m_wakeup_sock, &l_read_set))
+		{
+			char l_buf[64];
+			while (::recv(m_wakeup_sock, l_buf, sizeof(l_buf), 0) > 0)
+			{
+			}
+		}
+		for (auto i = m_connections.begin(); i != m_connections.end();)
+		{
+			const auto l_cur = i++;
+			Connection& l_conn = l_cur->second;
+			const bool l_is_read = FD_ISSET(l_conn.m_sock, &l_read_set) != 0;
+			const bool l_is_write = FD_ISSET(l_conn.m_sock, &l_write_set) != 0;
+			if (!l_is_read && !l_is_write)
+				continue;
+			if ((l_is_read && !readConnection(l_conn)) || !flushConnection(l_cur->first, l_conn))
+			{
+				closeConnection(l_cur);
+			}
+		}
+	}
+	return 0;
+}
+
+void CFlyHttpServer::closeConnection(ConnectionMap::iterator p_conn)
+{
+	::closesocket(p_conn->second.m_sock);
+	m_connections.erase(p_conn); // the result of the handler in progress is dropped
+}
+
+bool CFlyHttpServer::readConnection(Connection& p_conn)
+{
+	char l_buf[16 * 1024];
+	for (;;)
+	{
+		const int l_len = ::recv(p_conn.m_sock, l_buf, sizeof(l_buf), 0);
+		if (l_len == 0)
+			return false;
+		if (l_len < 0)
+			return WSAGetLastError() == WSAEWOULDBLOCK;
+		p_conn.m_last_activity = GET_TICK();
+		if (p_conn.m_state != STATE_STREAM) // the stream is one way
+		{
+			p_conn.m_in.append(l_buf, l_len);
+			if (p_conn.m_in.size() >= MAX_HEADER_SIZE)
+				return true;
+		}
+	}
+}
+
+bool CFlyHttpServer::flushConnection(uint64_t p_id, Connection& p_conn)
+{
+	for (;;)
+	{
+		while (p_conn.m_out_pos < p_conn.m_out.size())
+		{
+			const size_t l_len = std::min<size_t>(p_conn.m_out.size() - p_conn.m_out_pos, 64 * 1024);
+			const int l_sent = ::send(p_conn.m_sock, p_conn.m_out.data() + p_conn.m_out_pos, static_cast<int>(l_len), 0);
+			if (l_sent < 0)
+				return WSAGetLastError() == WSAEWOULDBLOCK;
+			p_conn.m_out_pos += l_sent;
+			p_conn.m_last_activity = GET_TICK();
+		}
+		p_conn.m_out.clear();
+		p_conn.m_out_pos = 0;
+		if (p_conn.m_is_close)
+			return false;
+		if (p_conn.m_state == STATE_STREAM && p_conn.m_pending_mask && !p_conn.m_is_chunk_busy)
+		{
+			const uint32_t l_mask = p_conn.m_pending_mask;
+			p_conn.m_pending_mask = 0;
+			p_conn.m_is_chunk_busy = true;
+			dispatch(p_id, p_conn, l_mask, true);
+		}
+		if (p_conn.m_state != STATE_READ || !processInput(p_id, p_conn))
+			return true;
+	}
+}
+
+bool CFlyHttpServer::processInput(uint64_t p_id, Connection& p_conn)
+{
+	const auto l_header_end = p_conn.m_in.find("\r\n\r\n");
+	Response l_error;
+	if (l_header_end == string::npos)
+	{
+		if (p_conn.m_in.size() < MAX_HEADER_SIZE)
+			return false;
+		l_error.m_status = 431;
+	}
+	else
+	{
+		Request l_request;
+		bool l_is_keep_alive = false;
+		size_t l_content_length = 0;
+		const size_t l_header_size = l_header_end + 4;
+		if (!parseRequest(p_conn.m_in.substr(0, l_header_size), l_request, l_is_keep_alive, l_content_length))
+		{
+			l_error.m_status = 400;
+		}
+		else if (l_content_length > MAX_HEADER_SIZE)
+		{
+			l_error.m_status = 413;
+		}
+		else
+		{
+			if (p_conn.m_in.size() < l_header_size + l_content_length)
+				return false;
+			// The body is not used (all the requests are GET with the query)
+			p_conn.m_in.erase(0, l_header_size + l_content_length);
+			l_request.m_ip = p_conn.m_request.m_ip;
+			p_conn.m_request = std::move(l_request);
+			p_conn.m_is_keep_alive = l_is_keep_alive && ++p_conn.m_count_requests < MAX_REQUESTS_PER_CONNECTION;
+			p_conn.m_state = STATE_BUSY;
+			p_conn.m_pending_mask = 0;
+			dispatch(p_id, p_conn, 0, false);
+			return false;
+		}
+	}
+	p_conn.m_in.clear();
+	p_conn.m_is_keep_alive = false;
+	sendResponse(p_conn, l_error);
+	return true;
+}
+
+void CFlyHttpServer::dispatch(uint64_t p_id, Connection& p_conn, uint32_t p_fired_mask, bool p_is_retry)
+{
+	p_conn.m_request.m_fired_mask = p_fired_mask;
+	p_conn.m_request.m_is_retry = p_is_retry;
+	const Request l_request = p_conn.m_request;
+	const auto l_task = [this, p_id, l_request]()
+	{
+		runHandler(p_id, l_request);
+	};
+	if (!m_pool.addTask(l_task))
+	{
+		l_task();
+	}
+}
+
+void CFlyHttpServer::runHandler(uint64_t p_id, const Request& p_request)
+{
+	Result l_result;
+	l_result.m_id = p_id;
+	try
+	{
+		m_handler(p_request, l_result.m_response);
+	}
+	catch (const std::exception& e)
+	{
+		l_result.m_response = Response();
+		l_result.m_response.m_status = 500;
+		l_result.m_response.m_content_type = "text/plain";
+		l_result.m_response.m_body = e.what();
+	}
+	{
+		CFlyFastLock(m_cs);
+		m_results.push_back(std::move(l_result));
+	}
+	wakeup();
+}
+
+void CFlyHttpServer::processResult(Result& p_result)
+{
+	const auto i = m_connections.find(p_result.m_id);
+	if (i == m_connections.end())
+		return;
+	Connection& l_conn = i->second;
+	const Response& l_response = p_result.m_response;
+	if (l_conn.m_state == STATE_STREAM)
+	{
+		l_conn.m_is_chunk_busy = false;
+		l_conn.m_out += l_response.m_body;
+		if (!l_response.m_is_stream)
+		{
+			l_conn.m_is_close = true;
+		}
+	}
+	else if (l_response.m_is_stream)
+	{
+		l_conn.m_state = STATE_STREAM;
+		l_conn.m_wait_mask = l_response.m_wait_mask;
+		l_conn.m_in.clear();
+		sendResponse(l_conn, l_response);
+	}
+	else if (l_response.m_wait_mask)
+	{
+		l_conn.m_wait_mask = l_response.m_wait_mask;
+		l_conn.m_wait_until = GET_TICK() + l_response.m_wait_ms;
+		// notify() while the handler was running - the data it has checked is already changed
+		const uint32_t l_mask = l_conn.m_pending_mask & l_conn.m_wait_mask;
+		l_conn.m_pending_mask = 0;
+		if (l_mask)
+			dispatch(i->first, l_conn, l_mask, true);
+		else
+			l_conn.m_state = STATE_WAIT;
+		return;
+	}
+	else
+	{
+		l_conn.m_state = STATE_READ;
+		l_conn.m_wait_mask = 0;
+		sendResponse(l_conn, l_response);
+	}
+	if (!flushConnection(i->first, l_conn))
+	{
+		closeConnection(i);
+	}
+}
+
+void CFlyHttpServer::processNotify(uint32_t p_mask)
+{
+	for (auto i = m_connections.begin(); i != m_connections.end(); ++i)
+	{
+		Connection& l_conn = i->second;
+		if (l_conn.m_state == STATE_BUSY)
+		{
+			l_conn.m_pending_mask |= p_mask;
+			continue;
+		}
+		const uint32_t l_mask = l_conn.m_wait_mask & p_mask;
+		if (!l_mask)
+			continue;
+		if (l_conn.m_state == STATE_WAIT)
+		{
+			l_conn.m_state = STATE_BUSY;
+			l_conn.m_pending_mask = 0;
+			dispatch(i->first, l_conn, l_mask, true);
+		}
+		else if (l_conn.m_state == STATE_STREAM)
+		{
+			// A slow reader gets one chunk with all the channels changed meanwhile
+			if (l_conn.m_is_chunk_busy || l_conn.m_out.size() - l_conn.m_out_pos > MAX_STREAM_OUTPUT)
+			{
+				l_conn.m_pending_mask |= l_mask;
+			}
+			else
+			{
+				l_conn.m_is_chunk_busy = true;
+				dispatch(i->first, l_conn, l_mask, true);
+			}
+		}
+	}
+}
+
+void CFlyHttpServer::processTimeouts(uint64_t p_now)
+{
+	for (auto i = m_connections.begin(); i != m_connections.end();)
+	{
+		const auto l_cur = i++;
+		Connection& l_conn = l_cur->second;
+		switch (l_conn.m_state)
+		{
+			case STATE_WAIT:
+				if (p_now >= l_conn.m_wait_until)
+				{
+					l_conn.m_state = STATE_BUSY;
+					dispatch(l_cur->first, l_conn, 0, true);
+				}
+				break;
+			case STATE_STREAM:
+				if (l_conn.m_out.empty() && p_now >= l_conn.m_last_activity + STREAM_PING_INTERVAL)
+				{
+					// Comment line - keeps the proxies and the browser from closing the idle stream
+					l_conn.m_out = ":\n\n";
+					if (!flushConnection(l_cur->first, l_conn))
+					{
+						closeConnection(l_cur);
+					}
+				}
+				break;
+			case STATE_READ:
+				if (p_now >= l_conn.m_last_activity + IDLE_TIMEOUT)
+				{
+					closeConnection(l_cur);
+				}
+				break;
+			default:
+				break;
+		}
+	}
+}
+
+void CFlyHttpServer::sendResponse(Connection& p_conn, const Response& p_response)
+{
+	string& l_out = p_conn.m_out;
+	l_out.reserve(l_out.size() + p_response.m_body.size() + 256);
+	l_out += "HTTP/1.1 " + Util::toString(p_response.m_status) + ' ' + getStatusText(p_response.m_status) + "\r\n";
+	if (!p_response.m_content_type.empty())
+	{
+		l_out += "Content-Type: " + p_response.m_content_type + "\r\n";
+	}
+	l_out += p_response.m_headers;
+	if (p_response.m_is_stream)
+	{
+		// The stream ends with the connection
+		l_out += "Cache-Control: no-cache\r\n";
+	}
+	else
+	{
+		l_out += "Content-Length: " + Util::toString(p_response.m_body.size()) + "\r\n";
+		if (p_conn.m_is_keep_alive)
+		{
+			l_out += "Connection: keep-alive\r\n";
+		}
+		else
+		{
+			l_out += "Connection: close\r\n";
+			p_conn.m_is_close = true;
+		}
+	}
+	l_out += "\r\n";
+	if (p_conn.m_request.m_method != "HEAD")
+	{
+		l_out += p_response.m_body;
+	}
+}
+
+bool CFlyHttpServer::parseRequest(const string& p_header, Request& p_request, bool& p_is_keep_alive, size_t& p_content_length)
+{
+	const auto l_line_end = p_header.find("\r\n");
+	const auto l_method_end = p_header.find(' ');
+	if (l_method_end == string::npos || l_method_end >= l_line_end)
+		return false;
+	const auto l_target_end = p_header.find(' ', l_method_end + 1);
+	if (l_target_end == string::npos || l_target_end >= l_line_end || l_target_end == l_method_end + 1)
+		return false;
+	const string l_version = p_header.substr(l_target_end + 1, l_line_end - l_target_end - 1);
+	if (l_version.compare(0, 5, "HTTP/", 5) != 0)
+		return false;
+	p_request.m_method = p_header.substr(0, l_method_end);
+	const string l_target = p_header.substr(l_method_end + 1, l_target_end - l_method_end - 1);
+	const auto l_query = l_target.find('?');
+	if (l_query != string::npos)
+	{
+		p_request.m_path = l_target.substr(0, l_query);
+		p_request.m_query = l_target.substr(l_query + 1);
+	}
+	else
+	{
+		p_request.m_path = l_target;
+	}
+	p_request.m_header = p_header;
+	const string l_connection = Text::toLower(getHeaderValue(p_header, "connection"));
+	if (l_version == "HTTP/1.0")
+		p_is_keep_alive = l_connection.find("keep-alive") != string::npos;
+	else
+		p_is_keep_alive = l_connection.find("close") == string::npos;
+	const int64_t l_content_length = Util::toInt64(getHeaderValue(p_header, "content-length"));
+	p_content_length = l_content_length > 0 ? static_cast<size_t>(l_content_length) : 0;
+	return true;
+}
+
+string CFlyHttpServer::getHeaderValue(const string& p_header, const char* p_name)
+{
+	const size_t l_name_len = strlen(p_name);
+	for (auto i = p_header.find("\r\n"); i != string::npos && i + 2 < p_header.size(); i = p_header.find("\r\n", i + 2))
+	{
+		const size_t l_start = i + 2;
+		if (_strnicmp(p_header.c_str() + l_start, p_name, l_name_len) != 0)
+			continue;
+		if (l_start + l_name_len >= p_header.size() || p_header[l_start + l_name_len] != ':')
+			continue;
+		const auto l_end = p_header.find("\r\n", l_start);
+		auto l_value = p_header.find_first_not_of(' ', l_start + l_name_len + 1);
+		if (l_value == string::npos || l_value >= l_end)
+			return Util::emptyString;
+		return p_header.substr(l_value, l_end - l_value);
+	}
+	return Util::emptyString;
+}
+
+StringMap CFlyHttpServer::parseQuery(const string& p_query)
+{
+	StringMap l_args;
+	string::size_type i = 0;
+	while (i < p_query.size())
+	{
+		auto l_end = p_query.find('&', i);
+		if (l_end == string::npos)
+			l_end = p_query.size();
+		const auto l_eq = p_query.find('=', i);
+		if (l_eq != string::npos && l_eq < l_end)
+			l_args[p_query.substr(i, l_eq - i)] = p_query.substr(l_eq + 1, l_end - l_eq - 1);
+		i = l_end + 1;
+	}
+	return l_args;
+}
+
+const char* CFlyHttpServer::getStatusText(int p_status)
+{
+	switch (p_status)
+	{
+		case 200:
+			return "OK";
+		case 204:
+			return "No Content";
+		case 304:
+			return "Not Modified";
+		case 400:
+			return "Bad Request";
+		case 403:
+			return "Forbidden";
+		case 404:
+			return "Not Found";
+		case 413:
+			return "Payload Too Large";
+		case 431:
+			return "Request Header Fields Too Large";
+		case 500:
+			return "Internal Server Error";
+		case 503:
+			return "Service Unavailable";
+		default:
+			return "Unknown";
+	}
+}
@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2017 FlylinkDC++ Team http://flylinkdc.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+#pragma once
+
+#ifndef CFLY_HTTP_SERVER_H
+#define CFLY_HTTP_SERVER_H
+
+#include <atomic>
+#include "Socket.h"
+#include "CFlyTaskPool.h"
+
+/**
+ * HTTP/1.1 server of the built-in web interface.
+ * One I/O thread waits (select) on all the accepted connections and does the
+ * non-blocking reads and writes, the requests are handled by a small worker pool.
+ * Connections are kept alive between the requests (pipelined requests are answered in order).
+ * Long polling: the handler parks the request (Response::m_wait_mask) and is called again
+ * on notify() of one of the channels or on the timeout.
+ * Event stream: the handler keeps the connection (Response::m_is_stream) and is called again
+ * on every notify() of its channels, the result is appended to the stream.
+ * The sockets are accepted by the caller (ServerSocket) and passed to addConnection().
+ */
+class CFlyHttpServer : private Thread
+{
+	public:
+		struct Request
+		{
+			Request() : m_fired_mask(0), m_is_retry(false)
+			{
+			}
+			string m_method;
+			string m_path; // without the query
+			string m_query; // after '?'
+			string m_header; // the whole request header as received
+			string m_ip;
+			uint32_t m_fired_mask; // the channels that woke up the parked request or the stream, 0 - timeout
+			bool m_is_retry; // the handler is called again for the parked request or the stream
+		};
+		struct Response
+		{
+			Response() : m_status(200), m_wait_mask(0), m_wait_ms(0), m_is_stream(false)
+			{
+			}
+			int m_status;
+			string m_content_type;
+			string m_headers; // additional header lines "Name: value\r\n"
+			string m_body;
+			uint32_t m_wait_mask; // park the request until notify() of these channels ...
+			uint32_t m_wait_ms; // ... or the timeout
+			bool m_is_stream; // keep the connection and call the handler on notify(m_wait_mask)
+		};
+		typedef std::function<void(const Request&, Response&)> Handler;
+
+		explicit CFlyHttpServer(const Handler& p_handler);
+		~CFlyHttpServer();
+
+		void start();
+		void stop();
+		/** Takes ownership of the accepted socket */
+		void addConnection(SOCKET p_sock, const string& p_ip);
+		/** Wakes up the requests and the streams parked on the channels */
+		void notify(uint32_t p_mask);
+		/** The channels someone is waiting for */
+		uint32_t getWaitMask() const
+		{
+			return m_wait_mask;
+		}
+		/** Runs the task in the worker pool, false - the server is not started */
+		bool addTask(const CFlyTaskPool::Task& p_task)
+		{
+			return m_pool.addTask(p_task);
+		}
+
+		static const char* getStatusText(int p_status);
+		/** name=value&... (the values are not decoded) */
+		static StringMap parseQuery(const string& p_query);
+		/** Value of the header line (the name is case insensitive), empty if there is no such line */
+		static string getHeaderValue(const string& p_header, const char* p_name);
+
+	private:
+		enum
+		{
+			MAX_CONNECTIONS = 60, // FD_SETSIZE (64) - the wakeup socket
+			MAX_HEADER_SIZE = 32 * 1024,
+			MAX_REQUESTS_PER_CONNECTION = 1000,
+			MAX_STREAM_OUTPUT = 1024 * 1024,
+			IDLE_TIMEOUT = 30 * 1000,
+			STREAM_PING_INTERVAL = 15 * 1000
+		};
+		enum State
+		{
+			STATE_READ,
+			STATE_BUSY, // the request is in the worker pool
+			STATE_WAIT, // long polling
+			STATE_STREAM
+		};
+		struct Connection
+		{
+			Connection() : m_sock(INVALID_SOCKET), m_out_pos(0), m_last_activity(0), m_wait_until(0),
+				m_count_requests(0), m_wait_mask(0), m_pending_mask(0), m_state(STATE_READ),
+				m_is_keep_alive(false), m_is_close(false), m_is_chunk_busy(false)
+			{
+			}
+			SOCKET m_sock;
+			string m_in;
+			string m_out;
+			size_t m_out_pos;
+			uint64_t m_last_activity;
+			uint64_t m_wait_until;
+			unsigned m_count_requests;
+			uint32_t m_wait_mask;
+			uint32_t m_pending_mask; // notified while the request or the previous chunk is in the pool
+			State m_state;
+			bool m_is_keep_alive;
+			bool m_is_close; // close after m_out is sent
+			bool m_is_chunk_busy;
+			Request m_request;
+		};
+		typedef std::map<uint64_t, Connection> ConnectionMap;
+		struct Result
+		{
+			Result() : m_id(0)
+			{
+			}
+			uint64_t m_id;
+			Response m_response;
+		};
+
+		int run();
+		void wakeup();
+		void closeConnection(ConnectionMap::iterator p_conn);
+		static bool readConnection(Connection& p_conn);
+		/** Sends the output and takes the next request. Returns false if the connection has to be closed. */
+		bool flushConnection(uint64_t p_id, Connection& p_conn);
+		/** Returns true if an error response was queued */
+		bool processInput(uint64_t p_id, Connection& p_conn);
+		void processResult(Result& p_result);
+		void processNotify(uint32_t p_mask);
+		void processTimeouts(uint64_t p_now);
+		void dispatch(uint64_t p_id, Connection& p_conn, uint32_t p_fired_mask, bool p_is_retry);
+		void runHandler(uint64_t p_id, const Request& p_request);
+		static void sendResponse(Connection& p_conn, const Response& p_response);
+		static SOCKET createWakeupSocket();
+
+		static bool parseRequest(const string& p_header, Request& p_request, bool& p_is_keep_alive, size_t& p_content_length);
+
+		const Handler m_handler;
+		CFlyTaskPool m_pool;
+		ConnectionMap m_connections; // I/O thread only
+		uint64_t m_next_id;
+
+		FastCriticalSection m_cs; // m_new_connections, m_results, m_notify_mask
+		std::vector<std::pair<SOCKET, string>> m_new_connections;
+		std::vector<Result> m_results;
+		uint32_t m_notify_mask;
+
+		std::atomic<uint32_t> m_wait_mask;
+		SOCKET m_wakeup_sock;
+		volatile bool m_is_stop;
+		bool m_is_started;
+};
+
+#endif // CFLY_HTTP_SERVER_H
@@ -1,128 +1,193 @@
 #include "stdinc.h"
+#include <mutex>
 #include "CFlyLockProfiler.h"
-#ifdef FLYLINKDC_USE_PROFILER_CS
+#include "CFlyMetrics.h"
+#include "Util.h"
 
-#include "ClientManager.h"
-
-BoostFastCriticalSection CFlyLockProfiler::g_cs_stat_map;
-std::map<string, std::pair<DWORD, DWORD> > CFlyLockProfiler::g_lock_map;
-void CFlyLockProfiler::log(const char* p_path, int p_recursion_count, bool p_is_unlock /*= false*/)
+namespace
+{
+struct SiteKey
 {
-	//LARGE_INTEGER l_finish;
-	//QueryPerformanceCounter(&l_finish);
-	//const double l_delta = l_finish.QuadPart - m_start.QuadPart;
-	const DWORD l_tick_delta = GetTickCount() - m_start_tick;
-	if (p_is_unlock && m_function)
+	const char* m_function;
+	int m_line;
+	bool operator==(const SiteKey& p_key) const
 	{
-		BoostFastLock l(g_cs_stat_map);
-		auto& l_item = g_lock_map[m_function + string(" Line:") + Util::toString(m_line)];
-		l_item.first++;
-		if (l_tick_delta > l_item.second)
-			l_item.second = l_tick_delta;
+		return m_function == p_key.m_function && m_line == p_key.m_line;
 	}
-	if (
-#define FLYLINKDC_USE_PROFILE_SELECTED_CLASS
-#ifdef FLYLINKDC_USE_PROFILE_SELECTED_CLASS
-	    (l_tick_delta >= 50 &&
-	     (m_function &&
-	      (
-	          // true
-	          strstr(m_function, "Queue") != 0
-	          //|| strstr(m_function, "CFlyServerConfig") != 0
-	          
-	      )
-	     )
-	     || p_recursion_count > 1
-	    )
-	    &&
-#endif
-	    (m_function &&
-	     (
-	         strstr(m_function, "DebugManager::") == 0 &&
-	         strstr(m_function, "ShareManager::") == 0 &&
-	         strstr(m_function, "::addListener") == 0 &&
-	         strstr(m_function, "::removeListener") == 0 &&
-	         strstr(m_function, "TaskQueue::add") == 0 &&
-	         strstr(m_function, "Identity::") == 0 &&
-	         strstr(m_function, "LogManager::") == 0
-	         
-	     )
-	    )
-	)
+};
+struct SiteKeyHash
+{
+	size_t operator()(const SiteKey& p_key) const
 	{
-		string l_path = p_path;
-		if (ClientManager::isBeforeShutdown())
+		return std::hash<const void*>()(p_key.m_function) ^ (size_t(p_key.m_line) * 2654435761U);
+	}
+};
+struct SiteStat
+{
+	SiteStat() : m_sampled(0), m_contended(0), m_wait_total(0), m_wait_max(0), m_hold_total(0), m_hold_max(0), m_hold_count(0)
+	{
+	}
+	uint64_t m_sampled;
+	uint64_t m_contended;
+	uint64_t m_wait_total;
+	uint64_t m_wait_max;
+	uint64_t m_hold_total;
+	uint64_t m_hold_max;
+	uint64_t m_hold_count;
+};
+struct Record
+{
+	SiteKey m_site;
+	uint64_t m_wait;
+	uint64_t m_hold;
+	bool m_is_contended;
+};
+
+// Not CriticalSection: the profiler is called from CriticalSection
+std::mutex g_cs;
+std::unordered_map<SiteKey, SiteStat, SiteKeyHash> g_sites;
+
+void mergeRecords(const Record* p_records, size_t p_count)
+{
+	std::lock_guard<std::mutex> l_lock(g_cs);
+	for (size_t i = 0; i < p_count; ++i)
+	{
+		const Record& l_record = p_records[i];
+		SiteStat& l_stat = g_sites[l_record.m_site];
+		if (l_record.m_is_contended)
+		{
+			++l_stat.m_contended;
+			l_stat.m_wait_total += l_record.m_wait;
+			l_stat.m_wait_max = std::max(l_stat.m_wait_max, l_record.m_wait);
+		}
+		else
+		{
+			++l_stat.m_sampled;
+		}
+		if (l_record.m_hold)
 		{
-			l_path += ".shutdown.txt";
+			++l_stat.m_hold_count;
+			l_stat.m_hold_total += l_record.m_hold;
+			l_stat.m_hold_max = std::max(l_stat.m_hold_max, l_record.m_hold);
 		}
-		else if (ClientManager::isStartup())
+	}
+}
+
+class ThreadBuffer
+{
+	public:
+		ThreadBuffer() : m_count(0), m_first_ticks(0), m_sample_counter(0)
 		{
-			l_path += ".startup.txt";
 		}
-		if (!m_add_log_info.empty())
+		~ThreadBuffer()
 		{
-			l_path += ".extinfo.txt";
+			flush();
+		}
+		/** Flushed when it is full or its first record is older than p_max_age (a thread with few locks) */
+		void add(const Record& p_record, uint64_t p_now, uint64_t p_max_age)
+		{
+			if (m_count == 0)
+			{
+				m_first_ticks = p_now;
+			}
+			m_records[m_count++] = p_record;
+			if (m_count == CFlyLockProfiler::BUFFER_SIZE || p_now - m_first_ticks >= p_max_age)
+			{
+				flush();
+			}
 		}
-		FILE *f = fopen(l_path.c_str(), "ab+");
-		if (f)
+		void flush()
 		{
-			char timeFormat[64];
-			timeFormat[0] = 0;
-			time_t now;
-			time(&now);
-			tm *now_tm = localtime(&now);
-			strftime(timeFormat, _countof(timeFormat), "%d.%m.%Y %H:%M:%S", now_tm);
-			fprintf(f, "[%6d][%s] %s [%d] tick_delta = %d RecursionCount = %d ext_info = %s\r\n",
-			        ::GetCurrentThreadId(),
-			        timeFormat,
-			        m_function ? m_function : "",
-			        m_line,
-			        //l_delta,
-			        l_tick_delta,
-			        p_recursion_count,
-			        m_add_log_info.c_str()
-			       );
-			if (m_function == nullptr)
+			if (m_count)
 			{
-				now_tm = nullptr;
+				mergeRecords(m_records, m_count);
+				m_count = 0;
 			}
-			fclose(f);
 		}
+	private:
+		Record m_records[CFlyLockProfiler::BUFFER_SIZE];
+		size_t m_count;
+		uint64_t m_first_ticks;
+	public:
+		unsigned m_sample_counter;
+};
+thread_local ThreadBuffer g_thread_buffer;
+
+// TSC ticks per microsecond - measured with QueryPerformanceCounter on start
+double calcTicksPerUs()
+{
+	LARGE_INTEGER l_frequency;
+	LARGE_INTEGER l_start;
+	LARGE_INTEGER l_now;
+	QueryPerformanceFrequency(&l_frequency);
+	QueryPerformanceCounter(&l_start);
+	const uint64_t l_start_ticks = __rdtsc();
+	const LONGLONG l_period = l_frequency.QuadPart / 500; // 2 ms
+	do
+	{
+		QueryPerformanceCounter(&l_now);
 	}
+	while (l_now.QuadPart - l_start.QuadPart < l_period);
+	const uint64_t l_ticks = __rdtsc() - l_start_ticks;
+	const double l_us = double(l_now.QuadPart - l_start.QuadPart) * 1000000 / double(l_frequency.QuadPart);
+	return l_us > 0 ? double(l_ticks) / l_us : 1;
+}
+const double g_ticks_per_us = calcTicksPerUs();
+// The records of the other threads are seen by getReport one second later at most
+const uint64_t g_max_age_ticks = uint64_t(g_ticks_per_us * 1000000);
 }
-CFlyLockProfiler::~CFlyLockProfiler()
+
+uint64_t CFlyLockProfiler::ticksToUs(uint64_t p_ticks)
 {
+	// Locks of the static initialization can be taken before the calibration
+	return g_ticks_per_us > 0 ? uint64_t(double(p_ticks) / g_ticks_per_us) : 0;
 }
-void CFlyLockProfiler::print_stat()
+
+bool CFlyLockProfiler::isSample()
 {
-	BoostFastLock l(g_cs_stat_map);
-	static std::multimap<DWORD, std::string> l_order_count;
-	static std::multimap<DWORD, std::string> l_order_delta;
-	FILE *f = fopen("D:\\AllStatCriticalSection.txt", "ab+");
-	if (f)
+	return (++g_thread_buffer.m_sample_counter % SAMPLE_RATE) == 0;
+}
+
+void CFlyLockProfiler::add(const char* p_function, int p_line, uint64_t p_wait_ticks, uint64_t p_hold_ticks, bool p_is_contended)
+{
+	if (p_is_contended)
 	{
-		fprintf(f, "==========================================\r\n\r\n");
-		for (auto i = g_lock_map.cbegin(); i != g_lock_map.cend(); ++i)
-		{
-			fprintf(f, "%s count = %u max tick =%u\r\n", i->first.c_str(), i->second.first, i->second.second);
-			l_order_count.insert(std::make_pair(i->second.first, i->first));
-			l_order_delta.insert(std::make_pair(i->second.second, i->first));
-		}
-		fprintf(f, "==========================================\r\n\r\n");
-		fprintf(f, "=============     order count   ==========\r\n\r\n");
-		fprintf(f, "==========================================\r\n\r\n");
-		for (auto j = l_order_count.cbegin(); j != l_order_count.cend(); ++j)
-		{
-			fprintf(f, "%d name =%s\r\n", j->first, j->second.c_str());
-		}
-		fprintf(f, "==========================================\r\n\r\n");
-		fprintf(f, "=============     order tick   ==========\r\n\r\n");
-		fprintf(f, "==========================================\r\n\r\n");
-		for (auto j = l_order_delta.cbegin(); j != l_order_delta.cend(); ++j)
-		{
-			fprintf(f, "%d name =%s\r\n", j->first, j->second.c_str());
-		}
-		fclose(f);
+		CFlyMetrics::observe(CFlyMetrics::LOCK_WAIT, ticksToUs(p_wait_ticks));
+	}
+	const Record l_record = { { p_function, p_line }, p_wait_ticks, p_hold_ticks, p_is_contended };
+	g_thread_buffer.add(l_record, getTicks(), g_max_age_ticks);
+}
+
+std::string CFlyLockProfiler::getReport(size_t p_top /* = 30 */)
+{
+	// The records of the current thread are shown too, the other threads flush by the buffer size or age
+	g_thread_buffer.flush();
+	std::vector<std::pair<SiteKey, SiteStat> > l_sites;
+	{
+		std::lock_guard<std::mutex> l_lock(g_cs);
+		l_sites.assign(g_sites.cbegin(), g_sites.cend());
+	}
+	std::sort(l_sites.begin(), l_sites.end(), [](const std::pair<SiteKey, SiteStat>& a, const std::pair<SiteKey, SiteStat>& b)
+	{
+		return a.second.m_wait_total > b.second.m_wait_total;
+	});
+	if (l_sites.size() > p_top)
+	{
+		l_sites.resize(p_top);
+	}
+	std::string l_result = "Lock contention (hold time of every " + Util::toString(int(SAMPLE_RATE)) + "th uncontended lock is sampled), times in us:\r\n";
+	for (auto i = l_sites.cbegin(); i != l_sites.cend(); ++i)
+	{
+		const SiteStat& l_stat = i->second;
+		if (!l_stat.m_contended)
+			break;
+		l_result += std::string(i->first.m_function ? i->first.m_function : "<lock()>") + ':' + Util::toString(i->first.m_line) +
+		            " contended = " + Util::toString(l_stat.m_contended) +
+		            " locks ~ " + Util::toString(l_stat.m_sampled * SAMPLE_RATE + l_stat.m_contended) +
+		            " wait total = " + Util::toString(ticksToUs(l_stat.m_wait_total)) +
+		            " max = " + Util::toString(ticksToUs(l_stat.m_wait_max)) +
+		            " hold avg = " + Util::toString(l_stat.m_hold_count ? ticksToUs(l_stat.m_hold_total / l_stat.m_hold_count) : 0) +
+		            " max = " + Util::toString(ticksToUs(l_stat.m_hold_max)) + "\r\n";
 	}
+	return l_result;
 }
-#endif // FLYLINKDC_USE_PROFILER_CS
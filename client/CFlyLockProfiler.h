@@ -3,45 +3,79 @@
 
 #pragma once
 
-#ifdef _DEBUG
-#define FLYLINKDC_USE_PROFILER_CS
-#endif
-
-#ifdef FLYLINKDC_USE_PROFILER_CS
-#include <ctime>
+#include <cstdint>
 #include <string>
-#include <map>
-#include <boost/utility.hpp>
-#include <boost/thread.hpp>
-
-typedef boost::detail::spinlock BoostFastCriticalSection;
-typedef boost::lock_guard<boost::detail::spinlock> BoostFastLock;
+#include <intrin.h>
 
+/**
+ * Always-on sampling lock contention profiler.
+ * The lock macros (CFlyLock, CFlyFastLock, CFlyReadLock, CFlyWriteLock) pass the call site -
+ * __FUNCTION__ and __LINE__ constants, no strings are built on the lock path.
+ * - uncontended acquisition: one try-lock and a thread local counter,
+ *   every SAMPLE_RATE-th acquisition also measures the hold time;
+ * - contended acquisition: the wait and hold times are always measured (the thread waits anyway).
+ * Times are in TSC ticks. The records are put to a buffer of the thread and merged
+ * to the per call site table when the buffer is full or the thread ends.
+ */
 class CFlyLockProfiler
-#ifdef _DEBUG
-	: boost::noncopyable
-#endif
 {
 	public:
-		explicit CFlyLockProfiler(const char* p_function, int p_line) : m_function(p_function), m_line(p_line)
+		enum { SAMPLE_RATE = 64, BUFFER_SIZE = 256 };
+		
+		static uint64_t getTicks()
 		{
-			//QueryPerformanceCounter(&m_start);
-			m_start_tick = GetTickCount();
+			return __rdtsc();
 		}
-		~CFlyLockProfiler();
-		static void print_stat();
-		void log(const char* p_path, int p_recursion_count, bool p_is_unlock = false);
-	private:
-		const char* m_function;
-		int m_line;
-		//LARGE_INTEGER m_start;
-		DWORD m_start_tick;
-		static BoostFastCriticalSection g_cs_stat_map;
-		static std::map<std::string, std::pair<DWORD, DWORD> > g_lock_map;
-	public:
-		std::string m_add_log_info;
+		static uint64_t ticksToUs(uint64_t p_ticks);
+		/** true - this uncontended acquisition is measured */
+		static bool isSample();
+		static void add(const char* p_function, int p_line, uint64_t p_wait_ticks, uint64_t p_hold_ticks, bool p_is_contended);
+		/** Wait of a lock taken without the call site (lock() called directly) */
+		static void addWait(uint64_t p_wait_ticks)
+		{
+			add(nullptr, 0, p_wait_ticks, 0, true);
+		}
+		/** Top contended call sites (sorted by the total wait time) as text */
+		static std::string getReport(size_t p_top = 30);
+		
+		/** Used by the lock guards: enter() with the result of the try-lock, leave() before the unlock */
+		class Scope
+		{
+			public:
+				Scope(const char* p_function, int p_line) : m_function(p_function), m_line(p_line), m_wait(0), m_start(0), m_is_contended(false)
+				{
+				}
+				/** p_is_locked - result of the try-lock */
+				template<class LockFunc> void enter(bool p_is_locked, const LockFunc& p_lock)
+				{
+					if (p_is_locked)
+					{
+						if (isSample())
+						{
+							m_start = getTicks();
+						}
+						return;
+					}
+					const uint64_t l_start = getTicks();
+					p_lock();
+					m_start = getTicks();
+					m_wait = m_start - l_start;
+					m_is_contended = true;
+				}
+				void leave()
+				{
+					if (m_start)
+					{
+						add(m_function, m_line, m_wait, getTicks() - m_start, m_is_contended);
+					}
+				}
+			private:
+				const char* const m_function;
+				const int m_line;
+				uint64_t m_wait;
+				uint64_t m_start;
+				bool m_is_contended;
+		};
 };
-#endif // FLYLINKDC_USE_PROFILER_CS
-
 
-#endif // DCPLUSPLUS_DCPP_CFLYLOCKPROFILER_H                                 
+#endif // DCPLUSPLUS_DCPP_CFLYLOCKPROFILER_H
@@ -205,5 +205,15 @@ struct CFlyHashCacheItem
 	}
 };
 
+/** Media info of the hashed file read by CFlyMediaInfoPool */
+struct CFlyMediaInfoUpdate
+{
+	__int64 m_path_id;
+	string m_file_name; // full path
+	TTHValue m_tth;
+	CFlyMediaInfo m_media;
+};
+typedef std::vector<CFlyMediaInfoUpdate> CFlyMediaInfoUpdateArray;
+
 
 #endif
@@ -0,0 +1,284 @@
+/*
+ * Copyright (C) 2017 FlylinkDC++ Team http://flylinkdc.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+#include "stdinc.h"
+#include "CFlyMediaInfoPool.h"
+#include "HashManager.h"
+#include "ShareManager.h"
+#include "CFlylinkDBManager.h"
+#include "LogManager.h"
+#include "ClientManager.h"
+#include "File.h"
+#include "../FlyFeatures/flyServer.h"
+
+CFlyMediaInfoPool::CFlyMediaInfoPool() : m_stop(false), m_is_started(false), m_is_saved(false)
+{
+}
+
+CFlyMediaInfoPool::~CFlyMediaInfoPool()
+{
+	shutdown();
+}
+
+void CFlyMediaInfoPool::startup()
+{
+	if (m_is_started)
+		return;
+	{
+		CFlyLock(m_cs_saved);
+		m_is_saved = File::isExist(getSavedFileName());
+	}
+	try
+	{
+		start(0, "CFlyMediaInfoPool");
+		setThreadPriority(Thread::IDLE);
+		m_is_started = true;
+	}
+	catch (const ThreadException& e)
+	{
+		LogManager::message("CFlyMediaInfoPool: " + e.getError());
+	}
+}
+
+void CFlyMediaInfoPool::shutdown()
+{
+	if (m_is_started)
+	{
+		m_is_started = false;
+		m_stop = true;
+		m_semaphore.signal();
+		join();
+	}
+}
+
+bool CFlyMediaInfoPool::add(__int64 p_path_id, const string& p_file_name, int64_t p_size, const TTHValue& p_tth)
+{
+	if (p_size < SETTING(MIN_MEDIAINFO_SIZE) * 1024 * 1024)
+		return false;
+#ifndef _DEBUG
+	if (!CFlyServerConfig::isMediainfoExt(Text::toLower(Util::getFileExtWithoutDot(p_file_name))))
+		return false;
+#endif
+	const Task l_task = { p_path_id, p_file_name, p_size, p_tth };
+	bool l_is_queued = false;
+	if (m_is_started && !m_stop)
+	{
+		CFlyFastLock(m_cs);
+		if (m_tasks.size() < MAX_QUEUE_SIZE)
+		{
+			m_tasks.push_back(l_task);
+			CFlyMetrics::setGauge(CFlyMetrics::MEDIAINFO_DB_QUEUE, m_tasks.size());
+			l_is_queued = true;
+		}
+	}
+	if (l_is_queued)
+	{
+		m_semaphore.signal();
+	}
+	else
+	{
+		// The queue is full or the thread is stopped - the task waits in the file
+		save(TaskArray(1, l_task));
+	}
+	return true;
+}
+
+string CFlyMediaInfoPool::getSavedFileName()
+{
+	return Util::getConfigPath() + "MediaInfoQueue.txt";
+}
+
+void CFlyMediaInfoPool::save(const TaskArray& p_tasks)
+{
+	if (p_tasks.empty())
+		return;
+	string l_lines;
+	for (auto i = p_tasks.cbegin(); i != p_tasks.cend(); ++i)
+	{
+		// The file name can't contain tab or new line
+		l_lines += Util::toString(i->m_path_id);
+		l_lines += '\t';
+		l_lines += Util::toString(i->m_size);
+		l_lines += '\t';
+		l_lines += i->m_tth.toBase32();
+		l_lines += '\t';
+		l_lines += i->m_file_name;
+		l_lines += '\n';
+	}
+	CFlyLock(m_cs_saved);
+	try
+	{
+		File l_file(getSavedFileName(), File::WRITE, File::OPEN | File::CREATE);
+		l_file.setEndPos(0);
+		l_file.write(l_lines);
+		m_is_saved = true;
+	}
+	catch (const FileException& e)
+	{
+		LogManager::message("CFlyMediaInfoPool: can't save the queue - " + e.getError());
+	}
+}
+
+bool CFlyMediaInfoPool::loadSaved()
+{
+	std::deque<Task> l_tasks;
+	{
+		CFlyLock(m_cs_saved);
+		if (!m_is_saved)
+			return false;
+		const string l_file_name = getSavedFileName();
+		try
+		{
+			const string l_data = File(l_file_name, File::READ, File::OPEN).read();
+			string::size_type l_pos = 0;
+			while (l_pos < l_data.size() && l_tasks.size() < MAX_QUEUE_SIZE)
+			{
+				string::size_type l_end = l_data.find('\n', l_pos);
+				if (l_end == string::npos)
+					l_end = l_data.size();
+				const string l_line = l_data.substr(l_pos, l_end - l_pos);
+				l_pos = l_end + 1;
+				const auto l_tab1 = l_line.find('\t');
+				const auto l_tab2 = l_tab1 == string::npos ? string::npos : l_line.find('\t', l_tab1 + 1);
+				const auto l_tab3 = l_tab2 == string::npos ? string::npos : l_line.find('\t', l_tab2 + 1);
+				if (l_tab3 == string::npos || l_tab3 - l_tab2 - 1 != 39)
+					continue;
+				Task l_task;
+				l_task.m_path_id = Util::toInt64(l_line.substr(0, l_tab1));
+				l_task.m_size = Util::toInt64(l_line.substr(l_tab1 + 1, l_tab2 - l_tab1 - 1));
+				l_task.m_tth = TTHValue(l_line.substr(l_tab2 + 1, 39));
+				l_task.m_file_name = l_line.substr(l_tab3 + 1);
+				l_tasks.push_back(std::move(l_task));
+			}
+			if (l_pos < l_data.size())
+			{
+				File(l_file_name, File::WRITE, File::CREATE | File::TRUNCATE).write(l_data.substr(l_pos));
+			}
+			else
+			{
+				File::deleteFile(l_file_name);
+				m_is_saved = false;
+			}
+		}
+		catch (const FileException& e)
+		{
+			LogManager::message("CFlyMediaInfoPool: can't load the queue - " + e.getError());
+			File::deleteFile(l_file_name);
+			m_is_saved = false;
+		}
+	}
+	if (l_tasks.empty())
+		return false;
+	CFlyFastLock(m_cs);
+	for (auto i = l_tasks.begin(); i != l_tasks.end(); ++i)
+	{
+		m_tasks.push_back(std::move(*i));
+	}
+	CFlyMetrics::setGauge(CFlyMetrics::MEDIAINFO_DB_QUEUE, m_tasks.size());
+	return true;
+}
+
+size_t CFlyMediaInfoPool::getQueueSize() const
+{
+	CFlyFastLock(m_cs);
+	return m_tasks.size();
+}
+
+void CFlyMediaInfoPool::flush(CFlyMediaInfoUpdateArray& p_items)
+{
+	if (p_items.empty())
+		return;
+	CFlylinkDBManager::getInstance()->merge_mediainfo(p_items);
+	ShareManager::getInstance()->updateMediainfo(p_items);
+	p_items.clear();
+}
+
+int CFlyMediaInfoPool::run()
+{
+	CFlyMediaInfoUpdateArray l_results;
+	TaskArray l_result_tasks; // the tasks of l_results - saved again if the results are not written
+	while (!m_stop && !ClientManager::isBeforeShutdown())
+	{
+		if (HashManager::getInstance()->IsHashing())
+		{
+			// The disk is busy with the hasher - the media info is read after it
+			flush(l_results);
+			l_result_tasks.clear();
+			m_semaphore.wait(1000);
+			continue;
+		}
+		Task l_task;
+		{
+			CFlyFastLock(m_cs);
+			if (!m_tasks.empty())
+			{
+				l_task = std::move(m_tasks.front());
+				m_tasks.pop_front();
+				CFlyMetrics::setGauge(CFlyMetrics::MEDIAINFO_DB_QUEUE, m_tasks.size());
+			}
+		}
+		if (l_task.m_file_name.empty())
+		{
+			flush(l_results);
+			l_result_tasks.clear();
+			if (!loadSaved())
+			{
+				m_semaphore.wait();
+			}
+			continue;
+		}
+		CFlyMediaInfoUpdate l_item;
+		l_item.m_path_id = l_task.m_path_id;
+		l_item.m_tth = l_task.m_tth;
+		try
+		{
+			if (getMediaInfo(l_task.m_file_name, l_item.m_media, l_task.m_size, l_task.m_tth) && l_item.m_media.isMedia())
+			{
+				l_item.m_file_name = l_task.m_file_name;
+				l_results.push_back(std::move(l_item));
+				l_result_tasks.push_back(std::move(l_task));
+				if (l_results.size() >= FLUSH_COUNT)
+				{
+					flush(l_results);
+					l_result_tasks.clear();
+				}
+			}
+		}
+		catch (const Exception& e)
+		{
+			LogManager::message("CFlyMediaInfoPool: " + l_task.m_file_name + " " + e.getError());
+		}
+	}
+	if (!ClientManager::isBeforeShutdown())
+	{
+		flush(l_results);
+		l_result_tasks.clear();
+	}
+	// Not done yet - next time (the files are not hashed again)
+	{
+		CFlyFastLock(m_cs);
+		for (auto i = m_tasks.begin(); i != m_tasks.end(); ++i)
+		{
+			l_result_tasks.push_back(std::move(*i));
+		}
+		m_tasks.clear();
+	}
+	save(l_result_tasks);
+	return 0;
+}
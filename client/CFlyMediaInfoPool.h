@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2017 FlylinkDC++ Team http://flylinkdc.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+#pragma once
+
+#ifndef CFLY_MEDIA_INFO_POOL_H
+#define CFLY_MEDIA_INFO_POOL_H
+
+#include <deque>
+#include "CFlyThread.h"
+#include "Semaphore.h"
+#include "CFlyMediaInfo.h"
+
+/**
+ * Media info of the hashed files is read in a separate low priority thread
+ * after the hashing, so the hashing speed doesn't depend on the media parsing.
+ * The queue is bounded, the results are written to the database in one transaction
+ * per batch and set to the files of the share.
+ * The tasks over the bound and the tasks left at shutdown are saved to MediaInfoQueue.txt
+ * and read back when the queue is empty (also after the restart) - the files are not rehashed.
+ * One thread: the MediaInfoLib instance and the freeze/crash report state of getMediaInfo are process wide.
+ */
+class CFlyMediaInfoPool : private Thread
+{
+	public:
+		CFlyMediaInfoPool();
+		~CFlyMediaInfoPool();
+		
+		void startup();
+		void shutdown();
+		/** false - not a media file */
+		bool add(__int64 p_path_id, const string& p_file_name, int64_t p_size, const TTHValue& p_tth);
+		size_t getQueueSize() const;
+		
+	private:
+		enum { MAX_QUEUE_SIZE = 100000, FLUSH_COUNT = 64 };
+		struct Task
+		{
+			__int64 m_path_id;
+			string m_file_name;
+			int64_t m_size;
+			TTHValue m_tth;
+		};
+		
+		typedef std::vector<Task> TaskArray;
+		
+		int run();
+		static void flush(CFlyMediaInfoUpdateArray& p_items);
+		static string getSavedFileName();
+		/** Appends the tasks to the file */
+		void save(const TaskArray& p_tasks);
+		/** Moves the saved tasks (up to MAX_QUEUE_SIZE) to the queue */
+		bool loadSaved();
+		
+		std::deque<Task> m_tasks;
+		mutable FastCriticalSection m_cs;
+		CriticalSection m_cs_saved;
+		Semaphore m_semaphore;
+		volatile bool m_stop;
+		bool m_is_started;
+		bool m_is_saved; // the file has tasks
+};
+
+#endif // CFLY_MEDIA_INFO_POOL_H
@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2017 FlylinkDC++ Team http://flylinkdc.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+#include "stdinc.h"
+#include <mutex>
+#include "CFlyMetrics.h"
+#include "Util.h"
+
+std::atomic<int64_t> CFlyMetrics::g_gauges[LAST_GAUGE];
+
+namespace
+{
+struct MetricInfo
+{
+	const char* m_name;
+	const char* m_help;
+};
+const MetricInfo g_counter_info[CFlyMetrics::LAST_COUNTER] =
+{
+	{ "flylinkdc_search_total", "Incoming searches processed by the share" },
+	{ "flylinkdc_search_tth_total", "Incoming TTH searches processed by the share" },
+	{ "flylinkdc_hash_bytes_total", "Bytes read by the hasher" },
+	{ "flylinkdc_hash_files_total", "Files hashed" },
+	{ "flylinkdc_upload_bytes_total", "Bytes uploaded to the users" },
+	{ "flylinkdc_download_bytes_total", "Bytes downloaded from the users" }
+};
+const MetricInfo g_histogram_info[CFlyMetrics::LAST_HISTOGRAM] =
+{
+	{ "flylinkdc_search_latency_seconds", "Time of the incoming search in the share" },
+	{ "flylinkdc_lock_wait_seconds", "Wait time of the contended locks" }
+};
+const MetricInfo g_gauge_info[CFlyMetrics::LAST_GAUGE] =
+{
+	{ "flylinkdc_sockets_open", "Open sockets" },
+	{ "flylinkdc_mediainfo_db_queue_size", "Hashed files waiting for the media info and the database" }
+};
+
+// Not CriticalSection: the contended CriticalSection itself writes to the metrics
+std::mutex g_cs;
+std::vector<CFlyMetrics::ThreadData*> g_threads;
+CFlyMetrics::ThreadData g_finished_threads;
+
+template<class T> void addValue(std::atomic<T>& p_to, const std::atomic<T>& p_from)
+{
+	p_to.store(p_to.load(std::memory_order_relaxed) + p_from.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+void addThreadData(CFlyMetrics::ThreadData& p_to, const CFlyMetrics::ThreadData& p_from)
+{
+	for (size_t i = 0; i < CFlyMetrics::LAST_COUNTER; ++i)
+	{
+		addValue(p_to.m_counters[i], p_from.m_counters[i]);
+	}
+	for (size_t i = 0; i < CFlyMetrics::LAST_HISTOGRAM; ++i)
+	{
+		for (size_t j = 0; j < CFlyMetrics::BUCKET_COUNT; ++j)
+		{
+			addValue(p_to.m_buckets[i][j], p_from.m_buckets[i][j]);
+		}
+		addValue(p_to.m_sums[i], p_from.m_sums[i]);
+	}
+}
+
+class ThreadDataHolder
+{
+	public:
+		ThreadDataHolder() : m_data(new CFlyMetrics::ThreadData)
+		{
+			std::lock_guard<std::mutex> l_lock(g_cs);
+			g_threads.push_back(m_data);
+		}
+		~ThreadDataHolder()
+		{
+			std::lock_guard<std::mutex> l_lock(g_cs);
+			addThreadData(g_finished_threads, *m_data);
+			g_threads.erase(std::remove(g_threads.begin(), g_threads.end(), m_data), g_threads.end());
+			delete m_data;
+		}
+		CFlyMetrics::ThreadData* const m_data;
+};
+
+string formatSeconds(uint64_t p_us)
+{
+	char l_buf[32];
+	_snprintf(l_buf, _countof(l_buf), "%.6f", double(p_us) / 1000000);
+	return l_buf;
+}
+}
+
+CFlyMetrics::ThreadData::ThreadData()
+{
+	for (size_t i = 0; i < LAST_COUNTER; ++i)
+	{
+		m_counters[i] = 0;
+	}
+	for (size_t i = 0; i < LAST_HISTOGRAM; ++i)
+	{
+		for (size_t j = 0; j < BUCKET_COUNT; ++j)
+		{
+			m_buckets[i][j] = 0;
+		}
+		m_sums[i] = 0;
+	}
+}
+
+CFlyMetrics::ThreadData& CFlyMetrics::getThreadData()
+{
+	static thread_local ThreadDataHolder g_holder;
+	return *g_holder.m_data;
+}
+
+uint64_t CFlyMetrics::getTickUs()
+{
+	static LARGE_INTEGER g_frequency = []
+	{
+		LARGE_INTEGER l_frequency;
+		QueryPerformanceFrequency(&l_frequency);
+		return l_frequency;
+	}();
+	LARGE_INTEGER l_counter;
+	QueryPerformanceCounter(&l_counter);
+	return uint64_t(l_counter.QuadPart / g_frequency.QuadPart * 1000000 + l_counter.QuadPart % g_frequency.QuadPart * 1000000 / g_frequency.QuadPart);
+}
+
+string CFlyMetrics::format()
+{
+	ThreadData l_total;
+	{
+		std::lock_guard<std::mutex> l_lock(g_cs);
+		addThreadData(l_total, g_finished_threads);
+		for (auto i = g_threads.cbegin(); i != g_threads.cend(); ++i)
+		{
+			addThreadData(l_total, **i);
+		}
+	}
+	string l_result;
+	l_result.reserve(4096);
+	const auto addHeader = [&l_result](const MetricInfo & p_info, const char* p_type)
+	{
+		l_result += string("# HELP ") + p_info.m_name + ' ' + p_info.m_help + '\n';
+		l_result += string("# TYPE ") + p_info.m_name + ' ' + p_type + '\n';
+	};
+	for (size_t i = 0; i < LAST_COUNTER; ++i)
+	{
+		addHeader(g_counter_info[i], "counter");
+		l_result += string(g_counter_info[i].m_name) + ' ' + Util::toString(l_total.m_counters[i].load()) + '\n';
+	}
+	for (size_t i = 0; i < LAST_GAUGE; ++i)
+	{
+		addHeader(g_gauge_info[i], "gauge");
+		l_result += string(g_gauge_info[i].m_name) + ' ' + Util::toString(g_gauges[i].load()) + '\n';
+	}
+	for (size_t i = 0; i < LAST_HISTOGRAM; ++i)
+	{
+		const string l_name = g_histogram_info[i].m_name;
+		addHeader(g_histogram_info[i], "histogram");
+		uint64_t l_count = 0;
+		for (size_t j = 0; j < BUCKET_COUNT; ++j)
+		{
+			l_count += l_total.m_buckets[i][j].load();
+			const string l_le = j == BUCKET_COUNT - 1 ? string("+Inf") : formatSeconds(uint64_t(1) << j);
+			l_result += l_name + "_bucket{le=\"" + l_le + "\"} " + Util::toString(l_count) + '\n';
+		}
+		l_result += l_name + "_sum " + formatSeconds(l_total.m_sums[i].load()) + '\n';
+		l_result += l_name + "_count " + Util::toString(l_count) + '\n';
+	}
+	return l_result;
+}
@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2017 FlylinkDC++ Team http://flylinkdc.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+#pragma once
+
+#ifndef CFLY_METRICS_H
+#define CFLY_METRICS_H
+
+#include <atomic>
+#include <string>
+#include <cstdint>
+
+/**
+ * Low overhead runtime counters for the /metrics page of the web server.
+ * Counters and histograms are written by every thread to its own slot without
+ * locked instructions and summed on read; the slot of a finished thread is added
+ * to the totals. Gauges are shared atomics (changed rarely).
+ * Histograms are in microseconds with power of two buckets.
+ */
+class CFlyMetrics
+{
+	public:
+		enum Counter
+		{
+			SEARCH_COUNT,
+			SEARCH_TTH_COUNT,
+			HASH_BYTES,
+			HASH_FILES,
+			UPLOAD_BYTES,
+			DOWNLOAD_BYTES,
+			LAST_COUNTER
+		};
+		enum Histogram
+		{
+			SEARCH_LATENCY,
+			LOCK_WAIT,
+			LAST_HISTOGRAM
+		};
+		enum Gauge
+		{
+			SOCKETS,
+			MEDIAINFO_DB_QUEUE,
+			LAST_GAUGE
+		};
+		enum { BUCKET_COUNT = 24 }; // 1 us .. 4 s, the last one is +Inf
+		
+		static void inc(Counter p_counter, int64_t p_value = 1)
+		{
+			auto& l_value = getThreadData().m_counters[p_counter];
+			l_value.store(l_value.load(std::memory_order_relaxed) + p_value, std::memory_order_relaxed);
+		}
+		static void observe(Histogram p_histogram, uint64_t p_us)
+		{
+			ThreadData& l_data = getThreadData();
+			auto& l_bucket = l_data.m_buckets[p_histogram][getBucket(p_us)];
+			l_bucket.store(l_bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			auto& l_sum = l_data.m_sums[p_histogram];
+			l_sum.store(l_sum.load(std::memory_order_relaxed) + p_us, std::memory_order_relaxed);
+		}
+		static void addGauge(Gauge p_gauge, int64_t p_delta)
+		{
+			g_gauges[p_gauge].fetch_add(p_delta, std::memory_order_relaxed);
+		}
+		static void setGauge(Gauge p_gauge, int64_t p_value)
+		{
+			g_gauges[p_gauge].store(p_value, std::memory_order_relaxed);
+		}
+		static uint64_t getTickUs();
+		/** Prometheus text format (version 0.0.4) */
+		static std::string format();
+		
+		class ScopedTimer
+		{
+			public:
+				explicit ScopedTimer(Histogram p_histogram) : m_histogram(p_histogram), m_start(getTickUs())
+				{
+				}
+				~ScopedTimer()
+				{
+					observe(m_histogram, getTickUs() - m_start);
+				}
+			private:
+				const Histogram m_histogram;
+				const uint64_t m_start;
+		};
+		
+		struct ThreadData
+		{
+			ThreadData();
+			std::atomic<int64_t> m_counters[LAST_COUNTER];
+			std::atomic<uint64_t> m_buckets[LAST_HISTOGRAM][BUCKET_COUNT];
+			std::atomic<uint64_t> m_sums[LAST_HISTOGRAM];
+		};
+	private:
+		static size_t getBucket(uint64_t p_us)
+		{
+			size_t l_bucket = 0;
+			while (p_us > (uint64_t(1) << l_bucket) && l_bucket < BUCKET_COUNT - 1)
+			{
+				++l_bucket;
+			}
+			return l_bucket;
+		}
+		static ThreadData& getThreadData();
+		static std::atomic<int64_t> g_gauges[LAST_GAUGE];
+};
+
+#endif // CFLY_METRICS_H
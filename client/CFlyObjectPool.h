@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2017 FlylinkDC++ Team http://flylinkdc.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#pragma once
+
+#ifndef CFLY_OBJECT_POOL_H
+#define CFLY_OBJECT_POOL_H
+
+#include <type_traits>
+#include "CFlyThread.h"
+
+/**
+ * Arena for small objects of the same size (nodes of the file list tree).
+ * Memory is taken from the heap by chunks of CHUNK_SIZE objects, freed objects go to the free list.
+ * All chunks are returned to the heap when the last object is freed (the last file list is closed).
+ * Use from class specific operator new / operator delete.
+ */
+template <class T, size_t CHUNK_SIZE = 4096>
+class CFlyObjectPool
+#ifdef _DEBUG
+	: private boost::noncopyable
+#endif
+{
+	public:
+		CFlyObjectPool() : m_free(nullptr), m_count(0)
+		{
+		}
+		~CFlyObjectPool()
+		{
+			// Objects still alive on exit - don't touch their memory.
+			if (m_count == 0)
+			{
+				releaseL();
+			}
+		}
+		void* allocate()
+		{
+			CFlyFastLock(m_cs);
+			if (!m_free)
+			{
+				addChunkL();
+			}
+			Node* l_node = m_free;
+			m_free = l_node->m_next;
+			++m_count;
+			return l_node;
+		}
+		void deallocate(void* p_ptr)
+		{
+			if (!p_ptr)
+				return;
+			CFlyFastLock(m_cs);
+			Node* l_node = static_cast<Node*>(p_ptr);
+			l_node->m_next = m_free;
+			m_free = l_node;
+			dcassert(m_count);
+			if (--m_count == 0)
+			{
+				releaseL();
+			}
+		}
+		size_t getCount() const
+		{
+			return m_count;
+		}
+		size_t getAllocatedBytes() const
+		{
+			return m_chunks.size() * CHUNK_SIZE * sizeof(Node);
+		}
+	private:
+		union Node
+		{
+			Node* m_next;
+			typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type m_data;
+		};
+		void addChunkL()
+		{
+			Node* l_chunk = static_cast<Node*>(::operator new(CHUNK_SIZE * sizeof(Node)));
+			m_chunks.push_back(l_chunk);
+			for (size_t i = 0; i < CHUNK_SIZE - 1; ++i)
+			{
+				l_chunk[i].m_next = &l_chunk[i + 1];
+			}
+			l_chunk[CHUNK_SIZE - 1].m_next = m_free;
+			m_free = l_chunk;
+		}
+		void releaseL()
+		{
+			for (auto i = m_chunks.cbegin(); i != m_chunks.cend(); ++i)
+			{
+				::operator delete(*i);
+			}
+			m_chunks.clear();
+			m_free = nullptr;
+		}
+
+		FastCriticalSection m_cs;
+		std::vector<Node*> m_chunks;
+		Node* m_free;
+		size_t m_count;
+};
+
+#endif // CFLY_OBJECT_POOL_H
@@ -0,0 +1,389 @@
+/*
+ * Copyright (C) 2017 FlylinkDC++ Team http://flylinkdc.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "stdinc.h"
+#include "CFlySearchCache.h"
+#include "StringTokenizer.h"
+#include "Text.h"
+
+CFlySearchCache::FrequencySketch::FrequencySketch()
+{
+	clear();
+}
+
+void CFlySearchCache::FrequencySketch::clear()
+{
+	memset(m_table, 0, sizeof(m_table));
+	m_additions = 0;
+}
+
+size_t CFlySearchCache::FrequencySketch::index(size_t p_hash, unsigned p_row)
+{
+	static const uint64_t g_seeds[DEPTH] = { 0xc3a5c85c97cb3127ULL, 0xb492b66fbe98f273ULL, 0x9ae16a3b2f90404fULL, 0xcbf29ce484222325ULL };
+	uint64_t l_hash = (uint64_t(p_hash) + g_seeds[p_row]) * g_seeds[(p_row + 1) % DEPTH];
+	l_hash ^= l_hash >> 32;
+	return size_t(l_hash % WIDTH);
+}
+
+void CFlySearchCache::FrequencySketch::increment(const string& p_key)
+{
+	const size_t l_hash = std::hash<string>()(p_key);
+	bool l_is_added = false;
+	for (unsigned i = 0; i < DEPTH; ++i)
+	{
+		uint8_t& l_counter = m_table[i][index(l_hash, i)];
+		if (l_counter < MAX_COUNT)
+		{
+			++l_counter;
+			l_is_added = true;
+		}
+	}
+	if (l_is_added && ++m_additions >= SAMPLE_SIZE)
+	{
+		// Aging - old popular queries must not stay in the cache forever.
+		for (unsigned i = 0; i < DEPTH; ++i)
+		{
+			for (unsigned j = 0; j < WIDTH; ++j)
+			{
+				m_table[i][j] >>= 1;
+			}
+		}
+		m_additions /= 2;
+	}
+}
+
+uint8_t CFlySearchCache::FrequencySketch::frequency(const string& p_key) const
+{
+	const size_t l_hash = std::hash<string>()(p_key);
+	uint8_t l_result = MAX_COUNT;
+	for (unsigned i = 0; i < DEPTH; ++i)
+	{
+		l_result = std::min(l_result, m_table[i][index(l_hash, i)]);
+	}
+	return l_result;
+}
+
+CFlySearchCache::CFlySearchCache(size_t p_max_bytes) : m_bytes(0), m_max_bytes(p_max_bytes), m_negative_count(0)
+{
+}
+
+bool CFlySearchCache::makeKey(const SearchParamBase& p_search_param, string& p_key, StringList& p_terms)
+{
+	if (p_search_param.m_file_type == Search::TYPE_TTH)
+		return false;
+	const StringTokenizer<string> l_tokens(Text::toLower(p_search_param.m_filter), '$');
+	p_terms.clear();
+	p_terms.reserve(l_tokens.getTokens().size());
+	for (auto i = l_tokens.getTokens().cbegin(); i != l_tokens.getTokens().cend(); ++i)
+	{
+		if (!i->empty())
+		{
+			p_terms.push_back(*i);
+		}
+	}
+	if (p_terms.empty())
+		return false;
+	// Search is "all terms must match" - order and duplicates do not change the result.
+	std::sort(p_terms.begin(), p_terms.end());
+	p_terms.erase(std::unique(p_terms.begin(), p_terms.end()), p_terms.end());
+
+	p_key.clear();
+	for (auto i = p_terms.cbegin(); i != p_terms.cend(); ++i)
+	{
+		p_key += *i;
+		p_key += '$';
+	}
+	p_key += '|';
+	p_key += Util::toString(int(p_search_param.m_file_type));
+	if (p_search_param.m_size_mode != Search::SIZE_DONTCARE)
+	{
+		p_key += p_search_param.m_size_mode == Search::SIZE_ATLEAST ? ">" : "<";
+		p_key += Util::toString(p_search_param.m_size);
+	}
+	return true;
+}
+
+size_t CFlySearchCache::calcBytes(const string& p_key, const Entry& p_entry)
+{
+	size_t l_bytes = sizeof(Entry) + p_key.size() * 2 + 64; // map node + lru node
+	for (auto i = p_entry.m_result.cbegin(); i != p_entry.m_result.cend(); ++i)
+	{
+		l_bytes += sizeof(SearchResultCore) + i->getFile().size();
+	}
+	for (auto i = p_entry.m_low_files.cbegin(); i != p_entry.m_low_files.cend(); ++i)
+	{
+		l_bytes += sizeof(string) + i->size();
+	}
+	for (auto i = p_entry.m_terms.cbegin(); i != p_entry.m_terms.cend(); ++i)
+	{
+		l_bytes += sizeof(string) + i->size();
+	}
+	return l_bytes;
+}
+
+void CFlySearchCache::touchL(Entry& p_entry)
+{
+	m_lru.splice(m_lru.begin(), m_lru, p_entry.m_lru);
+}
+
+void CFlySearchCache::eraseL(EntryMap::iterator p_entry)
+{
+	dcassert(m_bytes >= p_entry->second.m_bytes);
+	m_bytes -= p_entry->second.m_bytes;
+	if (p_entry->second.isNegative())
+	{
+		--m_negative_count;
+	}
+	m_lru.erase(p_entry->second.m_lru);
+	m_entries.erase(p_entry);
+}
+
+bool CFlySearchCache::find(const string& p_key, unsigned p_max_results, SearchResultList& p_result, bool& p_is_negative)
+{
+	CFlyFastLock(m_cs);
+	if (!m_pending.empty())
+	{
+		applyPendingL();
+	}
+	m_sketch.increment(p_key);
+	const auto i = m_entries.find(p_key);
+	if (i != m_entries.end())
+	{
+		Entry& l_entry = i->second;
+		// The result was cut by m_max_results - it can't answer a query with a bigger limit.
+		const bool l_is_complete = l_entry.m_result.size() < l_entry.m_max_results || p_max_results <= l_entry.m_max_results;
+		if (l_is_complete)
+		{
+			touchL(l_entry);
+			p_is_negative = l_entry.isNegative();
+			if (p_is_negative)
+			{
+				++m_stat.m_negative_hits;
+			}
+			else
+			{
+				++m_stat.m_hits;
+				const size_t l_count = std::min(l_entry.m_result.size(), size_t(p_max_results));
+				p_result.insert(p_result.end(), l_entry.m_result.cbegin(), l_entry.m_result.cbegin() + l_count);
+			}
+			return true;
+		}
+	}
+	++m_stat.m_misses;
+	return false;
+}
+
+bool CFlySearchCache::isNegative(const string& p_key)
+{
+	CFlyFastLock(m_cs);
+	if (!m_pending.empty())
+	{
+		applyPendingL();
+	}
+	const auto i = m_entries.find(p_key);
+	if (i != m_entries.end() && i->second.isNegative())
+	{
+		m_sketch.increment(p_key);
+		touchL(i->second);
+		++m_stat.m_negative_hits;
+		return true;
+	}
+	return false;
+}
+
+bool CFlySearchCache::makeRoomL(size_t p_bytes, uint8_t p_candidate_freq)
+{
+	if (p_bytes > m_max_bytes)
+	{
+		return false;
+	}
+	// TinyLFU admission against all the victims first: a rare query must not push out a popular one,
+	// and a rejected candidate must not evict anything.
+	size_t l_count = 0;
+	size_t l_bytes = m_bytes;
+	for (auto i = m_lru.crbegin(); l_bytes + p_bytes > m_max_bytes && i != m_lru.crend(); ++i, ++l_count)
+	{
+		const auto l_victim = m_entries.find(*i);
+		dcassert(l_victim != m_entries.end());
+		if (p_candidate_freq < m_sketch.frequency(l_victim->first))
+		{
+			return false;
+		}
+		l_bytes -= l_victim->second.m_bytes;
+	}
+	for (; l_count; --l_count)
+	{
+		eraseL(m_entries.find(m_lru.back()));
+		++m_stat.m_evictions;
+	}
+	return true;
+}
+
+void CFlySearchCache::add(const string& p_key, const StringList& p_terms, unsigned p_max_results, const SearchResultList& p_result)
+{
+	Entry l_entry;
+	l_entry.m_result = p_result;
+	l_entry.m_terms = p_terms;
+	l_entry.m_max_results = p_max_results;
+	l_entry.m_low_files.reserve(p_result.size());
+	for (auto i = p_result.cbegin(); i != p_result.cend(); ++i)
+	{
+		l_entry.m_low_files.push_back(Text::toLower(i->getFile()));
+	}
+	l_entry.m_bytes = calcBytes(p_key, l_entry);
+
+	CFlyFastLock(m_cs);
+	if (!m_pending.empty())
+	{
+		applyPendingL();
+	}
+	const auto l_prev = m_entries.find(p_key);
+	if (l_prev != m_entries.end())
+	{
+		eraseL(l_prev);
+	}
+	if (!makeRoomL(l_entry.m_bytes, m_sketch.frequency(p_key)))
+	{
+		++m_stat.m_rejects;
+		return;
+	}
+	m_lru.push_front(p_key);
+	l_entry.m_lru = m_lru.begin();
+	m_bytes += l_entry.m_bytes;
+	if (l_entry.isNegative())
+	{
+		++m_negative_count;
+	}
+	m_entries.insert(std::make_pair(p_key, std::move(l_entry)));
+	++m_stat.m_inserts;
+}
+
+bool CFlySearchCache::isStale(const Entry& p_entry, const PendingPath& p_path)
+{
+	if (p_path.m_is_add)
+	{
+		// Every term matches a part of the path - the new item can be a new result.
+		const bool l_is_new_result = std::all_of(p_entry.m_terms.cbegin(), p_entry.m_terms.cend(), [&](const string & p_term)
+		{
+			return p_path.m_low_path.find(p_term) != string::npos;
+		});
+		if (l_is_new_result)
+		{
+			return true;
+		}
+	}
+	// One of the cached results is changed or removed.
+	return std::any_of(p_entry.m_low_files.cbegin(), p_entry.m_low_files.cend(), [&](const string & p_file)
+	{
+		return p_file.compare(0, p_path.m_low_path.size(), p_path.m_low_path) == 0;
+	});
+}
+
+void CFlySearchCache::applyPendingL()
+{
+	for (auto i = m_entries.begin(); i != m_entries.end();)
+	{
+		const Entry& l_entry = i->second;
+		const bool l_is_stale = std::any_of(m_pending.cbegin(), m_pending.cend(), [&](const PendingPath & p_path)
+		{
+			return isStale(l_entry, p_path);
+		});
+		if (l_is_stale)
+		{
+			eraseL(i++);
+			++m_stat.m_invalidations;
+		}
+		else
+		{
+			++i;
+		}
+	}
+	m_pending.clear();
+}
+
+void CFlySearchCache::invalidatePath(const string& p_low_path, bool p_is_add)
+{
+	CFlyFastLock(m_cs);
+	if (m_entries.empty())
+	{
+		// Entries added later are built from the changed share.
+		return;
+	}
+	if (m_pending.size() >= MAX_PENDING_PATHS)
+	{
+		clearL();
+		return;
+	}
+	if (!m_pending.empty() && m_pending.back().m_low_path == p_low_path)
+	{
+		if (p_is_add)
+		{
+			m_pending.back().m_is_add = true;
+		}
+		return;
+	}
+	const PendingPath l_path = { p_low_path, p_is_add };
+	m_pending.push_back(l_path);
+}
+
+void CFlySearchCache::flushInvalidations()
+{
+	CFlyFastLock(m_cs);
+	if (!m_pending.empty())
+	{
+		applyPendingL();
+	}
+}
+
+void CFlySearchCache::clearL()
+{
+	m_stat.m_invalidations += m_entries.size();
+	m_entries.clear();
+	m_lru.clear();
+	m_pending.clear();
+	m_bytes = 0;
+	m_negative_count = 0;
+}
+
+void CFlySearchCache::clear()
+{
+	CFlyFastLock(m_cs);
+	clearL();
+}
+
+void CFlySearchCache::setMaxBytes(size_t p_max_bytes)
+{
+	CFlyFastLock(m_cs);
+	m_max_bytes = p_max_bytes;
+	while (m_bytes > m_max_bytes && !m_lru.empty())
+	{
+		eraseL(m_entries.find(m_lru.back()));
+		++m_stat.m_evictions;
+	}
+}
+
+CFlySearchCache::Stat CFlySearchCache::getStat() const
+{
+	CFlyFastLock(m_cs);
+	Stat l_stat = m_stat;
+	l_stat.m_count = m_entries.size();
+	l_stat.m_negative_count = m_negative_count;
+	l_stat.m_bytes = m_bytes;
+	l_stat.m_max_bytes = m_max_bytes;
+	return l_stat;
+}
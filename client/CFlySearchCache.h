@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2017 FlylinkDC++ Team http://flylinkdc.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#pragma once
+
+#ifndef CFLY_SEARCH_CACHE_H
+#define CFLY_SEARCH_CACHE_H
+
+#include <list>
+#include "CFlyThread.h"
+#include "SearchResult.h"
+
+typedef std::vector<SearchResultCore> SearchResultList;
+
+/**
+ * Cache of file search results (positive and negative) for ShareManager::search.
+ * Key is a normalized query: lower-cased and sorted terms + type + size constraints.
+ * Admission is TinyLFU (count-min sketch) in front of LRU eviction with a byte budget.
+ * Invalidation is done per path: only entries that could be affected by a change
+ * in the given directory (or file) are dropped. The paths are queued and checked
+ * in one pass over the entries - on the timer or before the next lookup.
+ */
+class CFlySearchCache
+{
+	public:
+		struct Stat
+		{
+			uint64_t m_hits;
+			uint64_t m_negative_hits;
+			uint64_t m_misses;
+			uint64_t m_inserts;
+			uint64_t m_rejects;
+			uint64_t m_evictions;
+			uint64_t m_invalidations;
+			size_t m_count;
+			size_t m_negative_count;
+			size_t m_bytes;
+			size_t m_max_bytes;
+			Stat() : m_hits(0), m_negative_hits(0), m_misses(0), m_inserts(0), m_rejects(0), m_evictions(0), m_invalidations(0),
+				m_count(0), m_negative_count(0), m_bytes(0), m_max_bytes(0)
+			{
+			}
+			unsigned getHitRatePercent() const
+			{
+				const uint64_t l_total = m_hits + m_negative_hits + m_misses;
+				return l_total ? unsigned((m_hits + m_negative_hits) * 100 / l_total) : 0;
+			}
+		};
+
+		explicit CFlySearchCache(size_t p_max_bytes);
+
+		/** Returns false for queries which can't be cached (empty terms, TTH search) */
+		static bool makeKey(const SearchParamBase& p_search_param, string& p_key, StringList& p_terms);
+
+		/** Lookup. p_is_negative = true - query is known to have no results */
+		bool find(const string& p_key, unsigned p_max_results, SearchResultList& p_result, bool& p_is_negative);
+		bool isNegative(const string& p_key);
+		/** p_max_results - limit used for the search which produced p_result */
+		void add(const string& p_key, const StringList& p_terms, unsigned p_max_results, const SearchResultList& p_result);
+
+		/**
+		 * p_low_path - lower-cased virtual path of the changed file or directory ("root\dir\" or "root\dir\file.ext")
+		 * p_is_add - item was added (negative entries matching the path are dropped too)
+		 */
+		void invalidatePath(const string& p_low_path, bool p_is_add);
+		/** Applies the queued paths (called once per second by ShareManager) */
+		void flushInvalidations();
+		void clear();
+
+		void setMaxBytes(size_t p_max_bytes);
+		Stat getStat() const;
+
+	private:
+		struct Entry
+		{
+			SearchResultList m_result;
+			StringList m_terms;
+			StringList m_low_files; // lower-cased paths of the results
+			unsigned m_max_results;
+			size_t m_bytes;
+			std::list<string>::iterator m_lru;
+			bool isNegative() const
+			{
+				return m_result.empty();
+			}
+		};
+		typedef boost::unordered_map<string, Entry> EntryMap;
+		struct PendingPath
+		{
+			string m_low_path;
+			bool m_is_add;
+		};
+		enum { MAX_PENDING_PATHS = 1024 }; // more changes between the ticks (mass hashing) - the whole cache is dropped
+
+		/** Count-min sketch with 4-bit saturating counters (stored in bytes) and periodic aging */
+		class FrequencySketch
+		{
+			public:
+				FrequencySketch();
+				void increment(const string& p_key);
+				uint8_t frequency(const string& p_key) const;
+				void clear();
+			private:
+				enum { DEPTH = 4, WIDTH = 4096, MAX_COUNT = 15, SAMPLE_SIZE = WIDTH * 10 };
+				static size_t index(size_t p_hash, unsigned p_row);
+				uint8_t m_table[DEPTH][WIDTH];
+				unsigned m_additions;
+		};
+
+		void touchL(Entry& p_entry);
+		void eraseL(EntryMap::iterator p_entry);
+		bool makeRoomL(size_t p_bytes, uint8_t p_candidate_freq);
+		void applyPendingL();
+		void clearL();
+		static bool isStale(const Entry& p_entry, const PendingPath& p_path);
+		static size_t calcBytes(const string& p_key, const Entry& p_entry);
+
+		mutable FastCriticalSection m_cs;
+		EntryMap m_entries;
+		std::list<string> m_lru; // front - most recently used
+		std::vector<PendingPath> m_pending; // invalidated paths not yet applied to m_entries
+		FrequencySketch m_sketch;
+		size_t m_bytes;
+		size_t m_max_bytes;
+		size_t m_negative_count;
+		Stat m_stat;
+};
+
+#endif // CFLY_SEARCH_CACHE_H
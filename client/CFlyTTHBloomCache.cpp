@@ -0,0 +1,219 @@
+/*
+ * Copyright (C) 2017 FlylinkDC++ Team http://flylinkdc.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+#include "stdinc.h"
+#include "CFlyTTHBloomCache.h"
+#include "HashBloom.h"
+#include "ShareManager.h"
+#include "TimerManager.h"
+
+FastCriticalSection CFlyTTHBloomCache::g_cs;
+CriticalSection CFlyTTHBloomCache::g_cs_build;
+CFlyTTHBloomCache::EntryMap CFlyTTHBloomCache::g_entries;
+std::vector<TTHValue> CFlyTTHBloomCache::g_journal;
+bool CFlyTTHBloomCache::g_is_journal = false;
+size_t CFlyTTHBloomCache::g_journal_removed = 0;
+uint32_t CFlyTTHBloomCache::g_journal_generation = 0;
+uint32_t CFlyTTHBloomCache::g_generation = 0;
+CFlyTaskPool CFlyTTHBloomCache::g_pool;
+volatile bool CFlyTTHBloomCache::g_is_stop = false;
+
+static const size_t g_max_entries = 4; // hubs usually ask the same k, m, h
+static const uint64_t g_max_idle_time = 60 * 60 * 1000;
+
+bool CFlyTTHBloomCache::isStaleL(const Entry& p_entry)
+{
+	return p_entry.m_generation != g_generation || p_entry.m_removed > p_entry.m_count / 16;
+}
+
+bool CFlyTTHBloomCache::get(ByteVector& p_bytes, size_t k, size_t m, size_t h)
+{
+	const Key l_key = { k, m, h };
+	CFlyFastLock(g_cs);
+	const auto i = g_entries.find(l_key);
+	if (i == g_entries.end())
+		return false;
+	// Stale filter has extra bits only (more false positives) - still good to send
+	i->second.m_last_access = GET_TICK();
+	p_bytes = i->second.m_bytes;
+	return true;
+}
+
+void CFlyTTHBloomCache::build(ByteVector& p_bytes, size_t k, size_t m, size_t h)
+{
+	const Key l_key = { k, m, h };
+	rebuild(l_key, &p_bytes);
+}
+
+void CFlyTTHBloomCache::rebuild(const Key& p_key, ByteVector* p_bytes)
+{
+	CFlyLock(g_cs_build);
+	if (p_bytes)
+	{
+		// Another hub could ask for the same filter while we were waiting
+		if (get(*p_bytes, p_key.m_k, p_key.m_m, p_key.m_h))
+			return;
+	}
+	else
+	{
+		CFlyFastLock(g_cs);
+		if (g_entries.find(p_key) == g_entries.end())
+			return;
+	}
+	dcdebug("Creating bloom filter, k=%u, m=%u, h=%u\n", unsigned(p_key.m_k), unsigned(p_key.m_m), unsigned(p_key.m_h));
+	std::vector<TTHValue> l_tths;
+	ShareManager::getTTHSnapshot(l_tths);
+	Entry l_entry;
+	l_entry.m_bytes.resize(p_key.m_m / 8);
+	for (auto i = l_tths.cbegin(); i != l_tths.cend(); ++i)
+	{
+		HashBloom::add(l_entry.m_bytes, *i, p_key.m_k, p_key.m_m, p_key.m_h);
+	}
+	l_entry.m_count = l_tths.size();
+	l_entry.m_last_access = GET_TICK();
+	
+	{
+		CFlyFastLock(g_cs);
+		for (auto i = g_journal.cbegin(); i != g_journal.cend(); ++i)
+		{
+			HashBloom::add(l_entry.m_bytes, *i, p_key.m_k, p_key.m_m, p_key.m_h);
+		}
+		l_entry.m_count += g_journal.size();
+		l_entry.m_removed = g_journal_removed;
+		l_entry.m_generation = g_journal_generation;
+		g_is_journal = false;
+		g_journal.clear();
+		g_journal.shrink_to_fit();
+	
+		auto& l_cur = g_entries[p_key];
+		if (!p_bytes)
+		{
+			l_entry.m_last_access = l_cur.m_last_access;
+		}
+		l_cur = std::move(l_entry);
+		if (p_bytes)
+		{
+			*p_bytes = l_cur.m_bytes;
+		}
+		while (g_entries.size() > g_max_entries)
+		{
+			auto l_oldest = g_entries.begin();
+			for (auto i = g_entries.begin(); i != g_entries.end(); ++i)
+			{
+				if (i->second.m_last_access < l_oldest->second.m_last_access)
+				{
+					l_oldest = i;
+				}
+			}
+			g_entries.erase(l_oldest);
+		}
+	}
+}
+
+void CFlyTTHBloomCache::startJournalL()
+{
+	CFlyFastLock(g_cs);
+	g_is_journal = true;
+	g_journal.clear();
+	g_journal_removed = 0;
+	g_journal_generation = g_generation;
+}
+
+void CFlyTTHBloomCache::addL(const TTHValue& p_tth)
+{
+	CFlyFastLock(g_cs);
+	for (auto i = g_entries.begin(); i != g_entries.end(); ++i)
+	{
+		HashBloom::add(i->second.m_bytes, p_tth, i->first.m_k, i->first.m_m, i->first.m_h);
+		++i->second.m_count;
+	}
+	if (g_is_journal)
+	{
+		g_journal.push_back(p_tth);
+	}
+}
+
+void CFlyTTHBloomCache::removeL()
+{
+	CFlyFastLock(g_cs);
+	for (auto i = g_entries.begin(); i != g_entries.end(); ++i)
+	{
+		++i->second.m_removed;
+	}
+	if (g_is_journal)
+	{
+		++g_journal_removed;
+	}
+}
+
+void CFlyTTHBloomCache::resetL()
+{
+	CFlyFastLock(g_cs);
+	++g_generation;
+}
+
+void CFlyTTHBloomCache::rebuildStale(uint64_t p_tick)
+{
+	if (g_is_stop)
+		return;
+	std::vector<Key> l_keys;
+	{
+		CFlyFastLock(g_cs);
+		for (auto i = g_entries.begin(); i != g_entries.end();)
+		{
+			if (i->second.m_last_access + g_max_idle_time < p_tick)
+			{
+				i = g_entries.erase(i);
+				continue;
+			}
+			if (!i->second.m_is_queued && isStaleL(i->second))
+			{
+				i->second.m_is_queued = true;
+				l_keys.push_back(i->first);
+			}
+			++i;
+		}
+	}
+	if (l_keys.empty())
+		return;
+	if (!g_pool.isStarted())
+	{
+		g_pool.start(1, "CFlyTTHBloomCache");
+	}
+	for (auto i = l_keys.cbegin(); i != l_keys.cend(); ++i)
+	{
+		const Key l_key = *i;
+		const CFlyTaskPool::Task l_task = [l_key]()
+		{
+			rebuild(l_key, nullptr);
+		};
+		if (!g_pool.addTask(l_task))
+		{
+			l_task();
+		}
+	}
+}
+
+void CFlyTTHBloomCache::stop()
+{
+	g_is_stop = true;
+	g_pool.stop();
+	CFlyFastLock(g_cs);
+	g_entries.clear();
+}
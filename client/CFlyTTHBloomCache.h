@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2017 FlylinkDC++ Team http://flylinkdc.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+#pragma once
+
+#ifndef CFLY_TTH_BLOOM_CACHE_H
+#define CFLY_TTH_BLOOM_CACHE_H
+
+#include "HashValue.h"
+#include "MerkleTree.h"
+#include "CFlyThread.h"
+#include "CFlyTaskPool.h"
+
+/**
+ * Ready ADC TTH bloom filters (GET blom) of the share, one per requested (k, m, h).
+ * A filter is built once from a snapshot of the TTH index (taken by ShareManager::getTTHSnapshot)
+ * and then kept up to date: every TTH added to the index sets its bits in all the filters.
+ * Removed TTHs can't be cleared from a bloom filter - they are only counted, a filter with
+ * too many removed TTHs (or after the index is rebuilt) is still served (false positives only)
+ * and rebuilt from a new snapshot in the background thread.
+ * The TTHs added while a snapshot is hashed are journaled and applied before the filter is installed.
+ */
+class CFlyTTHBloomCache
+{
+	public:
+		/** Copies the ready filter to p_bytes, false if the filter with these parameters is not built yet */
+		static bool get(ByteVector& p_bytes, size_t k, size_t m, size_t h);
+		/** Builds the filter from a snapshot of the share (in the calling thread) and copies it to p_bytes */
+		static void build(ByteVector& p_bytes, size_t k, size_t m, size_t h);
+
+		// Must be called under ShareManager::g_csTTHIndex
+		static void addL(const TTHValue& p_tth);
+		static void removeL();
+		/** The index is cleared and will be filled again - all the filters become stale */
+		static void resetL();
+		/** The snapshot of the index is taken - start the journal of the added TTHs */
+		static void startJournalL();
+
+		/** Drops the filters unused for an hour, queues the rebuild of the stale ones */
+		static void rebuildStale(uint64_t p_tick);
+		static void stop();
+
+	private:
+		struct Key
+		{
+			size_t m_k;
+			size_t m_m;
+			size_t m_h;
+			bool operator<(const Key& p_key) const
+			{
+				if (m_k != p_key.m_k)
+					return m_k < p_key.m_k;
+				if (m_m != p_key.m_m)
+					return m_m < p_key.m_m;
+				return m_h < p_key.m_h;
+			}
+		};
+		struct Entry
+		{
+			Entry() : m_count(0), m_removed(0), m_generation(0), m_last_access(0), m_is_queued(false)
+			{
+			}
+			ByteVector m_bytes;
+			size_t m_count; // TTHs added
+			size_t m_removed; // TTHs removed since the snapshot
+			uint32_t m_generation; // g_generation of the snapshot
+			uint64_t m_last_access;
+			bool m_is_queued;
+		};
+		typedef std::map<Key, Entry> EntryMap;
+
+		static bool isStaleL(const Entry& p_entry);
+		/** Builds and installs the filter, p_bytes - optional copy of the result */
+		static void rebuild(const Key& p_key, ByteVector* p_bytes);
+
+		static FastCriticalSection g_cs;
+		static CriticalSection g_cs_build; // one snapshot at a time
+		static EntryMap g_entries;
+		static std::vector<TTHValue> g_journal;
+		static bool g_is_journal;
+		static size_t g_journal_removed;
+		static uint32_t g_journal_generation;
+		static uint32_t g_generation;
+		static CFlyTaskPool g_pool;
+		static volatile bool g_is_stop;
+};
+
+#endif // CFLY_TTH_BLOOM_CACHE_H
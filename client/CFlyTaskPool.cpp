@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2017 FlylinkDC++ Team http://flylinkdc.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "stdinc.h"
+#include "CFlyTaskPool.h"
+
+int CFlyTaskPool::Worker::run()
+{
+	for (;;)
+	{
+		m_pool.m_wakeup.wait();
+		Task l_task;
+		{
+			CFlyFastLock(m_pool.m_cs);
+			if (m_pool.m_tasks.empty())
+			{
+				if (m_pool.m_is_stop)
+					break;
+				continue;
+			}
+			l_task.swap(m_pool.m_tasks.front());
+			m_pool.m_tasks.pop_front();
+		}
+		l_task();
+	}
+	return 0;
+}
+
+CFlyTaskPool::CFlyTaskPool() : m_is_stop(false)
+{
+}
+
+CFlyTaskPool::~CFlyTaskPool()
+{
+	stop();
+}
+
+void CFlyTaskPool::start(unsigned p_count_threads, const char* p_name)
+{
+	CFlyLock(m_cs_workers);
+	if (p_count_threads == m_workers.size())
+		return;
+	stop();
+	m_is_stop = false;
+	for (unsigned i = 0; i < p_count_threads; ++i)
+	{
+		try
+		{
+			auto l_worker = std::make_unique<Worker>(*this);
+			l_worker->start(128, p_name);
+			CFlyFastLock(m_cs);
+			m_workers.push_back(std::move(l_worker));
+		}
+		catch (const ThreadException& e)
+		{
+			dcdebug("CFlyTaskPool::start: %s\n", e.getError().c_str());
+			break;
+		}
+	}
+}
+
+void CFlyTaskPool::stop()
+{
+	CFlyLock(m_cs_workers);
+	if (m_workers.empty())
+		return;
+	{
+		CFlyFastLock(m_cs);
+		m_is_stop = true;
+	}
+	for (size_t i = 0; i < m_workers.size(); ++i)
+	{
+		m_wakeup.signal();
+	}
+	for (auto i = m_workers.cbegin(); i != m_workers.cend(); ++i)
+	{
+		(*i)->join();
+	}
+	CFlyFastLock(m_cs);
+	m_workers.clear();
+}
+
+bool CFlyTaskPool::addTask(const Task& p_task)
+{
+	{
+		CFlyFastLock(m_cs);
+		if (m_workers.empty() || m_is_stop)
+			return false;
+		m_tasks.push_back(p_task);
+	}
+	m_wakeup.signal();
+	return true;
+}
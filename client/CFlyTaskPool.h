@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2017 FlylinkDC++ Team http://flylinkdc.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#pragma once
+
+#ifndef CFLY_TASK_POOL_H
+#define CFLY_TASK_POOL_H
+
+#include <functional>
+#include <deque>
+#include "CFlyThread.h"
+#include "Semaphore.h"
+
+/**
+ * Worker threads with a common FIFO queue of independent tasks.
+ * Tasks that have to run in order are chained by the caller (one task drains its own queue).
+ * addTask returns false if the pool is not started - the caller does the work itself.
+ * stop() runs the tasks already in the queue and joins the threads.
+ */
+class CFlyTaskPool
+{
+	public:
+		typedef std::function<void()> Task;
+
+		CFlyTaskPool();
+		~CFlyTaskPool();
+
+		void start(unsigned p_count_threads, const char* p_name);
+		void stop();
+		bool isStarted() const
+		{
+			return !m_workers.empty();
+		}
+
+		bool addTask(const Task& p_task);
+
+	private:
+		class Worker : public Thread
+		{
+			public:
+				explicit Worker(CFlyTaskPool& p_pool) : m_pool(p_pool)
+				{
+				}
+			private:
+				int run();
+				CFlyTaskPool& m_pool;
+		};
+		friend class Worker;
+
+		std::vector<std::unique_ptr<Worker>> m_workers;
+		std::deque<Task> m_tasks;
+		FastCriticalSection m_cs;
+		CriticalSection m_cs_workers;
+		Semaphore m_wakeup;
+		volatile bool m_is_stop;
+};
+
+#endif // CFLY_TASK_POOL_H
@@ -284,6 +284,17 @@ class CriticalSection
 		void lock()
 		{
 			//dcassert(cs.RecursionCount == 0 || (cs.RecursionCount > 0 && tryLock() == true));
+			if (TryEnterCriticalSection(&cs) == FALSE)
+			{
+				const uint64_t l_start = CFlyLockProfiler::getTicks();
+				EnterCriticalSection(&cs);
+				CFlyLockProfiler::addWait(CFlyLockProfiler::getTicks() - l_start);
+			}
+			log("lock");
+		}
+		/** Blocking lock without the profiler (the lock guards measure the wait themselves) */
+		void waitLock()
+		{
 			EnterCriticalSection(&cs);
 			log("lock");
 		}
@@ -393,6 +404,25 @@ class FastCriticalSection
 		}
 #endif
 		void lock()
+		{
+			if (!tryLock())
+			{
+				const uint64_t l_start = CFlyLockProfiler::getTicks();
+				waitLock();
+				CFlyLockProfiler::addWait(CFlyLockProfiler::getTicks() - l_start);
+			}
+		}
+		bool tryLock()
+		{
+			if (Thread::failStateLock(m_state))
+			{
+				return false;
+			}
+			dcdrun(DEBUG_SPIN_LOCK_INSERT());
+			return true;
+		}
+		/** Blocking lock without the profiler (the lock guards measure the wait themselves) */
+		void waitLock()
 		{
 			dcdrun(DEBUG_SPIN_LOCK_INSERT());
 #ifdef _DEBUG
@@ -446,54 +476,33 @@ typedef CriticalSection FastCriticalSection;
 #endif // IRAINMAN_USE_SPIN_LOCK
 
 template<class T>  class LockBase
-#ifdef FLYLINKDC_USE_PROFILER_CS
-	: public CFlyLockProfiler
-#endif
 {
 	public:
-		explicit LockBase(T& aCs
-#ifdef FLYLINKDC_USE_PROFILER_CS
-		                  , const char* p_function
-		                  , int p_line
-#endif
-		                 ) : cs(aCs)
-#ifdef FLYLINKDC_USE_PROFILER_CS
-			, CFlyLockProfiler(p_function, p_line)
-#endif
+		explicit LockBase(T& aCs, const char* p_function = nullptr, int p_line = 0) : cs(aCs), m_profiler(p_function, p_line)
 		{
-			cs.lock();
-#ifdef FLYLINKDC_USE_PROFILER_CS
-			log("D:\\CriticalSectionLog-lock.txt", cs.getRecursionCount());
-#endif
+			m_profiler.enter(cs.tryLock() != FALSE, [this]
+			{
+				cs.waitLock();
+			});
 		}
 		~LockBase()
 		{
-#ifdef FLYLINKDC_USE_PROFILER_CS
-			log("D:\\CriticalSectionLog-unlock.txt", cs.getRecursionCount(), true);
-#endif
+			m_profiler.leave();
 			cs.unlock();
 		}
 	private:
 		T& cs;
+		CFlyLockProfiler::Scope m_profiler;
 };
 typedef LockBase<CriticalSection> Lock;
-#ifdef FLYLINKDC_USE_PROFILER_CS
-#define CFlyLock(cs) Lock l_lock(cs,__FUNCTION__, __LINE__);
-#define CFlyLockLine(cs, line) Lock l_lock(cs,line,0);
-#else
-#define CFlyLock(cs) Lock l_lock(cs);
-#endif
+#define CFlyLock(cs) Lock l_lock(cs, __FUNCTION__, __LINE__);
 #ifdef IRAINMAN_USE_SPIN_LOCK
 typedef LockBase<FastCriticalSection> FastLock;
 #else
 typedef Lock FastLock;
 #endif // IRAINMAN_USE_SPIN_LOCK
 
-#ifdef FLYLINKDC_USE_PROFILER_CS
-#define CFlyFastLock(cs) FastLock l_lock(cs,__FUNCTION__,__LINE__);
-#else
-#define CFlyFastLock(cs) FastLock l_lock(cs);
-#endif
+#define CFlyFastLock(cs) FastLock l_lock(cs, __FUNCTION__, __LINE__);
 
 #endif // FLYLINKDC_USE_BOOST_LOCK
 
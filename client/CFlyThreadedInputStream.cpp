@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2017 FlylinkDC++ Team http://flylinkdc.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "stdinc.h"
+#include "CFlyThreadedInputStream.h"
+
+CFlyThreadedInputStream::CFlyThreadedInputStream(InputStream* p_source) : m_source(p_source),
+	m_write_index(0), m_read_index(0), m_read_pos(0),
+	m_is_block_ready(false), m_is_eof(false), m_is_started(false), m_is_stop(false)
+{
+	for (size_t i = 0; i < BLOCK_COUNT; ++i)
+	{
+		m_blocks[i].m_data.resize(BLOCK_SIZE);
+		m_free.signal();
+	}
+	try
+	{
+		start(64, "CFlyThreadedInputStream");
+		m_is_started = true;
+	}
+	catch (const ThreadException& e)
+	{
+		dcdebug("CFlyThreadedInputStream: %s - read without thread\n", e.getError().c_str());
+	}
+}
+
+CFlyThreadedInputStream::~CFlyThreadedInputStream()
+{
+	if (m_is_started)
+	{
+		m_is_stop = true;
+		m_free.signal();
+		join();
+	}
+}
+
+int CFlyThreadedInputStream::run()
+{
+	for (;;)
+	{
+		m_free.wait();
+		if (m_is_stop)
+			break;
+		Block& l_block = m_blocks[m_write_index];
+		try
+		{
+			size_t l_len = l_block.m_data.size();
+			l_block.m_len = m_source->read(&l_block.m_data[0], l_len);
+		}
+		catch (const Exception& e)
+		{
+			m_error = e.getError();
+			l_block.m_len = 0;
+		}
+		m_write_index = (m_write_index + 1) % BLOCK_COUNT;
+		const bool l_is_last = l_block.m_len == 0;
+		m_filled.signal();
+		if (l_is_last)
+			break;
+	}
+	return 0;
+}
+
+size_t CFlyThreadedInputStream::read(void* p_buf, size_t& p_len)
+{
+	if (!m_is_started)
+	{
+		return m_source->read(p_buf, p_len);
+	}
+	uint8_t* l_out = static_cast<uint8_t*>(p_buf);
+	size_t l_produced = 0;
+	while (l_produced < p_len && !m_is_eof)
+	{
+		if (!m_is_block_ready)
+		{
+			m_filled.wait();
+			m_is_block_ready = true;
+			m_read_pos = 0;
+			if (m_blocks[m_read_index].m_len == 0)
+			{
+				m_is_eof = true;
+				if (!m_error.empty())
+				{
+					throw Exception(m_error);
+				}
+				break;
+			}
+		}
+		const Block& l_block = m_blocks[m_read_index];
+		const size_t l_count = std::min(p_len - l_produced, l_block.m_len - m_read_pos);
+		memcpy(l_out + l_produced, &l_block.m_data[m_read_pos], l_count);
+		l_produced += l_count;
+		m_read_pos += l_count;
+		if (m_read_pos == l_block.m_len)
+		{
+			m_is_block_ready = false;
+			m_read_index = (m_read_index + 1) % BLOCK_COUNT;
+			m_free.signal();
+		}
+	}
+	p_len = l_produced;
+	return l_produced;
+}
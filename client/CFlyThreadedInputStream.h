@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2017 FlylinkDC++ Team http://flylinkdc.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#pragma once
+
+#ifndef CFLY_THREADED_INPUT_STREAM_H
+#define CFLY_THREADED_INPUT_STREAM_H
+
+#include "Streams.h"
+#include "CFlyThread.h"
+#include "Semaphore.h"
+
+/**
+ * Reads the source stream in a separate thread ahead of the consumer.
+ * Used to decompress (bz2) a file list while the previous blocks are parsed.
+ * Errors of the source are rethrown from read() in the consumer thread.
+ * If the thread can't be started the source is read directly.
+ */
+class CFlyThreadedInputStream : public InputStream, private Thread
+{
+	public:
+		explicit CFlyThreadedInputStream(InputStream* p_source);
+		~CFlyThreadedInputStream();
+
+		size_t read(void* p_buf, size_t& p_len);
+
+	private:
+		enum { BLOCK_SIZE = 256 * 1024, BLOCK_COUNT = 4 };
+		struct Block
+		{
+			Block() : m_len(0)
+			{
+			}
+			std::vector<uint8_t> m_data;
+			size_t m_len;
+		};
+
+		int run();
+
+		InputStream* m_source;
+		Block m_blocks[BLOCK_COUNT];
+		Semaphore m_free;
+		Semaphore m_filled;
+		size_t m_write_index;
+		size_t m_read_index;
+		size_t m_read_pos;
+		bool m_is_block_ready;
+		bool m_is_eof;
+		bool m_is_started;
+		volatile bool m_is_stop;
+		string m_error;
+};
+
+#endif // CFLY_THREADED_INPUT_STREAM_H
@@ -0,0 +1,216 @@
+/*
+ * Copyright (C) 2017 FlylinkDC++ Team http://flylinkdc.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+#include "stdinc.h"
+#include "CFlyUploadCache.h"
+#include "File.h"
+
+FastCriticalSection CFlyUploadCache::g_cs;
+CFlyUploadCache::BlockMap CFlyUploadCache::g_blocks;
+CFlyUploadCache::LruList CFlyUploadCache::g_lru;
+boost::unordered_map<TTHValue, unsigned> CFlyUploadCache::g_readers;
+size_t CFlyUploadCache::g_cache_size = 0;
+std::atomic<uint32_t> CFlyUploadCache::g_hits(0);
+std::atomic<uint32_t> CFlyUploadCache::g_misses(0);
+std::atomic<int64_t> CFlyUploadCache::g_hit_bytes(0);
+
+static const size_t g_max_cache_size = 64 * 1024 * 1024;
+
+CFlyUploadCache::BlockPtr CFlyUploadCache::getBlock(const FileKey& p_file, uint64_t p_index)
+{
+	const Key l_key = { p_file, p_index };
+	CFlyFastLock(g_cs);
+	const auto i = g_blocks.find(l_key);
+	if (i == g_blocks.end())
+	{
+		++g_misses;
+		return BlockPtr();
+	}
+	g_lru.splice(g_lru.begin(), g_lru, i->second.m_lru);
+	++g_hits;
+	g_hit_bytes += i->second.m_block->size();
+	return i->second.m_block;
+}
+
+void CFlyUploadCache::addBlock(const FileKey& p_file, uint64_t p_index, const BlockPtr& p_block)
+{
+	const Key l_key = { p_file, p_index };
+	CFlyFastLock(g_cs);
+	auto& l_entry = g_blocks[l_key];
+	if (l_entry.m_block)
+	{
+		// already read by another upload
+		g_cache_size -= l_entry.m_block->size();
+		g_lru.splice(g_lru.begin(), g_lru, l_entry.m_lru);
+	}
+	else
+	{
+		g_lru.push_front(l_key);
+		l_entry.m_lru = g_lru.begin();
+	}
+	l_entry.m_block = p_block;
+	g_cache_size += p_block->size();
+	shrinkL();
+}
+
+void CFlyUploadCache::shrinkL()
+{
+	while (g_cache_size > g_max_cache_size && !g_lru.empty())
+	{
+		const auto i = g_blocks.find(g_lru.back());
+		dcassert(i != g_blocks.end());
+		g_cache_size -= i->second.m_block->size();
+		g_blocks.erase(i);
+		g_lru.pop_back();
+	}
+}
+
+unsigned CFlyUploadCache::addReader(const TTHValue& p_tth)
+{
+	CFlyFastLock(g_cs);
+	return ++g_readers[p_tth];
+}
+
+void CFlyUploadCache::removeReader(const TTHValue& p_tth)
+{
+	CFlyFastLock(g_cs);
+	const auto i = g_readers.find(p_tth);
+	dcassert(i != g_readers.end());
+	if (i != g_readers.end() && --i->second == 0)
+	{
+		g_readers.erase(i);
+	}
+}
+
+bool CFlyUploadCache::isShared(const TTHValue& p_tth)
+{
+	CFlyFastLock(g_cs);
+	const auto i = g_readers.find(p_tth);
+	return i != g_readers.end() && i->second > 1;
+}
+
+void CFlyUploadCache::clear()
+{
+	CFlyFastLock(g_cs);
+	g_blocks.clear();
+	g_lru.clear();
+	g_cache_size = 0;
+}
+
+string CFlyUploadCache::getStats()
+{
+	size_t l_cache_size;
+	{
+		CFlyFastLock(g_cs);
+		l_cache_size = g_cache_size;
+	}
+	const uint32_t l_hits = g_hits;
+	const uint32_t l_total = l_hits + g_misses;
+	char l_buf[256];
+	_snprintf(l_buf, _countof(l_buf), "-=[ Upload cache: %s, hits: %u of %u blocks (%u%%), sent from cache: %s ]=-\r\n",
+	          Util::formatBytes(int64_t(l_cache_size)).c_str(), l_hits, l_total, l_total ? uint32_t(uint64_t(l_hits) * 100 / l_total) : 0,
+	          Util::formatBytes(g_hit_bytes.load()).c_str());
+	return l_buf;
+}
+
+CFlyCachedFileStream::CFlyCachedFileStream(File* p_file, const TTHValue& p_tth, int64_t p_start, int64_t p_size) :
+	m_file(p_file), m_tth(p_tth), m_pos(p_start), m_end(p_start + p_size), m_block_index(0)
+{
+	m_file_key.m_tth = m_tth;
+	m_file_key.m_size = m_file->getSize();
+	m_file_key.m_time = m_file->getLastWriteTime();
+	CFlyUploadCache::addReader(m_tth);
+}
+
+CFlyCachedFileStream::~CFlyCachedFileStream()
+{
+	CFlyUploadCache::removeReader(m_tth);
+}
+
+CFlyUploadCache::BlockPtr CFlyCachedFileStream::readBlocks(uint64_t p_index, uint64_t p_count, bool p_is_shared)
+{
+	// don't read past the requested segment
+	const uint64_t l_last_index = (m_end + CFlyUploadCache::BLOCK_SIZE - 1) / CFlyUploadCache::BLOCK_SIZE;
+	p_count = std::max<uint64_t>(1, std::min(p_count, l_last_index - p_index));
+	
+	// the blocks follow each other in the file - read straight into each block buffer
+	m_file->setPos(int64_t(p_index * CFlyUploadCache::BLOCK_SIZE));
+	CFlyUploadCache::BlockPtr l_first;
+	for (uint64_t l_index = 0; l_index < p_count; ++l_index)
+	{
+		auto l_block = std::make_shared<ByteVector>(size_t(CFlyUploadCache::BLOCK_SIZE));
+		size_t l_total = 0;
+		while (l_total < l_block->size())
+		{
+			size_t l_len = l_block->size() - l_total;
+			if (m_file->read(l_block->data() + l_total, l_len) == 0)
+				break;
+			l_total += l_len;
+		}
+		// only the last block of the file can be short
+		l_block->resize(l_total);
+		if (p_is_shared && l_total)
+		{
+			CFlyUploadCache::addBlock(m_file_key, p_index + l_index, l_block);
+		}
+		if (l_index == 0)
+		{
+			l_first = l_block;
+		}
+		if (l_total < CFlyUploadCache::BLOCK_SIZE)
+			break;
+	}
+	return l_first;
+}
+
+CFlyUploadCache::BlockPtr CFlyCachedFileStream::getBlock(uint64_t p_index)
+{
+	if (CFlyUploadCache::isShared(m_tth))
+	{
+		auto l_block = CFlyUploadCache::getBlock(m_file_key, p_index);
+		if (l_block)
+			return l_block;
+		return readBlocks(p_index, CFlyUploadCache::READ_AHEAD_BLOCKS, true);
+	}
+	return readBlocks(p_index, 1, false);
+}
+
+size_t CFlyCachedFileStream::read(void* p_buf, size_t& p_len)
+{
+	uint8_t* l_out = static_cast<uint8_t*>(p_buf);
+	size_t l_produced = 0;
+	while (l_produced < p_len && m_pos < m_end)
+	{
+		const uint64_t l_index = uint64_t(m_pos) / CFlyUploadCache::BLOCK_SIZE;
+		if (!m_block || m_block_index != l_index)
+		{
+			m_block = getBlock(l_index);
+			m_block_index = l_index;
+		}
+		const size_t l_offset = size_t(uint64_t(m_pos) - l_index * CFlyUploadCache::BLOCK_SIZE);
+		if (l_offset >= m_block->size())
+			break; // the file was truncated
+		const size_t l_count = size_t(std::min<int64_t>(std::min(p_len - l_produced, m_block->size() - l_offset), m_end - m_pos));
+		memcpy(l_out + l_produced, m_block->data() + l_offset, l_count);
+		l_produced += l_count;
+		m_pos += l_count;
+	}
+	p_len = l_produced;
+	return l_produced;
+}
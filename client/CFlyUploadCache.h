@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2017 FlylinkDC++ Team http://flylinkdc.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+#pragma once
+
+#ifndef CFLY_UPLOAD_CACHE_H
+#define CFLY_UPLOAD_CACHE_H
+
+#include "Streams.h"
+#include "MerkleTree.h"
+#include "CFlyThread.h"
+
+class File;
+
+/**
+ * Shared block cache of the uploaded files, keyed by (TTH, file size and time, block number).
+ * Blocks are added to the cache only while the file is uploaded to more than one user,
+ * so a popular file is read from the disk once and the other uploads are served from RAM.
+ * The least recently used blocks are dropped when the cache is over the size limit.
+ */
+class CFlyUploadCache
+{
+	public:
+		enum { BLOCK_SIZE = 128 * 1024, READ_AHEAD_BLOCKS = 8 };
+		typedef std::shared_ptr<const ByteVector> BlockPtr;
+		/** Version of the file - the blocks of a changed file (before it is rehashed) are not used */
+		struct FileKey
+		{
+			TTHValue m_tth;
+			int64_t m_size;
+			int64_t m_time;
+			bool operator==(const FileKey& p_key) const
+			{
+				return m_size == p_key.m_size && m_time == p_key.m_time && m_tth == p_key.m_tth;
+			}
+		};
+		
+		static BlockPtr getBlock(const FileKey& p_file, uint64_t p_index);
+		static void addBlock(const FileKey& p_file, uint64_t p_index, const BlockPtr& p_block);
+		/** @return number of the uploads of the file (including the new one) */
+		static unsigned addReader(const TTHValue& p_tth);
+		static void removeReader(const TTHValue& p_tth);
+		static bool isShared(const TTHValue& p_tth);
+		static void clear();
+		static string getStats();
+		
+	private:
+		struct Key
+		{
+			FileKey m_file;
+			uint64_t m_index;
+			bool operator==(const Key& p_key) const
+			{
+				return m_index == p_key.m_index && m_file == p_key.m_file;
+			}
+		};
+		struct KeyHash
+		{
+			size_t operator()(const Key& p_key) const
+			{
+				size_t l_hash = std::hash<TTHValue>()(p_key.m_file.m_tth);
+				boost::hash_combine(l_hash, p_key.m_file.m_size);
+				boost::hash_combine(l_hash, p_key.m_file.m_time);
+				boost::hash_combine(l_hash, p_key.m_index);
+				return l_hash;
+			}
+		};
+		typedef std::list<Key> LruList;
+		struct Entry
+		{
+			BlockPtr m_block;
+			LruList::iterator m_lru;
+		};
+		typedef boost::unordered_map<Key, Entry, KeyHash> BlockMap;
+		
+		static void shrinkL();
+		
+		static FastCriticalSection g_cs;
+		static BlockMap g_blocks;
+		static LruList g_lru; // the most recently used blocks at the front
+		static boost::unordered_map<TTHValue, unsigned> g_readers;
+		static size_t g_cache_size;
+		static std::atomic<uint32_t> g_hits;
+		static std::atomic<uint32_t> g_misses;
+		static std::atomic<int64_t> g_hit_bytes;
+};
+
+/**
+ * Upload stream of a shared file by TTH, reads the file by blocks of CFlyUploadCache.
+ * While the file is uploaded to several users the blocks are taken from (and added to) the cache
+ * and a miss reads READ_AHEAD_BLOCKS following blocks at once, otherwise the file is read block by block.
+ * Takes the ownership of the file.
+ */
+class CFlyCachedFileStream : public InputStream
+{
+	public:
+		CFlyCachedFileStream(File* p_file, const TTHValue& p_tth, int64_t p_start, int64_t p_size);
+		~CFlyCachedFileStream();
+		
+		size_t read(void* p_buf, size_t& p_len);
+		
+	private:
+		CFlyUploadCache::BlockPtr getBlock(uint64_t p_index);
+		CFlyUploadCache::BlockPtr readBlocks(uint64_t p_index, uint64_t p_count, bool p_is_shared);
+		
+		std::unique_ptr<File> m_file;
+		const TTHValue m_tth;
+		CFlyUploadCache::FileKey m_file_key;
+		int64_t m_pos;
+		const int64_t m_end;
+		CFlyUploadCache::BlockPtr m_block;
+		uint64_t m_block_index;
+};
+
+#endif // CFLY_UPLOAD_CACHE_H
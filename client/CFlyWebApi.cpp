@@ -0,0 +1,511 @@
+/*
+ * Copyright (C) 2017 FlylinkDC++ Team http://flylinkdc.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+#include "stdinc.h"
+#include "CFlyWebApi.h"
+#include "QueueManager.h"
+#include "DownloadManager.h"
+#include "UploadManager.h"
+#include "SearchManager.h"
+#include "ClientManager.h"
+#include "SearchResult.h"
+#include "../jsoncpp/include/json/json.h"
+
+static const char* g_channel_names[CFlyWebApi::CHANNEL_COUNT] = { "queue", "transfers", "search" };
+
+static const string& getArg(const StringMap& p_args, const char* p_name)
+{
+	const auto i = p_args.find(p_name);
+	return i != p_args.end() ? i->second : Util::emptyString;
+}
+
+static string toJson(const Json::Value& p_value)
+{
+	Json::StreamWriterBuilder l_builder;
+	l_builder["indentation"] = "";
+	return Json::writeString(l_builder, p_value);
+}
+
+CFlyWebApi::CFlyWebApi(CFlyHttpServer& p_server) : m_server(p_server), m_last_version(0),
+	m_downloads_tick(0), m_uploads_tick(0), m_search_token(0), m_is_search_listener(false)
+{
+	QueueManager::getInstance()->addListener(this);
+	DownloadManager::getInstance()->addListener(this);
+	UploadManager::getInstance()->addListener(this);
+	TimerManager::getInstance()->addListener(this);
+}
+
+CFlyWebApi::~CFlyWebApi()
+{
+	TimerManager::getInstance()->removeListener(this);
+	UploadManager::getInstance()->removeListener(this);
+	DownloadManager::getInstance()->removeListener(this);
+	QueueManager::getInstance()->removeListener(this);
+	if (m_is_search_listener)
+	{
+		SearchManager::getInstance()->removeListener(this);
+	}
+}
+
+void CFlyWebApi::handle(const CFlyHttpServer::Request& p_request, CFlyHttpServer::Response& p_response)
+{
+	const StringMap l_args = CFlyHttpServer::parseQuery(p_request.m_query);
+	p_response.m_content_type = "application/json; charset=utf-8";
+	if (p_request.m_path == "/api/queue")
+	{
+		handleSnapshot(CHANNEL_QUEUE, p_request, l_args, p_response);
+	}
+	else if (p_request.m_path == "/api/transfers")
+	{
+		handleSnapshot(CHANNEL_TRANSFERS, p_request, l_args, p_response);
+	}
+	else if (p_request.m_path == "/api/search")
+	{
+		const string& l_query = getArg(l_args, "q");
+		if (!l_query.empty() && !p_request.m_is_retry)
+		{
+			// Starts the search on all the hubs - not for a link or an image of a foreign page (CSRF):
+			// the cross-site request can't have its own header without CORS
+			if (CFlyHttpServer::getHeaderValue(p_request.m_header, "X-Requested-With").empty())
+			{
+				p_response.m_status = 403;
+				p_response.m_body = "{\"error\":\"X-Requested-With header is required\"}";
+				return;
+			}
+			startSearch(Util::encodeURI(l_query, true), Search::TypeModes(Util::toInt(getArg(l_args, "type"))));
+		}
+		handleSnapshot(CHANNEL_SEARCH, p_request, l_args, p_response);
+	}
+	else if (p_request.m_path == "/api/events")
+	{
+		handleEvents(p_request, l_args, p_response);
+	}
+	else
+	{
+		p_response.m_status = 404;
+		p_response.m_body = "{\"error\":\"not found\"}";
+	}
+}
+
+void CFlyWebApi::handleSnapshot(Channel p_channel, const CFlyHttpServer::Request& p_request, const StringMap& p_args, CFlyHttpServer::Response& p_response)
+{
+	uint64_t l_version = 0;
+	const auto l_json = getSnapshot(p_channel, l_version);
+	const string& l_since = getArg(p_args, "since");
+	// The client already has this version - wait for the next one.
+	// Unknown version (the web server was restarted) - the current snapshot at once.
+	if (!l_since.empty() && Util::toInt64(l_since) == static_cast<int64_t>(l_version))
+	{
+		if (!p_request.m_is_retry || p_request.m_fired_mask)
+		{
+			p_response.m_wait_mask = getMask(p_channel);
+			p_response.m_wait_ms = LONG_POLL_TIMEOUT;
+		}
+		else
+		{
+			p_response.m_status = 304;
+			p_response.m_content_type.clear();
+		}
+		return;
+	}
+	p_response.m_body = *l_json;
+}
+
+void CFlyWebApi::handleEvents(const CFlyHttpServer::Request& p_request, const StringMap& p_args, CFlyHttpServer::Response& p_response)
+{
+	uint32_t l_mask = 0;
+	const string& l_channels = getArg(p_args, "channels");
+	for (int i = 0; i < CHANNEL_COUNT; ++i)
+	{
+		if (l_channels.empty() || l_channels.find(g_channel_names[i]) != string::npos)
+		{
+			l_mask |= getMask(Channel(i));
+		}
+	}
+	if (!l_mask)
+	{
+		p_response.m_status = 400;
+		p_response.m_body = "{\"error\":\"unknown channel\"}";
+		return;
+	}
+	p_response.m_content_type = "text/event-stream; charset=utf-8";
+	p_response.m_is_stream = true;
+	p_response.m_wait_mask = l_mask;
+	// The first response has all the channels, then the changed ones
+	const uint32_t l_send_mask = p_request.m_is_retry ? p_request.m_fired_mask & l_mask : l_mask;
+	if (!p_request.m_is_retry)
+	{
+		p_response.m_body = "retry: 3000\n\n";
+	}
+	for (int i = 0; i < CHANNEL_COUNT; ++i)
+	{
+		if (l_send_mask & getMask(Channel(i)))
+		{
+			uint64_t l_version = 0;
+			const auto l_json = getSnapshot(Channel(i), l_version);
+			p_response.m_body += "event: ";
+			p_response.m_body += g_channel_names[i];
+			p_response.m_body += "\ndata: ";
+			p_response.m_body += *l_json;
+			p_response.m_body += "\n\n";
+		}
+	}
+}
+
+std::shared_ptr<const string> CFlyWebApi::getSnapshot(Channel p_channel, uint64_t& p_version)
+{
+	{
+		CFlyFastLock(m_cs);
+		const Snapshot& l_snapshot = m_snapshots[p_channel];
+		if (l_snapshot.isActual())
+		{
+			p_version = l_snapshot.m_version;
+			return l_snapshot.m_json;
+		}
+	}
+	CFlyLock(m_cs_build);
+	{
+		CFlyFastLock(m_cs);
+		Snapshot& l_snapshot = m_snapshots[p_channel];
+		if (l_snapshot.isActual()) // built by the other thread
+		{
+			p_version = l_snapshot.m_version;
+			return l_snapshot.m_json;
+		}
+		l_snapshot.m_is_dirty = false; // the changes during the build make it dirty again
+	}
+	string l_data = build(p_channel);
+	std::shared_ptr<const string> l_json;
+	bool l_is_changed = false;
+	{
+		CFlyFastLock(m_cs);
+		Snapshot& l_snapshot = m_snapshots[p_channel];
+		l_snapshot.m_build_tick = GET_TICK();
+		// The same data - the same version (the clients are not woken up)
+		if (!l_snapshot.m_json || l_data != l_snapshot.m_data)
+		{
+			l_snapshot.m_version = ++m_last_version;
+			l_snapshot.m_json = std::make_shared<const string>("{\"version\":" + Util::toString(l_snapshot.m_version) + ",\"data\":" + l_data + '}');
+			l_snapshot.m_data.swap(l_data);
+			l_is_changed = true;
+		}
+		p_version = l_snapshot.m_version;
+		l_json = l_snapshot.m_json;
+	}
+	if (l_is_changed)
+	{
+		m_server.notify(getMask(p_channel));
+	}
+	return l_json;
+}
+
+string CFlyWebApi::build(Channel p_channel)
+{
+	switch (p_channel)
+	{
+		case CHANNEL_QUEUE:
+			return buildQueue();
+		case CHANNEL_TRANSFERS:
+			return buildTransfers();
+		case CHANNEL_SEARCH:
+			return buildSearch();
+		default:
+			dcassert(0);
+			return "{}";
+	}
+}
+
+string CFlyWebApi::buildQueue()
+{
+	// Only the items are taken under the queue lock, the values are read and serialized without it
+	std::vector<QueueItemPtr> l_queue;
+	{
+		QueueManager::LockFileQueueShared l_fileQueue;
+		const auto& l_queue_map = l_fileQueue.getQueueL();
+		l_queue.reserve(l_queue_map.size());
+		for (auto i = l_queue_map.cbegin(); i != l_queue_map.cend(); ++i)
+		{
+			l_queue.push_back(i->second);
+		}
+	}
+	Json::Value l_items(Json::arrayValue);
+	for (auto i = l_queue.cbegin(); i != l_queue.cend(); ++i)
+	{
+		const QueueItemPtr& qi = *i;
+		Json::Value& l_item = l_items.append(Json::Value(Json::objectValue));
+		l_item["target"] = qi->getTarget();
+		l_item["size"] = Json::Int64(qi->getSize());
+		l_item["downloaded"] = Json::UInt64(qi->getDownloadedBytes());
+		l_item["priority"] = int(qi->getPriority());
+		l_item["running"] = qi->isRunning();
+		l_item["speed"] = Json::UInt64(qi->isRunning() ? qi->getAverageSpeed() : 0);
+		l_item["sources"] = Json::UInt64(qi->getLastOnlineCount());
+		l_item["segments"] = int(qi->getMaxSegments());
+	}
+	Json::Value l_root(Json::objectValue);
+	l_root["items"].swap(l_items);
+	return toJson(l_root);
+}
+
+static void addTransfers(Json::Value& p_array, const std::vector<TransferData>& p_transfers)
+{
+	for (auto i = p_transfers.cbegin(); i != p_transfers.cend(); ++i)
+	{
+		Json::Value& l_item = p_array.append(Json::Value(Json::objectValue));
+		if (i->m_hinted_user.user)
+		{
+			l_item["user"] = i->m_hinted_user.user->getLastNick();
+		}
+		l_item["hub"] = i->m_hinted_user.hint;
+		l_item["path"] = i->m_path;
+		l_item["pos"] = Json::Int64(i->m_pos);
+		l_item["size"] = Json::Int64(i->m_size);
+		l_item["speed"] = Json::Int64(i->m_running_average);
+		l_item["percent"] = i->m_percent;
+		l_item["seconds_left"] = Json::Int64(i->m_second_left);
+	}
+}
+
+string CFlyWebApi::buildTransfers()
+{
+	DownloadArray l_downloads;
+	UploadArray l_uploads;
+	{
+		CFlyFastLock(m_cs);
+		l_downloads = m_downloads;
+		l_uploads = m_uploads;
+	}
+	Json::Value l_root(Json::objectValue);
+	addTransfers(l_root["downloads"] = Json::Value(Json::arrayValue), l_downloads);
+	addTransfers(l_root["uploads"] = Json::Value(Json::arrayValue), l_uploads);
+	return toJson(l_root);
+}
+
+string CFlyWebApi::buildSearch()
+{
+	Json::Value l_root(Json::objectValue);
+	Json::Value& l_results = l_root["results"] = Json::Value(Json::arrayValue);
+	CFlyFastLock(m_cs);
+	l_root["search"] = m_search_string;
+	for (auto i = m_search_results.cbegin(); i != m_search_results.cend(); ++i)
+	{
+		Json::Value& l_item = l_results.append(Json::Value(Json::objectValue));
+		l_item["user"] = i->m_nick;
+		l_item["hub"] = i->m_hub_url;
+		l_item["file"] = i->m_file;
+		l_item["type"] = i->m_type == SearchResult::TYPE_DIRECTORY ? "directory" : "file";
+		if (i->m_type == SearchResult::TYPE_FILE)
+		{
+			l_item["size"] = Json::Int64(i->m_size);
+			l_item["tth"] = i->m_tth;
+		}
+	}
+	return toJson(l_root);
+}
+
+void CFlyWebApi::setDirty(Channel p_channel)
+{
+	CFlyFastLock(m_cs);
+	m_snapshots[p_channel].m_is_dirty = true;
+}
+
+void CFlyWebApi::startSearch(string p_search_str, Search::TypeModes p_type)
+{
+	std::replace(p_search_str.begin(), p_search_str.end(), '+', ' ');
+	if (p_type == Search::TYPE_TTH)
+	{
+		p_search_str = g_tth + p_search_str;
+	}
+	const uint32_t l_token = Util::rand();
+	bool l_is_add_listener;
+	{
+		CFlyFastLock(m_cs);
+		m_search_token = l_token;
+		m_search_string = p_search_str;
+		m_search_results.clear();
+		m_snapshots[CHANNEL_SEARCH].m_is_dirty = true;
+		l_is_add_listener = !m_is_search_listener;
+		m_is_search_listener = true;
+	}
+	if (l_is_add_listener)
+	{
+		SearchManager::getInstance()->addListener(this);
+	}
+	SearchParamTokenMultiClient l_search_param;
+	l_search_param.m_filter = p_search_str;
+	l_search_param.m_size_mode = Search::SIZE_DONTCARE;
+	l_search_param.m_token = l_token;
+	l_search_param.m_file_type = p_type;
+	l_search_param.m_size = 0;
+	l_search_param.m_owner = this;
+	l_search_param.m_is_force_passive_searh = false;
+	ClientManager::multi_search(l_search_param);
+}
+
+void CFlyWebApi::buildSnapshots(uint32_t p_mask)
+{
+	for (int i = 0; i < CHANNEL_COUNT; ++i)
+	{
+		if (p_mask & getMask(Channel(i)))
+		{
+			uint64_t l_version;
+			getSnapshot(Channel(i), l_version); // notifies the waiters if changed
+		}
+	}
+	CFlyFastLock(m_cs);
+	for (int i = 0; i < CHANNEL_COUNT; ++i)
+	{
+		if (p_mask & getMask(Channel(i)))
+		{
+			m_snapshots[i].m_is_build_posted = false;
+		}
+	}
+}
+
+void CFlyWebApi::on(TimerManagerListener::Second, uint64_t aTick) noexcept
+{
+	// Without the waiters the snapshots are built on the request.
+	// The timer thread is shared - the snapshots are built in the worker pool of the server.
+	const uint32_t l_wait_mask = m_server.getWaitMask();
+	uint32_t l_build_mask = 0;
+	{
+		CFlyFastLock(m_cs);
+		if (!m_downloads.empty() && aTick - m_downloads_tick > TRANSFERS_TIMEOUT)
+		{
+			m_downloads.clear();
+			m_snapshots[CHANNEL_TRANSFERS].m_is_dirty = true;
+		}
+		if (!m_uploads.empty() && aTick - m_uploads_tick > TRANSFERS_TIMEOUT)
+		{
+			m_uploads.clear();
+			m_snapshots[CHANNEL_TRANSFERS].m_is_dirty = true;
+		}
+		for (int i = 0; i < CHANNEL_COUNT; ++i)
+		{
+			Snapshot& l_snapshot = m_snapshots[i];
+			if ((l_wait_mask & getMask(Channel(i))) && !l_snapshot.m_is_build_posted && !l_snapshot.isActual())
+			{
+				l_snapshot.m_is_build_posted = true;
+				l_build_mask |= getMask(Channel(i));
+			}
+		}
+	}
+	if (l_build_mask)
+	{
+		const CFlyTaskPool::Task l_task = [this, l_build_mask]()
+		{
+			buildSnapshots(l_build_mask);
+		};
+		if (!m_server.addTask(l_task))
+		{
+			// the server is stopped - nobody waits
+			CFlyFastLock(m_cs);
+			for (int i = 0; i < CHANNEL_COUNT; ++i)
+			{
+				if (l_build_mask & getMask(Channel(i)))
+				{
+					m_snapshots[i].m_is_build_posted = false;
+				}
+			}
+		}
+	}
+}
+
+void CFlyWebApi::on(QueueManagerListener::Added, const QueueItemPtr&) noexcept
+{
+	setDirty(CHANNEL_QUEUE);
+}
+
+void CFlyWebApi::on(QueueManagerListener::AddedArray, const std::vector<QueueItemPtr>&) noexcept
+{
+	setDirty(CHANNEL_QUEUE);
+}
+
+void CFlyWebApi::on(QueueManagerListener::Finished, const QueueItemPtr&, const string&, const DownloadPtr&) noexcept
+{
+	setDirty(CHANNEL_QUEUE);
+}
+
+void CFlyWebApi::on(QueueManagerListener::Removed, const QueueItemPtr&) noexcept
+{
+	setDirty(CHANNEL_QUEUE);
+}
+
+void CFlyWebApi::on(QueueManagerListener::RemovedArray, const std::vector<string>&) noexcept
+{
+	setDirty(CHANNEL_QUEUE);
+}
+
+void CFlyWebApi::on(QueueManagerListener::Moved, const QueueItemPtr&, const string&) noexcept
+{
+	setDirty(CHANNEL_QUEUE);
+}
+
+void CFlyWebApi::on(QueueManagerListener::StatusUpdated, const QueueItemPtr&) noexcept
+{
+	setDirty(CHANNEL_QUEUE);
+}
+
+void CFlyWebApi::on(QueueManagerListener::StatusUpdatedList, const QueueItemList&) noexcept
+{
+	setDirty(CHANNEL_QUEUE);
+}
+
+void CFlyWebApi::on(QueueManagerListener::Tick, const QueueItemList&) noexcept
+{
+	setDirty(CHANNEL_QUEUE);
+}
+
+void CFlyWebApi::on(DownloadManagerListener::Tick, const DownloadArray& p_downloads) noexcept
+{
+	CFlyFastLock(m_cs);
+	m_downloads = p_downloads;
+	m_downloads_tick = GET_TICK();
+	m_snapshots[CHANNEL_TRANSFERS].m_is_dirty = true;
+}
+
+void CFlyWebApi::on(UploadManagerListener::Tick, const UploadArray& p_uploads) noexcept
+{
+	CFlyFastLock(m_cs);
+	m_uploads = p_uploads;
+	m_uploads_tick = GET_TICK();
+	m_snapshots[CHANNEL_TRANSFERS].m_is_dirty = true;
+}
+
+void CFlyWebApi::on(SearchManagerListener::SR, const std::unique_ptr<SearchResult>& p_result) noexcept
+{
+	// the results of the other searches are dropped without the lock
+	if (p_result->getToken() != m_search_token.load())
+		return;
+	SearchItem l_item;
+	l_item.m_nick = p_result->getUser()->getLastNick();
+	l_item.m_hub_url = p_result->getHubUrl();
+	l_item.m_file = p_result->getFile();
+	l_item.m_type = p_result->getType();
+	l_item.m_size = p_result->getSize();
+	if (l_item.m_type == SearchResult::TYPE_FILE)
+	{
+		l_item.m_tth = p_result->getTTH().toBase32();
+	}
+	CFlyFastLock(m_cs);
+	if (p_result->getToken() != m_search_token || m_search_results.size() >= static_cast<size_t>(SETTING(WEBSERVER_SEARCHSIZE)))
+		return;
+	m_search_results.push_back(std::move(l_item));
+	m_snapshots[CHANNEL_SEARCH].m_is_dirty = true;
+}
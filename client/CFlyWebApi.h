@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2017 FlylinkDC++ Team http://flylinkdc.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+#pragma once
+
+#ifndef CFLY_WEB_API_H
+#define CFLY_WEB_API_H
+
+#include "CFlyHttpServer.h"
+#include "TimerManager.h"
+#include "QueueManagerListener.h"
+#include "DownloadManagerListener.h"
+#include "UploadManagerListener.h"
+#include "SearchManagerListener.h"
+#include "TransferData.h"
+#include "SearchQueue.h"
+
+/**
+ * JSON API of the web server.
+ * The queue, the transfers and the search results are served from read-only snapshots:
+ * a snapshot is built at most once a second if the data was changed and shared by all the requests.
+ *   /api/queue, /api/transfers, /api/search - the snapshot; with ?since=<version> the request
+ *      waits (long polling) until the snapshot is newer than the version
+ *   /api/search?q=<text>&type=<Search::TypeModes> - starts a new search (needs X-Requested-With header)
+ *   /api/events?channels=queue,transfers,search - event stream (text/event-stream),
+ *      the changed snapshot is sent as the event of the channel
+ * The access (logged in user, host name) is checked by the caller.
+ */
+class CFlyWebApi : private TimerManagerListener, private QueueManagerListener,
+	private DownloadManagerListener, private UploadManagerListener, private SearchManagerListener
+{
+	public:
+		enum Channel
+		{
+			CHANNEL_QUEUE,
+			CHANNEL_TRANSFERS,
+			CHANNEL_SEARCH,
+			CHANNEL_COUNT
+		};
+		static uint32_t getMask(Channel p_channel)
+		{
+			return 1 << p_channel;
+		}
+
+		explicit CFlyWebApi(CFlyHttpServer& p_server);
+		~CFlyWebApi();
+
+		static bool isApi(const string& p_path)
+		{
+			return p_path.compare(0, 5, "/api/") == 0;
+		}
+		void handle(const CFlyHttpServer::Request& p_request, CFlyHttpServer::Response& p_response);
+
+	private:
+		enum
+		{
+			MIN_BUILD_INTERVAL = 1000,
+			LONG_POLL_TIMEOUT = 25 * 1000,
+			TRANSFERS_TIMEOUT = 2500 // Tick is not sent without the transfers
+		};
+		struct Snapshot
+		{
+			Snapshot() : m_version(0), m_build_tick(0), m_is_dirty(true), m_is_build_posted(false)
+			{
+			}
+			/** Built and not changed (or built less than MIN_BUILD_INTERVAL ago) */
+			bool isActual() const
+			{
+				return m_json && (!m_is_dirty || GET_TICK() - m_build_tick < MIN_BUILD_INTERVAL);
+			}
+			std::shared_ptr<const string> m_json; // {"version":N,"data":m_data}
+			string m_data;
+			uint64_t m_version;
+			uint64_t m_build_tick;
+			bool m_is_dirty;
+			bool m_is_build_posted; // the timer posted the build to the worker pool
+		};
+		struct SearchItem
+		{
+			string m_nick;
+			string m_hub_url;
+			string m_file;
+			string m_tth;
+			int64_t m_size;
+			int m_type;
+		};
+
+		std::shared_ptr<const string> getSnapshot(Channel p_channel, uint64_t& p_version);
+		void buildSnapshots(uint32_t p_mask);
+		string build(Channel p_channel);
+		string buildQueue();
+		string buildTransfers();
+		string buildSearch();
+		void setDirty(Channel p_channel);
+		void startSearch(string p_search_str, Search::TypeModes p_type);
+		void handleSnapshot(Channel p_channel, const CFlyHttpServer::Request& p_request, const StringMap& p_args, CFlyHttpServer::Response& p_response);
+		void handleEvents(const CFlyHttpServer::Request& p_request, const StringMap& p_args, CFlyHttpServer::Response& p_response);
+
+		// TimerManagerListener
+		void on(TimerManagerListener::Second, uint64_t aTick) noexcept override;
+		// QueueManagerListener
+		void on(QueueManagerListener::Added, const QueueItemPtr&) noexcept override;
+		void on(QueueManagerListener::AddedArray, const std::vector<QueueItemPtr>&) noexcept override;
+		void on(QueueManagerListener::Finished, const QueueItemPtr&, const string&, const DownloadPtr&) noexcept override;
+		void on(QueueManagerListener::Removed, const QueueItemPtr&) noexcept override;
+		void on(QueueManagerListener::RemovedArray, const std::vector<string>&) noexcept override;
+		void on(QueueManagerListener::Moved, const QueueItemPtr&, const string&) noexcept override;
+		void on(QueueManagerListener::StatusUpdated, const QueueItemPtr&) noexcept override;
+		void on(QueueManagerListener::StatusUpdatedList, const QueueItemList&) noexcept override;
+		void on(QueueManagerListener::Tick, const QueueItemList&) noexcept override;
+		// DownloadManagerListener
+		void on(DownloadManagerListener::Tick, const DownloadArray& p_downloads) noexcept override;
+		// UploadManagerListener
+		void on(UploadManagerListener::Tick, const UploadArray& p_uploads) noexcept override;
+		// SearchManagerListener
+		void on(SearchManagerListener::SR, const std::unique_ptr<SearchResult>& p_result) noexcept override;
+
+		CFlyHttpServer& m_server;
+
+		FastCriticalSection m_cs; // all the data below
+		Snapshot m_snapshots[CHANNEL_COUNT];
+		uint64_t m_last_version;
+		DownloadArray m_downloads;
+		UploadArray m_uploads;
+		uint64_t m_downloads_tick;
+		uint64_t m_uploads_tick;
+		std::vector<SearchItem> m_search_results;
+		string m_search_string;
+		std::atomic<uint32_t> m_search_token; // also read by SR without the lock
+		bool m_is_search_listener;
+
+		CriticalSection m_cs_build; // one snapshot is built at a time
+};
+
+#endif // CFLY_WEB_API_H
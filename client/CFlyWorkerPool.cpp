@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2017 FlylinkDC++ Team http://flylinkdc.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "stdinc.h"
+#include "CFlyWorkerPool.h"
+
+bool CFlyWorkerPool::Batch::process()
+{
+	bool l_is_last = false;
+	for (;;)
+	{
+		const size_t l_index = m_next++;
+		if (l_index >= m_count)
+			break;
+		m_task(l_index);
+		if (++m_done == m_count)
+		{
+			l_is_last = true;
+		}
+	}
+	return l_is_last;
+}
+
+int CFlyWorkerPool::Worker::run()
+{
+	for (;;)
+	{
+		m_pool.m_wakeup.wait();
+		if (m_pool.m_is_stop)
+			break;
+		std::shared_ptr<Batch> l_batch;
+		{
+			CFlyFastLock(m_pool.m_cs_current);
+			l_batch = m_pool.m_current;
+		}
+		if (l_batch && l_batch->process())
+		{
+			l_batch->m_finished.signal();
+		}
+	}
+	return 0;
+}
+
+CFlyWorkerPool::CFlyWorkerPool() : m_is_stop(false)
+{
+}
+
+CFlyWorkerPool::~CFlyWorkerPool()
+{
+	stop();
+}
+
+void CFlyWorkerPool::start(unsigned p_count_threads, const char* p_name)
+{
+	CFlyLock(m_cs_batch);
+	if (p_count_threads == m_workers.size())
+		return;
+	stop();
+	m_is_stop = false;
+	for (unsigned i = 0; i < p_count_threads; ++i)
+	{
+		m_workers.push_back(std::make_unique<Worker>(*this));
+		m_workers.back()->start(128, p_name);
+	}
+}
+
+void CFlyWorkerPool::stop()
+{
+	CFlyLock(m_cs_batch);
+	if (m_workers.empty())
+		return;
+	m_is_stop = true;
+	for (size_t i = 0; i < m_workers.size(); ++i)
+	{
+		m_wakeup.signal();
+	}
+	for (auto i = m_workers.cbegin(); i != m_workers.cend(); ++i)
+	{
+		(*i)->join();
+	}
+	m_workers.clear();
+}
+
+bool CFlyWorkerPool::tryRunBatch(size_t p_count, const Task& p_task)
+{
+	if (!m_cs_batch.tryLock())
+		return false;
+	if (m_workers.empty() || m_is_stop)
+	{
+		m_cs_batch.unlock();
+		return false;
+	}
+	const auto l_batch = std::make_shared<Batch>(p_count, p_task);
+	{
+		CFlyFastLock(m_cs_current);
+		m_current = l_batch;
+	}
+	const size_t l_count_wakeup = std::min(m_workers.size(), p_count > 0 ? p_count - 1 : 0);
+	for (size_t i = 0; i < l_count_wakeup; ++i)
+	{
+		m_wakeup.signal();
+	}
+	if (!l_batch->process())
+	{
+		if (p_count)
+		{
+			l_batch->m_finished.wait();
+		}
+	}
+	{
+		CFlyFastLock(m_cs_current);
+		m_current.reset();
+	}
+	m_cs_batch.unlock();
+	return true;
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2017 FlylinkDC++ Team http://flylinkdc.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#pragma once
+
+#ifndef CFLY_WORKER_POOL_H
+#define CFLY_WORKER_POOL_H
+
+#include <functional>
+#include <atomic>
+#include "CFlyThread.h"
+#include "Semaphore.h"
+
+/**
+ * Small pool of worker threads for "parallel for" style jobs.
+ * The calling thread takes part in the job too, items are taken in index order
+ * by whoever is free (so a slow item does not hold the rest of the batch).
+ * Only one batch runs at a time - a concurrent caller gets false from tryRunBatch
+ * and is expected to do the work itself.
+ */
+class CFlyWorkerPool
+{
+	public:
+		typedef std::function<void(size_t)> Task;
+
+		CFlyWorkerPool();
+		~CFlyWorkerPool();
+
+		void start(unsigned p_count_threads, const char* p_name);
+		void stop();
+		unsigned getThreadCount() const
+		{
+			return unsigned(m_workers.size());
+		}
+
+		/** Runs p_task(0..p_count-1) and returns when all items are done. */
+		bool tryRunBatch(size_t p_count, const Task& p_task);
+
+	private:
+		struct Batch
+		{
+			Batch(size_t p_count, const Task& p_task) : m_count(p_count), m_task(p_task), m_next(0), m_done(0)
+			{
+			}
+			const size_t m_count;
+			const Task& m_task;
+			std::atomic<size_t> m_next;
+			std::atomic<size_t> m_done;
+			Semaphore m_finished;
+			/** Returns true if this call finished the last item */
+			bool process();
+		};
+
+		class Worker : public Thread
+		{
+			public:
+				explicit Worker(CFlyWorkerPool& p_pool) : m_pool(p_pool)
+				{
+				}
+			private:
+				int run();
+				CFlyWorkerPool& m_pool;
+		};
+		friend class Worker;
+
+		std::vector<std::unique_ptr<Worker>> m_workers;
+		Semaphore m_wakeup;
+		CriticalSection m_cs_batch; // one batch at a time
+		FastCriticalSection m_cs_current;
+		std::shared_ptr<Batch> m_current;
+		volatile bool m_is_stop;
+};
+
+#endif // CFLY_WORKER_POOL_H
@@ -4729,6 +4729,36 @@ bool CFlylinkDBManager::merge_mediainfo(const __int64 p_tth_id, const __int64 p_
 	return l_res;
 }
 //========================================================================================================
+void CFlylinkDBManager::merge_mediainfo(const CFlyMediaInfoUpdateArray& p_items)
+{
+	if (p_items.empty())
+		return;
+	flush_hash(); // the hashed files are cached by add_file - they must be in the base before the update
+	CFlyLock(m_cs);
+	try
+	{
+		sqlite3_transaction l_trans(m_flySQLiteDB, p_items.size() > 1);
+		for (auto i = p_items.cbegin(); i != p_items.cend(); ++i)
+		{
+			__int64 l_path_id = i->m_path_id;
+			if (l_path_id == 0)
+			{
+				bool l_is_no_mediainfo;
+				l_path_id = get_path_idL(Util::getFilePath(i->m_file_name), false, true, l_is_no_mediainfo, false);
+				if (l_path_id <= 0)
+					continue;
+			}
+			const __int64 l_tth_id = get_tth_idL(i->m_tth);
+			merge_mediainfoL(l_tth_id, l_path_id, Text::toLower(Util::getFileName(i->m_file_name)), i->m_media);
+		}
+		l_trans.commit();
+	}
+	catch (const database_error& e)
+	{
+		errorDB("SQLite - merge_mediainfo: " + e.getError());
+	}
+}
+//========================================================================================================
 bool CFlylinkDBManager::merge_mediainfoL(const __int64 p_tth_id, const __int64 p_path_id, const string& p_file_name, const CFlyMediaInfo& p_media)
 {
 	try
@@ -5064,6 +5094,52 @@ CFlylinkDBManager::FileStatus CFlylinkDBManager::get_status_file(const TTHValue&
 #endif // FLYLINKDC_USE_LEVELDB
 }
 //========================================================================================================
+void CFlylinkDBManager::get_status_files(const std::vector<TTHValue>& p_sorted_tths, std::vector<FileStatus>& p_result)
+{
+	p_result.assign(p_sorted_tths.size(), UNKNOWN);
+	if (p_sorted_tths.empty())
+		return;
+#ifdef FLYLINKDC_USE_LEVELDB
+	if (m_TTHLevelDB.is_open())
+	{
+		StringList l_values;
+		m_TTHLevelDB.get_values(p_sorted_tths, l_values);
+		for (size_t i = 0; i < l_values.size(); ++i)
+		{
+			if (!l_values[i].empty())
+			{
+				const int l_result = Util::toInt(l_values[i]);
+				dcassert(l_result >= 0 && l_result <= 7);
+				p_result[i] = static_cast<FileStatus>(l_result);
+			}
+		}
+		return;
+	}
+#endif // FLYLINKDC_USE_LEVELDB
+	CFlyLock(m_cs);
+	try
+	{
+		m_get_status_file.init(m_flySQLiteDB,
+		                       "select 2 from fly_hash_block where tth=?");
+		for (size_t i = 0; i < p_sorted_tths.size(); ++i)
+		{
+			m_get_status_file->bind(1, p_sorted_tths[i].data, 24, SQLITE_STATIC);
+			sqlite3_reader l_q = m_get_status_file->executereader();
+			int l_result = 0;
+			while (l_q.read())
+			{
+				l_result += l_q.getint(0);
+			}
+			dcassert(l_result >= 0 && l_result <= 3);
+			p_result[i] = static_cast<FileStatus>(l_result);
+		}
+	}
+	catch (const database_error& e)
+	{
+		errorDB("SQLite - get_status_files: " + e.getError());
+	}
+}
+//========================================================================================================
 #ifdef FLYLINKDC_LOG_IN_SQLITE_BASE
 void CFlylinkDBManager::log(const int p_area, const StringMap& p_params)
 {
@@ -5311,6 +5387,41 @@ bool CFlyLevelDB::get_value(const void* p_key, size_t p_key_len, string& p_resul
 	}
 }
 //========================================================================================================
+bool CFlyLevelDB::get_values(const std::vector<TTHValue>& p_sorted_tths, StringList& p_result)
+{
+	dcassert(m_level_db);
+	p_result.clear();
+	p_result.resize(p_sorted_tths.size());
+	if (m_level_db)
+	{
+		// The keys are sorted: Seek of the same iterator only moves forward and each block is read once
+		std::unique_ptr<leveldb::Iterator> l_it(m_level_db->NewIterator(m_readoptions));
+		for (size_t i = 0; i < p_sorted_tths.size(); ++i)
+		{
+			dcassert(i == 0 || p_sorted_tths[i - 1] < p_sorted_tths[i]);
+			const leveldb::Slice l_key((const char*)p_sorted_tths[i].data, p_sorted_tths[i].BYTES);
+			l_it->Seek(l_key);
+			if (!l_it->Valid())
+				break; // all the next keys are greater than the last one in the database
+			if (l_it->key() == l_key)
+			{
+				p_result[i] = l_it->value().ToString();
+			}
+		}
+		const auto l_status = l_it->status();
+		if (!l_status.ok())
+		{
+			LogManager::message(l_status.ToString(), true);
+		}
+		dcassert(l_status.ok());
+		return l_status.ok();
+	}
+	else
+	{
+		return false;
+	}
+}
+//========================================================================================================
 bool CFlyLevelDB::set_value(const void* p_key, size_t p_key_len, const void* p_val, size_t p_val_len)
 {
 	dcassert(m_level_db);
@@ -86,6 +86,8 @@ class CFlyLevelDB
 		
 		bool open_level_db(const string& p_db_name, bool& p_is_destroy);
 		bool get_value(const void* p_key, size_t p_key_len, string& p_result);
+		/** p_result[i] - value of p_sorted_tths[i] (empty if not found); one forward pass of an iterator */
+		bool get_values(const std::vector<TTHValue>& p_sorted_tths, StringList& p_result);
 		bool set_value(const void* p_key, size_t p_key_len, const void* p_val, size_t p_val_len);
 		bool get_value(const TTHValue& p_tth, string& p_result)
 		{
@@ -390,6 +392,8 @@ class CFlylinkDBManager : public Singleton<CFlylinkDBManager>
 		};
 		
 		FileStatus get_status_file(const TTHValue& p_tth);
+		/** Status of many files at once (file list loading); p_sorted_tths - sorted without duplicates */
+		void get_status_files(const std::vector<TTHValue>& p_sorted_tths, std::vector<FileStatus>& p_result);
 		
 		bool get_tree(const TTHValue& p_root, TigerTree& p_tt, __int64& p_block_size);
 		unsigned __int64 get_block_size_sql(const TTHValue& p_root, __int64 p_size);
@@ -419,6 +423,8 @@ class CFlylinkDBManager : public Singleton<CFlylinkDBManager>
 		void delete_torrent_resume(const libtorrent::sha1_hash& p_sha1);
 		
 		bool merge_mediainfo(const __int64 p_tth_id, const __int64 p_path_id, const string& p_file_name, const CFlyMediaInfo& p_media);
+		/** One transaction for all the items (CFlyMediaInfoPool) */
+		void merge_mediainfo(const CFlyMediaInfoUpdateArray& p_items);
 #ifdef USE_REBUILD_MEDIAINFO
 		bool rebuild_mediainfo(const __int64 p_path_id, const string& p_file_name, const CFlyMediaInfo& p_media, const TTHValue& p_tth);
 #endif
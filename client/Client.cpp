@@ -46,6 +46,7 @@ Client::Client(const string& p_HubURL, char p_separator, bool p_is_secure, bool
 	m_countType(COUNT_UNCOUNTED),
 	m_availableBytes(0),
 	m_isChangeAvailableBytes(false),
+	m_next_user_update_tick(0),
 	m_exclChecks(false), // [+] IRainman fix.
 	m_message_count(0),
 	m_is_hide_share(0),
@@ -153,10 +154,7 @@ Client::~Client()
 		dcassert(FavoriteManager::countUserCommand(getHubUrl()) == 0);
 	}
 	updateCounts(true);
-	{
-		//CFlyFastLock(m_fs_update_online_user);
-		//m_update_online_user_deque.clear();
-	}
+	clearUserUpdates();
 }
 void Client::reset_socket()
 {
@@ -629,9 +627,12 @@ bool Client::changeBytesSharedL(Identity& p_id, const int64_t p_bytes)
 
 void Client::fire_user_updated(const OnlineUserList& p_list)
 {
-	if (!p_list.empty() && !ClientManager::isBeforeShutdown())
+	if (!ClientManager::isBeforeShutdown())
 	{
-		fly_fire2(ClientListener::UsersUpdated(), this, p_list);
+		for (auto i = p_list.cbegin(); i != p_list.cend(); ++i)
+		{
+			addUserUpdate(*i, USER_UPDATE_INFO);
+		}
 	}
 }
 
@@ -639,10 +640,99 @@ void Client::updatedMyINFO(const OnlineUserPtr& aUser)
 {
 	if (!ClientManager::isBeforeShutdown())
 	{
-		//CFlyFastLock(m_fs_update_online_user);
-		//m_update_online_user_deque.push_back(aUser);
-		fly_fire1(ClientListener::UserUpdatedMyINFO(), aUser);
+		addUserUpdate(aUser, USER_UPDATE_MYINFO);
+	}
+}
+
+void Client::addUserUpdate(const OnlineUserPtr& p_ou, uint8_t p_kind)
+{
+	CFlyFastLock(m_cs_user_updates);
+	auto l_res = m_user_updates.insert(std::make_pair(p_ou, p_kind));
+	if (l_res.second)
+	{
+		m_user_update_order.push_back(p_ou);
+	}
+	else
+	{
+		l_res.first->second |= p_kind;
+	}
+}
+
+void Client::removeUserUpdate(const OnlineUserPtr& p_ou)
+{
+	CFlyLock(m_cs_user_updates_fire); // wait for the batch that may hold the user
+	{
+		CFlyFastLock(m_cs_user_updates);
+		m_user_updates.erase(p_ou);
+	}
+}
+
+void Client::clearUserUpdates()
+{
+	CFlyLock(m_cs_user_updates_fire);
+	{
+		CFlyFastLock(m_cs_user_updates);
+		m_user_updates.clear();
+		m_user_update_order.clear();
+	}
+}
+
+bool Client::flushUserUpdates(uint64_t p_tick, bool p_is_force)
+{
+	CFlyLock(m_cs_user_updates_fire);
+	if (!p_is_force && p_tick < m_next_user_update_tick)
+	{
+		return true;
+	}
+	m_next_user_update_tick = p_tick + SETTING(USER_UPDATE_INTERVAL);
+	OnlineUserList l_myinfo;
+	OnlineUserList l_info;
+	bool l_is_more;
+	{
+		CFlyFastLock(m_cs_user_updates);
+		if (m_user_update_order.empty())
+		{
+			return false;
+		}
+		const size_t l_max_count = std::max(SETTING(USER_UPDATE_BATCH_SIZE), 1);
+		size_t l_count = 0;
+		while (!m_user_update_order.empty() && l_count < l_max_count)
+		{
+			const auto i = m_user_updates.find(m_user_update_order.front());
+			m_user_update_order.pop_front();
+			if (i == m_user_updates.end())
+			{
+				continue; // removed or already fired
+			}
+			if (i->second & USER_UPDATE_MYINFO)
+			{
+				l_myinfo.push_back(i->first);
+			}
+			if (i->second & USER_UPDATE_INFO)
+			{
+				l_info.push_back(i->first);
+			}
+			m_user_updates.erase(i);
+			++l_count;
+		}
+		l_is_more = !m_user_updates.empty();
+		if (!l_is_more)
+		{
+			m_user_update_order.clear();
+		}
+	}
+	if (!ClientManager::isBeforeShutdown())
+	{
+		if (!l_myinfo.empty())
+		{
+			fly_fire2(ClientListener::UsersUpdatedMyINFO(), this, l_myinfo);
+		}
+		if (!l_info.empty())
+		{
+			fly_fire2(ClientListener::UsersUpdated(), this, l_info);
+		}
 	}
+	return l_is_more;
 }
 
 string Client::getLocalIp() const
@@ -728,6 +818,10 @@ uint64_t Client::search_internal(const SearchParamToken& p_search_param)
 void Client::on(Line, const string& aLine) noexcept
 {
 	updateActivity();
+	if (m_lastActivity >= m_next_user_update_tick) // without the lock - rechecked inside
+	{
+		flushUserUpdates(m_lastActivity, false);
+	}
 	COMMAND_DEBUG(aLine, DebugTask::HUB_IN, getIpPort());
 }
 
@@ -741,6 +835,13 @@ void Client::on(Minute, uint64_t aTick) noexcept
 
 void Client::on(Second, uint64_t aTick) noexcept
 {
+	// The tail of a burst - the batches that would be fired during the second at USER_UPDATE_INTERVAL
+	const int l_count_batch = std::max(1000 / std::max(SETTING(USER_UPDATE_INTERVAL), 1), 1);
+	for (int i = 0; i < l_count_batch; ++i)
+	{
+		if (!flushUserUpdates(aTick, true))
+			break;
+	}
 	if (state == STATE_DISCONNECTED && getAutoReconnect() && (aTick > (getLastActivity() + getReconnDelay() * 1000)))
 	{
 		// Try to reconnect...
@@ -880,8 +981,7 @@ bool Client::isFloodCommand(const string& p_command, const string& p_line)
 OnlineUserPtr Client::getUser(const UserPtr& aUser)
 {
 	// for generic client, use ClientManager, but it does not correctly handle ClientManager::me
-	ClientManager::LockInstanceOnlineUsers lockedInstance; // [+] IRainman fix.
-	return lockedInstance->getOnlineUserL(aUser);
+	return ClientManager::getOnlineUser(aUser);
 }
 // [+] IRainman fix.
 bool Client::isMeCheck(const OnlineUserPtr& ou)
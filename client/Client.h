@@ -96,6 +96,9 @@ class Client : public ClientBase, public Speaker<ClientListener>, public Buffere
 	protected:
 		std::unique_ptr<webrtc::RWLockWrapper> m_cs;
 		void fire_user_updated(const OnlineUserList& p_list);
+		/** Must be called before ClientListener::UserRemoved - a queued update must not add the user again */
+		void removeUserUpdate(const OnlineUserPtr& p_ou);
+		void clearUserUpdates();
 		void clearAvailableBytesL();
 		void decBytesSharedL(int64_t p_bytes_shared);
 		bool changeBytesSharedL(Identity& p_id, const int64_t p_bytes);
@@ -244,16 +247,13 @@ class Client : public ClientBase, public Speaker<ClientListener>, public Buffere
 		string getLocalIp() const;
 		
 		void updatedMyINFO(const OnlineUserPtr& aUser);
+		/**
+		 * Fires one batch (at most USER_UPDATE_BATCH_SIZE users) of the coalesced user updates.
+		 * Without p_is_force nothing is done until USER_UPDATE_INTERVAL ms are passed since the previous batch.
+		 * @return true if some updates are still queued
+		 */
+		bool flushUserUpdates(uint64_t p_tick, bool p_is_force);
 		
-		/*
-		std::deque<OnlineUserPtr> m_update_online_user_deque;
-		FastCriticalSection m_fs_update_online_user;
-		void getNewMyINFO(std::deque<OnlineUserPtr>&    p_ou_array)
-		{
-		    CFlyFastLock(m_fs_update_online_user);
-		    p_ou_array.swap(m_update_online_user_deque);
-		}
-		*/
 		static int getTotalCounts()
 		{
 			return g_counts[COUNT_NORMAL] + g_counts[COUNT_REGISTERED] + g_counts[COUNT_OP];
@@ -582,6 +582,21 @@ class Client : public ClientBase, public Speaker<ClientListener>, public Buffere
 #endif
 		int64_t m_availableBytes;
 		bool    m_isChangeAvailableBytes;
+		
+		// Coalesced user updates: a user is queued once whatever the count of $MyINFO/INF,
+		// the changed columns are accumulated by Identity (CHANGES_*) until the batch is fired.
+		enum
+		{
+			USER_UPDATE_MYINFO = 0x01, // ClientListener::UsersUpdatedMyINFO
+			USER_UPDATE_INFO = 0x02 // ClientListener::UsersUpdated
+		};
+		typedef boost::unordered_map<OnlineUserPtr, uint8_t, OnlineUser::Hash> UserUpdateMap;
+		void addUserUpdate(const OnlineUserPtr& p_ou, uint8_t p_kind);
+		FastCriticalSection m_cs_user_updates;
+		CriticalSection m_cs_user_updates_fire; // a batch is fired under it - keeps the order with UserRemoved
+		UserUpdateMap m_user_updates; // user -> USER_UPDATE_*
+		std::deque<OnlineUserPtr> m_user_update_order; // users in the order of the first change (may hold removed ones)
+		uint64_t m_next_user_update_tick;
 		//unsigned m_count_validate_denide;
 		
 		void updateCounts(bool aRemove);
@@ -21,7 +21,7 @@ class ClientListener
 		
 		typedef X<0> Connecting;
 		typedef X<1> Connected;
-		typedef X<3> UserUpdatedMyINFO;
+		typedef X<3> UsersUpdatedMyINFO;
 		typedef X<4> UsersUpdated;
 		typedef X<5> UserRemoved;
 		typedef X<6> Redirect;
@@ -55,7 +55,8 @@ class ClientListener
 		
 		virtual void on(Connecting, const Client*) noexcept { }
 		virtual void on(Connected, const Client*) noexcept { }
-		virtual void on(UserUpdatedMyINFO, const OnlineUserPtr&) noexcept { }
+		/** New or changed ($MyINFO/INF) users - coalesced and fired in batches, see Client::flushUserUpdates */
+		virtual void on(UsersUpdatedMyINFO, const Client*, const OnlineUserList&) noexcept { }
 		virtual void on(UserDescUpdated, const OnlineUserPtr&) noexcept { }
 #ifdef FLYLINKDC_USE_CHECK_CHANGE_MYINFO
 		virtual void on(UserShareUpdated, const OnlineUserPtr&) noexcept {}
@@ -44,17 +44,9 @@ volatile bool g_isBeforeShutdown = false;
 bool g_isStartupProcess = true;
 bool ClientManager::g_isSpyFrame = false;
 ClientManager::ClientList ClientManager::g_clients;
-#ifdef FLYLINKDC_USE_ASYN_USER_UPDATE
-OnlineUserList ClientManager::g_UserUpdateQueue;
-std::unique_ptr<webrtc::RWLockWrapper> ClientManager::g_csOnlineUsersUpdateQueue = std::unique_ptr<webrtc::RWLockWrapper>(webrtc::RWLockWrapper::CreateRWLock());
-#endif
 
 std::unique_ptr<webrtc::RWLockWrapper> ClientManager::g_csClients = std::unique_ptr<webrtc::RWLockWrapper> (webrtc::RWLockWrapper::CreateRWLock());
-std::unique_ptr<webrtc::RWLockWrapper> ClientManager::g_csOnlineUsers = std::unique_ptr<webrtc::RWLockWrapper> (webrtc::RWLockWrapper::CreateRWLock());
-std::unique_ptr<webrtc::RWLockWrapper> ClientManager::g_csUsers = std::unique_ptr<webrtc::RWLockWrapper>(webrtc::RWLockWrapper::CreateRWLock());
-
-ClientManager::OnlineMap ClientManager::g_onlineUsers;
-ClientManager::UserMap ClientManager::g_users;
+ClientManager::UserShard ClientManager::g_user_shards[USER_SHARDS];
 
 ClientManager::ClientManager()
 {
@@ -69,9 +61,6 @@ ClientManager::ClientManager()
 ClientManager::~ClientManager()
 {
 	dcassert(isShutdown());
-#ifdef FLYLINKDC_USE_ASYN_USER_UPDATE
-	dcassert(g_UserUpdateQueue.empty());
-#endif
 }
 
 Client* ClientManager::getClient(const string& p_HubURL, bool p_is_auto_connect)
@@ -142,12 +131,6 @@ void ClientManager::shutdown()
 	dcassert(!isShutdown());
 	::g_isShutdown = true;
 	::g_isBeforeShutdown = true; //  
-#ifdef FLYLINKDC_USE_ASYN_USER_UPDATE
-	{
-		CFlyWriteLock(*g_csOnlineUsersUpdateQueue);
-		g_UserUpdateQueue.clear();
-	}
-#endif
 }
 void ClientManager::before_shutdown()
 {
@@ -157,17 +140,27 @@ void ClientManager::before_shutdown()
 
 void ClientManager::clear()
 {
+	for (size_t i = 0; i < USER_SHARDS; ++i)
 	{
-		CFlyWriteLock(*g_csOnlineUsers);
-		g_onlineUsers.clear();
-	}
-	{
-		CFlyWriteLock(*g_csUsers);
-		//CFlyLock(g_csUsers);
-		g_users.clear();
+		{
+			CFlyWriteLock(*g_user_shards[i].m_csOnlineUsers);
+			g_user_shards[i].m_online_users.clear();
+		}
+		{
+			CFlyWriteLock(*g_user_shards[i].m_csUsers);
+			g_user_shards[i].m_users.clear();
+		}
 	}
 }
 
+const ClientManager::OnlineUserArray& ClientManager::getOnlineUsersL(const CID& p_cid)
+{
+	static const OnlineUserArray g_empty;
+	const auto& l_map = getShard(p_cid).m_online_users;
+	const auto i = l_map.find(p_cid);
+	return i != l_map.end() ? i->second : g_empty;
+}
+
 unsigned ClientManager::getTotalUsers()
 {
 	unsigned l_users = 0;
@@ -183,9 +176,9 @@ void ClientManager::setIPUser(const UserPtr& p_user, const string& p_ip, const u
 	if (p_ip.empty())
 		return;
 		
-	CFlyWriteLock(*g_csOnlineUsers);
-	const auto p = g_onlineUsers.equal_range(p_user->getCID());
-	for (auto i = p.first; i != p.second; ++i)
+	CFlyWriteLock(*getShard(p_user->getCID()).m_csOnlineUsers);
+	const auto& l_users = getOnlineUsersL(p_user->getCID());
+	for (auto i = l_users.cbegin(); i != l_users.cend(); ++i)
 	{
 #ifdef _DEBUG
 //		const auto l_old_ip = i->second->getIdentity().getIpAsString();
@@ -194,17 +187,17 @@ void ClientManager::setIPUser(const UserPtr& p_user, const string& p_ip, const u
 //			LogManager::message("ClientManager::setIPUser, p_user = " + p_user->getLastNick() + " old ip = " + l_old_ip + " ip = " + p_ip);
 //		}
 #endif
-		i->second->getIdentity().setIp(p_ip);
+		(*i)->getIdentity().setIp(p_ip);
 		if (p_udpPort != 0)
 		{
-			i->second->getIdentity().setUdpPort(p_udpPort);
+			(*i)->getIdentity().setUdpPort(p_udpPort);
 		}
 	}
 }
 
 bool ClientManager::getUserParams(const UserPtr& user, UserParams& p_params)
 {
-	CFlyReadLock(*g_csOnlineUsers);
+	CFlyReadLock(*getShard(user->getCID()).m_csOnlineUsers);
 	const OnlineUserPtr u = getOnlineUserL(user);
 	if (u)
 	{
@@ -299,18 +292,17 @@ StringList ClientManager::getNicks(const CID& cid, const string& hintUrl)
 StringList ClientManager::getHubs(const CID& cid, const string& hintUrl, bool priv)
 {
 	StringList lst;
+	CFlyReadLock(*getShard(cid).m_csOnlineUsers); // [+] IRainman opt.
 	if (!priv)
 	{
-		CFlyReadLock(*g_csOnlineUsers); // [+] IRainman opt.
-		const auto op = g_onlineUsers.equal_range(cid);
-		for (auto i = op.first; i != op.second; ++i)
+		const auto& l_users = getOnlineUsersL(cid);
+		for (auto i = l_users.cbegin(); i != l_users.cend(); ++i)
 		{
-			lst.push_back(i->second->getClientBase().getHubUrl());
+			lst.push_back((*i)->getClientBase().getHubUrl());
 		}
 	}
 	else
 	{
-		CFlyReadLock(*g_csOnlineUsers); // [+] IRainman opt.
 		const OnlineUserPtr u = findOnlineUserHintL(cid, hintUrl);
 		if (u)
 		{
@@ -326,18 +318,17 @@ StringList ClientManager::getHubNames(const CID& cid, const string& hintUrl, boo
 	//LogManager::message("[!!!!!!!] ClientManager::getHubNames cid = " + cid.toBase32() + " hintUrl = " + hintUrl + " priv = " + Util::toString(priv));
 #endif
 	StringList lst;
+	CFlyReadLock(*getShard(cid).m_csOnlineUsers); // [+] IRainman opt.
 	if (!priv)
 	{
-		CFlyReadLock(*g_csOnlineUsers); // [+] IRainman opt.
-		const auto op = g_onlineUsers.equal_range(cid);
-		for (auto i = op.first; i != op.second; ++i)
+		const auto& l_users = getOnlineUsersL(cid);
+		for (auto i = l_users.cbegin(); i != l_users.cend(); ++i)
 		{
-			lst.push_back(i->second->getClientBase().getHubName()); // https://crash-server.com/DumpGroup.aspx?ClientID=guest&DumpGroupID=114958
+			lst.push_back((*i)->getClientBase().getHubName()); // https://crash-server.com/DumpGroup.aspx?ClientID=guest&DumpGroupID=114958
 		}
 	}
 	else
 	{
-		CFlyReadLock(*g_csOnlineUsers); // [+] IRainman opt.
 		const OnlineUserPtr u = findOnlineUserHintL(cid, hintUrl);
 		if (u)
 		{
@@ -352,14 +343,14 @@ StringList ClientManager::getHubNames(const CID& cid, const string& hintUrl, boo
 StringList ClientManager::getAntivirusNicks(const CID& p_cid)
 {
 	StringSet ret;
-	CFlyReadLock(*g_csOnlineUsers); // [+] IRainman opt.
-	const auto op = g_onlineUsers.equal_range(p_cid);
-	for (auto i = op.first; i != op.second; ++i)
+	CFlyReadLock(*getShard(p_cid).m_csOnlineUsers); // [+] IRainman opt.
+	const auto& l_users = getOnlineUsersL(p_cid);
+	for (auto i = l_users.cbegin(); i != l_users.cend(); ++i)
 	{
 		//      - 
 		//if (i->second->getIdentity().calcVirusType() & ~Identity::VT_CALC_AVDB)
 		{
-			ret.insert(i->second->getIdentity().getVirusDesc());
+			ret.insert((*i)->getIdentity().getVirusDesc());
 		}
 	}
 	if (!ret.empty())
@@ -373,22 +364,23 @@ StringList ClientManager::getAntivirusNicks(const CID& p_cid)
 StringList ClientManager::getNicks(const CID& p_cid, const string& hintUrl, bool priv)
 {
 	StringSet ret;
-	if (!priv)
 	{
-		CFlyReadLock(*g_csOnlineUsers); // [+] IRainman opt.
-		const auto op = g_onlineUsers.equal_range(p_cid);
-		for (auto i = op.first; i != op.second; ++i)
+		CFlyReadLock(*getShard(p_cid).m_csOnlineUsers); // [+] IRainman opt.
+		if (!priv)
 		{
-			ret.insert(i->second->getIdentity().getNick());
+			const auto& l_users = getOnlineUsersL(p_cid);
+			for (auto i = l_users.cbegin(); i != l_users.cend(); ++i)
+			{
+				ret.insert((*i)->getIdentity().getNick());
+			}
 		}
-	}
-	else
-	{
-		CFlyReadLock(*g_csOnlineUsers); // [+] IRainman opt.
-		const OnlineUserPtr u = findOnlineUserHintL(p_cid, hintUrl);
-		if (u)
+		else
 		{
-			ret.insert(u->getIdentity().getNick());
+			const OnlineUserPtr u = findOnlineUserHintL(p_cid, hintUrl);
+			if (u)
+			{
+				ret.insert(u->getIdentity().getNick());
+			}
 		}
 	}
 	if (ret.empty())
@@ -423,8 +415,8 @@ bool ClientManager::isConnected(const string& aUrl)
 }
 bool ClientManager::isOnline(const UserPtr& aUser)
 {
-	CFlyReadLock(*g_csOnlineUsers);
-	return g_onlineUsers.find(aUser->getCID()) != g_onlineUsers.end();
+	CFlyReadLock(*getShard(aUser->getCID()).m_csOnlineUsers);
+	return !getOnlineUsersL(aUser->getCID()).empty();
 }
 OnlineUserPtr ClientManager::findOnlineUserL(const HintedUser& user, bool priv)
 {
@@ -440,12 +432,12 @@ UserPtr ClientManager::findUser(const string& aNick, const string& aHubUrl)
 OnlineUserPtr ClientManager::findOnlineUserL(const CID& cid, const string& hintUrl, bool priv)
 {
 	// [!] IRainman: This function need to external lock.
-	OnlinePairC p;
+	const OnlineUserArray* p;
 	OnlineUserPtr u = findOnlineUserHintL(cid, hintUrl, p);
 	if (u) // found an exact match (CID + hint).
 		return u;
 		
-	if (p.first == p.second) // no user found with the given CID.
+	if (p->empty()) // no user found with the given CID.
 		return nullptr;
 		
 	// if the hint hub is private, don't allow connecting to the same user from another hub.
@@ -453,14 +445,14 @@ OnlineUserPtr ClientManager::findOnlineUserL(const CID& cid, const string& hintU
 		return nullptr;
 		
 	// ok, hub not private, return a random user that matches the given CID but not the hint.
-	return p.first->second;
+	return p->front();
 }
 
 string ClientManager::getStringField(const CID& cid, const string& hint, const char* field) // [!] IRainman fix.
 {
-	CFlyReadLock(*g_csOnlineUsers);
+	CFlyReadLock(*getShard(cid).m_csOnlineUsers);
 	
-	OnlinePairC p;
+	const OnlineUserArray* p;
 	const auto u = findOnlineUserHintL(cid, hint, p);
 	if (u)
 	{
@@ -471,9 +463,9 @@ string ClientManager::getStringField(const CID& cid, const string& hint, const c
 		}
 	}
 	
-	for (auto i = p.first; i != p.second; ++i)
+	for (auto i = p->cbegin(); i != p->cend(); ++i)
 	{
-		auto value = i->second->getIdentity().getStringParam(field);
+		auto value = (*i)->getIdentity().getStringParam(field);
 		if (!value.empty())
 		{
 			return value;
@@ -484,11 +476,11 @@ string ClientManager::getStringField(const CID& cid, const string& hint, const c
 
 uint8_t ClientManager::getSlots(const CID& cid)
 {
-	CFlyReadLock(*g_csOnlineUsers);
-	const auto i = g_onlineUsers.find(cid);
-	if (i != g_onlineUsers.end())
+	CFlyReadLock(*getShard(cid).m_csOnlineUsers);
+	const auto& l_users = getOnlineUsersL(cid);
+	if (!l_users.empty())
 	{
-		return i->second->getIdentity().getSlots();
+		return l_users.front()->getIdentity().getSlots();
 	}
 	return 0;
 }
@@ -600,10 +592,10 @@ UserPtr ClientManager::getUser(const string& p_Nick, const string& p_HubURL, uin
 	dcassert(!p_Nick.empty());
 	const CID cid = makeCid(p_Nick, p_HubURL);
 	
-	CFlyWriteLock(*g_csUsers);
-	//CFlyLock(g_csUsers);
+	auto& l_shard = getShard(cid);
+	CFlyWriteLock(*l_shard.m_csUsers);
 	//  dcassert(p_first_load == false || p_first_load == true && g_users.find(cid) == g_users.end())
-	const auto& l_result_insert = g_users.insert(make_pair(cid, std::make_shared<User>(cid, p_Nick, p_HubID)));
+	const auto& l_result_insert = l_shard.m_users.insert(make_pair(cid, std::make_shared<User>(cid, p_Nick, p_HubID)));
 	if (!l_result_insert.second)
 	{
 		const auto &l_user = l_result_insert.first->second;
@@ -626,9 +618,9 @@ UserPtr ClientManager::getUser(const string& p_Nick, const string& p_HubURL, uin
 UserPtr ClientManager::createUser(const CID& p_cid, const string& p_nick, uint32_t p_hub_id)
 {
 	dcassert(!ClientManager::isBeforeShutdown());
-	CFlyWriteLock(*g_csUsers);
-	//CFlyLock(g_csUsers);
-	auto l_item = g_users.insert(make_pair(p_cid, UserPtr()));
+	auto& l_shard = getShard(p_cid);
+	CFlyWriteLock(*l_shard.m_csUsers);
+	auto l_item = l_shard.m_users.insert(make_pair(p_cid, UserPtr()));
 	if (l_item.second == false)
 	{
 		//dcassert(p_nick == l_item.first->second->getLastNick());
@@ -640,10 +632,10 @@ UserPtr ClientManager::createUser(const CID& p_cid, const string& p_nick, uint32
 
 UserPtr ClientManager::findUser(const CID& cid)
 {
-	CFlyReadLock(*g_csUsers);
-	//CFlyLock(g_csUsers);
-	const auto& ui = g_users.find(cid);
-	if (ui != g_users.end())
+	auto& l_shard = getShard(cid);
+	CFlyReadLock(*l_shard.m_csUsers);
+	const auto& ui = l_shard.m_users.find(cid);
+	if (ui != l_shard.m_users.end())
 	{
 		return ui->second;
 	}
@@ -653,13 +645,13 @@ UserPtr ClientManager::findUser(const CID& cid)
 // deprecated
 bool ClientManager::isOp(const UserPtr& user, const string& aHubUrl)
 {
-	CFlyReadLock(*g_csOnlineUsers);
-	const auto p = g_onlineUsers.equal_range(user->getCID());
-	for (auto i = p.first; i != p.second; ++i)
+	CFlyReadLock(*getShard(user->getCID()).m_csOnlineUsers);
+	const auto& l_users = getOnlineUsersL(user->getCID());
+	for (auto i = l_users.cbegin(); i != l_users.cend(); ++i)
 	{
-		const auto& l_hub = i->second->getClient().getHubUrl();
+		const auto& l_hub = (*i)->getClient().getHubUrl();
 		if (l_hub == aHubUrl)
-			return i->second->getIdentity().isOp();
+			return (*i)->getIdentity().isOp();
 	}
 	return false;
 }
@@ -682,9 +674,9 @@ void ClientManager::putOnline(const OnlineUserPtr& ou, bool p_is_fire_online) no
 		dcassert(ou->getIdentity().getSID() != AdcCommand::HUB_SID);
 		dcassert(!user->getCID().isZero());
 		{
-			CFlyWriteLock(*g_csOnlineUsers);
-			const auto l_res = g_onlineUsers.insert(make_pair(user->getCID(), ou));
-			dcassert(l_res->second);
+			auto& l_shard = getShard(user->getCID());
+			CFlyWriteLock(*l_shard.m_csOnlineUsers);
+			l_shard.m_online_users[user->getCID()].push_back(ou);
 		}
 		
 		if (!user->isOnline())
@@ -698,63 +690,145 @@ void ClientManager::putOnline(const OnlineUserPtr& ou, bool p_is_fire_online) no
 	}
 }
 
-void ClientManager::putOffline(const OnlineUserPtr& ou, bool p_is_disconnect) noexcept
+void ClientManager::putOnline(const OnlineUserList& p_users, bool p_is_fire_online) noexcept
 {
-	if (!isBeforeShutdown())
+	if (isBeforeShutdown() || p_users.empty())
+		return;
+	// Users grouped by shard: every shard is locked once
+	std::vector<const OnlineUserPtr*> l_by_shard[USER_SHARDS];
+	for (auto i = p_users.cbegin(); i != p_users.cend(); ++i)
 	{
-		// [!] IRainman fix: don't put any hub to online or offline! Any hubs as user is always offline!
-		dcassert(ou->getIdentity().getSID() != AdcCommand::HUB_SID);
-		dcassert(!ou->getUser()->getCID().isZero());
-		// [~] IRainman fix.
-		OnlineIter::difference_type diff = 0;
+		dcassert((*i)->getIdentity().getSID() != AdcCommand::HUB_SID);
+		dcassert(!(*i)->getUser()->getCID().isZero());
+		l_by_shard[(*i)->getUser()->getCID().toHash() % USER_SHARDS].push_back(&*i);
+	}
+	for (size_t j = 0; j < USER_SHARDS; ++j)
+	{
+		if (l_by_shard[j].empty())
+			continue;
+		auto& l_shard = g_user_shards[j];
+		CFlyWriteLock(*l_shard.m_csOnlineUsers);
+		for (auto i = l_by_shard[j].cbegin(); i != l_by_shard[j].cend(); ++i)
 		{
-			CFlyWriteLock(*g_csOnlineUsers);
-			auto op = g_onlineUsers.equal_range(ou->getUser()->getCID()); //    -    .
-			// [-] dcassert(op.first != op.second); [!] L: this is normal and means that the user is offline.
-			for (auto i = op.first; i != op.second; ++i)
-			{
-				if (ou == i->second)
-				{
-					diff = distance(op.first, op.second);
-					g_onlineUsers.erase(i);
-					break;
-				}
-			}
+			l_shard.m_online_users[(**i)->getUser()->getCID()].push_back(**i);
 		}
-		
-		if (diff == 1) //last user
+	}
+	for (auto i = p_users.cbegin(); i != p_users.cend(); ++i)
+	{
+		const auto& user = (*i)->getUser();
+		if (!user->isOnline())
 		{
-			UserPtr& u = ou->getUser();
-			u->unsetFlag(User::ONLINE);
-			if (p_is_disconnect)
-			{
-				ConnectionManager::disconnect(u);
-			}
-			if (!ClientManager::isBeforeShutdown())
+			user->setFlag(User::ONLINE);
+			if (p_is_fire_online && !ClientManager::isBeforeShutdown())
 			{
-				fly_fire1(ClientManagerListener::UserDisconnected(), u);
+				fly_fire1(ClientManagerListener::UserConnected(), user);
 			}
 		}
-		else if (diff > 1 && !ClientManager::isBeforeShutdown())
+	}
+}
+
+size_t ClientManager::removeOnlineUserL(OnlineMap& p_map, const OnlineUserPtr& ou)
+{
+	const auto l_users = p_map.find(ou->getUser()->getCID());
+	if (l_users == p_map.end())
+		return 0; // this is normal and means that the user is offline.
+	auto& l_array = l_users->second;
+	const auto i = std::find(l_array.begin(), l_array.end(), ou);
+	if (i == l_array.end())
+		return 0;
+	const size_t l_count = l_array.size();
+	if (l_count == 1)
+	{
+		p_map.erase(l_users);
+	}
+	else
+	{
+		l_array.erase(i);
+	}
+	return l_count;
+}
+
+void ClientManager::putOfflineDone(const OnlineUserPtr& ou, size_t p_count, bool p_is_disconnect)
+{
+	if (p_count == 1) //last user
+	{
+		UserPtr& u = ou->getUser();
+		u->unsetFlag(User::ONLINE);
+		if (p_is_disconnect)
+		{
+			ConnectionManager::disconnect(u);
+		}
+		if (!ClientManager::isBeforeShutdown())
+		{
+			fly_fire1(ClientManagerListener::UserDisconnected(), u);
+		}
+	}
+	else if (p_count > 1 && !ClientManager::isBeforeShutdown())
+	{
+		fly_fire1(ClientManagerListener::UsersUpdated(), OnlineUserList(1, ou));
+	}
+}
+
+void ClientManager::putOffline(const OnlineUserList& p_users, bool p_is_disconnect) noexcept
+{
+	if (isBeforeShutdown() || p_users.empty())
+		return;
+	std::vector<size_t> l_counts(p_users.size());
+	std::vector<size_t> l_by_shard[USER_SHARDS];
+	for (size_t i = 0; i < p_users.size(); ++i)
+	{
+		dcassert(p_users[i]->getIdentity().getSID() != AdcCommand::HUB_SID);
+		dcassert(!p_users[i]->getUser()->getCID().isZero());
+		l_by_shard[p_users[i]->getUser()->getCID().toHash() % USER_SHARDS].push_back(i);
+	}
+	for (size_t j = 0; j < USER_SHARDS; ++j)
+	{
+		if (l_by_shard[j].empty())
+			continue;
+		auto& l_shard = g_user_shards[j];
+		CFlyWriteLock(*l_shard.m_csOnlineUsers);
+		for (auto i = l_by_shard[j].cbegin(); i != l_by_shard[j].cend(); ++i)
+		{
+			l_counts[*i] = removeOnlineUserL(l_shard.m_online_users, p_users[*i]);
+		}
+	}
+	for (size_t i = 0; i < p_users.size(); ++i)
+	{
+		putOfflineDone(p_users[i], l_counts[i], p_is_disconnect);
+	}
+}
+
+void ClientManager::putOffline(const OnlineUserPtr& ou, bool p_is_disconnect) noexcept
+{
+	if (!isBeforeShutdown())
+	{
+		// [!] IRainman fix: don't put any hub to online or offline! Any hubs as user is always offline!
+		dcassert(ou->getIdentity().getSID() != AdcCommand::HUB_SID);
+		dcassert(!ou->getUser()->getCID().isZero());
+		// [~] IRainman fix.
+		size_t l_count;
 		{
-			addAsyncOnlineUserUpdated(ou);
+			auto& l_shard = getShard(ou->getUser()->getCID());
+			CFlyWriteLock(*l_shard.m_csOnlineUsers);
+			l_count = removeOnlineUserL(l_shard.m_online_users, ou);
 		}
+		putOfflineDone(ou, l_count, p_is_disconnect);
 	}
 }
 
-OnlineUserPtr ClientManager::findOnlineUserHintL(const CID& cid, const string& hintUrl, OnlinePairC& p)
+OnlineUserPtr ClientManager::findOnlineUserHintL(const CID& cid, const string& hintUrl, const OnlineUserArray*& p)
 {
 	// [!] IRainman fix: This function need to external lock.
-	p = g_onlineUsers.equal_range(cid);
+	p = &getOnlineUsersL(cid);
 	
-	if (p.first == p.second) // no user found with the given CID.
+	if (p->empty()) // no user found with the given CID.
 		return nullptr;
 		
 	if (!hintUrl.empty()) // [+] IRainman fix.
 	{
-		for (auto i = p.first; i != p.second; ++i)
+		for (auto i = p->cbegin(); i != p->cend(); ++i)
 		{
-			const OnlineUserPtr u = i->second;
+			const OnlineUserPtr& u = *i;
 			if (u->getClientBase().getHubUrl() == hintUrl)
 			{
 				return u;
@@ -799,11 +873,11 @@ void ClientManager::connect(const HintedUser& p_user, const string& p_token, boo
 {
 	p_is_active_client = false;
 	dcassert(!isBeforeShutdown());
-	if (!isBeforeShutdown())
+	if (!isBeforeShutdown() && p_user.user)
 	{
 		const bool priv = FavoriteManager::isPrivate(p_user.hint);
 		
-		CFlyReadLock(*g_csOnlineUsers);
+		CFlyReadLock(*getShard(p_user.user->getCID()).m_csOnlineUsers);
 		OnlineUserPtr u = findOnlineUserL(p_user, priv);
 		
 		if (u)
@@ -827,11 +901,12 @@ void ClientManager::privateMessage(const HintedUser& user, const string& msg, bo
 {
 	const bool priv = FavoriteManager::isPrivate(user.hint);
 	OnlineUserPtr u;
+	if (user.user)
 	{
 		// # u->getClientBase().privateMessage     -    fire
 		//    Mikhail Korbakov    .
 		// http://www.flickr.com/photos/96019675@N02/11424193335/
-		CFlyReadLock(*g_csOnlineUsers);
+		CFlyReadLock(*getShard(user.user->getCID()).m_csOnlineUsers);
 		u = findOnlineUserL(user, priv);
 	}
 	if (u)
@@ -841,8 +916,11 @@ void ClientManager::privateMessage(const HintedUser& user, const string& msg, bo
 }
 void ClientManager::userCommand(const HintedUser& hintedUser, const UserCommand& uc, StringMap& params, bool compatibility)
 {
-	CFlyReadLock(*g_csOnlineUsers);
-	userCommandL(hintedUser, uc, params, compatibility);
+	if (hintedUser.user)
+	{
+		CFlyReadLock(*getShard(hintedUser.user->getCID()).m_csOnlineUsers);
+		userCommandL(hintedUser, uc, params, compatibility);
+	}
 }
 
 void ClientManager::userCommandL(const HintedUser& hintedUser, const UserCommand& uc, StringMap& params, bool compatibility)
@@ -880,11 +958,11 @@ void ClientManager::send(AdcCommand& cmd, const CID& cid)
 	bool l_is_send = false;
 	OnlineUserPtr u;
 	{
-		CFlyReadLock(*g_csOnlineUsers);
-		const auto i = g_onlineUsers.find(cid);
-		if (i != g_onlineUsers.end())
+		CFlyReadLock(*getShard(cid).m_csOnlineUsers);
+		const auto& l_users = getOnlineUsersL(cid);
+		if (!l_users.empty())
 		{
-			u = i->second;
+			u = l_users.front();
 			if (cmd.getType() == AdcCommand::TYPE_UDP && !u->getIdentity().isUdpActive())
 			{
 				if (u->getUser()->isNMDC())
@@ -995,11 +1073,11 @@ void ClientManager::on(AdcSearch, const Client* c, const AdcCommand& adc, const
 {
 	bool isUdpActive = false;
 	{
-		CFlyReadLock(*g_csOnlineUsers);
-		const auto op = g_onlineUsers.equal_range((from));
-		for (auto i = op.first; i != op.second; ++i)
+		CFlyReadLock(*getShard(from).m_csOnlineUsers);
+		const auto& l_users = getOnlineUsersL(from);
+		for (auto i = l_users.cbegin(); i != l_users.cend(); ++i)
 		{
-			const OnlineUserPtr& u = i->second;
+			const OnlineUserPtr& u = *i;
 			if (&u->getClient() == c)
 			{
 				isUdpActive = u->getIdentity().isUdpActive();
@@ -1081,35 +1159,6 @@ void ClientManager::getOnlineClients(StringSet& p_onlineClients)
 			p_onlineClients.insert(i->second->getHubUrl());
 	}
 }
-void ClientManager::addAsyncOnlineUserUpdated(const OnlineUserPtr& p_ou)
-{
-	if (!isBeforeShutdown())
-	{
-#ifdef FLYLINKDC_USE_ASYN_USER_UPDATE
-		CFlyWriteLock(*g_csOnlineUsersUpdateQueue);
-		g_UserUpdateQueue.push_back(p_ou);
-#else
-		fly_fire1(ClientManagerListener::UserUpdated(), p_ou);
-#endif
-	}
-}
-
-#ifdef FLYLINKDC_USE_ASYN_USER_UPDATE
-void ClientManager::on(TimerManagerListener::Second, uint64_t aTick) noexcept
-{
-	if (!isBeforeShutdown())
-	{
-		CFlyReadLock(*g_csOnlineUsersUpdateQueue);
-		for (auto i = g_UserUpdateQueue.cbegin(); i != g_UserUpdateQueue.cend(); ++i)
-		{
-			fly_fire1(ClientManagerListener::UserUpdated(), *i);
-		}
-	}
-	CFlyWriteLock(*g_csOnlineUsersUpdateQueue);
-	g_UserUpdateQueue.clear();
-}
-#endif
-
 void ClientManager::flushRatio(int p_max_count_flush)
 {
 	static bool g_isBusy = false;
@@ -1125,16 +1174,17 @@ void ClientManager::flushRatio(int p_max_count_flush)
 #ifdef _DEBUG
 			//CFlyLog l_log_debug("[ClientManager::flushRatio - read all USERS - _DEBUG]");
 #endif
-			CFlyReadLock(*g_csUsers);
-			//CFlyLock(g_csUsers);
-			auto i = g_users.cbegin();
-			while (i != g_users.cend())
+			for (size_t j = 0; j < USER_SHARDS; ++j)
 			{
-				if (i->second->isDirty())
+				CFlyReadLock(*g_user_shards[j].m_csUsers);
+				const auto& l_map = g_user_shards[j].m_users;
+				for (auto i = l_map.cbegin(); i != l_map.cend(); ++i)
 				{
-					l_users.push_back(i->second);
+					if (i->second->isDirty())
+					{
+						l_users.push_back(i->second);
+					}
 				}
-				++i;
 			}
 #ifdef _DEBUG
 			//l_log_debug.step("l_users.size() =" + Util::toString(l_users.size()));
@@ -1168,21 +1218,24 @@ void ClientManager::flushRatio(int p_max_count_flush)
 void ClientManager::usersCleanup()
 {
 	//CFlyLog l_log("[ClientManager::usersCleanup]");
-	CFlyWriteLock(*g_csUsers);
-	//CFlyLock(g_csUsers);
-	auto i = g_users.begin();
-	while (i != g_users.end() && !isBeforeShutdown())
+	for (size_t j = 0; j < USER_SHARDS && !isBeforeShutdown(); ++j)
 	{
-		if (i->second.unique())
+		CFlyWriteLock(*g_user_shards[j].m_csUsers);
+		auto& l_map = g_user_shards[j].m_users;
+		auto i = l_map.begin();
+		while (i != l_map.end() && !isBeforeShutdown())
 		{
+			if (i->second.unique())
+			{
 #ifdef _DEBUG
-			//LogManager::message("g_users.erase(i++); - Nick = " + i->second->getLastNick());
+				//LogManager::message("g_users.erase(i++); - Nick = " + i->second->getLastNick());
 #endif
-			g_users.erase(i++);
-		}
-		else
-		{
-			++i;
+				l_map.erase(i++);
+			}
+			else
+			{
+				++i;
+			}
 		}
 	}
 }
@@ -1229,9 +1282,9 @@ void ClientManager::createMe(const string& p_cid, const string& p_nick)
 	g_iflylinkdc.setUser(g_uflylinkdc);
 	// [~] IRainman fix.
 	{
-		CFlyWriteLock(*g_csUsers);
-		//CFlyLock(g_csUsers);
-		g_users.insert(make_pair(g_me->getCID(), g_me));
+		auto& l_shard = getShard(g_me->getCID());
+		CFlyWriteLock(*l_shard.m_csUsers);
+		l_shard.m_users.insert(make_pair(g_me->getCID(), g_me));
 	}
 }
 void ClientManager::generateNewMyCID()
@@ -1330,9 +1383,12 @@ void ClientManager::on(Connected, const Client* c) noexcept
 	fly_fire1(ClientManagerListener::ClientConnected(), c);
 }
 
-void ClientManager::on(UserUpdatedMyINFO, const OnlineUserPtr& p_ou) noexcept
+void ClientManager::on(UsersUpdatedMyINFO, const Client*, const OnlineUserList& p_list) noexcept
 {
-	addAsyncOnlineUserUpdated(p_ou);
+	if (!isBeforeShutdown())
+	{
+		fly_fire1(ClientManagerListener::UsersUpdated(), p_list);
+	}
 }
 
 void ClientManager::on(UsersUpdated, const Client* client, const OnlineUserList& l) noexcept
@@ -1416,11 +1472,19 @@ OnlineUserPtr ClientManager::getOnlineUserL(const UserPtr& p)
 	if (p == nullptr)
 		return nullptr;
 		
-	const auto i = g_onlineUsers.find(p->getCID());
-	if (i == g_onlineUsers.end())
+	const auto& l_users = getOnlineUsersL(p->getCID());
+	if (l_users.empty())
 		return OnlineUserPtr();
 		
-	return i->second;
+	return l_users.front();
+}
+
+OnlineUserPtr ClientManager::getOnlineUser(const UserPtr& p)
+{
+	if (p == nullptr)
+		return nullptr;
+	CFlyReadLock(*getShard(p->getCID()).m_csOnlineUsers);
+	return getOnlineUserL(p);
 }
 
 void ClientManager::sendRawCommandL(const OnlineUser& ou, const int aRawCommand)
@@ -1437,11 +1501,11 @@ void ClientManager::sendRawCommandL(const OnlineUser& ou, const int aRawCommand)
 
 void ClientManager::setListLength(const UserPtr& p, const string& listLen)
 {
-	CFlyWriteLock(*g_csOnlineUsers); // TODO Write
-	const auto i = g_onlineUsers.find(p->getCID());
-	if (i != g_onlineUsers.end())
+	CFlyWriteLock(*getShard(p->getCID()).m_csOnlineUsers);
+	const auto& l_users = getOnlineUsersL(p->getCID());
+	if (!l_users.empty())
 	{
-		i->second->getIdentity().setStringParam("LL", listLen);
+		l_users.front()->getIdentity().setStringParam("LL", listLen);
 	}
 }
 void ClientManager::cheatMessage(Client* p_client, const string& p_report)
@@ -1457,11 +1521,11 @@ void ClientManager::fileListDisconnected(const UserPtr& p)
 	string report;
 	Client* c = nullptr;
 	{
-		CFlyReadLock(*g_csOnlineUsers);
-		const auto i = g_onlineUsers.find(p->getCID());
-		if (i != g_onlineUsers.end())
+		CFlyReadLock(*getShard(p->getCID()).m_csOnlineUsers);
+		const auto& l_users = getOnlineUsersL(p->getCID());
+		if (!l_users.empty())
 		{
-			OnlineUser* ou = i->second;
+			OnlineUser* ou = l_users.front();
 			auto& id = ou->getIdentity(); // [!] PVS V807 Decreased performance. Consider creating a reference to avoid using the 'ou->getIdentity()' expression repeatedly. cheatmanager.h 43
 			
 			auto fileListDisconnects = id.incFileListDisconnects(); // 8   ?
@@ -1487,11 +1551,11 @@ void ClientManager::connectionTimeout(const UserPtr& p)
 	bool remove = false;
 	Client* c = nullptr;
 	{
-		CFlyReadLock(*g_csOnlineUsers);
-		const auto i = g_onlineUsers.find(p->getCID());
-		if (i != g_onlineUsers.end())
+		CFlyReadLock(*getShard(p->getCID()).m_csOnlineUsers);
+		const auto& l_users = getOnlineUsersL(p->getCID());
+		if (!l_users.empty())
 		{
-			OnlineUserPtr ou = i->second;
+			OnlineUserPtr ou = l_users.front();
 			auto& id = ou->getIdentity(); // [!] PVS V807 Decreased performance. Consider creating a reference to avoid using the 'ou.getIdentity()' expression repeatedly. cheatmanager.h 80
 			
 			auto connectionTimeouts = id.incConnectionTimeouts(); // 8   ?
@@ -1522,12 +1586,12 @@ void ClientManager::checkCheating(const UserPtr& p, DirectoryListing* dl)
 	string report;
 	OnlineUserPtr ou;
 	{
-		CFlyReadLock(*g_csOnlineUsers);
-		const auto i = g_onlineUsers.find(p->getCID());
-		if (i == g_onlineUsers.end())
+		CFlyReadLock(*getShard(p->getCID()).m_csOnlineUsers);
+		const auto& l_users = getOnlineUsersL(p->getCID());
+		if (l_users.empty())
 			return;
 			
-		ou = i->second;
+		ou = l_users.front();
 		auto& id = ou->getIdentity(); // [!] PVS V807 Decreased performance. Consider creating a reference to avoid using the 'ou->getIdentity()' expression repeatedly. cheatmanager.h 127
 		
 		const int64_t l_statedSize = id.getBytesShared();
@@ -1579,12 +1643,12 @@ void ClientManager::setClientStatus(const UserPtr& p, const string& aCheatString
 	OnlineUserPtr ou;
 	string report;
 	{
-		CFlyReadLock(*g_csOnlineUsers);
-		const auto i = g_onlineUsers.find(p->getCID());
-		if (i == g_onlineUsers.end())
+		CFlyReadLock(*getShard(p->getCID()).m_csOnlineUsers);
+		const auto& l_users = getOnlineUsersL(p->getCID());
+		if (l_users.empty())
 			return;
 			
-		ou = i->second;
+		ou = l_users.front();
 		ou->getIdentity().updateClientType(*ou);
 		if (!aCheatString.empty())
 		{
@@ -1603,11 +1667,11 @@ void ClientManager::setClientStatus(const UserPtr& p, const string& aCheatString
 #endif // IRAINMAN_INCLUDE_USER_CHECK
 void ClientManager::setSupports(const UserPtr& p, const StringList & aSupports, const uint8_t knownUcSupports)
 {
-	CFlyWriteLock(*g_csOnlineUsers);
-	const auto i = g_onlineUsers.find(p->getCID());
-	if (i != g_onlineUsers.end())
+	CFlyWriteLock(*getShard(p->getCID()).m_csOnlineUsers);
+	const auto& l_users = getOnlineUsersL(p->getCID());
+	if (!l_users.empty())
 	{
-		auto& id = i->second->getIdentity();
+		auto& id = l_users.front()->getIdentity();
 		id.setKnownUcSupports(knownUcSupports);
 		{
 			AdcSupports::setSupports(id, aSupports);
@@ -1616,11 +1680,11 @@ void ClientManager::setSupports(const UserPtr& p, const StringList & aSupports,
 }
 void ClientManager::setUnknownCommand(const UserPtr& p, const string& aUnknownCommand)
 {
-	CFlyWriteLock(*g_csOnlineUsers);
-	const auto i = g_onlineUsers.find(p->getCID());
-	if (i != g_onlineUsers.end())
+	CFlyWriteLock(*getShard(p->getCID()).m_csOnlineUsers);
+	const auto& l_users = getOnlineUsersL(p->getCID());
+	if (!l_users.empty())
 	{
-		i->second->getIdentity().setStringParam("UC", aUnknownCommand);
+		l_users.front()->getIdentity().setStringParam("UC", aUnknownCommand);
 	}
 }
 
@@ -1631,7 +1695,7 @@ void ClientManager::reportUser(const HintedUser& user)
 	Client* l_client = nullptr;
 	if (user.user)
 	{
-		CFlyReadLock(*g_csOnlineUsers);
+		CFlyReadLock(*getShard(user.user->getCID()).m_csOnlineUsers);
 		OnlineUserPtr ou = findOnlineUserL(user.user->getCID(), user.hint, priv);
 		if (!ou)
 			return;
@@ -1649,7 +1713,9 @@ void ClientManager::reportUser(const HintedUser& user)
 #ifndef IRAINMAN_IDENTITY_IS_NON_COPYABLE
 Identity ClientManager::getIdentity(const UserPtr& user)
 {
-	CFlyReadLock(*g_csOnlineUsers);
+	if (!user)
+		return Identity();
+	CFlyReadLock(*getShard(user->getCID()).m_csOnlineUsers);
 	const OnlineUser* ou = getOnlineUserL(user);
 	if (ou)
 		return  ou->getIdentity(); // https://www.box.net/shared/1w3v80olr2oro7s1gqt4
@@ -1663,16 +1729,23 @@ StringList ClientManager::getUsersByIp(const string &p_ip) // TODO - boost
 	StringList l_result;
 	l_result.reserve(1);
 	std::unordered_set<string> l_fix_dup;
-	CFlyReadLock(*g_csOnlineUsers);
-	for (auto i = g_onlineUsers.cbegin(); i != g_onlineUsers.cend(); ++i)
+	for (size_t j = 0; j < USER_SHARDS; ++j)
 	{
-		if (i->second->getUser() && i->second->getUser()->getLastIPfromRAM().to_string() == p_ip) // TODO - boost
+		CFlyReadLock(*g_user_shards[j].m_csOnlineUsers);
+		const auto& l_map = g_user_shards[j].m_online_users;
+		for (auto i = l_map.cbegin(); i != l_map.cend(); ++i)
 		{
-			const auto l_nick = i->second->getUser()->getLastNick();
-			const auto l_res = l_fix_dup.insert(l_nick);
-			if (l_res.second == true)
+			for (auto k = i->second.cbegin(); k != i->second.cend(); ++k)
 			{
-				l_result.push_back(l_nick);
+				if ((*k)->getUser() && (*k)->getUser()->getLastIPfromRAM().to_string() == p_ip) // TODO - boost
+				{
+					const auto l_nick = (*k)->getUser()->getLastNick();
+					const auto l_res = l_fix_dup.insert(l_nick);
+					if (l_res.second == true)
+					{
+						l_result.push_back(l_nick);
+					}
+				}
 			}
 		}
 	}
@@ -26,6 +26,7 @@
 #include "AdcSupports.h"
 #include "DirectoryListing.h"
 #include "FavoriteManager.h"
+#include <boost/container/small_vector.hpp>
 
 class UserCommand;
 
@@ -154,7 +155,6 @@ class ClientManager : public Speaker<ClientManagerListener>,
 	}
 		// [!] IRainman opt.
 		CREATE_LOCK_INSTANCE_CM(g, Clients);
-		CREATE_LOCK_INSTANCE_CM(g, OnlineUsers);
 		//CREATE_LOCK_INSTANCE_CM(g, Users);
 		// [~] IRainman opt.
 #undef CREATE_LOCK_INSTANCE_CM
@@ -166,12 +166,16 @@ class ClientManager : public Speaker<ClientManagerListener>,
 		static Identity getIdentity(const UserPtr& user);
 #endif // IRAINMAN_IDENTITY_IS_NON_COPYABLE
 		static OnlineUserPtr getOnlineUserL(const UserPtr& p);
+		static OnlineUserPtr getOnlineUser(const UserPtr& p);
 		static bool isOp(const UserPtr& aUser, const string& aHubUrl);
 		/** Constructs a synthetic, hopefully unique CID */
 		static CID makeCid(const string& nick, const string& hubUrl);
 		
 		void putOnline(const OnlineUserPtr& ou, bool p_is_fire_online) noexcept; // [!] IRainman fix.
 		void putOffline(const OnlineUserPtr& ou, bool p_is_disconnect = false) noexcept; // [!] IRainman fix.
+		/** Bulk versions for the user lists of a hub (login and disconnect) - one lock of a shard for all its users */
+		void putOnline(const OnlineUserList& p_users, bool p_is_fire_online) noexcept;
+		void putOffline(const OnlineUserList& p_users, bool p_is_disconnect = false) noexcept;
 		
 		static bool isMe(const CID& p_cid)
 		{
@@ -271,25 +275,36 @@ class ClientManager : public Speaker<ClientManagerListener>,
 		static std::unique_ptr<webrtc::RWLockWrapper> g_csClients;
 		
 		typedef boost::unordered_map<CID, UserPtr> UserMap;
+		/** Online users of the CID on all the hubs (in the order of putOnline) - usually one or two */
+		typedef boost::container::small_vector<OnlineUserPtr, 2> OnlineUserArray;
+		typedef boost::unordered_map<CID, OnlineUserArray> OnlineMap;
 		
-		static UserMap g_users;
-		
-		static std::unique_ptr<webrtc::RWLockWrapper> g_csUsers;
-		typedef std::multimap<CID, OnlineUserPtr> OnlineMap;
-		typedef OnlineMap::iterator OnlineIter;
-		typedef OnlineMap::const_iterator OnlineIterC;
-		typedef pair<OnlineIter, OnlineIter> OnlinePair;
-		typedef pair<OnlineIterC, OnlineIterC> OnlinePairC;
-		
-		static OnlineMap g_onlineUsers;
-		static std::unique_ptr<webrtc::RWLockWrapper> g_csOnlineUsers;
-#ifdef FLYLINKDC_USE_ASYN_USER_UPDATE
-		static OnlineUserList g_UserUpdateQueue;
-		static std::unique_ptr<webrtc::RWLockWrapper> g_csOnlineUsersUpdateQueue;
-		void on(TimerManagerListener::Second, uint64_t aTick) noexcept override;
-#endif
-		//static
-		void addAsyncOnlineUserUpdated(const OnlineUserPtr& p_ou);
+		/**
+		 * Users and online users are split by CID into shards with own locks,
+		 * so putOnline/putOffline and lookups of different users don't contend.
+		 * A function with the L suffix needs the lock of the shard of the CID.
+		 */
+		struct UserShard
+		{
+			UserShard() : m_csUsers(webrtc::RWLockWrapper::CreateRWLock()), m_csOnlineUsers(webrtc::RWLockWrapper::CreateRWLock())
+			{
+			}
+			UserMap m_users;
+			std::unique_ptr<webrtc::RWLockWrapper> m_csUsers;
+			OnlineMap m_online_users;
+			std::unique_ptr<webrtc::RWLockWrapper> m_csOnlineUsers;
+		};
+		enum { USER_SHARDS = 32 };
+		static UserShard g_user_shards[USER_SHARDS];
+		static UserShard& getShard(const CID& p_cid)
+		{
+			return g_user_shards[p_cid.toHash() % USER_SHARDS];
+		}
+		/** Empty array if the user is offline */
+		static const OnlineUserArray& getOnlineUsersL(const CID& p_cid);
+		/** @return count of the online users of the CID before the removal, 0 - ou was not found */
+		static size_t removeOnlineUserL(OnlineMap& p_map, const OnlineUserPtr& ou);
+		void putOfflineDone(const OnlineUserPtr& ou, size_t p_count, bool p_is_disconnect);
 		static UserPtr g_me; // [!] IRainman fix: this is static object.
 		static UserPtr g_uflylinkdc; // [+] IRainman fix.
 		static Identity g_iflylinkdc; // [+] IRainman fix.
@@ -307,19 +322,19 @@ class ClientManager : public Speaker<ClientManagerListener>,
 		static OnlineUserPtr findOnlineUserHintL(const CID& cid, const string& hintUrl)
 		{
 			// [!] IRainman: This function need to external lock.
-			OnlinePairC p;
+			const OnlineUserArray* p;
 			return findOnlineUserHintL(cid, hintUrl, p);
 		}
 		/**
-		* @param p OnlinePair of all the users found by CID, even those who don't match the hint.
+		* @param p all the users found by CID, even those who don't match the hint.
 		* @return OnlineUserPtr found by CID and hint; discard any user that doesn't match the hint.
 		*/
-		static OnlineUserPtr findOnlineUserHintL(const CID& cid, const string& hintUrl, OnlinePairC& p);
+		static OnlineUserPtr findOnlineUserHintL(const CID& cid, const string& hintUrl, const OnlineUserArray*& p);
 		
 		void fireIncomingSearch(const string&, const string&, ClientManagerListener::SearchReply);
 		// ClientListener
 		void on(Connected, const Client* c) noexcept override;
-		void on(UserUpdatedMyINFO, const OnlineUserPtr& user) noexcept override;
+		void on(UsersUpdatedMyINFO, const Client* c, const OnlineUserList&) noexcept override;
 		void on(UsersUpdated, const Client* c, const OnlineUserList&) noexcept override;
 		void on(ClientFailed, const Client*, const string&) noexcept override;
 		void on(HubUpdated, const Client* c) noexcept override;
@@ -35,7 +35,7 @@ class ClientManagerListener
 		};
 		
 		typedef X<0> UserConnected;
-		typedef X<1> UserUpdated;
+		typedef X<1> UsersUpdated;
 		typedef X<2> UserDisconnected;
 		typedef X<3> IncomingSearch;
 		typedef X<4> ClientConnected;
@@ -46,7 +46,8 @@ class ClientManagerListener
 		
 		/** User online in at least one hub */
 		virtual void on(UserConnected, const UserPtr&) noexcept { }
-		virtual void on(UserUpdated, const OnlineUserPtr&) noexcept { }
+		/** Consolidated batch of the changed users */
+		virtual void on(UsersUpdated, const OnlineUserList&) noexcept { }
 		/** User offline in all hubs */
 		virtual void on(UserDisconnected, const UserPtr&) noexcept { }
 		virtual void on(IncomingSearch, const string&, const string&, SearchReply) noexcept { } // !SMT!-S
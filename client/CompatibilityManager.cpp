@@ -37,11 +37,13 @@
 #endif
 #include "Util.h"
 #include "Socket.h"
+#include "CryptoManager.h"
 #include "DownloadManager.h"
 #include "UploadManager.h"
 #include "CompatibilityManager.h"
 #include "CFlylinkDBManager.h"
 #include "ShareManager.h"
+#include "CFlyUploadCache.h"
 #include "../FlyFeatures/flyServer.h"
 #include <iphlpapi.h>
 #include <direct.h>
@@ -704,7 +706,7 @@ string CompatibilityManager::generateNetworkStats()
 	          // TODO Util::formatBytes(Socket::g_stats.m_dht.totalDown).c_str(), Util::formatBytes(Socket::g_stats.m_dht.totalUp).c_str(),
 	          Util::formatBytes(Socket::g_stats.m_ssl.totalDown).c_str(), Util::formatBytes(Socket::g_stats.m_ssl.totalUp).c_str()
 	         );
-	return l_buf.data();
+	return l_buf.data() + CryptoManager::getSessionStats() + CFlyUploadCache::getStats();
 }
 void CompatibilityManager::caclPhysMemoryStat()
 {
@@ -758,7 +760,7 @@ string CompatibilityManager::generateProgramStats() // moved form WinUtil.
 				          "\t-=[ RAM (peak): %s (%s). Virtual (peak): %s (%s) ]=-\r\n"
 				          "\t-=[ GDI units (peak): %d (%d). Handle (peak): %d (%d) ]=-\r\n"
 				          "\t-=[ Share: %s. Files in share: %u. Total users: %u on hubs: %u ]=-\r\n"
-				          "\t-=[ TigerTree cache: %u Search not exists cache: %u Search exists cache: %u]=-\r\n"
+				          "\t-=[ TigerTree cache: %u Search not exists cache: %u Search exists cache: %u Search cache hit rate: %u%%]=-\r\n"
 #ifdef FLYLINKDC_USE_LASTIP_AND_USER_RATIO
 				          "\t-=[ Total download: %s. Total upload: %s ]=-\r\n"
 #endif
@@ -794,6 +796,7 @@ string CompatibilityManager::generateProgramStats() // moved form WinUtil.
 				          CFlylinkDBManager::get_tth_cache_size(),
 				          ShareManager::get_cache_size_file_not_exists_set(),
 				          ShareManager::get_cache_file_map(),
+				          ShareManager::getSearchCacheStat().getHitRatePercent(),
 #ifdef FLYLINKDC_USE_LASTIP_AND_USER_RATIO
 				          Util::formatBytes(CFlylinkDBManager::getInstance()->m_global_ratio.get_download()).c_str(),
 				          Util::formatBytes(CFlylinkDBManager::getInstance()->m_global_ratio.get_upload()).c_str(),
@@ -48,6 +48,11 @@ boost::unordered_set<string> ConnectionManager::g_ddos_ctm2hub;
 std::map<ConnectionManager::CFlyDDOSkey, ConnectionManager::CFlyDDoSTick> ConnectionManager::g_ddos_map;
 std::set<ConnectionQueueItemPtr> ConnectionManager::g_downloads; // TODO -    User?
 std::set<ConnectionQueueItemPtr> ConnectionManager::g_uploads; // TODO -    User?
+FastCriticalSection ConnectionManager::g_csSchedule;
+ConnectionQueueItem::Schedule ConnectionManager::g_download_schedule;
+
+static const unsigned g_attempt_period_sec = 60;     // 10 for debug
+static const unsigned g_connecting_timeout_sec = 50; // 5 for debug
 
 FastCriticalSection ConnectionManager::g_cs_update;
 UserSet ConnectionManager::g_users_for_update;
@@ -146,20 +151,22 @@ string TokenManager::toString() noexcept
 ConnectionManager::ConnectionManager() : m_floodCounter(0), server(nullptr),
 	secureServer(nullptr)
 {
-	nmdcFeatures.reserve(5);
+	nmdcFeatures.reserve(6);
 	nmdcFeatures.push_back(UserConnection::FEATURE_MINISLOTS);
 	nmdcFeatures.push_back(UserConnection::FEATURE_XML_BZLIST);
 	nmdcFeatures.push_back(UserConnection::FEATURE_ADCGET);
 	nmdcFeatures.push_back(UserConnection::FEATURE_TTHL);
 	nmdcFeatures.push_back(UserConnection::FEATURE_TTHF);
+	nmdcFeatures.push_back(UserConnection::FEATURE_PIPELINE);
 #ifdef SMT_ENABLE_FEATURE_BAN_MSG
 	nmdcFeatures.push_back(UserConnection::FEATURE_BANMSG); // !SMT!-B
 #endif
-	adcFeatures.reserve(4);
+	adcFeatures.reserve(5);
 	adcFeatures.push_back("AD" + UserConnection::FEATURE_ADC_BAS0);
 	adcFeatures.push_back("AD" + UserConnection::FEATURE_ADC_BASE);
 	adcFeatures.push_back("AD" + UserConnection::FEATURE_ADC_TIGR);
 	adcFeatures.push_back("AD" + UserConnection::FEATURE_ADC_BZIP);
+	adcFeatures.push_back("AD" + UserConnection::FEATURE_PIPELINE);
 	
 	TimerManager::getInstance()->addListener(this); // [+] IRainman fix.
 	ClientManager::getInstance()->addListener(this);
@@ -252,11 +259,17 @@ void ConnectionManager::getDownloadConnection(const UserPtr& aUser)
 #ifdef USING_IDLERS_IN_CONNECTION_MANAGER
 			else
 			{
+				wakeUpAttempt(*i);
 				if (find(m_checkIdle.begin(), m_checkIdle.end(), aUser) == m_checkIdle.end())
 				{
 					m_checkIdle.push_back(aUser); // TODO - ?
 				}
 			}
+#else
+			else
+			{
+				wakeUpAttempt(*i);
+			}
 #endif
 		}
 		if (l_cqi && !ClientManager::isBeforeShutdown())
@@ -277,6 +290,7 @@ ConnectionQueueItemPtr ConnectionManager::getCQI_L(const HintedUser& aHintedUser
 	{
 		dcassert(find(g_downloads.begin(), g_downloads.end(), aHintedUser) == g_downloads.end());
 		g_downloads.insert(cqi);
+		scheduleAttempt(cqi);
 		DETECTION_DEBUG("[ConnectionManager][getCQI][download] " + aHintedUser.to_string());
 	}
 	else
@@ -292,6 +306,10 @@ void ConnectionManager::putCQI_L(ConnectionQueueItemPtr& cqi)
 {
 	if (cqi->isDownload())
 	{
+		{
+			CFlyFastLock(g_csSchedule);
+			unscheduleAttemptL(cqi);
+		}
 		g_downloads.erase(cqi);
 		DETECTION_DEBUG("[ConnectionManager][putCQI][download] " + cqi->getHintedUser().to_string());
 	}
@@ -314,6 +332,77 @@ void ConnectionManager::putCQI_L(ConnectionQueueItemPtr& cqi)
 	}
 }
 
+/**
+ * Tick when the timer has to look at the not active download again:
+ * a new or forced item - at once, CONNECTING - connection timeout,
+ * WAITING/NO_DOWNLOAD_SLOTS - next attempt (backoff by the number of errors).
+ * After a protocol error the item waits for a forced attempt (or user update).
+ */
+bool ConnectionManager::getNextAttempt(const ConnectionQueueItemPtr& p_cqi, uint64_t& p_tick)
+{
+	if (p_cqi->getState() == ConnectionQueueItem::ACTIVE)
+		return false;
+	const uint64_t l_last_attempt = p_cqi->getLastAttempt();
+	if (l_last_attempt == 0)
+	{
+		p_tick = 0;
+		return true;
+	}
+	if (p_cqi->getErrors() == -1)
+		return false;
+	if (p_cqi->getState() == ConnectionQueueItem::CONNECTING)
+		p_tick = l_last_attempt + g_connecting_timeout_sec * 1000;
+	else
+		p_tick = l_last_attempt + g_attempt_period_sec * 1000 * max(1, p_cqi->getErrors());
+	return true;
+}
+
+void ConnectionManager::unscheduleAttemptL(const ConnectionQueueItemPtr& p_cqi)
+{
+	if (p_cqi->m_is_scheduled)
+	{
+		g_download_schedule.erase(p_cqi->m_schedule_pos);
+		p_cqi->m_is_scheduled = false;
+	}
+}
+
+void ConnectionManager::scheduleAttempt(const ConnectionQueueItemPtr& p_cqi, uint64_t p_min_tick /*= 0 */)
+{
+	uint64_t l_tick = 0;
+	const bool l_is_needed = getNextAttempt(p_cqi, l_tick);
+	CFlyFastLock(g_csSchedule);
+	unscheduleAttemptL(p_cqi);
+	if (l_is_needed)
+	{
+		p_cqi->m_schedule_pos = g_download_schedule.insert(std::make_pair(std::max(l_tick, p_min_tick), p_cqi));
+		p_cqi->m_is_scheduled = true;
+	}
+}
+
+void ConnectionManager::wakeUpAttempt(const ConnectionQueueItemPtr& p_cqi)
+{
+	if (p_cqi->getState() == ConnectionQueueItem::ACTIVE)
+		return;
+	CFlyFastLock(g_csSchedule);
+	if (p_cqi->m_is_scheduled && p_cqi->m_schedule_pos->first == 0)
+		return;
+	unscheduleAttemptL(p_cqi);
+	p_cqi->m_schedule_pos = g_download_schedule.insert(std::make_pair(uint64_t(0), p_cqi));
+	p_cqi->m_is_scheduled = true;
+}
+
+void ConnectionManager::popDueAttempts(uint64_t p_tick, std::vector<ConnectionQueueItemPtr>& p_due)
+{
+	CFlyFastLock(g_csSchedule);
+	const auto l_end = g_download_schedule.upper_bound(p_tick);
+	for (auto i = g_download_schedule.begin(); i != l_end; ++i)
+	{
+		i->second->m_is_scheduled = false;
+		p_due.push_back(i->second);
+	}
+	g_download_schedule.erase(g_download_schedule.begin(), l_end);
+}
+
 #if 0
 bool ConnectionManager::getCipherNameAndIP(UserConnection* p_conn, string& p_chiper_name, string& p_ip)
 {
@@ -364,9 +453,9 @@ void ConnectionManager::flushOnUserUpdated()
 		CFlyFastLock(g_cs_update);
 		l_users_for_update.swap(g_users_for_update);
 	}
-	for (auto i = l_users_for_update.cbegin(); i != l_users_for_update.cend(); ++i)
+	if (!l_users_for_update.empty())
 	{
-		onUserUpdated(*i);
+		onUsersUpdated(l_users_for_update);
 	}
 }
 void ConnectionManager::addOnUserUpdated(const UserPtr& aUser)
@@ -432,7 +521,7 @@ struct CFlyReasonItem : public CFlyTokenItem
 	}
 };
 
-void ConnectionManager::onUserUpdated(const UserPtr& aUser)
+void ConnectionManager::onUsersUpdated(const UserSet& p_users)
 {
 	if (!ClientManager::isBeforeShutdown())
 	{
@@ -442,8 +531,9 @@ void ConnectionManager::onUserUpdated(const UserPtr& aUser)
 			CFlyReadLock(*g_csDownloads);
 			for (auto i = g_downloads.cbegin(); i != g_downloads.cend(); ++i)
 			{
-				if ((*i)->getUser() == aUser) // todo - map
+				if (p_users.find((*i)->getUser()) != p_users.end())
 				{
+					wakeUpAttempt(*i); // online/offline - look at it on the next timer tick
 					l_download_users.push_back(CFlyTokenItem(*i));
 				}
 			}
@@ -453,7 +543,7 @@ void ConnectionManager::onUserUpdated(const UserPtr& aUser)
 			CFlyLock(g_csUploads);
 			for (auto i = g_uploads.cbegin(); i != g_uploads.cend(); ++i)
 			{
-				if ((*i)->getUser() == aUser)  // todo - map
+				if (p_users.find((*i)->getUser()) != p_users.end())
 				{
 					l_upload_users.push_back(CFlyTokenItem(*i));
 				}
@@ -495,9 +585,11 @@ void ConnectionManager::on(TimerManagerListener::Second, uint64_t aTick) noexcep
 #ifdef USING_IDLERS_IN_CONNECTION_MANAGER
 		l_idlers.swap(m_checkIdle); // [!] IRainman opt: use swap.
 #endif
-		for (auto i = g_downloads.cbegin(); i != g_downloads.cend() && !ClientManager::isBeforeShutdown(); ++i)
+		std::vector<ConnectionQueueItemPtr> l_due;
+		popDueAttempts(aTick, l_due);
+		for (auto i = l_due.cbegin(); i != l_due.cend() && !ClientManager::isBeforeShutdown(); ++i)
 		{
-			const auto cqi = *i;
+			const auto& cqi = *i;
 			if (cqi->getState() != ConnectionQueueItem::ACTIVE) // crash - https://www.crash-server.com/Problem.aspx?ClientID=guest&ProblemID=44111
 			{
 				if (!cqi->getUser()->isOnline())
@@ -512,18 +604,9 @@ void ConnectionManager::on(TimerManagerListener::Second, uint64_t aTick) noexcep
 					// protocol error, don't reconnect except after a forced attempt
 					continue;
 				}
-#ifdef _DEBUG
-				const unsigned l_count_sec = 60;
-				const unsigned l_count_sec_connecting = 50;
-				//const unsigned l_count_sec = 10;
-				//const unsigned l_count_sec_connecting = 5;
-#else
-				const unsigned l_count_sec = 60;
-				const unsigned l_count_sec_connecting = 50;
-#endif
 				const auto l_count_error = cqi->getErrors();
 				if (cqi->getLastAttempt() == 0 || ((SETTING(DOWNCONN_PER_SEC) == 0 || l_attempts < SETTING(DOWNCONN_PER_SEC)) &&
-				                                   cqi->getLastAttempt() + l_count_sec * 1000 * max(1, l_count_error) < aTick))
+				                                   cqi->getLastAttempt() + g_attempt_period_sec * 1000 * max(1, l_count_error) < aTick))
 				{
 					cqi->setLastAttempt(aTick);
 					
@@ -586,7 +669,7 @@ void ConnectionManager::on(TimerManagerListener::Second, uint64_t aTick) noexcep
 						cqi->setState(ConnectionQueueItem::WAITING);
 					}
 				}
-				else if (cqi->getState() == ConnectionQueueItem::CONNECTING && cqi->getLastAttempt() + l_count_sec_connecting * 1000 < aTick)
+				else if (cqi->getState() == ConnectionQueueItem::CONNECTING && cqi->getLastAttempt() + g_connecting_timeout_sec * 1000 < aTick)
 				{
 					ClientManager::connectionTimeout(cqi->getUser());
 					
@@ -607,6 +690,8 @@ void ConnectionManager::on(TimerManagerListener::Second, uint64_t aTick) noexcep
 						cqi->setState(ConnectionQueueItem::WAITING);
 					}
 				}
+				// Not before the next tick - the attempt can be delayed by DOWNCONN_PER_SEC
+				scheduleAttempt(cqi, aTick + 1);
 			}
 		}
 	}
@@ -1260,6 +1345,10 @@ void ConnectionManager::on(AdcCommand::SUP, UserConnection* aSource, const AdcCo
 			{
 				aSource->setFlag(UserConnection::FLAG_SUPPORTS_XML_BZLIST);
 			}
+			else if (feat == UserConnection::FEATURE_PIPELINE)
+			{
+				aSource->setFlag(UserConnection::FLAG_SUPPORTS_PIPELINE);
+			}
 			else if (feat == UserConnection::FEATURE_ADC_TIGR)
 			{
 				tigrOk = true; // Variable 'tigrOk' is assigned a value that is never used.
@@ -1408,7 +1497,11 @@ void ConnectionManager::on(UserConnectionListener::MyNick, UserConnection* aSour
 		for (auto i = g_downloads.cbegin(); i != g_downloads.cend(); ++i)
 		{
 			const ConnectionQueueItemPtr& cqi = *i;
-			cqi->setErrors(0);
+			if (cqi->getErrors())
+			{
+				cqi->setErrors(0);
+				scheduleAttempt(cqi);
+			}
 			if ((cqi->getState() == ConnectionQueueItem::CONNECTING || cqi->getState() == ConnectionQueueItem::WAITING) &&
 			        cqi->getUser()->getCID() == cid)
 			{
@@ -1694,7 +1787,11 @@ void ConnectionManager::on(AdcCommand::INF, UserConnection* aSource, const AdcCo
 		
 		if (i != g_downloads.cend())
 		{
-			(*i)->setErrors(0);
+			if ((*i)->getErrors())
+			{
+				(*i)->setErrors(0);
+				scheduleAttempt(*i);
+			}
 			if ((*i)->getConnectionQueueToken() == l_token) // TODO -            ?
 			{
 				down = true;
@@ -1762,6 +1859,7 @@ void ConnectionManager::force(const UserPtr& aUser)
 		fly_fire1(ConnectionManagerListener::Forced(), *i);
 #endif
 		(*i)->setLastAttempt(0);
+		scheduleAttempt(*i);
 	}
 }
 
@@ -1800,6 +1898,7 @@ void ConnectionManager::failed(UserConnection* aSource, const string& aError, bo
 				cqi->setState(ConnectionQueueItem::WAITING);
 				cqi->setLastAttempt(GET_TICK());
 				cqi->setErrors(protocolError ? -1 : (cqi->getErrors() + 1));
+				scheduleAttempt(cqi);
 				l_error_download.m_hinted_user = cqi->getHintedUser();
 				l_error_download.m_reason = aError;
 				l_error_download.m_token = cqi->getConnectionQueueToken();
@@ -1941,6 +2040,10 @@ void ConnectionManager::shutdown()
 		}
 	}
 #endif
+	{
+		CFlyFastLock(g_csSchedule);
+		g_download_schedule.clear();
+	}
 	g_downloads.clear();
 	g_uploads.clear();
 }
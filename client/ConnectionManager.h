@@ -70,7 +70,7 @@ class ConnectionQueueItem
 		ConnectionQueueItem(const HintedUser& aHintedUser, bool aDownload, const string& aToken) :
 			m_connection_queue_token(aToken),
 			lastAttempt(0),
-			errors(0), state(WAITING), m_is_download(aDownload), m_hinted_user(aHintedUser), m_is_active_client(false)
+			errors(0), state(WAITING), m_is_download(aDownload), m_hinted_user(aHintedUser), m_is_active_client(false), m_is_scheduled(false)
 #ifdef FLYLINKDC_USE_AUTOMATIC_PASSIVE_CONNECTION
 			, m_count_waiting(0), m_is_force_passive(false)
 #endif
@@ -85,6 +85,11 @@ class ConnectionQueueItem
 		GETSET(State, state, State);
 		//GETSET(string, hubUrl, HubUrl); // TODO -        
 		bool m_is_active_client;
+		
+		/** Download items ordered by the tick of the next check (see ConnectionManager::scheduleAttempt) */
+		typedef std::multimap<uint64_t, std::shared_ptr<ConnectionQueueItem> > Schedule;
+		Schedule::iterator m_schedule_pos;
+		bool m_is_scheduled;
 #ifdef FLYLINKDC_USE_AUTOMATIC_PASSIVE_CONNECTION
 		unsigned short m_count_waiting;
 		bool m_is_force_passive;
@@ -293,6 +298,15 @@ class ConnectionManager :
 		static std::set<ConnectionQueueItemPtr> g_downloads;
 		static std::set<ConnectionQueueItemPtr> g_uploads;
 		
+		/** Not active downloads by the tick of the next attempt/timeout check - the timer looks only at the due items */
+		static FastCriticalSection g_csSchedule;
+		static ConnectionQueueItem::Schedule g_download_schedule;
+		static bool getNextAttempt(const ConnectionQueueItemPtr& p_cqi, uint64_t& p_tick);
+		static void scheduleAttempt(const ConnectionQueueItemPtr& p_cqi, uint64_t p_min_tick = 0);
+		static void wakeUpAttempt(const ConnectionQueueItemPtr& p_cqi);
+		static void unscheduleAttemptL(const ConnectionQueueItemPtr& p_cqi);
+		static void popDueAttempts(uint64_t p_tick, std::vector<ConnectionQueueItemPtr>& p_due);
+		
 		/** All active connections */
 		static boost::unordered_set<UserConnection*> g_userConnections;
 		
@@ -437,7 +451,8 @@ class ConnectionManager :
 		void on(ClientManagerListener::UserConnected, const UserPtr& aUser) noexcept override;
 		void on(ClientManagerListener::UserDisconnected, const UserPtr& aUser) noexcept override;
 		
-		void onUserUpdated(const UserPtr& aUser);
+		/** One pass over the connections for all the users of the batch */
+		void onUsersUpdated(const UserSet& p_users);
 		
 };
 
@@ -32,7 +32,6 @@
 
 #include <bzlib.h>
 
-void* CryptoManager::g_tmpKeysMap[KEY_LAST] = { NULL, NULL, NULL };
 CriticalSection* CryptoManager::cs = NULL;
 int CryptoManager::idxVerifyData = 0;
 char CryptoManager::idxVerifyDataName[] = "FlylinkDC.VerifyData";
@@ -40,6 +39,13 @@ CryptoManager::SSLVerifyData CryptoManager::trustedKeyprint = { false, "trusted_
 bool CryptoManager::certsLoaded = false;
 ByteVector CryptoManager::keyprint;
 static CriticalSection g_cs;
+FastCriticalSection CryptoManager::g_cs_sessions;
+CryptoManager::SessionMap CryptoManager::g_sessions;
+uint64_t CryptoManager::g_session_access_counter = 0;
+CryptoManager::SessionStats CryptoManager::g_session_stats[2];
+
+static const size_t g_max_sessions = 1024;
+static const long g_session_timeout_sec = 60 * 60 * 2;
 
 unsigned char alpn_protos[] = {
 	3, 'a', 'd', 'c',
@@ -70,31 +76,29 @@ CryptoManager::CryptoManager()
 		// Check that openssl rng has been seeded with enough data
 		sslRandCheck();
 		
-		// http://www.flylinkdc.ru/2016/06/openssl.html
-		// initTmpKeyMaps();
-		
-		const char ciphersuites[] = "ECDHE-ECDSA-AES128-GCM-SHA256:ECDHE-RSA-AES128-GCM-SHA256:ECDHE-ECDSA-AES256-GCM-SHA384:ECDHE-RSA-AES256-GCM-SHA384:DHE-RSA-AES128-GCM-SHA256:ECDHE-ECDSA-AES128-SHA256:ECDHE-RSA-AES128-SHA256:ECDHE-ECDSA-AES256-SHA384:ECDHE-RSA-AES256-SHA384:DHE-RSA-AES128-SHA256:ECDHE-ECDSA-AES128-SHA:ECDHE-RSA-AES128-SHA:ECDHE-ECDSA-AES256-SHA:ECDHE-RSA-AES256-SHA:DHE-RSA-AES128-SHA:AES128-GCM-SHA256:AES256-GCM-SHA384:AES128-SHA256:AES256-SHA256:AES128-SHA:AES256-SHA";
-		SSL_CTX_set_options(clientContext, SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3 | SSL_OP_NO_COMPRESSION);
-		SSL_CTX_set_cipher_list(clientContext, ciphersuites);
-		SSL_CTX_set1_curves_list(clientContext, "P-256");
-		SSL_CTX_set_options(clientALPNContext, SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3 | SSL_OP_NO_COMPRESSION);
-		SSL_CTX_set_cipher_list(clientALPNContext, ciphersuites);
-		SSL_CTX_set1_curves_list(clientALPNContext, "P-256");
-		SSL_CTX_set_options(serverContext, SSL_OP_SINGLE_DH_USE | SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3 | SSL_OP_NO_COMPRESSION);
-		SSL_CTX_set_cipher_list(serverContext, ciphersuites);
-		SSL_CTX_set1_curves_list(serverContext, "P-256");
-		
-		EC_KEY* tmp_ecdh;
-		if ((tmp_ecdh = EC_KEY_new_by_curve_name(NID_X9_62_prime256v1)) != NULL)
+		// Only ECDHE key exchange (forward secrecy) - no static RSA and no temporary DH/RSA keys
+		const char ciphersuites[] = "ECDHE-ECDSA-AES128-GCM-SHA256:ECDHE-RSA-AES128-GCM-SHA256:ECDHE-ECDSA-AES256-GCM-SHA384:ECDHE-RSA-AES256-GCM-SHA384:ECDHE-ECDSA-AES128-SHA256:ECDHE-RSA-AES128-SHA256:ECDHE-ECDSA-AES256-SHA384:ECDHE-RSA-AES256-SHA384:ECDHE-ECDSA-AES128-SHA:ECDHE-RSA-AES128-SHA:ECDHE-ECDSA-AES256-SHA:ECDHE-RSA-AES256-SHA";
+		const char curves[] = "P-256:P-384";
+		::SSL_CTX* l_contexts[] = { clientContext, clientALPNContext, serverContext };
+		for (auto l_ctx : l_contexts)
 		{
-			SSL_CTX_set_options(serverContext, SSL_OP_SINGLE_ECDH_USE);
-			SSL_CTX_set_tmp_ecdh(serverContext, tmp_ecdh);
-			
-			EC_KEY_free(tmp_ecdh);
+			SSL_CTX_set_options(l_ctx, SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3 | SSL_OP_NO_COMPRESSION);
+			SSL_CTX_set_cipher_list(l_ctx, ciphersuites);
+			SSL_CTX_set1_curves_list(l_ctx, curves);
+			SSL_CTX_set_ecdh_auto(l_ctx, 1);
 		}
+		SSL_CTX_set_options(serverContext, SSL_OP_SINGLE_ECDH_USE);
 		
-		SSL_CTX_set_tmp_dh_callback(serverContext, CryptoManager::tmp_dh_cb);
-		SSL_CTX_set_tmp_rsa_callback(serverContext, CryptoManager::tmp_rsa_cb);
+		// Session resumption: the server side cache (session id and tickets) is kept by OpenSSL,
+		// the client side sessions are kept by us (see restoreSession/storeSession) - keyed by the peer keyprint
+		SSL_CTX_set_session_cache_mode(serverContext, SSL_SESS_CACHE_SERVER);
+		SSL_CTX_set_session_id_context(serverContext, reinterpret_cast<const unsigned char*>(idxVerifyDataName), strlen(idxVerifyDataName));
+		SSL_CTX_sess_set_cache_size(serverContext, g_max_sessions);
+		SSL_CTX_set_timeout(serverContext, g_session_timeout_sec);
+		SSL_CTX_set_session_cache_mode(clientContext, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+		SSL_CTX_set_session_cache_mode(clientALPNContext, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+		SSL_CTX_set_timeout(clientContext, g_session_timeout_sec);
+		SSL_CTX_set_timeout(clientALPNContext, g_session_timeout_sec);
 		
 		SSL_CTX_set_verify(clientContext, SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT, verify_callback);
 		SSL_CTX_set_verify(clientALPNContext, SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT, verify_callback);
@@ -103,60 +107,18 @@ CryptoManager::CryptoManager()
 		SSL_CTX_set_alpn_protos(clientALPNContext, alpn_protos, sizeof(alpn_protos));
 	}
 }
-void CryptoManager::initTmpKeyMaps()
-{
-	static bool g_is_init_tmp_key_map = false;
-	if (g_is_init_tmp_key_map == false)
-	{
-		g_is_init_tmp_key_map = true;
-		// Init temp data for DH keys
-		for (int i = KEY_FIRST; i != KEY_RSA_2048; ++i)
-			if (!g_tmpKeysMap[i])
-			{
-				g_tmpKeysMap[i] = getTmpDH(getKeyLength(static_cast<TLSTmpKeys>(i)));
-			}
-			
-		// and same for RSA keys
-		for (int i = KEY_RSA_2048; i != KEY_LAST; ++i)
-		{
-			if (!g_tmpKeysMap[i])
-			{
-				g_tmpKeysMap[i] = getTmpRSA(getKeyLength(static_cast<TLSTmpKeys>(i)));
-			}
-		}
-	}
-}
-
-void CryptoManager::freeTmpKeyMaps()
-{
-	for (int i = KEY_FIRST; i != KEY_RSA_2048; ++i)
-	{
-		if (g_tmpKeysMap[i])
-		{
-			DH_free((DH*)g_tmpKeysMap[i]);
-		}
-	}
-	
-	for (int i = KEY_RSA_2048; i != KEY_LAST; ++i)
-	{
-		if (g_tmpKeysMap[i])
-		{
-			RSA_free((RSA*)g_tmpKeysMap[i]);
-		}
-	}
-}
 CryptoManager::~CryptoManager()
 {
 
 	/* thread-local cleanup */
 	ERR_remove_thread_state(NULL);
 	
+	clearSessions();
+	
 	clientContext.reset();
 	clientALPNContext.reset();
 	serverContext.reset();
 	
-	freeTmpKeyMaps();
-	
 	/* global application exit cleanup (after all SSL activity is shutdown) */
 	SSL_COMP_free_compression_methods();
 	
@@ -355,153 +317,6 @@ int CryptoManager::verify_callback(int preverify_ok, X509_STORE_CTX *ctx)
 	return preverify_ok;
 }
 
-int CryptoManager::getKeyLength(TLSTmpKeys key)
-{
-	switch (key)
-	{
-		case KEY_DH_2048:
-		case KEY_RSA_2048:
-			return 2048;
-		case KEY_DH_4096:
-			return 4096;
-		default:
-			dcassert(0);
-			return 0;
-	}
-}
-
-DH* CryptoManager::getTmpDH(int keyLen)
-{
-	if (keyLen < 2048)
-		return nullptr;
-		
-	DH* tmpDH = DH_new();
-	if (!tmpDH) return nullptr;
-	
-	// From RFC 3526; checked via http://wiki.openssl.org/index.php/Diffie-Hellman_parameters#Validating_Parameters
-	switch (keyLen)
-	{
-		case 2048:
-		{
-			static unsigned char dh2048_p[] =
-			{
-				0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xC9, 0x0F, 0xDA, 0xA2,
-				0x21, 0x68, 0xC2, 0x34, 0xC4, 0xC6, 0x62, 0x8B, 0x80, 0xDC, 0x1C, 0xD1,
-				0x29, 0x02, 0x4E, 0x08, 0x8A, 0x67, 0xCC, 0x74, 0x02, 0x0B, 0xBE, 0xA6,
-				0x3B, 0x13, 0x9B, 0x22, 0x51, 0x4A, 0x08, 0x79, 0x8E, 0x34, 0x04, 0xDD,
-				0xEF, 0x95, 0x19, 0xB3, 0xCD, 0x3A, 0x43, 0x1B, 0x30, 0x2B, 0x0A, 0x6D,
-				0xF2, 0x5F, 0x14, 0x37, 0x4F, 0xE1, 0x35, 0x6D, 0x6D, 0x51, 0xC2, 0x45,
-				0xE4, 0x85, 0xB5, 0x76, 0x62, 0x5E, 0x7E, 0xC6, 0xF4, 0x4C, 0x42, 0xE9,
-				0xA6, 0x37, 0xED, 0x6B, 0x0B, 0xFF, 0x5C, 0xB6, 0xF4, 0x06, 0xB7, 0xED,
-				0xEE, 0x38, 0x6B, 0xFB, 0x5A, 0x89, 0x9F, 0xA5, 0xAE, 0x9F, 0x24, 0x11,
-				0x7C, 0x4B, 0x1F, 0xE6, 0x49, 0x28, 0x66, 0x51, 0xEC, 0xE4, 0x5B, 0x3D,
-				0xC2, 0x00, 0x7C, 0xB8, 0xA1, 0x63, 0xBF, 0x05, 0x98, 0xDA, 0x48, 0x36,
-				0x1C, 0x55, 0xD3, 0x9A, 0x69, 0x16, 0x3F, 0xA8, 0xFD, 0x24, 0xCF, 0x5F,
-				0x83, 0x65, 0x5D, 0x23, 0xDC, 0xA3, 0xAD, 0x96, 0x1C, 0x62, 0xF3, 0x56,
-				0x20, 0x85, 0x52, 0xBB, 0x9E, 0xD5, 0x29, 0x07, 0x70, 0x96, 0x96, 0x6D,
-				0x67, 0x0C, 0x35, 0x4E, 0x4A, 0xBC, 0x98, 0x04, 0xF1, 0x74, 0x6C, 0x08,
-				0xCA, 0x18, 0x21, 0x7C, 0x32, 0x90, 0x5E, 0x46, 0x2E, 0x36, 0xCE, 0x3B,
-				0xE3, 0x9E, 0x77, 0x2C, 0x18, 0x0E, 0x86, 0x03, 0x9B, 0x27, 0x83, 0xA2,
-				0xEC, 0x07, 0xA2, 0x8F, 0xB5, 0xC5, 0x5D, 0xF0, 0x6F, 0x4C, 0x52, 0xC9,
-				0xDE, 0x2B, 0xCB, 0xF6, 0x95, 0x58, 0x17, 0x18, 0x39, 0x95, 0x49, 0x7C,
-				0xEA, 0x95, 0x6A, 0xE5, 0x15, 0xD2, 0x26, 0x18, 0x98, 0xFA, 0x05, 0x10,
-				0x15, 0x72, 0x8E, 0x5A, 0x8A, 0xAC, 0xAA, 0x68, 0xFF, 0xFF, 0xFF, 0xFF,
-				0xFF, 0xFF, 0xFF, 0xFF,
-			};
-			tmpDH->p = BN_bin2bn(dh2048_p, sizeof(dh2048_p), nullptr);
-			break;
-		}
-		
-		case 4096:
-		{
-			static unsigned char dh4096_p[] =
-			{
-				0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xC9, 0x0F, 0xDA, 0xA2,
-				0x21, 0x68, 0xC2, 0x34, 0xC4, 0xC6, 0x62, 0x8B, 0x80, 0xDC, 0x1C, 0xD1,
-				0x29, 0x02, 0x4E, 0x08, 0x8A, 0x67, 0xCC, 0x74, 0x02, 0x0B, 0xBE, 0xA6,
-				0x3B, 0x13, 0x9B, 0x22, 0x51, 0x4A, 0x08, 0x79, 0x8E, 0x34, 0x04, 0xDD,
-				0xEF, 0x95, 0x19, 0xB3, 0xCD, 0x3A, 0x43, 0x1B, 0x30, 0x2B, 0x0A, 0x6D,
-				0xF2, 0x5F, 0x14, 0x37, 0x4F, 0xE1, 0x35, 0x6D, 0x6D, 0x51, 0xC2, 0x45,
-				0xE4, 0x85, 0xB5, 0x76, 0x62, 0x5E, 0x7E, 0xC6, 0xF4, 0x4C, 0x42, 0xE9,
-				0xA6, 0x37, 0xED, 0x6B, 0x0B, 0xFF, 0x5C, 0xB6, 0xF4, 0x06, 0xB7, 0xED,
-				0xEE, 0x38, 0x6B, 0xFB, 0x5A, 0x89, 0x9F, 0xA5, 0xAE, 0x9F, 0x24, 0x11,
-				0x7C, 0x4B, 0x1F, 0xE6, 0x49, 0x28, 0x66, 0x51, 0xEC, 0xE4, 0x5B, 0x3D,
-				0xC2, 0x00, 0x7C, 0xB8, 0xA1, 0x63, 0xBF, 0x05, 0x98, 0xDA, 0x48, 0x36,
-				0x1C, 0x55, 0xD3, 0x9A, 0x69, 0x16, 0x3F, 0xA8, 0xFD, 0x24, 0xCF, 0x5F,
-				0x83, 0x65, 0x5D, 0x23, 0xDC, 0xA3, 0xAD, 0x96, 0x1C, 0x62, 0xF3, 0x56,
-				0x20, 0x85, 0x52, 0xBB, 0x9E, 0xD5, 0x29, 0x07, 0x70, 0x96, 0x96, 0x6D,
-				0x67, 0x0C, 0x35, 0x4E, 0x4A, 0xBC, 0x98, 0x04, 0xF1, 0x74, 0x6C, 0x08,
-				0xCA, 0x18, 0x21, 0x7C, 0x32, 0x90, 0x5E, 0x46, 0x2E, 0x36, 0xCE, 0x3B,
-				0xE3, 0x9E, 0x77, 0x2C, 0x18, 0x0E, 0x86, 0x03, 0x9B, 0x27, 0x83, 0xA2,
-				0xEC, 0x07, 0xA2, 0x8F, 0xB5, 0xC5, 0x5D, 0xF0, 0x6F, 0x4C, 0x52, 0xC9,
-				0xDE, 0x2B, 0xCB, 0xF6, 0x95, 0x58, 0x17, 0x18, 0x39, 0x95, 0x49, 0x7C,
-				0xEA, 0x95, 0x6A, 0xE5, 0x15, 0xD2, 0x26, 0x18, 0x98, 0xFA, 0x05, 0x10,
-				0x15, 0x72, 0x8E, 0x5A, 0x8A, 0xAA, 0xC4, 0x2D, 0xAD, 0x33, 0x17, 0x0D,
-				0x04, 0x50, 0x7A, 0x33, 0xA8, 0x55, 0x21, 0xAB, 0xDF, 0x1C, 0xBA, 0x64,
-				0xEC, 0xFB, 0x85, 0x04, 0x58, 0xDB, 0xEF, 0x0A, 0x8A, 0xEA, 0x71, 0x57,
-				0x5D, 0x06, 0x0C, 0x7D, 0xB3, 0x97, 0x0F, 0x85, 0xA6, 0xE1, 0xE4, 0xC7,
-				0xAB, 0xF5, 0xAE, 0x8C, 0xDB, 0x09, 0x33, 0xD7, 0x1E, 0x8C, 0x94, 0xE0,
-				0x4A, 0x25, 0x61, 0x9D, 0xCE, 0xE3, 0xD2, 0x26, 0x1A, 0xD2, 0xEE, 0x6B,
-				0xF1, 0x2F, 0xFA, 0x06, 0xD9, 0x8A, 0x08, 0x64, 0xD8, 0x76, 0x02, 0x73,
-				0x3E, 0xC8, 0x6A, 0x64, 0x52, 0x1F, 0x2B, 0x18, 0x17, 0x7B, 0x20, 0x0C,
-				0xBB, 0xE1, 0x17, 0x57, 0x7A, 0x61, 0x5D, 0x6C, 0x77, 0x09, 0x88, 0xC0,
-				0xBA, 0xD9, 0x46, 0xE2, 0x08, 0xE2, 0x4F, 0xA0, 0x74, 0xE5, 0xAB, 0x31,
-				0x43, 0xDB, 0x5B, 0xFC, 0xE0, 0xFD, 0x10, 0x8E, 0x4B, 0x82, 0xD1, 0x20,
-				0xA9, 0x21, 0x08, 0x01, 0x1A, 0x72, 0x3C, 0x12, 0xA7, 0x87, 0xE6, 0xD7,
-				0x88, 0x71, 0x9A, 0x10, 0xBD, 0xBA, 0x5B, 0x26, 0x99, 0xC3, 0x27, 0x18,
-				0x6A, 0xF4, 0xE2, 0x3C, 0x1A, 0x94, 0x68, 0x34, 0xB6, 0x15, 0x0B, 0xDA,
-				0x25, 0x83, 0xE9, 0xCA, 0x2A, 0xD4, 0x4C, 0xE8, 0xDB, 0xBB, 0xC2, 0xDB,
-				0x04, 0xDE, 0x8E, 0xF9, 0x2E, 0x8E, 0xFC, 0x14, 0x1F, 0xBE, 0xCA, 0xA6,
-				0x28, 0x7C, 0x59, 0x47, 0x4E, 0x6B, 0xC0, 0x5D, 0x99, 0xB2, 0x96, 0x4F,
-				0xA0, 0x90, 0xC3, 0xA2, 0x23, 0x3B, 0xA1, 0x86, 0x51, 0x5B, 0xE7, 0xED,
-				0x1F, 0x61, 0x29, 0x70, 0xCE, 0xE2, 0xD7, 0xAF, 0xB8, 0x1B, 0xDD, 0x76,
-				0x21, 0x70, 0x48, 0x1C, 0xD0, 0x06, 0x91, 0x27, 0xD5, 0xB0, 0x5A, 0xA9,
-				0x93, 0xB4, 0xEA, 0x98, 0x8D, 0x8F, 0xDD, 0xC1, 0x86, 0xFF, 0xB7, 0xDC,
-				0x90, 0xA6, 0xC0, 0x8F, 0x4D, 0xF4, 0x35, 0xC9, 0x34, 0x06, 0x31, 0x99,
-				0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-			};
-			tmpDH->p = BN_bin2bn(dh4096_p, sizeof(dh4096_p), nullptr);
-			break;
-		}
-	}
-	
-	static unsigned char dh_g[] =
-	{
-		0x02,
-	};
-	
-	tmpDH->g = BN_bin2bn(dh_g, sizeof(dh_g), nullptr);
-	
-	if (!tmpDH->p || !tmpDH->g)
-	{
-		DH_free(tmpDH);
-		return nullptr;
-	}
-	else
-	{
-		return tmpDH;
-	}
-}
-
-RSA* CryptoManager::getTmpRSA(int keyLen)
-{
-	if (keyLen < 2048)
-		return nullptr;
-		
-	RSA* tmpRSA = RSA_new();
-	BIGNUM* bn = BN_new();
-	
-	if (!bn || !BN_set_word(bn, RSA_F4) || !RSA_generate_key_ex(tmpRSA, keyLen, bn, nullptr))
-	{
-		if (bn) BN_free(bn);
-		RSA_free(tmpRSA);
-		return nullptr;
-	}
-	
-	BN_free(bn);
-	return tmpRSA;
-}
-
 bool CryptoManager::TLSOk() noexcept
 {
 	return BOOLSETTING(USE_TLS) && certsLoaded && !keyprint.empty();
@@ -605,6 +420,7 @@ void CryptoManager::loadCertificates() noexcept
 	
 	keyprint.clear();
 	certsLoaded = false;
+	clearSessions();
 	
 	if (cert.empty() || key.empty())
 	{
@@ -786,6 +602,101 @@ SSL_CTX* CryptoManager::getSSLContext(SSLContext wanted)
 	}
 }
 
+bool CryptoManager::restoreSession(::SSL* p_ssl, const string& p_key)
+{
+	CFlyFastLock(g_cs_sessions);
+	const auto i = g_sessions.find(p_key);
+	if (i == g_sessions.end())
+	{
+		return false;
+	}
+	SSL_SESSION* l_session = i->second.m_session;
+	if (SSL_SESSION_get_time(l_session) + SSL_SESSION_get_timeout(l_session) < time(nullptr))
+	{
+		SSL_SESSION_free(l_session);
+		g_sessions.erase(i);
+		return false;
+	}
+	i->second.m_last_access = ++g_session_access_counter;
+	return SSL_set_session(p_ssl, l_session) == SSL_SUCCESS;
+}
+
+void CryptoManager::storeSession(::SSL* p_ssl, const string& p_key)
+{
+	SSL_SESSION* l_session = SSL_get1_session(p_ssl);
+	if (!l_session)
+	{
+		return;
+	}
+	CFlyFastLock(g_cs_sessions);
+	auto& l_item = g_sessions[p_key];
+	if (l_item.m_session)
+	{
+		SSL_SESSION_free(l_item.m_session);
+	}
+	l_item.m_session = l_session;
+	l_item.m_last_access = ++g_session_access_counter;
+	while (g_sessions.size() > g_max_sessions)
+	{
+		auto l_oldest = g_sessions.begin();
+		for (auto j = g_sessions.begin(); j != g_sessions.end(); ++j)
+		{
+			if (j->second.m_last_access < l_oldest->second.m_last_access)
+			{
+				l_oldest = j;
+			}
+		}
+		SSL_SESSION_free(l_oldest->second.m_session);
+		g_sessions.erase(l_oldest);
+	}
+}
+
+void CryptoManager::removeSession(const string& p_key)
+{
+	CFlyFastLock(g_cs_sessions);
+	const auto i = g_sessions.find(p_key);
+	if (i != g_sessions.end())
+	{
+		SSL_SESSION_free(i->second.m_session);
+		g_sessions.erase(i);
+	}
+}
+
+void CryptoManager::clearSessions()
+{
+	CFlyFastLock(g_cs_sessions);
+	for (auto i = g_sessions.cbegin(); i != g_sessions.cend(); ++i)
+	{
+		SSL_SESSION_free(i->second.m_session);
+	}
+	g_sessions.clear();
+}
+
+void CryptoManager::addHandshake(bool p_is_server, bool p_is_resumed)
+{
+	SessionStats& l_stats = g_session_stats[p_is_server ? 1 : 0];
+	if (p_is_resumed)
+		++l_stats.m_resumed;
+	else
+		++l_stats.m_full;
+}
+
+string CryptoManager::getSessionStats()
+{
+	string l_result;
+	const char* l_names[] = { "client", "server" };
+	for (int i = 0; i < 2; ++i)
+	{
+		const uint32_t l_resumed = g_session_stats[i].m_resumed;
+		const uint32_t l_total = g_session_stats[i].m_full + l_resumed;
+		char l_buf[128];
+		_snprintf(l_buf, _countof(l_buf), "-=[ TLS %s handshakes: %u, resumed: %u (%u%%) ]=-\r\n",
+		          l_names[i], l_total, l_resumed, l_total ? l_resumed * 100 / l_total : 0);
+		l_result += l_buf;
+	}
+	return l_result;
+}
+
 void CryptoManager::decodeBZ2(const uint8_t* is, unsigned int sz, string& os)
 {
 	bz_stream bs = { 0 };
@@ -924,43 +835,6 @@ string CryptoManager::makeKey(const string& aLock)
 	return keySubst(&temp[0], aLock.length(), extra);
 }
 
-DH* CryptoManager::tmp_dh_cb(SSL* /*ssl*/, int /*is_export*/, int keylength)
-{
-	initTmpKeyMaps(); // [+] FlylinDC++
-	if (keylength < 2048)
-		return (DH*)g_tmpKeysMap[KEY_DH_2048];
-		
-	void* tmpDH = NULL;
-	switch (keylength)
-	{
-		case 2048:
-			tmpDH = g_tmpKeysMap[KEY_DH_2048];
-			break;
-		case 4096:
-			tmpDH = g_tmpKeysMap[KEY_DH_4096];
-			break;
-	}
-	
-	return (DH*)(tmpDH ? tmpDH : g_tmpKeysMap[KEY_DH_2048]);
-}
-
-RSA* CryptoManager::tmp_rsa_cb(SSL* /*ssl*/, int /*is_export*/, int keylength)
-{
-	initTmpKeyMaps(); // [+] FlylinDC++
-	if (keylength < 2048)
-		return (RSA*)g_tmpKeysMap[KEY_RSA_2048];
-		
-	void* tmpRSA = NULL;
-	switch (keylength)
-	{
-		case 2048:
-			tmpRSA = g_tmpKeysMap[KEY_RSA_2048];
-			break;
-	}
-	
-	return (RSA*)(tmpRSA ? tmpRSA : g_tmpKeysMap[KEY_RSA_2048]);
-}
-
 void CryptoManager::locking_function(int mode, int n, const char* /*file*/, int /*line*/)
 {
 	if (mode & CRYPTO_LOCK)
@@ -25,7 +25,10 @@
 
 #include "Exception.h"
 #include "Singleton.h"
+#include "CFlyThread.h"
 
+#include <atomic>
+#include <boost/unordered/unordered_map.hpp>
 #include <openssl/ssl.h>
 
 namespace ssl
@@ -96,15 +99,6 @@ class CryptoManager : public Singleton<CryptoManager>
 	public:
 		typedef pair<bool, string> SSLVerifyData;
 		
-		enum TLSTmpKeys
-		{
-			KEY_FIRST = 0,
-			KEY_DH_2048 = KEY_FIRST,
-			KEY_DH_4096,
-			KEY_RSA_2048,
-			KEY_LAST
-		};
-		
 		enum SSLContext
 		{
 			SSL_CLIENT,
@@ -137,9 +131,18 @@ class CryptoManager : public Singleton<CryptoManager>
 		
 		static bool TLSOk() noexcept;
 		
+		/**
+		 * Client side TLS session cache for the resumption (abbreviated handshake).
+		 * p_key - keyprint of the peer ("SHA256/...") if known, otherwise its address.
+		 */
+		static bool restoreSession(::SSL* p_ssl, const string& p_key);
+		static void storeSession(::SSL* p_ssl, const string& p_key);
+		static void removeSession(const string& p_key);
+		static void clearSessions();
+		static void addHandshake(bool p_is_server, bool p_is_resumed);
+		static string getSessionStats();
+		
 		static int verify_callback(int preverify_ok, X509_STORE_CTX *ctx);
-		static DH* tmp_dh_cb(SSL* /*ssl*/, int /*is_export*/, int keylength);
-		static RSA* tmp_rsa_cb(SSL* /*ssl*/, int /*is_export*/, int keylength);
 		static void locking_function(int mode, int n, const char *file, int line);
 		
 		static int idxVerifyData;
@@ -156,15 +159,28 @@ class CryptoManager : public Singleton<CryptoManager>
 		
 		void sslRandCheck();
 		
-		static int getKeyLength(TLSTmpKeys key);
-		static DH* getTmpDH(int keyLen);
-		static RSA* getTmpRSA(int keyLen);
-		
 		static bool certsLoaded;
 		
-		static void* g_tmpKeysMap[KEY_LAST];
-		static void initTmpKeyMaps();
-		static void freeTmpKeyMaps();
+		struct Session
+		{
+			Session() : m_session(nullptr), m_last_access(0)
+			{
+			}
+			SSL_SESSION* m_session;
+			uint64_t m_last_access;
+		};
+		typedef boost::unordered_map<string, Session> SessionMap;
+		static FastCriticalSection g_cs_sessions;
+		static SessionMap g_sessions;
+		static uint64_t g_session_access_counter;
+		
+		struct SessionStats
+		{
+			std::atomic<uint32_t> m_full;
+			std::atomic<uint32_t> m_resumed;
+		};
+		static SessionStats g_session_stats[2]; // client, server
+		
 		static CriticalSection* cs;
 		static char idxVerifyDataName[];
 		static SSLVerifyData trustedKeyprint;
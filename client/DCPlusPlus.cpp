@@ -193,6 +193,7 @@ void preparingCoreToShutdown() // [+] IRainamn fix.
 	{
 		g_is_first = true;
 		CFlyLog l_log("[Core shutdown]");
+		LogManager::message(CFlyLockProfiler::getReport(), true);
         ClientManager::shutdown();
         SearchManager::getInstance()->disconnect();
 		TimerManager::getInstance()->shutdown();
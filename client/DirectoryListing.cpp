@@ -28,6 +28,8 @@
 #include "SimpleXMLReader.h"
 #include "User.h"
 #include "ShareManager.h"
+#include "CFlyObjectPool.h"
+#include "CFlyThreadedInputStream.h"
 #include "../FlyFeatures/flyServer.h"
 
 #ifdef FLYLINKDC_USE_DIRLIST_FILE_EXT_STAT
@@ -44,6 +46,40 @@ DirectoryListing::~DirectoryListing()
 	delete root;
 }
 
+static CFlyObjectPool<DirectoryListing::File> g_file_pool;
+static CFlyObjectPool<DirectoryListing::Directory, 1024> g_directory_pool;
+
+void* DirectoryListing::File::operator new(size_t p_size)
+{
+	dcassert(p_size == sizeof(File));
+	return g_file_pool.allocate();
+}
+
+void DirectoryListing::File::operator delete(void* p_ptr, size_t p_size)
+{
+	dcassert(p_size == sizeof(File));
+	g_file_pool.deallocate(p_ptr);
+}
+
+void* DirectoryListing::Directory::operator new(size_t p_size)
+{
+	if (p_size != sizeof(Directory))
+	{
+		return ::operator new(p_size); // AdlDirectory
+	}
+	return g_directory_pool.allocate();
+}
+
+void DirectoryListing::Directory::operator delete(void* p_ptr, size_t p_size)
+{
+	if (p_size != sizeof(Directory))
+	{
+		::operator delete(p_ptr);
+		return;
+	}
+	g_directory_pool.deallocate(p_ptr);
+}
+
 UserPtr DirectoryListing::getUserFromFilename(const string& fileName)
 {
 	// General file list name format: [username].[CID].[xml|xml.bz2]
@@ -109,7 +145,16 @@ void DirectoryListing::loadFile(const string& p_file, bool p_own_list)
 		   )
 		{
 			FilteredInputStream<UnBZFilter, false> f(&ff);
-			loadXML(f, false, p_own_list);
+			if (ff.getSize() >= 256 * 1024)
+			{
+				// Decompress in a separate thread while the previous blocks are parsed
+				CFlyThreadedInputStream l_read_ahead(&f);
+				loadXML(l_read_ahead, false, p_own_list);
+			}
+			else
+			{
+				loadXML(f, false, p_own_list);
+			}
 		}
 		else if (stricmp(ext, ".xml") == 0)
 		{
@@ -126,7 +171,7 @@ class ListLoader : public SimpleXMLReader::CallBack
 			: m_list(aList), m_cur(root), m_base("/"), m_is_in_listing(false),
 			  m_is_updating(aUpdating), m_user(p_user), m_is_own_list(p_own_list),
 			  m_is_mediainfo_list(false), m_is_first_check_mediainfo_list(false),
-			  m_empty_file_name_counter(0)
+			  m_empty_file_name_counter(0), m_update_files_dir(nullptr)
 		{
 		}
 		
@@ -139,14 +184,20 @@ class ListLoader : public SimpleXMLReader::CallBack
 		{
 			return m_base;
 		}
+		/** Shared/queued/downloaded/virus status of the loaded files - called after the parse */
+		void checkFiles();
 		bool isMediainfoList() const
 		{
 			return m_is_first_check_mediainfo_list ? m_is_mediainfo_list : true;
 		}
 	private:
-#ifdef _DEBUG
-		static CFlyCacheMediaInfo g_cache_mediainfo;
-#endif
+		const std::shared_ptr<CFlyMediaInfo>& getMediaInfo(const string& p_WH, const string& p_br, const string& p_audio, const string& p_video);
+		
+		// Merge of the partial list into the loaded tree: hash indexes instead of the linear search
+		typedef boost::unordered_map<string, DirectoryListing::Directory*> DirIndex;
+		DirIndex& getUpdateDirIndex();
+		bool updateFile(const string& p_name, int64_t p_size, const TTHValue& p_tth);
+		
 		DirectoryListing* m_list;
 		DirectoryListing::Directory* m_cur;
 		UserPtr m_user;
@@ -159,14 +210,175 @@ class ListLoader : public SimpleXMLReader::CallBack
 		bool m_is_mediainfo_list;
 		bool m_is_first_check_mediainfo_list;
 		int m_empty_file_name_counter;
+		
+		// Same media info is shared by all files with the same attributes (it repeats a lot in the big lists)
+		boost::unordered_map<string, std::shared_ptr<CFlyMediaInfo> > m_media_cache;
+		string m_media_key;
+		
+		boost::unordered_map<const DirectoryListing::Directory*, DirIndex> m_update_dirs; // parent -> subdirectories by name
+		const DirectoryListing::Directory* m_update_files_dir; // files of the partial list go in a row - index of one directory is enough
+		boost::unordered_map<string, size_t> m_update_file_names;
+		boost::unordered_map<TTHValue, size_t> m_update_file_tths;
+		
+		std::vector<DirectoryListing::File*> m_check_files; // new files of the list for checkFiles
 };
 
-#ifdef _DEBUG
-CFlyCacheMediaInfo ListLoader::g_cache_mediainfo;
-#endif
+ListLoader::DirIndex& ListLoader::getUpdateDirIndex()
+{
+	const auto l_res = m_update_dirs.insert(std::make_pair(m_cur, DirIndex()));
+	if (l_res.second)
+	{
+		for (auto i = m_cur->directories.cbegin(); i != m_cur->directories.cend(); ++i)
+		{
+			l_res.first->second.insert(std::make_pair((*i)->getName(), *i));
+		}
+	}
+	return l_res.first->second;
+}
+
+bool ListLoader::updateFile(const string& p_name, int64_t p_size, const TTHValue& p_tth)
+{
+	if (m_update_files_dir != m_cur)
+	{
+		m_update_files_dir = m_cur;
+		m_update_file_names.clear();
+		m_update_file_tths.clear();
+		for (size_t i = 0; i < m_cur->m_files.size(); ++i)
+		{
+			m_update_file_names.insert(std::make_pair(m_cur->m_files[i]->getName(), i));
+			m_update_file_tths.insert(std::make_pair(m_cur->m_files[i]->getTTH(), i));
+		}
+	}
+	// The first file with the same name or TTH (as the old linear search did)
+	size_t l_pos = m_cur->m_files.size();
+	const auto l_by_name = m_update_file_names.find(p_name);
+	if (l_by_name != m_update_file_names.end())
+	{
+		l_pos = l_by_name->second;
+	}
+	const auto l_by_tth = m_update_file_tths.find(p_tth);
+	if (l_by_tth != m_update_file_tths.end())
+	{
+		l_pos = std::min(l_pos, l_by_tth->second);
+	}
+	if (l_pos == m_cur->m_files.size())
+	{
+		return false;
+	}
+	auto& file = *m_cur->m_files[l_pos];
+	if (file.getName() != p_name)
+	{
+		const auto i = m_update_file_names.find(file.getName());
+		if (i != m_update_file_names.end() && i->second == l_pos)
+		{
+			m_update_file_names.erase(i);
+		}
+		m_update_file_names.insert(std::make_pair(p_name, l_pos));
+		file.setName(p_name);
+	}
+	if (file.getTTH() != p_tth)
+	{
+		const auto i = m_update_file_tths.find(file.getTTH());
+		if (i != m_update_file_tths.end() && i->second == l_pos)
+		{
+			m_update_file_tths.erase(i);
+		}
+		m_update_file_tths.insert(std::make_pair(p_tth, l_pos));
+		file.setTTH(p_tth);
+	}
+	file.setSize(p_size);
+	return true;
+}
+
+const std::shared_ptr<CFlyMediaInfo>& ListLoader::getMediaInfo(const string& p_WH, const string& p_br, const string& p_audio, const string& p_video)
+{
+	m_media_key.clear();
+	m_media_key.append(p_WH).append(1, '\n').append(p_br).append(1, '\n').append(p_audio).append(1, '\n').append(p_video);
+	auto& l_media = m_media_cache[m_media_key];
+	if (!l_media)
+	{
+		l_media = std::make_shared<CFlyMediaInfo>(p_WH, atoi(p_br.c_str()), p_audio, p_video);
+	}
+	return l_media;
+}
+
+void ListLoader::checkFiles()
+{
+	if (m_check_files.empty())
+		return;
+	// Sorted by TTH: each TTH is looked up once and the stores are walked in the key order
+	std::sort(m_check_files.begin(), m_check_files.end(), [](const DirectoryListing::File * a, const DirectoryListing::File * b)
+	{
+		return a->getTTH() < b->getTTH();
+	});
+	std::vector<TTHValue> l_tths;
+	l_tths.reserve(m_check_files.size());
+	for (auto i = m_check_files.cbegin(); i != m_check_files.cend(); ++i)
+	{
+		if (l_tths.empty() || l_tths.back() != (*i)->getTTH())
+		{
+			l_tths.push_back((*i)->getTTH());
+		}
+	}
+	std::vector<bool> l_shared;
+	ShareManager::isTTHShared(l_tths, l_shared);
+	
+	// The queue and the database are asked only about the files that are not shared
+	std::vector<TTHValue> l_not_shared_tths;
+	for (size_t i = 0; i < l_tths.size(); ++i)
+	{
+		if (!l_shared[i])
+		{
+			l_not_shared_tths.push_back(l_tths[i]);
+		}
+	}
+	std::vector<bool> l_queue;
+	QueueManager::is_queue_tth(l_not_shared_tths, l_queue);
+	std::vector<CFlylinkDBManager::FileStatus> l_status;
+	CFlylinkDBManager::getInstance()->get_status_files(l_not_shared_tths, l_status);
+	
+	size_t l_tth_index = 0;
+	size_t l_not_shared_index = 0;
+	for (auto i = m_check_files.cbegin(); i != m_check_files.cend(); ++i)
+	{
+		DirectoryListing::File* f = *i;
+		if (l_tths[l_tth_index] != f->getTTH())
+		{
+			if (!l_shared[l_tth_index])
+			{
+				++l_not_shared_index;
+			}
+			++l_tth_index;
+		}
+		dcassert(l_tths[l_tth_index] == f->getTTH());
+		if (l_shared[l_tth_index])
+		{
+			f->setFlag(DirectoryListing::FLAG_SHARED);
+			continue;
+		}
+		if (l_queue[l_not_shared_index])
+		{
+			f->setFlag(DirectoryListing::FLAG_QUEUE);
+		}
+		// TODO if(l_size >= 100 * 1024 *1024)
+		if (!CFlyServerConfig::isParasitFile(f->getName())) // TODO -   
+		{
+			f->setFlag(DirectoryListing::FLAG_NOT_SHARED);
+			const auto l_status_file = l_status[l_not_shared_index];
+			if (l_status_file & CFlylinkDBManager::PREVIOUSLY_DOWNLOADED)
+				f->setFlag(DirectoryListing::FLAG_DOWNLOAD);
+			if (l_status_file & CFlylinkDBManager::VIRUS_FILE_KNOWN)
+				f->setFlag(DirectoryListing::FLAG_VIRUS_FILE);
+			if (l_status_file & CFlylinkDBManager::PREVIOUSLY_BEEN_IN_SHARE)
+				f->setFlag(DirectoryListing::FLAG_OLD_TTH);
+		}
+	}
+	m_check_files.clear();
+}
 
 string DirectoryListing::updateXML(const string& xml, bool p_own_list)
 {
+	m_file.clear(); // the tree is not the same as the list file anymore
 	MemoryInputStream mis(xml);
 	return loadXML(mis, true, p_own_list);
 }
@@ -196,6 +408,7 @@ string DirectoryListing::loadXML(InputStream& is, bool updating, bool p_is_own_l
 	//l_log.step("start parse");
 	SimpleXMLReader(&ll).parse(is);
 	l_log.step("Stop parse file:" + m_file);
+	ll.checkFiles();
 	m_is_mediainfo = ll.isMediainfoList();
 	m_is_own_list = p_is_own_list;
 	return ll.getBase();
@@ -291,17 +504,9 @@ void ListLoader::startTag(const string& name, StringPairList& attribs, bool simp
 			if (m_is_updating)
 			{
 				// just update the current file if it is already there.
-				for (auto i = m_cur->m_files.cbegin(); i != m_cur->m_files.cend(); ++i)
+				if (updateFile(l_name, l_size, l_tth))
 				{
-					auto& file = **i;
-					/// @todo comparisons should be case-insensitive but it takes too long - add a cache
-					if (file.getName() == l_name || file.getTTH() == l_tth)
-					{
-						file.setName(l_name);
-						file.setSize(l_size);
-						file.setTTH(l_tth);
-						return;
-					}
+					return;
 				}
 			}
 			// [+] FlylinkDC
@@ -323,7 +528,7 @@ void ListLoader::startTag(const string& name, StringPairList& attribs, bool simp
 				if (attribs.size() == 4 ||
 				        attribs.size() >= 11)  //     http://p2p.toom.su/fs/hms/FCYECUWQ7F5A2FABW32UTMCT6MEMI3GPXBZDQCQ/)
 				{
-					const string l_sharedGL = getAttrib(attribs, g_SShared, 4);
+					const string& l_sharedGL = getAttrib(attribs, g_SShared, 4);
 					if (!l_sharedGL.empty())
 					{
 						const int64_t tmp_ts = _atoi64(l_sharedGL.c_str()) - 116444736000000000L ;
@@ -359,56 +564,20 @@ void ListLoader::startTag(const string& name, StringPairList& attribs, bool simp
 						const std::string& l_video = getAttrib(attribs, g_SMVideo, 3);
 						if (!l_audio.empty() || !l_video.empty())
 						{
-							const string& l_br = getAttrib(attribs, g_SBR, 4);
-							l_mediaXY = std::make_shared<CFlyMediaInfo>(getAttrib(attribs, g_SWH, 3),
-							                                            atoi(l_br.c_str()),
-							                                            l_audio,
-							                                            l_video
-							                                           );
+							l_mediaXY = getMediaInfo(getAttrib(attribs, g_SWH, 3), getAttrib(attribs, g_SBR, 4), l_audio, l_video);
 						}
 					}
-					
-#if 0
-					if (attribs.size() > 4) // TODO -    
-					{
-						CFlyMediainfoRAW l_media_item;
-						{
-							l_media_item.m_audio = getAttrib(attribs, g_SMAudio, 3);
-							const size_t l_pos = l_media_item.m_audio.find('|', 0);
-							if (l_pos != string::npos && l_pos)
-							{
-								if (l_pos + 2 < l_media_item.m_audio.length())
-								{
-									l_media_item.m_audio = l_media_item.m_audio.substr(l_pos + 2);
-								}
-							}
-						}
-						
-						l_media_item.m_video = getAttrib(attribs, g_SMVideo, 3);
-						l_hit = getAttrib(attribs, g_SHit, 3);
-						l_media_item.m_WH = getAttrib(attribs, g_SWH, 3);
-						if (!l_media_item.m_audio.empty() || !l_media_item.m_video.empty())
-						{
-							l_media_item.m_br = getAttrib(attribs, g_SBR, 4);
-							auto& l_find_mi = g_cache_mediainfo[l_media_item];
-							if (!l_find_mi)
-							{
-							
-								l_find_mi = std::make_shared<CFlyMediaInfo>(l_media_item.m_WH,
-								                                            atoi(l_media_item.m_br.c_str()),
-								                                            l_media_item.m_audio,
-								                                            l_media_item.m_video
-								                                           );
-								l_mediaXY = l_find_mi;
-							}
-						}
-					}
-#endif
 				}
 				l_i_hit = l_hit.empty() ? 0 : atoi(l_hit.c_str());
 			}
 			auto f = new DirectoryListing::File(m_cur, l_name, l_size, l_tth, l_i_hit, l_i_ts, l_mediaXY);
 			m_cur->m_virus_detect.add(l_name, l_size);
+			if (m_is_updating)
+			{
+				const size_t l_pos = m_cur->m_files.size();
+				m_update_file_names.insert(std::make_pair(l_name, l_pos));
+				m_update_file_tths.insert(std::make_pair(l_tth, l_pos));
+			}
 			m_cur->m_files.push_back(f);
 			if (l_size)
 			{
@@ -418,31 +587,7 @@ void ListLoader::startTag(const string& name, StringPairList& attribs, bool simp
 				}
 				else
 				{
-					if (ShareManager::isTTHShared(f->getTTH()))
-					{
-						f->setFlag(DirectoryListing::FLAG_SHARED);
-					}
-					else
-					{
-						if (QueueManager::is_queue_tth(f->getTTH()))
-						{
-							f->setFlag(DirectoryListing::FLAG_QUEUE);
-						}
-						// TODO if(l_size >= 100 * 1024 *1024)
-						{
-							if (!CFlyServerConfig::isParasitFile(f->getName())) // TODO -   
-							{
-								f->setFlag(DirectoryListing::FLAG_NOT_SHARED);
-								const auto l_status_file = CFlylinkDBManager::getInstance()->get_status_file(f->getTTH()); // TODO -    ?
-								if (l_status_file & CFlylinkDBManager::PREVIOUSLY_DOWNLOADED)
-									f->setFlag(DirectoryListing::FLAG_DOWNLOAD);
-								if (l_status_file & CFlylinkDBManager::VIRUS_FILE_KNOWN)
-									f->setFlag(DirectoryListing::FLAG_VIRUS_FILE);
-								if (l_status_file & CFlylinkDBManager::PREVIOUSLY_BEEN_IN_SHARE)
-									f->setFlag(DirectoryListing::FLAG_OLD_TTH);
-							}
-						}
-					}
+					m_check_files.push_back(f);
 				}//[+] FlylinkDC++
 			}
 		}
@@ -458,23 +603,25 @@ void ListLoader::startTag(const string& name, StringPairList& attribs, bool simp
 			DirectoryListing::Directory* d = nullptr;
 			if (m_is_updating)
 			{
-				for (auto i  = m_cur->directories.cbegin(); i != m_cur->directories.cend(); ++i)
+				/// @todo comparisons should be case-insensitive
+				auto& l_sub_dirs = getUpdateDirIndex();
+				const auto i = l_sub_dirs.find(l_file_name);
+				if (i != l_sub_dirs.end())
 				{
-					/// @todo comparisons should be case-insensitive but it takes too long - add a cache
-					if ((*i)->getName() == l_file_name)
+					d = i->second;
+					if (!d->getComplete())
 					{
-						d = *i;
-						if (!d->getComplete())
-						{
-							d->setComplete(!incomp);
-						}
-						break;
+						d->setComplete(!incomp);
 					}
 				}
 			}
 			if (d == nullptr)
 			{
 				d = new DirectoryListing::Directory(m_list, m_cur, l_file_name, false, !incomp, isMediainfoList());
+				if (m_is_updating)
+				{
+					getUpdateDirIndex().insert(std::make_pair(l_file_name, d));
+				}
 				m_cur->directories.push_back(d);
 			}
 			m_cur = d;
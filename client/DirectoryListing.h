@@ -77,6 +77,9 @@ class DirectoryListing : public UserInfoBase
 				~File()
 				{
 				}
+				// Nodes of the huge file lists are taken from the arena (see CFlyObjectPool)
+				static void* operator new(size_t p_size);
+				static void operator delete(void* p_ptr, size_t p_size);
 				
 				GETSET(string, name, Name);
 				GETSET(int64_t, size, Size);
@@ -138,6 +141,8 @@ class DirectoryListing : public UserInfoBase
 				}
 				
 				virtual ~Directory();
+				static void* operator new(size_t p_size);
+				static void operator delete(void* p_ptr, size_t p_size);
 				
 				size_t   getTotalFileCount(bool adls = false) const;
 				size_t   getTotalFolderCount() const;
@@ -239,7 +244,12 @@ class DirectoryListing : public UserInfoBase
 		GETSET(HintedUser, hintedUser, HintedUser);
 		GETSET(bool, abort, Abort);
 		GETSET(bool, includeSelf, IncludeSelf);
-		void logMatchedFiles(const UserPtr& p_user, int p_count); //[+]PPA
+		static void logMatchedFiles(const UserPtr& p_user, int p_count); //[+]PPA
+		/** List file the tree was loaded from (empty for partial lists) */
+		const string& getFileName() const
+		{
+			return m_file;
+		}
 	private:
 		friend class ListLoader;
 		friend class DirectoryListingFrame;
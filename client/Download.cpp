@@ -22,12 +22,14 @@
 #include "UserConnection.h"
 #include "QueueItem.h"
 #include "HashManager.h"
+#include "MerkleCheckOutputStream.h"
 
 // [!] IRainman fix.
 Download::Download(UserConnection* p_conn, const QueueItemPtr& p_item, const string& p_ip, const string& p_chiper_name) noexcept :
 	Transfer(p_conn, p_item->getTarget(), p_item->getTTH(), p_ip, p_chiper_name),
 	m_qi(p_item),
 	m_download_file(nullptr),
+	m_tth_check(nullptr),
 	treeValid(false)
 #ifdef FLYLINKDC_USE_DROP_SLOW
 	, m_lastNormalSpeed(0)
@@ -127,6 +129,14 @@ Download::~Download()
 	//////////getUserConnection()->setDownload(nullptr);
 }
 
+int64_t Download::getVerifiedPos()
+{
+	if (!m_tth_check)
+		return -1;
+	m_tth_check->waitPending();
+	return m_tth_check->verifiedBytes();
+}
+
 void Download::getCommand(AdcCommand& cmd, bool zlib) const
 {
 	cmd.addParam(Transfer::g_type_names[getType()]);
@@ -13,6 +13,7 @@
  * Use it to retrieve information about the ongoing transfer.
  */
 class AdcCommand;
+template<class TreeType, bool managed> class MerkleCheckOutputStream;
 class Download : public Transfer, public Flags
 {
 	public:
@@ -86,11 +87,21 @@ class Download : public Transfer, public Flags
 		GETSET(bool, treeValid, TreeValid);
 		void reset_download_file()
 		{
+			m_tth_check = nullptr;
 			safe_delete(m_download_file);
 		}
+		typedef MerkleCheckOutputStream<TigerTree, true> TTHCheckStream;
+		/** The stream is owned by the download file chain */
+		void setTTHCheck(TTHCheckStream* p_check)
+		{
+			m_tth_check = p_check;
+		}
+		/** End of the data checked by TTH (the pending checks are done first), -1 - the download is not checked */
+		int64_t getVerifiedPos();
 		string     m_reason;
 	private:
 		OutputStream* m_download_file;
+		TTHCheckStream* m_tth_check;
 		const QueueItemPtr m_qi;
 		TigerTree  m_tiger_tree;
 		string     m_pfs;
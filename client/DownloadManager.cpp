@@ -25,6 +25,8 @@
 #include "Download.h"
 #include "HashManager.h"
 #include "MerkleCheckOutputStream.h"
+#include "CFlyTaskPool.h"
+#include "CompatibilityManager.h"
 #include "UploadManager.h"
 #include "FinishedManager.h"
 #include "PGLoader.h"
@@ -48,9 +50,24 @@ DownloadList DownloadManager::g_download_map;
 UserConnectionList DownloadManager::g_idlers;
 int64_t DownloadManager::g_runningAverage;
 
+// TTH check of the received data (hashing is not done by the connection thread)
+static CFlyTaskPool g_tth_check_pool;
+
+// Pipelining (UserConnection::FLAG_SUPPORTS_PIPELINE): the next requests are sent while the current
+// transfer is running. Only for small transfers - a big one hides the round trip anyway.
+static const size_t g_max_pipelined_requests = 2;
+static const int64_t g_max_pipelined_size = 1024 * 1024;
+
+static bool isPipelinedSize(const DownloadPtr& d)
+{
+	return d->getSize() >= 0 && d->getSize() <= g_max_pipelined_size;
+}
+
 DownloadManager::DownloadManager()
 {
 	TimerManager::getInstance()->addListener(this);
+	const unsigned l_count_procs = unsigned(CompatibilityManager::getProcessorsCount());
+	g_tth_check_pool.start(std::max(1u, std::min(4u, l_count_procs / 2)), "TTHCheck");
 }
 
 static int g_outstanding_resume_data;
@@ -186,6 +203,7 @@ DownloadManager::~DownloadManager()
 		// TODO -         ?
 		//      
 	}
+	g_tth_check_pool.stop();
 }
 
 size_t DownloadManager::getDownloadCount()
@@ -400,6 +418,18 @@ void DownloadManager::checkDownloads(UserConnection* aConn)
 	}
 	///////////////// dcassert(aConn->getDownload() == nullptr);
 	
+	auto& l_pipeline = aConn->getPipelinedDownloads();
+	if (!l_pipeline.empty())
+	{
+		// The next download is requested already (and counted in g_download_map) - wait for its SND
+		const auto d = l_pipeline.front();
+		l_pipeline.pop_front();
+		aConn->setDownload(d);
+		aConn->setState(UserConnection::STATE_SND);
+		fly_fire1(DownloadManagerListener::Requesting(), d);
+		return;
+	}
+	
 	auto qm = QueueManager::getInstance();
 	
 	const QueueItem::Priority prio = QueueManager::hasDownload(aConn->getUser());
@@ -432,24 +462,62 @@ void DownloadManager::checkDownloads(UserConnection* aConn)
 	
 	aConn->setState(UserConnection::STATE_SND);
 	
-	if (aConn->isSet(UserConnection::FLAG_SUPPORTS_XML_BZLIST) && d->getType() == Transfer::TYPE_FULL_LIST)
-	{
-		d->setFlag(Download::FLAG_XML_BZ_LIST);
-	}
-	
 	{
 		CFlyWriteLock(*g_csDownload);
 		dcassert(d->getUser());
 		g_download_map.push_back(d);
 	}
+	sendRequest(aConn, d);
 	fly_fire1(DownloadManagerListener::Requesting(), d);
+}
+
+void DownloadManager::sendRequest(UserConnection* aConn, const DownloadPtr& d)
+{
+	if (aConn->isSet(UserConnection::FLAG_SUPPORTS_XML_BZLIST) && d->getType() == Transfer::TYPE_FULL_LIST)
+	{
+		d->setFlag(Download::FLAG_XML_BZ_LIST);
+	}
+	// The length of the compressed data is unknown, so it can't be followed by a pipelined response
+	const bool l_is_zlib = aConn->isSet(UserConnection::FLAG_SUPPORTS_ZLIB_GET) &&
+	                       !(aConn->isSet(UserConnection::FLAG_SUPPORTS_PIPELINE) && isPipelinedSize(d));
 	
 	dcdebug("Requesting " I64_FMT "/" I64_FMT "\n", d->getStartPos(), d->getSize());
 	AdcCommand cmd(AdcCommand::CMD_GET);
-	d->getCommand(cmd, aConn->isSet(UserConnection::FLAG_SUPPORTS_ZLIB_GET));
+	d->getCommand(cmd, l_is_zlib);
 	aConn->send(cmd);
 }
 
+void DownloadManager::requestPipelined(UserConnection* aConn)
+{
+	auto& l_pipeline = aConn->getPipelinedDownloads();
+	const DownloadPtr l_current = aConn->getDownload();
+	while (l_pipeline.size() < g_max_pipelined_requests)
+	{
+		if (!isPipelinedSize(l_pipeline.empty() ? l_current : l_pipeline.back()))
+		{
+			break; // A big (maybe compressed) transfer is ahead
+		}
+		if (!isStartDownload(QueueManager::hasDownload(aConn->getUser())))
+		{
+			break;
+		}
+		std::string l_error;
+		const auto d = QueueManager::getInstance()->getDownload(aConn, l_error);
+		aConn->setDownload(l_current); // getDownload makes the new one current
+		if (!d)
+		{
+			break;
+		}
+		{
+			// Takes a download slot right away - isStartDownload counts it
+			CFlyWriteLock(*g_csDownload);
+			g_download_map.push_back(d);
+		}
+		l_pipeline.push_back(d);
+		sendRequest(aConn, d);
+	}
+}
+
 void DownloadManager::on(AdcCommand::SND, UserConnection* aSource, const AdcCommand& cmd) noexcept
 {
 	dcassert(!ClientManager::isBeforeShutdown());
@@ -552,9 +620,9 @@ void DownloadManager::startData(UserConnection* aSource, int64_t start, int64_t
 	
 	if (d->getType() == Transfer::TYPE_FILE)
 	{
-		typedef MerkleCheckOutputStream<TigerTree, true> MerkleStream;
-		
-		d->setDownloadFile(new MerkleStream(d->getTigerTree(), d->getDownloadFile(), d->getStartPos()));
+		const auto l_check = new Download::TTHCheckStream(d->getTigerTree(), d->getDownloadFile(), d->getStartPos(), &g_tth_check_pool);
+		d->setDownloadFile(l_check);
+		d->setTTHCheck(l_check);
 		d->setFlag(Download::FLAG_TTH_CHECK);
 	}
 	
@@ -586,6 +654,12 @@ void DownloadManager::startData(UserConnection* aSource, int64_t start, int64_t
 			failDownload(aSource, e.getError());
 		}
 	}
+	else if (!z && aSource->isSet(UserConnection::FLAG_SUPPORTS_PIPELINE))
+	{
+		// Exact length - the SND of the pipelined request follows the data
+		aSource->setDataMode(bytes);
+		requestPipelined(aSource);
+	}
 	else
 	{
 		aSource->setDataMode();
@@ -600,6 +674,7 @@ void DownloadManager::fireData(UserConnection* aSource, const uint8_t* aData, si
 	try
 	{
 		d->addPos(d->getDownloadFile()->write(aData, aLen), aLen);
+		CFlyMetrics::inc(CFlyMetrics::DOWNLOAD_BYTES, aLen);
 		d->tick(aSource->getLastActivity(true));
 		
 		if (d->getDownloadFile()->eof())
@@ -797,6 +872,15 @@ void DownloadManager::removeConnection(UserConnection* p_conn, bool p_is_remove_
 {
 	// dcassert(!ClientManager::isBeforeShutdown());
 	///////////// dcassert(p_conn->getDownload() == nullptr);
+	auto& l_pipeline = p_conn->getPipelinedDownloads();
+	while (!l_pipeline.empty())
+	{
+		// Requested but not started - back to the queue
+		const auto d = l_pipeline.front();
+		l_pipeline.pop_front();
+		removeDownload(d);
+		QueueManager::getInstance()->putDownload(d->getPath(), d, false);
+	}
 	if (p_is_remove_listener)
 	{
 		p_conn->removeListener(this);
@@ -118,6 +118,8 @@ class DownloadManager : public Speaker<DownloadManagerListener>,
 		~DownloadManager();
 		
 		void checkDownloads(UserConnection* aConn);
+		static void sendRequest(UserConnection* aConn, const DownloadPtr& d);
+		void requestPipelined(UserConnection* aConn);
 		void startData(UserConnection* aSource, int64_t start, int64_t newSize, bool z);
 		void endData(UserConnection* aSource);
 		
@@ -1897,9 +1897,20 @@ UserCommand::List FavoriteManager::getUserCommands(int ctx, const StringList& hu
 	return lst;
 }
 
-void FavoriteManager::on(UserUpdated, const OnlineUserPtr& user) noexcept
+void FavoriteManager::on(UsersUpdated, const OnlineUserList& p_list) noexcept
 {
-	userUpdated(*user);
+	if (!ClientManager::isBeforeShutdown() && isNotEmpty())
+	{
+		CFlyReadLock(*g_csFavUsers); // once for the batch
+		for (auto i = p_list.cbegin(); i != p_list.cend(); ++i)
+		{
+			auto j = g_fav_users_map.find((*i)->getUser()->getCID());
+			if (j != g_fav_users_map.end())
+			{
+				j->second.update(**i);
+			}
+		}
+	}
 }
 
 void FavoriteManager::on(UserDisconnected, const UserPtr& aUser) noexcept
@@ -425,7 +425,7 @@ class FavoriteManager : private Speaker<FavoriteManagerListener>,
 		static RecentHubEntry::Iter getRecentHub(const string& aServer);
 		
 		// ClientManagerListener
-		void on(UserUpdated, const OnlineUserPtr& user) noexcept override;
+		void on(UsersUpdated, const OnlineUserList& p_list) noexcept override;
 		void on(UserConnected, const UserPtr& user) noexcept override;
 		void on(UserDisconnected, const UserPtr& user) noexcept override;
 		
@@ -47,7 +47,17 @@ void HashBloom::add(const TTHValue& tth)
 {
 	for (size_t i = 0; i < k; ++i)
 	{
-		bloom[pos(tth, i)] = true;
+		bloom[pos(tth, i, bloom.size(), h)] = true;
+	}
+}
+
+void HashBloom::add(ByteVector& p_bytes, const TTHValue& tth, size_t k, size_t m, size_t h)
+{
+	dcassert(p_bytes.size() * 8 == m);
+	for (size_t i = 0; i < k; ++i)
+	{
+		const size_t l_pos = pos(tth, i, m, h);
+		p_bytes[l_pos / 8] |= uint8_t(1 << (l_pos % 8));
 	}
 }
 
@@ -59,7 +69,7 @@ bool HashBloom::match(const TTHValue& tth) const
 	}
 	for (size_t i = 0; i < k; ++i)
 	{
-		if (!bloom[pos(tth, i)])
+		if (!bloom[pos(tth, i, bloom.size(), h)])
 		{
 			return false;
 		}
@@ -79,7 +89,7 @@ void HashBloom::reset(size_t k_, size_t m, size_t h_)
 	h = h_;
 }
 
-size_t HashBloom::pos(const TTHValue& tth, size_t n) const
+size_t HashBloom::pos(const TTHValue& tth, size_t n, size_t m, size_t h)
 {
 	if ((n + 1)*h > TTHValue::BITS)
 	{
@@ -100,7 +110,7 @@ size_t HashBloom::pos(const TTHValue& tth, size_t n) const
 			x |= (1i64 << i);
 		}
 	}
-	return x % bloom.size();
+	return x % m;
 }
 
 void HashBloom::copy_to(ByteVector& v) const
@@ -51,9 +51,12 @@ class HashBloom
 		void push_back(bool v);
 		
 		void copy_to(ByteVector& v) const;
+		
+		/** Sets the bits of tth right in the bytes of copy_to (m bits, m % 8 == 0) */
+		static void add(ByteVector& p_bytes, const TTHValue& tth, size_t k, size_t m, size_t h);
 	private:
 	
-		size_t pos(const TTHValue& tth, size_t n) const;
+		static size_t pos(const TTHValue& tth, size_t n, size_t m, size_t h);
 		
 		std::vector<bool> bloom;
 		size_t k;
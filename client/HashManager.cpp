@@ -233,6 +233,7 @@ void HashManager::hashDone(__int64 p_path_id, const string& aFileName, int64_t a
 		LogManager::message("HashManager::hashDone - aFileName.empty()");
 		return;
 	}
+	CFlyMetrics::inc(CFlyMetrics::HASH_FILES);
 	CFlyMediaInfo l_out_media;
 	try
 	{
@@ -282,8 +283,9 @@ void HashManager::addFile(__int64 p_path_id, const string& p_file_name, int64_t
 {
 	// dcassert(p_path_id);
 	p_out_media.init(); // TODO -   
-	getMediaInfo(p_file_name, p_out_media, p_size, p_tth.getRoot());
 	CFlylinkDBManager::getInstance()->add_file(p_path_id, p_file_name, p_time_stamp, p_tth, p_size, p_out_media);
+	// Media info is read by the pool after hashing and then written to the base and the share
+	m_media_pool.add(p_path_id, p_file_name, p_size, p_tth.getRoot());
 }
 
 void HashManager::Hasher::hashFile(__int64 p_path_id, const string& fileName, int64_t size)
@@ -537,6 +539,7 @@ bool HashManager::Hasher::fastHash(const string& fname, uint8_t* buf, unsigned p
 		}
 		
 		tth.update(hbuf, hn);
+		CFlyMetrics::inc(CFlyMetrics::HASH_BYTES, hn);
 		
 		{
 			CFlyFastLock(cs);
@@ -747,6 +750,7 @@ int HashManager::Hasher::run()
 								if (n > 0)
 								{
 									tth->update(l_buf, n);
+									CFlyMetrics::inc(CFlyMetrics::HASH_BYTES, n);
 									{
 										CFlyFastLock(cs);
 										m_currentSize = max(static_cast<uint64_t>(m_currentSize - n), static_cast<uint64_t>(0)); // TODO - max  0  ?
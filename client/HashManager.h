@@ -25,7 +25,7 @@
 #include "Semaphore.h"
 #include "TimerManager.h"
 #include "Streams.h"
-#include "CFlyMediaInfo.h"
+#include "CFlyMediaInfoPool.h"
 
 #ifdef RIP_USE_STREAM_SUPPORT_DETECTION
 #include "FsUtils.h"
@@ -68,6 +68,7 @@ class HashManager : public Singleton<HashManager>, public Speaker<HashManagerLis
 		{
 			TimerManager::getInstance()->removeListener(this);
 			hasher.join();
+			m_media_pool.shutdown();
 		}
 		
 		void hashFile(__int64 p_path_id, const string& fileName, int64_t aSize)
@@ -114,6 +115,7 @@ class HashManager : public Singleton<HashManager>, public Speaker<HashManagerLis
 		void startup()
 		{
 			hasher.start(0, "HashManager");
+			m_media_pool.startup();
 		}
 		
 		void shutdown()
@@ -126,6 +128,7 @@ class HashManager : public Singleton<HashManager>, public Speaker<HashManagerLis
 			//CFlyLock(cs); //[!]IRainman
 			hasher.shutdown();
 			hasher.join();
+			m_media_pool.shutdown();
 		}
 		
 		struct HashPauser
@@ -408,6 +411,7 @@ class HashManager : public Singleton<HashManager>, public Speaker<HashManagerLis
 #endif
 		
 		Hasher hasher;
+		CFlyMediaInfoPool m_media_pool;
 		
 		void hashDone(__int64 p_path_id, const string& aFileName, int64_t aTimeStamp, const TigerTree& tth, int64_t speed,
 		              bool p_is_ntfs,
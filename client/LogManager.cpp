@@ -23,6 +23,7 @@
 #include "CompatibilityManager.h"
 #include "TimerManager.h"
 #include "ClientManager.h"
+#include "File.h"
 
 #ifdef _DEBUG
 boost::unordered_map<string, pair<string, size_t> > LogManager::g_pathCache;
@@ -33,15 +34,122 @@ boost::unordered_map<string, string> LogManager::g_pathCache;
 #endif
 bool LogManager::g_isInit = false;
 int LogManager::g_logOptions[LAST][2];
-FastCriticalSection LogManager::g_csPathCache;
-std::map<std::string, FastCriticalSection> LogManager::g_csFile;
-FastCriticalSection LogManager::g_csFileArea;
-CFlyMessagesBuffer LogManager::g_LogFilesBuffer;
-FastCriticalSection LogManager::g_csLogFilesBuffer;
+LogManager::LogTemplatePtr LogManager::g_templates[LAST][2];
+std::atomic<LogManager::LogRecord*> LogManager::g_queue(nullptr);
+std::atomic<size_t> LogManager::g_queue_bytes(0);
+std::atomic<size_t> LogManager::g_dropped(0);
+boost::unordered_map<string, LogManager::LogFile> LogManager::g_files;
+CriticalSection LogManager::g_csFlush;
 HWND LogManager::g_mainWnd = nullptr;
 int  LogManager::g_LogMessageID = 0;
 bool LogManager::g_isLogSpeakerEnabled = false;
 
+static const size_t g_max_queue_bytes = 16 * 1024 * 1024; // more - trace messages are dropped
+static const int64_t g_max_trace_file_size = 64 * 1024 * 1024; // more - the trace log is renamed to .old
+static const uint64_t g_idle_file_timeout = 60 * 1000;
+static const size_t g_max_open_files = 16;
+
+class LogManager::LogTemplate
+{
+	public:
+		/** The same steps as Util::formatParams: escape of the unknown % codes, strftime, %[param] */
+		explicit LogTemplate(const string& p_source) : m_source(p_source)
+		{
+			static const string g_goodchars = "aAbBcdHIjmMpSUwWxXyYzZ%";
+			string l_text = p_source;
+			bool l_is_format = false;
+			string::size_type c = 0;
+			while ((c = l_text.find('%', c)) != string::npos)
+			{
+				l_is_format = true;
+				if (c < l_text.length() - 1)
+				{
+					if (g_goodchars.find(l_text[c + 1]) == string::npos)
+					{
+						l_text.replace(c, 1, "%%");
+						c++;
+					}
+					c++;
+				}
+				else
+				{
+					l_text.replace(c, 1, "%%");
+					break;
+				}
+			}
+			if (!l_is_format)
+			{
+				addSegment(l_text, Util::emptyString, false);
+				return;
+			}
+			// "%[" was escaped to "%%[" - strftime makes it "%[" again
+			string::size_type i = 0;
+			string::size_type j;
+			while ((j = l_text.find("%%[", i)) != string::npos)
+			{
+				const string::size_type k = l_text.find(']', j + 3);
+				if (k == string::npos)
+				{
+					l_text.erase(j, 3);
+					break;
+				}
+				addSegment(l_text.substr(i, j - i), l_text.substr(j + 3, k - j - 3), true);
+				i = k + 1;
+			}
+			addSegment(l_text.substr(i), Util::emptyString, true);
+		}
+		/** p_get_param(name) - const string* of the value or nullptr */
+		template<class GetParam> string format(const time_t p_t, const GetParam& p_get_param) const
+		{
+			string l_result;
+			for (auto i = m_segments.cbegin(); i != m_segments.cend(); ++i)
+			{
+				if (i->m_is_time)
+				{
+					l_result += Util::formatTime(i->m_text, p_t);
+				}
+				else
+				{
+					l_result += i->m_text;
+				}
+				if (!i->m_param.empty())
+				{
+					if (const string* l_value = p_get_param(i->m_param))
+					{
+						l_result += *l_value;
+					}
+				}
+			}
+			return l_result;
+		}
+		const string m_source;
+	private:
+		struct Segment
+		{
+			string m_text;
+			string m_param;
+			bool m_is_time;
+		};
+		void addSegment(const string& p_text, const string& p_param, bool p_is_format)
+		{
+			const Segment l_segment = { p_text, p_param, p_is_format && p_text.find('%') != string::npos };
+			m_segments.push_back(l_segment);
+		}
+		std::vector<Segment> m_segments;
+};
+
+LogManager::LogTemplatePtr LogManager::getTemplate(LogArea area, int sel)
+{
+	const string& l_source = getSetting(area, sel);
+	auto l_template = std::atomic_load(&g_templates[area][sel]);
+	if (!l_template || l_template->m_source != l_source)
+	{
+		l_template = std::make_shared<const LogTemplate>(l_source);
+		std::atomic_store(&g_templates[area][sel], l_template);
+	}
+	return l_template;
+}
+
 void LogManager::init()
 {
 	g_logOptions[UPLOAD][FILE]        = SettingsManager::LOG_FILE_UPLOAD;
@@ -98,71 +206,29 @@ LogManager::LogManager()
 	flush_all_log();
 }
 
-void LogManager::log(const string& p_area, const string& p_msg) noexcept
+void LogManager::push(const string& p_path, const string& p_msg, bool p_is_low_severity) noexcept
 {
 	dcassert(g_isInit);
 	if (!g_isInit)
 		return;
-	string l_area;
-	bool l_is_new_path;
-	{
-		CFlyFastLock(g_csPathCache);
-		const auto l_fine_it = g_pathCache.find(p_area);
-		l_is_new_path = l_fine_it == g_pathCache.end();
-		if (l_is_new_path)
-		{
-			if (g_pathCache.size() > 250)
-			{
-				g_pathCache.clear();
-			}
-			
-			l_area = Util::validateFileName(p_area);
+	LogRecord* l_record = new LogRecord;
+	l_record->m_path = p_path;
 #ifdef _DEBUG
-			g_debugMissed++;
-			const std::pair<string, size_t> l_pair(l_area, 0);
-			g_pathCache[p_area] = l_pair;
-#else
-			g_pathCache[p_area] = l_area;
+	if (ClientManager::isStartup())
+		l_record->m_msg += "[init]";
+	if (ClientManager::isBeforeShutdown())
+		l_record->m_msg += "[before_shutdown]";
+	if (ClientManager::isShutdown())
+		l_record->m_msg += "[shutdown]";
+	l_record->m_msg += "[" + Util::toString(::GetCurrentThreadId()) + "]";
 #endif
-		}
-		else
-		{
-#ifdef _DEBUG
-			g_debugTotal++;
-			if (++l_fine_it->second.second % 100 == 0)
-			{
-				// dcdebug("log path cache: size=%i [%s] %i\n", g_pathCache.size(), p_area.c_str(), l_fine_it->second.second);
-			}
-			
-			l_area = l_fine_it->second.first;
-#else
-			l_area = l_fine_it->second;
-#endif
-		}
-	}
+	l_record->m_msg += p_msg;
+	l_record->m_msg += "\r\n";
+	l_record->m_is_low_severity = p_is_low_severity;
+	g_queue_bytes += l_record->m_msg.size();
+	l_record->m_next = g_queue.load(std::memory_order_relaxed);
+	while (!g_queue.compare_exchange_weak(l_record->m_next, l_record, std::memory_order_release, std::memory_order_relaxed))
 	{
-		CFlyFastLock(g_csLogFilesBuffer);
-		string l_msg;
-#ifdef _DEBUG
-		if (ClientManager::isStartup())
-			l_msg += "[init]";
-		if (ClientManager::isBeforeShutdown())
-			l_msg += "[before_shutdown]";
-		if (ClientManager::isShutdown())
-			l_msg += "[shutdown]";
-		l_msg += "[" + Util::toString(::GetCurrentThreadId()) + "]";
-#endif
-		l_msg += p_msg + "\r\n";
-		auto l_log = g_LogFilesBuffer.insert(make_pair(l_area, l_msg));
-		if (l_log.second == false)
-		{
-			l_log.first->second += l_msg;
-		}
-	}
-	dcassert(!l_area.empty());
-	if (l_is_new_path)
-	{
-		File::ensureDirectory(l_area);
 	}
 #ifndef _DEBUG
 	if (ClientManager::isStartup() == true)
@@ -173,28 +239,78 @@ void LogManager::log(const string& p_area, const string& p_msg) noexcept
 }
 void LogManager::flush_all_log()
 {
-	CFlyMessagesBuffer l_buffer;
+	CFlyLock(g_csFlush);
+	// The queue is a stack - restore the order of the messages
+	LogRecord* l_list = g_queue.exchange(nullptr, std::memory_order_acquire);
+	LogRecord* l_ordered = nullptr;
+	while (l_list)
+	{
+		LogRecord* l_next = l_list->m_next;
+		l_list->m_next = l_ordered;
+		l_ordered = l_list;
+		l_list = l_next;
+	}
+	boost::unordered_map<string, std::pair<string, bool> > l_buffer;
+	size_t l_bytes = 0;
+	while (l_ordered)
 	{
-		CFlyFastLock(g_csLogFilesBuffer);
-		l_buffer.swap(g_LogFilesBuffer);
+		LogRecord* l_record = l_ordered;
+		l_ordered = l_record->m_next;
+		auto& l_item = l_buffer[l_record->m_path];
+		l_item.first += l_record->m_msg;
+		l_item.second = l_record->m_is_low_severity;
+		l_bytes += l_record->m_msg.size();
+		delete l_record;
 	}
+	g_queue_bytes -= l_bytes;
 	for (auto i = l_buffer.cbegin(); i != l_buffer.cend(); ++i)
 	{
+		// validateFileName is done once for the path
+		string l_area;
+		{
+			const auto l_fine_it = g_pathCache.find(i->first);
+			if (l_fine_it == g_pathCache.end())
+			{
+				if (g_pathCache.size() > 250)
+				{
+					g_pathCache.clear();
+				}
+				l_area = Util::validateFileName(i->first);
+#ifdef _DEBUG
+				g_debugMissed++;
+				g_pathCache[i->first] = std::make_pair(l_area, size_t(0));
+#else
+				g_pathCache[i->first] = l_area;
+#endif
+				File::ensureDirectory(l_area);
+			}
+			else
+			{
+#ifdef _DEBUG
+				g_debugTotal++;
+				++l_fine_it->second.second;
+				l_area = l_fine_it->second.first;
+#else
+				l_area = l_fine_it->second;
+#endif
+			}
+		}
+		dcassert(!l_area.empty());
 		try
 		{
-			flush_file(i->first, i->second);
+			flush_file(l_area, i->second.first, i->second.second);
 		}
-		catch (const FileException& e)
+		catch (const FileException&)
 		{
 			const auto l_code = GetLastError();
 			if (l_code == 3) // ERROR_PATH_NOT_FOUND
 			{
 				try
 				{
-					File::ensureDirectory(i->first);
-					flush_file(i->first, i->second);
+					File::ensureDirectory(l_area);
+					flush_file(l_area, i->second.first, i->second.second);
 				}
-				catch (const FileException& e)
+				catch (const FileException&)
 				{
 					dcassert(0);
 				}
@@ -205,20 +321,70 @@ void LogManager::flush_all_log()
 			}
 		}
 	}
+	closeIdleFiles(GET_TICK());
+	const size_t l_dropped = g_dropped.exchange(0);
+	if (l_dropped)
+	{
+		message("[LogManager] Overload: " + Util::toString(l_dropped) + " trace messages dropped", true);
+	}
 }
 
-void LogManager::flush_file(const string& p_area, const string& p_msg)
+void LogManager::flush_file(const string& p_path, const string& p_msg, bool p_is_low_severity)
 {
-	g_csFileArea.lock();
-	FastCriticalSection& l_cs = g_csFile[p_area];
-	g_csFileArea.unlock();
-	CFlyFastLock(l_cs);
-	File f(p_area, File::WRITE, File::OPEN | File::CREATE);
-	if (f.setEndPos(0) == 0)
+	auto& l_file = g_files[p_path];
+	try
+	{
+		if (l_file.m_file && p_is_low_severity && l_file.m_size > g_max_trace_file_size)
+		{
+			l_file.m_file.reset();
+			const string l_old = p_path + ".old";
+			File::deleteFile(l_old);
+			File::renameFile(p_path, l_old);
+		}
+		if (!l_file.m_file)
+		{
+			l_file.m_file.reset(new File(p_path, File::WRITE, File::OPEN | File::CREATE | File::SHARED));
+			l_file.m_size = l_file.m_file->setEndPos(0);
+			if (l_file.m_size == 0)
+			{
+				l_file.m_size = l_file.m_file->write("\xef\xbb\xbf");
+			}
+		}
+		l_file.m_size += l_file.m_file->write(p_msg);
+		l_file.m_last_write = GET_TICK();
+	}
+	catch (const FileException&)
 	{
-		f.write("\xef\xbb\xbf");
+		g_files.erase(p_path);
+		throw;
+	}
+}
+
+void LogManager::closeIdleFiles(uint64_t p_tick)
+{
+	for (auto i = g_files.begin(); i != g_files.end();)
+	{
+		if (p_tick - i->second.m_last_write > g_idle_file_timeout || ClientManager::isShutdown())
+		{
+			i = g_files.erase(i);
+		}
+		else
+		{
+			++i;
+		}
+	}
+	while (g_files.size() > g_max_open_files)
+	{
+		auto l_oldest = g_files.begin();
+		for (auto i = g_files.begin(); i != g_files.end(); ++i)
+		{
+			if (i->second.m_last_write < l_oldest->second.m_last_write)
+			{
+				l_oldest = i;
+			}
+		}
+		g_files.erase(l_oldest);
 	}
-	f.write(p_msg);
 }
 
 const string& LogManager::getSetting(int area, int sel)
@@ -242,19 +408,52 @@ void LogManager::log(LogArea area, const StringMap& params, bool p_only_file /*
 	else
 #endif // FLYLINKDC_LOG_IN_SQLITE_BASE
 	{
-		const string path = SETTING(LOG_DIRECTORY) + Util::formatParams(getSetting(area, FILE), params, false);
-		const string msg = Util::formatParams(getSetting(area, FORMAT), params, false);
-		log(path, msg);
+		const bool l_is_low_severity = isLowSeverity(area);
+		if (l_is_low_severity && g_queue_bytes > g_max_queue_bytes)
+		{
+			++g_dropped;
+			return;
+		}
+		const time_t l_t = time(nullptr);
+		const auto l_get_param = [&params](const string & p_name) -> const string*
+		{
+			const auto i = params.find(p_name);
+			return i != params.end() ? &i->second : nullptr;
+		};
+		push(SETTING(LOG_DIRECTORY) + getTemplate(area, FILE)->format(l_t, l_get_param), getTemplate(area, FORMAT)->format(l_t, l_get_param), l_is_low_severity);
 	}
 }
 
-void LogManager::virus_message(const string& p_message)
+void LogManager::log_message(LogArea area, const string& p_message, bool p_only_file /* = false */) noexcept
 {
-	if (BOOLSETTING(LOG_VIRUS_TRACE))
+#ifdef FLYLINKDC_LOG_IN_SQLITE_BASE
+	if (!p_only_file && BOOLSETTING(FLY_SQLITE_LOG) && CFlylinkDBManager::isValidInstance())
 	{
 		StringMap params;
 		params["message"] = p_message;
-		LOG(VIRUS_TRACE, params);
+		log(area, params, p_only_file);
+		return;
+	}
+#endif // FLYLINKDC_LOG_IN_SQLITE_BASE
+	const bool l_is_low_severity = isLowSeverity(area);
+	if (l_is_low_severity && g_queue_bytes > g_max_queue_bytes)
+	{
+		++g_dropped;
+		return;
+	}
+	const time_t l_t = time(nullptr);
+	const auto l_get_param = [&p_message](const string & p_name) -> const string*
+	{
+		return p_name == "message" ? &p_message : nullptr;
+	};
+	push(SETTING(LOG_DIRECTORY) + getTemplate(area, FILE)->format(l_t, l_get_param), getTemplate(area, FORMAT)->format(l_t, l_get_param), l_is_low_severity);
+}
+
+void LogManager::virus_message(const string& p_message)
+{
+	if (BOOLSETTING(LOG_VIRUS_TRACE))
+	{
+		log_message(VIRUS_TRACE, p_message);
 	}
 }
 
@@ -262,9 +461,7 @@ void LogManager::ddos_message(const string& p_message)
 {
 	if (BOOLSETTING(LOG_DDOS_TRACE))
 	{
-		StringMap params;
-		params["message"] = p_message;
-		LOG(DDOS_TRACE, params);
+		log_message(DDOS_TRACE, p_message);
 	}
 }
 
@@ -273,9 +470,7 @@ void LogManager::cmd_debug_message(const string& p_message)
 {
 	if (BOOLSETTING(LOG_CMDDEBUG_TRACE))
 	{
-		StringMap params;
-		params["message"] = p_message;
-		LOG(CMDDEBUG_TRACE, params);
+		log_message(CMDDEBUG_TRACE, p_message);
 	}
 }
 
@@ -283,9 +478,7 @@ void LogManager::flood_message(const string& p_message)
 {
 	if (BOOLSETTING(LOG_FLOOD_TRACE))
 	{
-		StringMap params;
-		params["message"] = p_message;
-		LOG(FLOOD_TRACE, params);
+		log_message(FLOOD_TRACE, p_message);
 	}
 }
 
@@ -293,9 +486,7 @@ void LogManager::psr_message(const string& p_message)
 {
 	if (BOOLSETTING(LOG_PSR_TRACE))
 	{
-		StringMap params;
-		params["message"] = p_message;
-		LOG(PSR_TRACE, params);
+		log_message(PSR_TRACE, p_message);
 	}
 }
 
@@ -303,15 +494,11 @@ void LogManager::torrent_message(const string& p_message, bool p_is_add_sys_mess
 {
 	if (BOOLSETTING(LOG_TORRENT_TRACE))
 	{
-		StringMap params;
-		params["message"] = p_message;
-		LOG(TORRENT_TRACE, params);
+		log_message(TORRENT_TRACE, p_message);
 	}
 	if (p_is_add_sys_message)
 	{
-		StringMap params;
-		params["message"] = p_message;
-		LOG(SYSTEM, params);
+		log_message(SYSTEM, p_message);
 	}
 }
 
@@ -340,9 +527,7 @@ void LogManager::message(const string& p_msg, bool p_only_file /*= false */)
 	if (BOOLSETTING(LOG_SYSTEM))
 #endif
 	{
-		StringMap params;
-		params["message"] = p_msg;
-		log(SYSTEM, params, p_only_file); // [1] https://www.box.net/shared/9e63916273d37e5b2932
+		log_message(SYSTEM, p_msg, p_only_file); // [1] https://www.box.net/shared/9e63916273d37e5b2932
 	}
 	speak_status_message(p_msg);
 }
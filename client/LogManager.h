@@ -22,12 +22,15 @@
 #ifndef DCPLUSPLUS_DCPP_LOG_MANAGER_H
 #define DCPLUSPLUS_DCPP_LOG_MANAGER_H
 
+#include <atomic>
 #include "Util.h"
 
 //#define FMT_HEADER_ONLY
 //#include "../cppformat/format.h"
 //#include "dcformat.h"
 
+class File;
+
 typedef std::unordered_map<string, string> CFlyMessagesBuffer;
 class LogMessage
 {
@@ -84,8 +87,48 @@ class LogManager
 		static int  g_LogMessageID;
 		static void flush_all_log();
 	private:
-		static void flush_file(const string& p_area, const string& p_msg);
-		static void log(const string& p_area, const string& p_msg) noexcept;
+		/** FILE/FORMAT setting compiled once: the time parts and %[param] are not searched for every message */
+		class LogTemplate;
+		typedef std::shared_ptr<const LogTemplate> LogTemplatePtr;
+		static LogTemplatePtr getTemplate(LogArea area, int sel);
+		static LogTemplatePtr g_templates[LAST][2];
+		
+		/**
+		 * Lock-free MPSC queue: the writers push the records to the head of the list,
+		 * flush_all_log (timer thread) takes the whole list at once and writes it to the files.
+		 */
+		struct LogRecord
+		{
+			LogRecord* m_next;
+			string m_path;
+			string m_msg;
+			bool m_is_low_severity;
+		};
+		static std::atomic<LogRecord*> g_queue;
+		static std::atomic<size_t> g_queue_bytes;
+		static std::atomic<size_t> g_dropped;
+		/** Trace logs - dropped under overload and rotated by size */
+		static bool isLowSeverity(LogArea area)
+		{
+			return area >= TRACE_SQLITE && area != VIRUS_TRACE;
+		}
+		static void log_message(LogArea area, const string& p_message, bool p_only_file = false) noexcept;
+		static void push(const string& p_path, const string& p_msg, bool p_is_low_severity) noexcept;
+		
+		/** Log files are kept open between the flushes (flush_all_log only) */
+		struct LogFile
+		{
+			LogFile() : m_size(0), m_last_write(0)
+			{
+			}
+			std::unique_ptr<File> m_file;
+			int64_t m_size;
+			uint64_t m_last_write;
+		};
+		static boost::unordered_map<string, LogFile> g_files;
+		static CriticalSection g_csFlush;
+		static void flush_file(const string& p_path, const string& p_msg, bool p_is_low_severity);
+		static void closeIdleFiles(uint64_t p_tick);
 		
 		static int g_logOptions[LAST][2];
 #ifdef _DEBUG
@@ -96,14 +139,8 @@ class LogManager
 #else
 		static boost::unordered_map<string, string> g_pathCache;
 #endif
-		static FastCriticalSection g_csPathCache; // [!] IRainman opt: use spin lock here.
 		static bool g_isInit;
 		
-		static CFlyMessagesBuffer g_LogFilesBuffer;
-		static FastCriticalSection g_csLogFilesBuffer;
-		static std::map<std::string, FastCriticalSection> g_csFile; // map -   
-		static FastCriticalSection g_csFileArea;
-		
 		LogManager();
 		~LogManager()
 		{
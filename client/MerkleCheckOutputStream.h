@@ -24,31 +24,33 @@
 
 #include "Streams.h"
 #include "MerkleTree.h"
+#include "CFlyTaskPool.h"
 
+/**
+ * Checks the written data against the leaves of the reference tree.
+ * The new data is hashed into a tree of its own (leaf 0 - block at the start position),
+ * so the already verified leaves of the reference tree are not copied.
+ * With a pool the hashing is done by the pool thread while the next data is received
+ * (in order, at most MAX_PENDING chunks ahead), a bad block is thrown by the next write/flushBuffers.
+ * verifiedBytes() - end of the verified data, only it may be marked as downloaded.
+ */
 template<class TreeType, bool managed>
 class MerkleCheckOutputStream : public OutputStream
 {
 	public:
-		MerkleCheckOutputStream(const TreeType& aTree, OutputStream* aStream, int64_t start) : s(aStream), real(aTree), cur(aTree.getBlockSize()), verified(0), bufPos(0)
+		MerkleCheckOutputStream(const TreeType& aTree, OutputStream* aStream, int64_t start, CFlyTaskPool* p_pool = nullptr) :
+			s(aStream), m_check(std::make_shared<Check>(aTree, start)), m_pool(p_pool)
 		{
 			//dcdebug("[==========================] MerkleCheckOutputStream() start = %d s = %d this = %d\r\n\r\n", start, s, this);
-			// Only start at block boundaries
-			const auto l_blocksize = aTree.getBlockSize();
-			dcassert(start % l_blocksize == 0);
-			cur.setFileSize(start);
-			
-			const size_t nBlocks = static_cast<size_t>(start / l_blocksize);
-			if (nBlocks > aTree.getLeaves().size())
-			{
-				dcdebug("Invalid tree / parameters");
-				return;
-			}
-			cur.getLeaves().insert(cur.getLeaves().begin(), aTree.getLeaves().begin(), aTree.getLeaves().begin() + nBlocks);
 		}
 		
 		~MerkleCheckOutputStream()
 		{
-			//dcdebug("[==========================] ~MerkleCheckOutputStream() bufPos = %d s = %d this = %d\r\n\r\n", bufPos, s,  this);
+			//dcdebug("[==========================] ~MerkleCheckOutputStream() s = %d this = %d\r\n\r\n", s,  this);
+			if (m_pool)
+			{
+				m_check->waitPending(0);
+			}
 			if (managed)
 			{
 				delete s;
@@ -57,90 +59,293 @@ class MerkleCheckOutputStream : public OutputStream
 		
 		size_t flushBuffers(bool aForce) override
 		{
-			if (bufPos != 0)
-				cur.update(buf, bufPos);
-			bufPos = 0;
-			
-			cur.finalize();
-			if (cur.getLeaves().size() == real.getLeaves().size())
-			{
-				if (cur.getRoot() != real.getRoot())
-					throw FileException(STRING(TTH_INCONSISTENCY));
-			}
-			else
+			if (m_pool)
 			{
-				checkTrees();
+				m_check->pushChunk(m_pool);
+				m_check->waitPending(0);
+				m_check->throwError();
 			}
+			m_check->finish();
 			return s->flushBuffers(aForce);
 		}
 		
-		void commitBytes(const void* b, size_t len)
+		size_t write(const void* b, size_t len) override
 		{
-			uint8_t* xb = (uint8_t*)b;
-			size_t pos = 0;
-			
-			if (bufPos != 0)
+			if (m_pool)
 			{
-				size_t bytes = min(TreeType::BASE_BLOCK_SIZE - bufPos, len);
-				memcpy(buf + bufPos, xb, bytes);
-				pos = bytes;
-				bufPos += bytes;
-				
-				if (bufPos == TreeType::BASE_BLOCK_SIZE)
-				{
-					cur.update(buf, TreeType::BASE_BLOCK_SIZE);
-					bufPos = 0;
-				}
+				m_check->throwError();
+				m_check->push(b, len, m_pool);
 			}
-			
-			if (pos < len)
+			else
 			{
-				dcassert(bufPos == 0);
-				size_t left = len - pos;
-				size_t part = left - (left %  TreeType::BASE_BLOCK_SIZE);
-				if (part > 0)
-				{
-					cur.update(xb + pos, part);
-					pos += part;
-				}
-				left = len - pos;
-				memcpy(buf, xb + pos, left);
-				bufPos = left;
+				m_check->commitBytes(b, len);
+				m_check->checkTrees();
 			}
+			return s->write(b, len);
 		}
 		
-		size_t write(const void* b, size_t len)
+		/** Checks all the received full blocks - the pool thread is done with the data after it */
+		void waitPending()
 		{
-			commitBytes(b, len);
-			checkTrees();
-			return s->write(b, len);
+			if (m_pool)
+			{
+				m_check->pushChunk(m_pool);
+				m_check->waitPending(0);
+			}
 		}
 		
 		int64_t verifiedBytes() const
 		{
-			return min(real.getFileSize(), (int64_t)(cur.getBlockSize() * cur.getLeaves().size()));
+			return m_check->verifiedBytes();
 		}
 	private:
-		OutputStream* s;
-		TreeType real;
-		TreeType cur;
-		size_t verified;
-		
-		uint8_t buf[TreeType::BASE_BLOCK_SIZE];
-		size_t bufPos;
+		enum { CHUNK_SIZE = 256 * 1024, MAX_PENDING = 8 };
 		
-		void checkTrees()
+		class Check : public std::enable_shared_from_this<Check>
 		{
-			while (cur.getLeaves().size() > verified)
-			{
-				if (cur.getLeaves().size() > real.getLeaves().size() ||
-				        !(cur.getLeaves()[verified] == real.getLeaves()[verified]))
+			public:
+				Check(const TreeType& p_real, int64_t p_start) : m_real(p_real), m_cur(p_real.getBlockSize()),
+					m_start_block(0), m_verified(0), m_committed(0), m_bufPos(0),
+					m_count_pending(0), m_wait_pending(0), m_is_running(false), m_is_waiting(false), m_is_finished(false), m_is_bad(false)
 				{
-					throw FileException(STRING(TTH_INCONSISTENCY));
+					// Only start at block boundaries
+					const auto l_blocksize = p_real.getBlockSize();
+					dcassert(p_start % l_blocksize == 0);
+					m_start_block = static_cast<size_t>(p_start / l_blocksize);
+					if (m_start_block > p_real.getLeaves().size())
+					{
+						dcdebug("Invalid tree / parameters");
+						m_is_bad = true;
+					}
 				}
-				verified++;
-			}
-		}
+				
+				void commitBytes(const void* b, size_t len)
+				{
+					const uint8_t* xb = static_cast<const uint8_t*>(b);
+					size_t pos = 0;
+					m_committed += len;
+					
+					if (m_bufPos != 0)
+					{
+						size_t bytes = min(TreeType::BASE_BLOCK_SIZE - m_bufPos, len);
+						memcpy(m_buf + m_bufPos, xb, bytes);
+						pos = bytes;
+						m_bufPos += bytes;
+						
+						if (m_bufPos == TreeType::BASE_BLOCK_SIZE)
+						{
+							m_cur.update(m_buf, TreeType::BASE_BLOCK_SIZE);
+							m_bufPos = 0;
+						}
+					}
+					
+					if (pos < len)
+					{
+						dcassert(m_bufPos == 0);
+						size_t left = len - pos;
+						size_t part = left - (left %  TreeType::BASE_BLOCK_SIZE);
+						if (part > 0)
+						{
+							m_cur.update(xb + pos, part);
+							pos += part;
+						}
+						left = len - pos;
+						memcpy(m_buf, xb + pos, left);
+						m_bufPos = left;
+					}
+				}
+				
+				void checkTrees()
+				{
+					const auto& l_cur = m_cur.getLeaves();
+					const auto& l_real = m_real.getLeaves();
+					while (l_cur.size() > m_verified)
+					{
+						const size_t l_index = m_start_block + m_verified;
+						if (m_is_bad || l_index >= l_real.size() || !(l_cur[m_verified] == l_real[l_index]))
+						{
+							m_is_bad = true;
+							throw FileException(STRING(TTH_INCONSISTENCY));
+						}
+						m_verified++;
+					}
+				}
+				
+				/** Last (incomplete) block, the tree of the segment is closed */
+				void finish()
+				{
+					if (m_is_finished)
+						return;
+					m_is_finished = true;
+					if (m_committed == 0)
+						return;
+					if (m_bufPos != 0)
+						m_cur.update(m_buf, m_bufPos);
+					m_bufPos = 0;
+					m_cur.finalize();
+					checkTrees();
+				}
+				
+				int64_t verifiedBytes() const
+				{
+					return min(m_real.getFileSize(), m_real.getBlockSize() * int64_t(m_start_block + m_verified));
+				}
+				
+				void push(const void* b, size_t len, CFlyTaskPool* p_pool)
+				{
+					const uint8_t* xb = static_cast<const uint8_t*>(b);
+					while (len > 0)
+					{
+						if (m_chunk.empty())
+						{
+							m_chunk.reserve(CHUNK_SIZE);
+						}
+						const size_t l_count = min(size_t(CHUNK_SIZE) - m_chunk.size(), len);
+						m_chunk.insert(m_chunk.end(), xb, xb + l_count);
+						xb += l_count;
+						len -= l_count;
+						if (m_chunk.size() == CHUNK_SIZE)
+						{
+							waitPending(MAX_PENDING - 1);
+							pushChunk(p_pool);
+						}
+					}
+				}
+				
+				void pushChunk(CFlyTaskPool* p_pool)
+				{
+					if (m_chunk.empty())
+						return;
+					bool l_is_start = false;
+					{
+						CFlyFastLock(m_cs);
+						m_pending.push_back(std::vector<uint8_t>());
+						m_pending.back().swap(m_chunk);
+						if (!m_free.empty())
+						{
+							m_chunk.swap(m_free.back());
+							m_free.pop_back();
+						}
+						++m_count_pending;
+						if (!m_is_running)
+						{
+							m_is_running = l_is_start = true;
+						}
+					}
+					if (l_is_start)
+					{
+						// The task keeps the state alive until it returns
+						const auto l_self = this->shared_from_this();
+						const CFlyTaskPool::Task l_task = [l_self]()
+						{
+							l_self->process();
+						};
+						if (!p_pool->addTask(l_task))
+						{
+							process(); // the pool is stopped
+						}
+					}
+				}
+				
+				void waitPending(size_t p_max_pending)
+				{
+					for (;;)
+					{
+						{
+							CFlyFastLock(m_cs);
+							if (m_count_pending <= p_max_pending)
+								return;
+							m_wait_pending = p_max_pending;
+							m_is_waiting = true;
+						}
+						m_done.wait();
+					}
+				}
+				
+				void throwError()
+				{
+					if (m_is_bad)
+					{
+						throw FileException(STRING(TTH_INCONSISTENCY));
+					}
+				}
+				
+			private:
+				void process()
+				{
+					for (;;)
+					{
+						std::vector<uint8_t> l_data;
+						{
+							CFlyFastLock(m_cs);
+							if (m_pending.empty())
+							{
+								m_is_running = false;
+								return;
+							}
+							l_data.swap(m_pending.front());
+							m_pending.pop_front();
+						}
+						if (!m_is_bad)
+						{
+							try
+							{
+								commitBytes(l_data.data(), l_data.size());
+								checkTrees();
+							}
+							catch (const Exception&)
+							{
+								dcassert(m_is_bad);
+							}
+						}
+						bool l_is_signal = false;
+						{
+							CFlyFastLock(m_cs);
+							l_data.clear();
+							if (m_free.size() < 2)
+							{
+								m_free.push_back(std::vector<uint8_t>());
+								m_free.back().swap(l_data);
+							}
+							--m_count_pending;
+							if (m_is_waiting && m_count_pending <= m_wait_pending)
+							{
+								m_is_waiting = false;
+								l_is_signal = true;
+							}
+						}
+						if (l_is_signal)
+						{
+							m_done.signal();
+						}
+					}
+				}
+				
+				const TreeType& m_real;
+				TreeType m_cur;
+				size_t m_start_block;
+				size_t m_verified;
+				int64_t m_committed;
+				
+				uint8_t m_buf[TreeType::BASE_BLOCK_SIZE];
+				size_t m_bufPos;
+				
+				std::vector<uint8_t> m_chunk;
+				std::deque<std::vector<uint8_t>> m_pending;
+				std::vector<std::vector<uint8_t>> m_free;
+				size_t m_count_pending;
+				size_t m_wait_pending;
+				FastCriticalSection m_cs;
+				Semaphore m_done;
+				bool m_is_running;
+				bool m_is_waiting;
+				bool m_is_finished;
+				volatile bool m_is_bad;
+		};
+		
+		OutputStream* s;
+		std::shared_ptr<Check> m_check;
+		CFlyTaskPool* m_pool;
 };
 
 #endif // !defined(MERKLE_CHECK_OUTPUT_STREAM_H)
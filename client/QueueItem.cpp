@@ -487,6 +487,25 @@ bool QueueItem::removeDownload(const UserPtr& p_user)
 	}
 	return l_size_before != m_downloads.size();
 }
+bool QueueItem::removeDownload(const DownloadPtr& p_download)
+{
+	CFlyFastLock(m_fcs_download);
+	const auto i = std::find(m_downloads.begin(), m_downloads.end(), p_download);
+	if (i == m_downloads.end())
+		return false;
+	m_downloads.erase(i);
+	return true;
+}
+bool QueueItem::isDownloadOf(const UserPtr& p_user) const
+{
+	CFlyFastLock(m_fcs_download);
+	for (auto i = m_downloads.cbegin(); i != m_downloads.cend(); ++i)
+	{
+		if ((*i)->getUser() == p_user)
+			return true;
+	}
+	return false;
+}
 Segment QueueItem::getNextSegmentL(const int64_t  blockSize, const int64_t wantedSize, const int64_t lastSpeed, const PartialSource::Ptr &partialSource) const
 {
 	if (getSize() == -1 || blockSize == 0)
@@ -311,6 +311,8 @@ class QueueItem : public Flags
 		mutable FastCriticalSection m_fcs_segment;
 		void addDownload(const DownloadPtr& p_download);
 		bool removeDownload(const UserPtr& p_user);
+		bool removeDownload(const DownloadPtr& p_download);
+		bool isDownloadOf(const UserPtr& p_user) const;
 		size_t getDownloadsSegmentCount() const
 		{
 			return m_downloads.size();
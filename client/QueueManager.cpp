@@ -194,6 +194,15 @@ bool QueueManager::FileQueue::is_queue_tth(const TTHValue& p_tth)
 	auto l_count_tth = g_queue_tth_map.find(p_tth);
 	return l_count_tth != g_queue_tth_map.end();
 }
+void QueueManager::FileQueue::is_queue_tth(const std::vector<TTHValue>& p_tths, std::vector<bool>& p_result)
+{
+	p_result.assign(p_tths.size(), false);
+	RLock(*g_csFQ);
+	for (size_t i = 0; i < p_tths.size(); ++i)
+	{
+		p_result[i] = g_queue_tth_map.find(p_tths[i]) != g_queue_tth_map.end();
+	}
+}
 
 void QueueManager::FileQueue::add(const QueueItemPtr& qi) // [!] IRainman fix.
 {
@@ -499,6 +508,8 @@ QueueItemPtr QueueManager::UserQueue::getNextL(const UserPtr& aUser, QueueItem::
 				const auto l_source = qi->findSourceL(aUser);
 				if (l_source == qi->m_sources.end())
 					continue;
+				if (qi->isRunning() && isRunning(qi, aUser))
+					continue; // Pipelined request - only one segment of the file from the user at a time
 				if (l_source->second.isSet(QueueItem::Source::FLAG_PARTIAL)) // TODO Crash
 				{
 					// check partial source
@@ -556,10 +567,9 @@ QueueItemPtr QueueManager::UserQueue::getNextL(const UserPtr& aUser, QueueItem::
 void QueueManager::UserQueue::addDownload(const QueueItemPtr& qi, const DownloadPtr& d) // [!] IRainman fix: this function needs external lock.
 {
 	qi->addDownload(d);
-	// Only one download per user...
 	{
 		CFlyWriteLock(*g_runningMapCS);
-		g_runningMap[d->getUser()] = qi;
+		g_runningMap[d->getUser()].push_back(qi);
 	}
 }
 
@@ -621,15 +631,49 @@ void QueueManager::FileQueue::calcPriorityAndGetRunningFilesL(bool p_is_calc_pri
 void QueueManager::UserQueue::removeRunning(const UserPtr& aUser)
 {
 	CFlyWriteLock(*g_runningMapCS);
-	g_runningMap.erase(aUser);
+	const auto i = g_runningMap.find(aUser);
+	if (i == g_runningMap.end())
+		return;
+	// Pipelined downloads of the user are still outstanding - keep them
+	i->second.remove_if([&aUser](const QueueItemPtr & qi)
+	{
+		return !qi->isDownloadOf(aUser);
+	});
+	if (i->second.empty())
+	{
+		g_runningMap.erase(i);
+	}
+}
+
+void QueueManager::UserQueue::removeRunning(const QueueItemPtr& qi, const UserPtr& aUser)
+{
+	CFlyWriteLock(*g_runningMapCS);
+	const auto i = g_runningMap.find(aUser);
+	if (i == g_runningMap.end())
+		return;
+	const auto j = std::find(i->second.begin(), i->second.end(), qi);
+	if (j != i->second.end())
+	{
+		i->second.erase(j);
+	}
+	if (i->second.empty())
+	{
+		g_runningMap.erase(i);
+	}
 }
 
 bool QueueManager::UserQueue::removeDownload(const QueueItemPtr& qi, const UserPtr& aUser)
 {
-	removeRunning(aUser);
+	removeRunning(qi, aUser);
 	return qi->removeDownload(aUser);
 }
 
+bool QueueManager::UserQueue::removeDownload(const QueueItemPtr& qi, const DownloadPtr& d)
+{
+	removeRunning(qi, d->getUser());
+	return qi->removeDownload(d);
+}
+
 void QueueManager::UserQueue::setQIPriority(const QueueItemPtr& qi, QueueItem::Priority p) // [!] IRainman fix.
 {
 	WLock(*QueueItem::g_cs);
@@ -642,7 +686,24 @@ QueueItemPtr QueueManager::UserQueue::getRunning(const UserPtr& aUser)
 {
 	CFlyReadLock(*g_runningMapCS);
 	const auto i = g_runningMap.find(aUser);
-	return i == g_runningMap.cend() ? nullptr : i->second;
+	return i == g_runningMap.cend() ? nullptr : i->second.front();
+}
+
+void QueueManager::UserQueue::getRunning(const UserPtr& aUser, QueueItemList& p_items)
+{
+	CFlyReadLock(*g_runningMapCS);
+	const auto i = g_runningMap.find(aUser);
+	if (i != g_runningMap.cend())
+	{
+		p_items = i->second;
+	}
+}
+
+bool QueueManager::UserQueue::isRunning(const QueueItemPtr& qi, const UserPtr& aUser)
+{
+	CFlyReadLock(*g_runningMapCS);
+	const auto i = g_runningMap.find(aUser);
+	return i != g_runningMap.cend() && std::find(i->second.cbegin(), i->second.cend(), qi) != i->second.cend();
 }
 
 void QueueManager::UserQueue::removeQueueItem(const QueueItemPtr& qi)
@@ -662,7 +723,7 @@ void QueueManager::UserQueue::removeQueueItemL(const QueueItemPtr& qi)
 
 void QueueManager::UserQueue::removeUserL(const QueueItemPtr& qi, const UserPtr& aUser)
 {
-	if (qi == getRunning(aUser))
+	if (isRunning(qi, aUser))
 	{
 		removeDownload(qi, aUser);
 	}
@@ -953,6 +1014,7 @@ void QueueManager::shutdown() // [+] IRainman opt.
 	dclstLoader.forceStop();
 	m_mover.forceStop();
 	rechecker.forceStop();
+	CFlyFileListCache::clear();
 }
 
 struct PartsInfoReqParam
@@ -1548,36 +1610,39 @@ QueueItem::Priority QueueManager::hasDownload(const UserPtr& aUser)
 	}
 	return qi->getPriority();
 }
-void QueueManager::buildMap(const DirectoryListing::Directory* dir, TTHMap& p_tthMap) noexcept // [!] IRainman fix.
+int QueueManager::matchListing(const DirectoryListing& dl) noexcept
 {
-	for (auto j = dir->directories.cbegin(); j != dir->directories.cend(); ++j)
+	dcassert(dl.getUser()); // [!] IRainman fix: It makes no sense to check the file list on the presence of a file from our download queue if the user in the file list is empty!
+	
+	if (g_fileQueue.empty()) // [!] opt
 	{
-		if (!(*j)->getAdls()) // [1] https://www.box.net/shared/d511d114cb87f7fa5b8d
-		{
-			buildMap(*j, p_tthMap); // [!] IRainman fix.
-		}
+		return 0;
 	}
-	
-	for (auto i = dir->m_files.cbegin(); i != dir->m_files.cend(); ++i)
+	// The list loaded from the file is remembered - the next match of the same list doesn't need to load it.
+	const auto l_index = dl.getFileName().empty() ?
+	                     CFlyFileListCache::makeIndex(dl) :
+	                     CFlyFileListCache::add(dl.getUser()->getCID(), dl.getFileName(), dl);
+	return matchListing(dl.getUser(), *l_index);
+}
+
+bool QueueManager::matchCachedListing(const UserPtr& p_user, const string& p_file) noexcept
+{
+	const auto l_index = CFlyFileListCache::find(p_user->getCID(), p_file);
+	if (!l_index)
 	{
-		const DirectoryListing::File* df = *i;
-		p_tthMap.insert(make_pair(df->getTTH(), df));
+		return false;
 	}
+	DirectoryListing::logMatchedFiles(p_user, g_fileQueue.empty() ? 0 : matchListing(p_user, *l_index));
+	return true;
 }
 
-int QueueManager::matchListing(const DirectoryListing& dl) noexcept
+int QueueManager::matchListing(const UserPtr& p_user, const CFlyFileListCache::Index& p_index) noexcept
 {
-	dcassert(dl.getUser()); // [!] IRainman fix: It makes no sense to check the file list on the presence of a file from our download queue if the user in the file list is empty!
-	
 	int matches = 0;
 	
 	// [!] IRainman fix.
-	if (!g_fileQueue.empty()) // [!] opt
 	{
-		// [-] CFlyLock(cs); [-]
-		TTHMap l_tthMap;// tthMap.clear(); [!]
-		buildMap(dl.getRoot(), l_tthMap); // [!]
-		dcassert(!l_tthMap.empty());
+		dcassert(!p_index.empty());
 		{
 			WLock(*QueueItem::g_cs);
 			{
@@ -1590,12 +1655,12 @@ int QueueManager::matchListing(const DirectoryListing& dl) noexcept
 						continue;
 					if (qi->isAnySet(QueueItem::FLAG_USER_LIST | QueueItem::FLAG_USER_GET_IP))
 						continue;
-					const auto j = l_tthMap.find(qi->getTTH());
-					if (j != l_tthMap.end() && j->second->getSize() == qi->getSize()) // [!] IRainman fix.
+					const auto l_item = CFlyFileListCache::findTTH(p_index, qi->getTTH());
+					if (l_item && l_item->m_size == qi->getSize()) // [!] IRainman fix.
 					{
 						try
 						{
-							addSourceL(qi, dl.getUser(), QueueItem::Source::FLAG_FILE_NOT_AVAILABLE);
+							addSourceL(qi, p_user, QueueItem::Source::FLAG_FILE_NOT_AVAILABLE);
 							matches++;
 						}
 						catch (const Exception&)
@@ -1608,7 +1673,7 @@ int QueueManager::matchListing(const DirectoryListing& dl) noexcept
 		}
 		if (matches > 0)
 		{
-			get_download_connection(dl.getUser());
+			get_download_connection(p_user);
 		}
 	}
 	return matches;
@@ -1642,6 +1707,8 @@ void QueueManager::ListMatcher::execute(const StringList& list) // [+] IRainman
 		UserPtr u = DirectoryListing::getUserFromFilename(*i);
 		if (!u)
 			continue;
+		if (QueueManager::getInstance()->matchCachedListing(u, *i))
+			continue;
 			
 		DirectoryListing dl(HintedUser(u, Util::emptyString));
 		try
@@ -2143,7 +2210,11 @@ void QueueManager::putDownload(const string& p_path, DownloadPtr aDownload, bool
 	bool downloadList = false;
 	
 	{
+		const int64_t l_verified_pos = aDownload->getVerifiedPos(); // waits for the check pool, before the check stream is deleted
 		aDownload->reset_download_file();  // https://drdump.com/Problem.aspx?ProblemID=130529
+		string l_write_error;
+		const bool l_is_write_error = aDownload->getType() == Transfer::TYPE_FILE &&
+		                              SharedFileStream::getWriteError(aDownload->getDownloadTarget(), l_write_error);
 		
 		if (aDownload->getType() == Transfer::TYPE_PARTIAL_LIST)
 		{
@@ -2214,7 +2285,7 @@ void QueueManager::putDownload(const string& p_path, DownloadPtr aDownload, bool
 						dcassert(aDownload->getTreeValid());
 						HashManager::addTree(aDownload->getTigerTree());
 						
-						g_userQueue.removeDownload(q, aDownload->getUser());
+						g_userQueue.removeDownload(q, aDownload);
 						
 						fire_status_updated(q);
 					}
@@ -2339,7 +2410,7 @@ void QueueManager::putDownload(const string& p_path, DownloadPtr aDownload, bool
 						}
 						else
 						{
-							g_userQueue.removeDownload(q, aDownload->getUser());
+							g_userQueue.removeDownload(q, aDownload);
 							if (aDownload->getType() != Transfer::TYPE_FILE || (p_is_report_finish && q->isWaiting()))
 							{
 								fire_status_updated(q);
@@ -2373,6 +2444,17 @@ void QueueManager::putDownload(const string& p_path, DownloadPtr aDownload, bool
 							// mark partially downloaded chunk, but align it to block size
 							int64_t downloaded = aDownload->getPos();
 							downloaded -= downloaded % aDownload->getTigerTree().getBlockSize();
+							if (l_verified_pos >= 0)
+							{
+								// the received data can be ahead of the TTH check, a bad block is not marked
+								downloaded = std::min(downloaded, std::max(int64_t(0), l_verified_pos - aDownload->getStartPos()));
+							}
+							if (l_is_write_error)
+							{
+								// the write-behind data of the closed file is lost - download the segment again
+								LogManager::message("QueueManager::putDownload " + aDownload->getDownloadTarget() + " write error = " + l_write_error);
+								downloaded = 0;
+							}
 							
 							if (downloaded > 0)
 							{
@@ -2402,7 +2484,7 @@ void QueueManager::putDownload(const string& p_path, DownloadPtr aDownload, bool
 						}
 					}
 					
-					g_userQueue.removeDownload(q, aDownload->getUser());
+					g_userQueue.removeDownload(q, aDownload);
 					
 					fire_status_updated(q);
 					
@@ -2456,6 +2538,12 @@ void QueueManager::processList(const string& name, const HintedUser& hintedUser,
 {
 	dcassert(hintedUser.user); // [!] IRainman fix: It makes no sense to check the file list on the presence of a file from our download queue if the user in the file list is empty!
 	
+	if ((flags & (QueueItem::FLAG_TEXT | QueueItem::FLAG_DIRECTORY_DOWNLOAD | QueueItem::FLAG_MATCH_QUEUE)) == QueueItem::FLAG_MATCH_QUEUE)
+	{
+		// Same list as the last time - nothing to load
+		if (matchCachedListing(hintedUser.user, name))
+			return;
+	}
 	DirectoryListing dirList(hintedUser);
 	try
 	{
@@ -2630,7 +2718,7 @@ void QueueManager::removeSource(const string& aTarget, const UserPtr& aUser, Fla
 			break;
 		}
 		
-		if (q->isRunning() && g_userQueue.getRunning(aUser) == q)
+		if (q->isRunning() && g_userQueue.isRunning(q, aUser))
 		{
 			isRunning = true;
 			g_userQueue.removeDownload(q, aUser);
@@ -2690,9 +2778,11 @@ void QueueManager::removeSource(const UserPtr& aUser, Flags::MaskType reason) no
 			}
 		}
 		
-		qi = g_userQueue.getRunning(aUser);
-		if (qi)
+		QueueItemList l_running;
+		g_userQueue.getRunning(aUser, l_running);
+		for (auto i = l_running.cbegin(); i != l_running.cend(); ++i)
 		{
+			qi = *i;
 			if (qi->isSet(QueueItem::FLAG_USER_LIST))
 			{
 				removeRunning = qi->getTarget();
@@ -28,6 +28,7 @@
 #include "SearchManagerListener.h"
 #include "LogManager.h"
 #include "SharedFileStream.h"
+#include "CFlyFileListCache.h"
 
 STANDARD_EXCEPTION(QueueException);
 
@@ -186,8 +187,9 @@ class QueueManager : public Singleton<QueueManager>,
 		                  
 		int matchListing(const DirectoryListing& dl) noexcept;
 	private:
-		typedef boost::unordered_map<TTHValue, const DirectoryListing::File*> TTHMap;
-		static void buildMap(const DirectoryListing::Directory* dir, TTHMap& tthMap) noexcept;
+		int matchListing(const UserPtr& p_user, const CFlyFileListCache::Index& p_index) noexcept;
+		/** Matches the list file with the queue without loading it if the list is in CFlyFileListCache */
+		bool matchCachedListing(const UserPtr& p_user, const string& p_file) noexcept;
 		void fire_remove_internal(const QueueItemPtr& p_qi, bool p_is_remove_item, bool p_is_force_remove_item, bool p_is_batch_remove);
 	public:
 		void fire_remove_batch();
@@ -375,6 +377,7 @@ class QueueManager : public Singleton<QueueManager>,
 #endif
 				static std::unique_ptr<webrtc::RWLockWrapper> g_cs_remove;
 				static bool is_queue_tth(const TTHValue& p_tth);
+				static void is_queue_tth(const std::vector<TTHValue>& p_tths, std::vector<bool>& p_result);
 			private:
 				static QueueItem::QIStringMap g_queue;
 				static boost::unordered_map<TTHValue, int> g_queue_tth_map;
@@ -386,6 +389,11 @@ class QueueManager : public Singleton<QueueManager>,
 		{
 			return g_fileQueue.is_queue_tth(p_tth);
 		}
+		/** p_result[i] - p_tths[i] is in the queue; one lock for all the TTHs (file list loading) */
+		static void is_queue_tth(const std::vector<TTHValue>& p_tths, std::vector<bool>& p_result)
+		{
+			g_fileQueue.is_queue_tth(p_tths, p_result);
+		}
 		/** QueueItems by target */
 		static FileQueue g_fileQueue;
 		
@@ -397,8 +405,12 @@ class QueueManager : public Singleton<QueueManager>,
 				void addL(const QueueItemPtr& qi, const UserPtr& aUser, bool p_is_first_load); // [!] IRainman fix.
 				QueueItemPtr getNextL(const UserPtr& aUser, QueueItem::Priority minPrio = QueueItem::LOWEST, int64_t wantedSize = 0, int64_t lastSpeed = 0, bool allowRemove = false); // [!] IRainman fix.
 				QueueItemPtr getRunning(const UserPtr& aUser);
+				void getRunning(const UserPtr& aUser, QueueItemList& p_items);
+				bool isRunning(const QueueItemPtr& qi, const UserPtr& aUser);
 				void addDownload(const QueueItemPtr& qi, const DownloadPtr& d);
 				bool removeDownload(const QueueItemPtr& qi, const UserPtr& d);
+				bool removeDownload(const QueueItemPtr& qi, const DownloadPtr& d);
+				/** Drops the running items of the user that have no Download of him any more */
 				void removeRunning(const UserPtr& d);
 				void removeQueueItemL(const QueueItemPtr& qi);
 				void removeQueueItem(const QueueItemPtr& qi);
@@ -406,7 +418,7 @@ class QueueManager : public Singleton<QueueManager>,
 				void setQIPriority(const QueueItemPtr& qi, QueueItem::Priority p);
 				
 				typedef boost::unordered_map<UserPtr, QueueItemList, User::Hash> UserQueueMap; // TODO - set ?
-				typedef boost::unordered_map<UserPtr, QueueItemPtr, User::Hash> RunningMap;
+				typedef boost::unordered_map<UserPtr, QueueItemList, User::Hash> RunningMap;
 #ifdef IRAINMAN_NON_COPYABLE_USER_QUEUE_ON_USER_CONNECTED_OR_DISCONECTED
 				const UserQueueMap& getListL(size_t i) const
 				{
@@ -422,9 +434,12 @@ class QueueManager : public Singleton<QueueManager>,
 				}
 				
 			private:
+				void removeRunning(const QueueItemPtr& qi, const UserPtr& aUser);
+				
 				/** QueueItems by priority and user (this is where the download order is determined) */
 				static UserQueueMap g_userQueueMap[QueueItem::LAST];
-				/** Currently running downloads, a QueueItem is always either here or in the userQueue */
+				/** Currently running downloads, a QueueItem is always either here or in the userQueue.
+				    Several items per user with pipelined requests (one Download of the user per item) */
 				static RunningMap g_runningMap;
 				/** Last error message to sent to TransferView */
 #ifdef FLYLINKDC_USE_USER_QUEUE_CS
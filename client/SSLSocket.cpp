@@ -31,6 +31,10 @@
 SSLSocket::SSLSocket(CryptoManager::SSLContext context, bool allowUntrusted, const string& expKP) : SSLSocket(context)
 {
 	verifyData.reset(new CryptoManager::SSLVerifyData(allowUntrusted, expKP));
+	if (expKP.compare(0, 7, "SHA256/") == 0)
+	{
+		m_session_key = expKP;
+	}
 }
 SSLSocket::SSLSocket(CryptoManager::SSLContext context) : /*Socket(/*TYPE_TCP), */ctx(NULL), ssl(NULL), verifyData(nullptr), m_is_trusted(false)
 {
@@ -39,6 +43,10 @@ SSLSocket::SSLSocket(CryptoManager::SSLContext context) : /*Socket(/*TYPE_TCP),
 
 void SSLSocket::connect(const string& aIp, uint16_t aPort)
 {
+	if (m_session_key.empty())
+	{
+		m_session_key = aIp + ':' + Util::toString(aPort);
+	}
 	Socket::connect(aIp, aPort);
 	
 	waitConnected(0);
@@ -66,6 +74,11 @@ bool SSLSocket::waitConnected(uint64_t millis)
 		}
 		
 		checkSSL(SSL_set_fd(ssl, static_cast<int>(getSock())));
+		
+		if (!ssl->server && !m_session_key.empty())
+		{
+			CryptoManager::restoreSession(ssl, m_session_key);
+		}
 	}
 	
 	if (SSL_is_init_finished(ssl))
@@ -79,8 +92,13 @@ bool SSLSocket::waitConnected(uint64_t millis)
 		if (ret == 1)
 		{
 			dcdebug("Connected to SSL server using %s as %s\n", SSL_get_cipher(ssl), ssl->server ? "server" : "client");
+			CryptoManager::addHandshake(ssl->server != 0, SSL_session_reused(ssl) != 0);
 			if (!ssl->server)
 			{
+				if (!m_session_key.empty())
+				{
+					CryptoManager::storeSession(ssl, m_session_key);
+				}
 				const unsigned char* protocol = 0;
 				unsigned int len = 0;
 				SSL_get0_alpn_selected(ssl, &protocol, &len);
@@ -144,6 +162,7 @@ bool SSLSocket::waitAccepted(uint64_t millis)
 		if (ret == 1)
 		{
 			dcdebug("Connected to SSL client using %s\n", SSL_get_cipher(ssl));
+			CryptoManager::addHandshake(true, SSL_session_reused(ssl) != 0);
 			return true;
 		}
 		if (!waitWant(ret, millis))
@@ -265,6 +284,11 @@ int SSLSocket::checkSSL(int ret)
 				{
 					_error = ERR_error_string(sys_err, NULL);
 				}
+				if (!ssl->server && !m_session_key.empty())
+				{
+					// Don't try to resume the failed session again
+					CryptoManager::removeSession(m_session_key);
+				}
 				ssl.reset();
 				//dcdebug("TLS error: call ret = %d, SSL_get_error = %d, ERR_get_error = " U64_FMT ",ERROR string: %s \n", ret, err, sys_err, ERR_error_string(sys_err, NULL));
 				throw SSLSocketException(STRING(TLS_ERROR) + (_error.empty() ? "" : + ": " + _error));
@@ -333,15 +357,18 @@ ByteVector SSLSocket::getKeyprint() const noexcept
 	if (!ssl)
 		return ByteVector();
 		
+	if (!m_keyprint.empty())
+		return m_keyprint;
+		
 	X509* x509 = SSL_get_peer_certificate(ssl);
 	
 	if (!x509)
 		return ByteVector();
 		
-	ByteVector res = CryptoManager::X509_digest_internal(x509, EVP_sha256());
+	m_keyprint = CryptoManager::X509_digest_internal(x509, EVP_sha256());
 	
 	X509_free(x509);
-	return res;
+	return m_keyprint;
 }
 
 bool SSLSocket::verifyKeyprint(const string& expKP, bool allowUntrusted) noexcept
@@ -404,6 +431,7 @@ void SSLSocket::shutdown() noexcept
 void SSLSocket::close() noexcept
 {
 	m_is_trusted = false;
+	m_keyprint.clear();
 	if (ssl)
 	{
 		ssl.reset();
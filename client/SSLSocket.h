@@ -88,6 +88,8 @@ class SSLSocket : public Socket
 		SSL_CTX* ctx;
 		ssl::SSL ssl;
 		bool m_is_trusted;
+		string m_session_key; // CryptoManager::restoreSession
+		mutable ByteVector m_keyprint; // peer keyprint, calculated once per connection
 		
 		unique_ptr<CryptoManager::SSLVerifyData> verifyData;    // application data used by CryptoManager::verify_callback(...)
 		
@@ -378,8 +378,10 @@ int SearchManager::UdpQueue::run()
 			}
 			else if (x.compare(1, 4, "RES ", 4) == 0 && x[x.length() - 1] == 0x0a)
 			{
-				AdcCommand c(x.substr(0, x.length() - 1));
-				if (c.getParameters().empty())
+				CFlyAdcCommandView c;
+				if (const char* l_error = c.parse(x.c_str(), x.length() - 1))
+					throw ParseException(l_error);
+				if (c.getParamCount() == 0)
 					continue;
 				const string cid = c.getParam(0);
 				if (cid.size() != 39)
@@ -391,18 +393,17 @@ int SearchManager::UdpQueue::run()
 				if (!user)
 					continue;
 					
-				// This should be handled by AdcCommand really...
-				c.getParameters().erase(c.getParameters().begin());
-				
-				SearchManager::getInstance()->onRES(c, user, remoteIp);
+				SearchManager::getInstance()->onRES(AdcParams(c, 1), user, remoteIp);
 #ifdef FLYLINKDC_USE_COLLECT_STAT
 				CFlylinkDBManager::getInstance()->push_event_statistic("SearchManager::UdpQueue::run()", "RES", x, remoteIp, "", "", "");
 #endif
 			}
 			else if (x.compare(1, 4, "PSR ", 4) == 0 && x[x.length() - 1] == 0x0a)
 			{
-				AdcCommand c(x.substr(0, x.length() - 1));
-				if (c.getParameters().empty())
+				CFlyAdcCommandView c;
+				if (const char* l_error = c.parse(x.c_str(), x.length() - 1))
+					throw ParseException(l_error);
+				if (c.getParamCount() == 0)
 					continue;
 				const string cid = c.getParam(0);
 				if (cid.size() != 39)
@@ -413,8 +414,7 @@ int SearchManager::UdpQueue::run()
 				
 				if (user)
 				{
-					c.getParameters().erase(c.getParameters().begin());
-					SearchManager::getInstance()->onPSR(c, user, remoteIp);
+					SearchManager::getInstance()->onPSR(AdcParams(c, 1), user, remoteIp);
 #ifdef FLYLINKDC_USE_COLLECT_STAT
 					CFlylinkDBManager::getInstance()->push_event_statistic("SearchManager::UdpQueue::run()", "PSR", x, remoteIp, "", "", "");
 #endif
@@ -507,7 +507,7 @@ void SearchManager::search_auto(const string& p_tth)
 	ClientManager::search(l_search_param);
 }
 
-void SearchManager::onRES(const AdcCommand& cmd, const UserPtr& from, const boost::asio::ip::address_v4& p_remoteIp)
+void SearchManager::onRES(const AdcParams& p_params, const UserPtr& from, const boost::asio::ip::address_v4& p_remoteIp)
 {
 	int freeSlots = -1;
 	int64_t size = -1;
@@ -515,9 +515,10 @@ void SearchManager::onRES(const AdcCommand& cmd, const UserPtr& from, const boos
 	string tth;
 	uint32_t l_token = -1; // 0 == auto
 	
-	for (auto i = cmd.getParameters().cbegin(); i != cmd.getParameters().cend(); ++i)
+	string l_buf;
+	for (size_t i = 0; i < p_params.size(); ++i)
 	{
-		const string& str = *i;
+		const string& str = p_params.get(i, l_buf);
 		if (str.compare(0, 2, "FN", 2) == 0)
 		{
 			file = Util::toNmdcFile(str.substr(2));
@@ -560,7 +561,7 @@ void SearchManager::onRES(const AdcCommand& cmd, const UserPtr& from, const boos
 	}
 }
 
-void SearchManager::onPSR(const AdcCommand& p_cmd, UserPtr from, const boost::asio::ip::address_v4& remoteIp)
+void SearchManager::onPSR(const AdcParams& p_params, UserPtr from, const boost::asio::ip::address_v4& remoteIp)
 {
 	uint16_t udpPort = 0;
 	uint32_t partialCount = 0;
@@ -569,9 +570,10 @@ void SearchManager::onPSR(const AdcCommand& p_cmd, UserPtr from, const boost::as
 	string nick;
 	PartsInfo partialInfo;
 	
-	for (auto i = p_cmd.getParameters().cbegin(); i != p_cmd.getParameters().cend(); ++i)
+	string l_buf;
+	for (size_t i = 0; i < p_params.size(); ++i)
 	{
-		const string& str = *i;
+		const string& str = p_params.get(i, l_buf);
 		if (str.compare(0, 2, "U4", 2) == 0)
 		{
 			udpPort = static_cast<uint16_t>(Util::toInt(str.substr(2)));
@@ -26,6 +26,7 @@
 #include "StringSearch.h" // [+] IRainman
 #include "SearchManagerListener.h"
 #include "AdcCommand.h"
+#include "CFlyAdcCommandView.h"
 #include "ClientManager.h"
 
 class SearchManager : public Speaker<SearchManagerListener>, public Singleton<SearchManager>, public Thread
@@ -60,11 +61,49 @@ class SearchManager : public Speaker<SearchManagerListener>, public Singleton<Se
 			onData(aLine);
 		}
 		
-		void onRES(const AdcCommand& cmd, const UserPtr& from, const boost::asio::ip::address_v4& remoteIp);
-		void onPSR(const AdcCommand& cmd, UserPtr from, const boost::asio::ip::address_v4& remoteIp);
+		void onRES(const AdcCommand& cmd, const UserPtr& from, const boost::asio::ip::address_v4& remoteIp)
+		{
+			onRES(AdcParams(cmd), from, remoteIp);
+		}
+		void onPSR(const AdcCommand& cmd, UserPtr from, const boost::asio::ip::address_v4& remoteIp)
+		{
+			onPSR(AdcParams(cmd), from, remoteIp);
+		}
 		static void toPSR(AdcCommand& cmd, bool wantResponse, const string& myNick, const string& hubIpPort, const string& tth, const vector<uint16_t>& partialInfo);
 		
 	private:
+		/** Parameters of RES/PSR: of the hub command or of the UDP packet parsed in place (no StringList) */
+		class AdcParams
+		{
+			public:
+				explicit AdcParams(const AdcCommand& p_cmd) : m_cmd(&p_cmd), m_view(nullptr), m_start(0)
+				{
+				}
+				/** p_start - index of the first parameter (after CID) */
+				AdcParams(const CFlyAdcCommandView& p_view, size_t p_start) : m_cmd(nullptr), m_view(&p_view), m_start(p_start)
+				{
+				}
+				size_t size() const
+				{
+					return m_cmd ? m_cmd->getParameters().size() : m_view->getParamCount() - m_start;
+				}
+				/** p_buf - for the unescaped value of the view */
+				const string& get(size_t n, string& p_buf) const
+				{
+					if (m_cmd)
+						return m_cmd->getParameters()[n];
+					p_buf.clear();
+					m_view->appendParam(m_start + n, p_buf);
+					return p_buf;
+				}
+			private:
+				const AdcCommand* m_cmd;
+				const CFlyAdcCommandView* m_view;
+				const size_t m_start;
+		};
+		void onRES(const AdcParams& p_params, const UserPtr& from, const boost::asio::ip::address_v4& remoteIp);
+		void onPSR(const AdcParams& p_params, UserPtr from, const boost::asio::ip::address_v4& remoteIp);
+		
 		class UdpQueue: public Thread
 		{
 			public:
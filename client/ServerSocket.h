@@ -69,7 +69,6 @@ class ServerSocket : public Speaker<ServerSocketListener>
 	private:
 	
 		friend class Socket;
-		friend class WebServerSocket;
 		
 		Socket socket;
 };
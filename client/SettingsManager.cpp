@@ -440,6 +440,9 @@ static const char* g_settingTags[] =
 	"TTHGPUDevNum",
 	//"UsersTop", "UsersBottom", "UsersLeft", "UsersRight",
 	"FavUsersSplitterPos",
+	"ShareSearchThreads",
+	"UserUpdateInterval",
+	"UserUpdateBatchSize",
 	"SENTRY",
 };
 
@@ -1265,6 +1268,9 @@ void SettingsManager::setDefaults()
 	setDefault(REPORT_TO_USER_IF_OUTDATED_OS_DETECTED, TRUE);
 #endif
 	setDefault(TTH_GPU_DEV_NUM, -1);
+	setDefault(SHARE_SEARCH_THREADS, 0);
+	setDefault(USER_UPDATE_INTERVAL, 100); // ms between the batches of the user updates of a hub
+	setDefault(USER_UPDATE_BATCH_SIZE, 1000);
 	setSearchTypeDefaults();
 	// TODO -        .
 	Util::shrink_to_fit(&strDefaults[STR_FIRST], &strDefaults[STR_LAST]); // [+] IRainman opt.
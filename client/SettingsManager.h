@@ -461,6 +461,9 @@ class SettingsManager : public Singleton<SettingsManager>, public Speaker<Settin
 		                  TTH_GPU_DEV_NUM,
 		                  //  USERS_TOP, USERS_BOTTOM, USERS_LEFT, USERS_RIGHT,
 		                  FAV_USERS_SPLITTER_POS,
+		                  SHARE_SEARCH_THREADS,
+		                  USER_UPDATE_INTERVAL,
+		                  USER_UPDATE_BATCH_SIZE,
 		                  INT_LAST,
 		                  SETTINGS_LAST = INT_LAST
 		                };
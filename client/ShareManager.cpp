@@ -32,7 +32,7 @@
 #include "Wildcards.h"
 #include "Transfer.h"
 #include "Download.h"
-#include "HashBloom.h"
+#include "CFlyTTHBloomCache.h"
 #include "SearchResult.h"
 #include "UploadManager.h"
 #include "../FlyFeatures/flyServer.h"
@@ -51,7 +51,7 @@
 #include <boost/algorithm/string.hpp>
 
 bool ShareManager::g_ignoreFileSizeHFS = false; // http://www.flylinkdc.ru/2015/01/hfs-mac-windows.html
-size_t ShareManager::g_hits = 0;
+std::atomic<size_t> ShareManager::g_hits(0);
 int ShareManager::g_RebuildIndexes = 0;
 std::unique_ptr<webrtc::RWLockWrapper> ShareManager::g_csBloom = std::unique_ptr<webrtc::RWLockWrapper>(webrtc::RWLockWrapper::CreateRWLock());
 #ifdef FLYLINKDC_USE_RW_LOCK_SHARE
@@ -59,19 +59,21 @@ std::unique_ptr<webrtc::RWLockWrapper> ShareManager::g_csShare = std::unique_ptr
 #else
 CriticalSection ShareManager::g_csShare;
 #endif
-std::unique_ptr<webrtc::RWLockWrapper> ShareManager::g_csShareNotExists = std::unique_ptr<webrtc::RWLockWrapper>(webrtc::RWLockWrapper::CreateRWLock());
-std::unique_ptr<webrtc::RWLockWrapper> ShareManager::g_csShareCache = std::unique_ptr<webrtc::RWLockWrapper>(webrtc::RWLockWrapper::CreateRWLock());
 
 CriticalSection ShareManager::g_csTTHIndex;
 
 FastCriticalSection ShareManager::g_csPartialCache;
-std::unordered_map<string, std::pair<string, unsigned> > ShareManager::g_partial_list_cache;
+std::unordered_map<string, std::shared_ptr<const string> > ShareManager::g_partial_list_cache;
+size_t ShareManager::g_partial_cache_size = 0;
+uint64_t ShareManager::g_partial_cache_generation = 0;
+static const size_t g_max_partial_cache_size = 32 * 1024 * 1024;
 
 FastCriticalSection ShareManager::g_csTTHPathCache;
 std::unordered_map<TTHValue, std::pair<string, unsigned> > ShareManager::g_tth_path_cache;
 
-QueryNotExistsSet ShareManager::g_file_not_exists_set;
-QueryCacheMap ShareManager::g_file_cache_map;
+size_t ShareManager::g_search_cache_max_bytes = 16 * 1024 * 1024;
+CFlySearchCache ShareManager::g_search_cache(ShareManager::g_search_cache_max_bytes);
+CFlyWorkerPool ShareManager::g_search_pool;
 ShareManager::HashFileMap ShareManager::g_tthIndex;
 ShareManager::ShareMap ShareManager::g_shares;
 ShareManager::ShareMap ShareManager::g_lost_shares;
@@ -83,7 +85,6 @@ int64_t ShareManager::g_CurrentShareSize = -1;
 bool ShareManager::g_is_initial = true;
 ShareManager::DirList ShareManager::g_list_directories;
 BloomFilter<5> ShareManager::g_bloom(1 << 20);
-unsigned ShareManager::g_cache_limit = 1000;
 FastCriticalSection ShareManager::g_csBot;
 std::unordered_map<string, unsigned> ShareManager::g_BotDetectMap;
 
@@ -118,6 +119,7 @@ ShareManager::ShareManager() : xmlListLen(0), bzXmlListLen(0),
 	TimerManager::getInstance()->addListener(this);
 	QueueManager::getInstance()->addListener(this);
 	HashManager::getInstance()->addListener(this);
+	updateSearchPool();
 }
 
 ShareManager::~ShareManager()
@@ -160,7 +162,22 @@ void ShareManager::shutdown()
 	{
 		CFlylinkDBManager::getInstance()->set_registry_variable_int64(e_LastShareSize, g_CurrentShareSize);
 	}
-	internalClearCache(true);
+	g_search_pool.stop();
+	CFlyTTHBloomCache::stop();
+	internalClearCache();
+}
+
+void ShareManager::updateSearchPool()
+{
+	const int l_count_threads = std::min(SETTING(SHARE_SEARCH_THREADS), 16);
+	if (l_count_threads > 0)
+	{
+		g_search_pool.start(l_count_threads, "ShareManager::search");
+	}
+	else
+	{
+		g_search_pool.stop();
+	}
 }
 
 ShareManager::Directory::Directory(const string& aName, const ShareManager::Directory::Ptr& aParent) :
@@ -291,6 +308,18 @@ bool ShareManager::isTTHShared(const TTHValue& tth)
 	}
 	return false;
 }
+void ShareManager::isTTHShared(const std::vector<TTHValue>& p_tths, std::vector<bool>& p_result)
+{
+	p_result.assign(p_tths.size(), false);
+	if (!ClientManager::isBeforeShutdown())
+	{
+		CFlyLock(g_csTTHIndex);
+		for (size_t i = 0; i < p_tths.size(); ++i)
+		{
+			p_result[i] = g_tthIndex.find(p_tths[i]) != g_tthIndex.end();
+		}
+	}
+}
 tstring ShareManager::calc_status_file(const TTHValue& p_tth)
 {
 	tstring l_result;
@@ -834,7 +863,7 @@ bool ShareManager::loadCache() noexcept
 					}
 				}
 			}
-			internalClearCache(true);
+			internalClearCache();
 			l_cache_loader_log.step("update indices done");
 			//internalClearCache(true);
 			//l_cache_loader_log.step("internalClearCache");
@@ -855,7 +884,7 @@ bool ShareManager::loadCache() noexcept
 	}
 	catch (const Exception& e)
 	{
-		internalClearCache(true);
+		internalClearCache();
 		dcdebug("%s\n", e.getError().c_str());
 	}
 	return false;
@@ -1024,6 +1053,7 @@ void ShareManager::addDirectory(const string& realPath, const string& virtualNam
 				}
 			}
 		}
+		internalClearCache();
 		setDirty();
 	}
 }
@@ -1143,6 +1173,7 @@ void ShareManager::removeDirectory(const string& realPath)
 		
 		HashManager::HashPauser pauser;
 		
+		bool l_is_readd = false;
 		// Readd all directories with the same vName
 		for (i = g_shares.begin(); i != g_shares.end(); ++i)
 		{
@@ -1153,9 +1184,19 @@ void ShareManager::removeDirectory(const string& realPath)
 				{
 					get_mergeL(dp);
 				}
+				l_is_readd = true;
 			}
 		}
 		rebuildIndicesL(true);
+		if (l_is_readd)
+		{
+			internalClearCache();
+		}
+		else
+		{
+			// Removing can't add new results - drop only entries pointing into the removed root.
+			g_search_cache.invalidatePath(Text::toLower(l_Name) + '\\', false);
+		}
 	}
 	internalCalcShareSize();
 	setDirty();
@@ -1592,6 +1633,7 @@ void ShareManager::rebuildIndicesL(bool p_is_clear_cache)
 		{
 			CFlyLock(g_csTTHIndex);
 			g_tthIndex.clear();
+			CFlyTTHBloomCache::resetL();
 		}
 		{
 			CFlyWriteLock(*g_csBloom);
@@ -1599,7 +1641,7 @@ void ShareManager::rebuildIndicesL(bool p_is_clear_cache)
 		}
 		if (p_is_clear_cache)
 		{
-			clear_partial_cache("");
+			clear_partial_cache();
 			clear_tth_path_cache();
 		}
 		{
@@ -1625,6 +1667,7 @@ bool ShareManager::updateIndicesFileL(Directory& dir, const Directory::ShareFile
 			{
 				dir.m_size += f.getSize();
 				g_tthIndex.insert(make_pair(f.getTTH(), i));
+				CFlyTTHBloomCache::addL(f.getTTH());
 				g_isNeedsUpdateShareSize = true;
 			}
 			else
@@ -1790,6 +1833,7 @@ int ShareManager::run()
 			}
 			rebuildIndicesL(false);
 		}
+		internalClearCache();
 		internalCalcShareSize();
 		m_is_refreshDirs = false;
 		LogManager::message(STRING(FILE_LIST_REFRESH_FINISHED));
@@ -1805,17 +1849,21 @@ int ShareManager::run()
 
 void ShareManager::getBloom(ByteVector& v, size_t k, size_t m, size_t h)
 {
-	dcdebug("Creating bloom filter, k=%u, m=%u, h=%u\n", unsigned(k), unsigned(m), unsigned(h));
-	HashBloom bloom;
-	bloom.reset(k, m, h);
+	if (!CFlyTTHBloomCache::get(v, k, m, h))
 	{
-		CFlyLock(g_csTTHIndex);
-		for (auto i = g_tthIndex.cbegin(); i != g_tthIndex.cend(); ++i)
-		{
-			bloom.add(i->first);
-		}
+		CFlyTTHBloomCache::build(v, k, m, h);
+	}
+}
+
+void ShareManager::getTTHSnapshot(std::vector<TTHValue>& p_tths)
+{
+	CFlyLock(g_csTTHIndex);
+	p_tths.reserve(g_tthIndex.size());
+	for (auto i = g_tthIndex.cbegin(); i != g_tthIndex.cend(); ++i)
+	{
+		p_tths.push_back(i->first);
 	}
-	bloom.copy_to(v);
+	CFlyTTHBloomCache::startJournalL();
 }
 
 void ShareManager::generateXmlList()
@@ -1949,20 +1997,61 @@ MemoryInputStream* ShareManager::generatePartialList(const string& dir, bool rec
 		return new MemoryInputStream(xml);
 	}
 #endif
-	if (recurse == false)
+	// The body of the list is cached per directory and served without the share lock
+	const string l_key = Text::toLower(dir) + (recurse ? "*" : "");
+	std::shared_ptr<const string> l_body;
+	uint64_t l_generation;
 	{
 		CFlyFastLock(g_csPartialCache);
-		auto i = g_partial_list_cache.find(dir);
+		const auto i = g_partial_list_cache.find(l_key);
 		if (i != g_partial_list_cache.end())
 		{
-			i->second.second++;
-#ifdef FLYLINKDC_BETA
-			// LogManager::message("Use partial file list cache: " + dir + " count = " + Util::toString(i->second.second));
-#endif // FLYLINKDC_BETA
-			return new MemoryInputStream(i->second.first);
+			l_body = i->second;
+		}
+		l_generation = g_partial_cache_generation;
+	}
+	if (!l_body)
+	{
+		auto l_new_body = std::make_shared<string>();
+		if (!generatePartialListBody(dir, recurse, *l_new_body))
+			return nullptr;
+		l_body = l_new_body;
+		CFlyFastLock(g_csPartialCache);
+		// a directory could be changed while the body was built
+		if (l_generation == g_partial_cache_generation && g_partial_cache_size + l_body->size() <= g_max_partial_cache_size)
+		{
+			auto& l_cur = g_partial_list_cache[l_key];
+			if (l_cur)
+			{
+				g_partial_cache_size -= l_cur->size();
+			}
+			l_cur = l_body;
+			g_partial_cache_size += l_body->size();
 		}
 	}
-	StringOutputStream sos(xml);
+	xml.reserve(xml.size() + l_body->size() + 16);
+	xml += *l_body;
+	xml += "</FileListing>";
+	
+#ifdef _DEBUG
+	std::ofstream l_fs;
+	l_fs.open(_T("flylinkdc-partial-list.log"), std::ifstream::out | std::ifstream::app);
+	if (l_fs.good())
+	{
+		l_fs << std::endl << std::endl << std::endl << " xml: [" << xml << "]" << std::endl;
+	}
+	else
+	{
+		//dcassert(0);
+	}
+#endif
+	return new MemoryInputStream(xml);
+}
+
+bool ShareManager::generatePartialListBody(const string& dir, bool recurse, string& p_body)
+{
+	StringOutputStream sos(p_body);
+	string tmp;
 	
 #ifdef FLYLINKDC_USE_RW_LOCK_SHARE
 	CFlyReadLock(*g_csShare);
@@ -2003,7 +2092,7 @@ MemoryInputStream* ShareManager::generatePartialList(const string& dir, bool rec
 				const auto it = getByVirtualL(dir.substr(j, i - j));
 				
 				if (it == g_list_directories.end())
-					return nullptr;
+					return false;
 					
 				root = *it;
 			}
@@ -2012,7 +2101,7 @@ MemoryInputStream* ShareManager::generatePartialList(const string& dir, bool rec
 				const auto  it2 = root->m_share_directories.find(dir.substr(j, i - j));
 				if (it2 == root->m_share_directories.end())
 				{
-					return nullptr;
+					return false;
 				}
 				
 				root = it2->second;
@@ -2020,7 +2109,7 @@ MemoryInputStream* ShareManager::generatePartialList(const string& dir, bool rec
 			j = i + 1;
 		}
 		if (!root)
-			return nullptr;
+			return false;
 			
 		for (auto it2 = root->m_share_directories.cbegin(); it2 != root->m_share_directories.cend(); ++it2)
 		{
@@ -2028,28 +2117,7 @@ MemoryInputStream* ShareManager::generatePartialList(const string& dir, bool rec
 		}
 		root->filesToXmlL(sos, indent, tmp);
 	}
-	
-	xml += "</FileListing>";
-	if (recurse == false)
-	{
-		CFlyFastLock(g_csPartialCache);
-		auto& i = g_partial_list_cache[dir];
-		i.first = xml;
-	}
-	
-#ifdef _DEBUG
-	std::ofstream l_fs;
-	l_fs.open(_T("flylinkdc-partial-list.log"), std::ifstream::out | std::ifstream::app);
-	if (l_fs.good())
-	{
-		l_fs << std::endl << std::endl << std::endl << " xml: [" << xml << "]" << std::endl;
-	}
-	else
-	{
-		//dcassert(0);
-	}
-#endif
-	return new MemoryInputStream(xml);
+	return true;
 }
 
 #define LITERAL(n) n, sizeof(n)-1
@@ -2443,8 +2511,18 @@ void ShareManager::Directory::search(SearchResultList& aResults, StringSearch::L
 	if (!hasType(p_search_param.m_file_type))
 		return;
 		
-	StringSearch::List* cur = &aStrings;
 	unique_ptr<StringSearch::List> newStr;
+	StringSearch::List* cur = searchLocal(aResults, aStrings, p_search_param, newStr);
+	for (auto l = m_share_directories.cbegin(); l != m_share_directories.cend() && aResults.size() < p_search_param.m_max_results; ++l)
+	{
+		l->second->search(aResults, *cur, p_search_param); //TODO - Hot point
+	}
+}
+
+StringSearch::List* ShareManager::Directory::searchLocal(SearchResultList& aResults, StringSearch::List& aStrings, const SearchParamBase& p_search_param,
+                                                         unique_ptr<StringSearch::List>& newStr) const noexcept
+{
+	StringSearch::List* cur = &aStrings;
 	
 	// Find any matches in the directory name
 #ifdef FLYLINKDC_USE_COLLECT_STAT
@@ -2544,13 +2622,11 @@ void ShareManager::Directory::search(SearchResultList& aResults, StringSearch::L
 			}
 		}
 	}
-	for (auto l = m_share_directories.cbegin(); l != m_share_directories.cend() && aResults.size() < p_search_param.m_max_results; ++l)
-	{
-		l->second->search(aResults, *cur, p_search_param); //TODO - Hot point
-	}
+	return cur;
 }
 bool ShareManager::search_tth(const TTHValue& p_tth, SearchResultList& aResults, bool p_is_check_parent)
 {
+	CFlyMetrics::inc(CFlyMetrics::SEARCH_TTH_COUNT);
 	CFlyLock(g_csTTHIndex);
 	const auto& i = g_tthIndex.find(p_tth);
 	if (i == g_tthIndex.end())
@@ -2572,6 +2648,7 @@ bool ShareManager::search_tth(const TTHValue& p_tth, SearchResultList& aResults,
 bool ShareManager::searchTTHArray(CFlySearchArrayTTH& p_all_search_array, const Client* p_client)
 {
 	bool l_result = true;
+	CFlyMetrics::inc(CFlyMetrics::SEARCH_TTH_COUNT, p_all_search_array.size());
 	CFlyLock(g_csTTHIndex);
 	for (auto j = p_all_search_array.begin(); j != p_all_search_array.end(); ++j)
 	{
@@ -2610,37 +2687,20 @@ bool ShareManager::isUnknownTTH(const TTHValue& p_tth)
 	return g_tthIndex.find(p_tth) == g_tthIndex.end();
 }
 
-bool ShareManager::isUnknownFile(const string& p_search)
-{
-	CFlyReadLock(*g_csShareNotExists);
-	return g_file_not_exists_set.find(p_search) != g_file_not_exists_set.end();
-}
-
-void ShareManager::addUnknownFile(const string& p_search)
-{
-	CFlyWriteLock(*g_csShareNotExists);
-	g_file_not_exists_set.insert(p_search);
-}
-bool ShareManager::isCacheFile(const string& p_search, SearchResultList& p_search_result)
-{
-	CFlyReadLock(*g_csShareCache);
-	const auto l_result = g_file_cache_map.find(p_search);
-	if (l_result != g_file_cache_map.end())
-	{
-		p_search_result = l_result->second;
-		return true;
-	}
-	return false;
-}
-void ShareManager::addCacheFile(const string& p_search, const SearchResultList& p_search_result)
+bool ShareManager::isUnknownFile(const SearchParamBase& p_search_param)
 {
-	CFlyWriteLock(*g_csShareCache);
-	g_file_cache_map.insert(make_pair(p_search, p_search_result));
+	string l_key;
+	StringList l_terms;
+	if (!CFlySearchCache::makeKey(p_search_param, l_key, l_terms))
+		return false;
+	return g_search_cache.isNegative(l_key);
 }
 void ShareManager::search(SearchResultList& aResults, const SearchParam& p_search_param) noexcept
 {
 	if (ClientManager::isBeforeShutdown())
 		return;
+	CFlyMetrics::inc(CFlyMetrics::SEARCH_COUNT);
+	CFlyMetrics::ScopedTimer l_metrics_timer(CFlyMetrics::SEARCH_LATENCY);
 	if (p_search_param.m_file_type == Search::TYPE_TTH)
 	{
 		//dcassert(isTTHBase64(p_search_param.m_filter));
@@ -2675,14 +2735,16 @@ void ShareManager::search(SearchResultList& aResults, const SearchParam& p_searc
 		}
 		return;
 	}
-	const auto l_raw_query = p_search_param.getRAWQuery();
-	if (isUnknownFile(l_raw_query))
-	{
-		return; //   -       .
-	}
-	if (isCacheFile(l_raw_query, aResults))
+	string l_cache_key;
+	StringList l_cache_terms;
+	const bool l_is_cacheable = CFlySearchCache::makeKey(p_search_param, l_cache_key, l_cache_terms) && p_search_param.m_max_results > 0;
+	if (l_is_cacheable)
 	{
-		return;
+		bool l_is_negative = false;
+		if (g_search_cache.find(l_cache_key, p_search_param.m_max_results, aResults, l_is_negative))
+		{
+			return; //   -        (    ).
+		}
 	}
 #ifdef DEBUG
 	string l_search_line;
@@ -2707,7 +2769,10 @@ void ShareManager::search(SearchResultList& aResults, const SearchParam& p_searc
 		}
 		if (!l_is_bloom)
 		{
-			addUnknownFile(l_raw_query); // TODO -   bloom   .
+			if (l_is_cacheable)
+			{
+				g_search_cache.add(l_cache_key, l_cache_terms, p_search_param.m_max_results, aResults);
+			}
 			return;
 		}
 	}
@@ -2743,20 +2808,120 @@ void ShareManager::search(SearchResultList& aResults, const SearchParam& p_searc
 #else
 		CFlyLock(g_csShare);
 #endif
-		for (auto j = g_list_directories.cbegin(); j != g_list_directories.cend() && aResults.size() < p_search_param.m_max_results; ++j)
+		if (!searchParallelL(aResults, ssl, p_search_param))
 		{
-			(*j)->search(aResults, ssl, p_search_param);
+			for (auto j = g_list_directories.cbegin(); j != g_list_directories.cend() && aResults.size() < p_search_param.m_max_results; ++j)
+			{
+				(*j)->search(aResults, ssl, p_search_param);
+			}
 		}
 	}
 	//    -          - .
-	if (aResults.empty())
+	//    -      .
+	if (l_is_cacheable)
 	{
-		addUnknownFile(l_raw_query);
+		g_search_cache.add(l_cache_key, l_cache_terms, p_search_param.m_max_results, aResults);
 	}
-	else
+}
+
+bool ShareManager::searchParallelL(SearchResultList& aResults, StringSearch::List& aStrings, const SearchParamBase& p_search_param)
+{
+	if (g_search_pool.getThreadCount() == 0)
+		return false;
+	// Work items in the order of the serial search: a big root is split into
+	// "the root itself + its files" and one item per subdirectory.
+	struct SearchUnit
+	{
+		const Directory* m_dir;
+		StringSearch::List* m_strings;
+		bool m_is_local;
+		SearchResultList m_results;
+	};
+	std::vector<SearchUnit> l_units;
+	std::list<unique_ptr<StringSearch::List>> l_sub_strings;
+	for (auto j = g_list_directories.cbegin(); j != g_list_directories.cend(); ++j)
+	{
+		const Directory& l_root = **j;
+		if (!l_root.hasType(p_search_param.m_file_type))
+			continue;
+		if (l_root.m_share_directories.size() < 2)
+		{
+			l_units.push_back(SearchUnit{ &l_root, &aStrings, false, SearchResultList() });
+			continue;
+		}
+		// Terms left after matching the root name - the same as Directory::searchLocal does.
+		unique_ptr<StringSearch::List> l_sub;
+		for (auto k = aStrings.cbegin(); k != aStrings.cend(); ++k)
+		{
+			if (k->matchLower(l_root.getLowName()))
+			{
+				if (!l_sub)
+				{
+					l_sub = std::make_unique<StringSearch::List>(aStrings);
+				}
+				l_sub->erase(remove(l_sub->begin(), l_sub->end(), *k), l_sub->end());
+			}
+		}
+		StringSearch::List* l_strings = &aStrings;
+		if (l_sub)
+		{
+			l_strings = l_sub.get();
+			l_sub_strings.push_back(std::move(l_sub));
+		}
+		l_units.push_back(SearchUnit{ &l_root, &aStrings, true, SearchResultList() });
+		for (auto l = l_root.m_share_directories.cbegin(); l != l_root.m_share_directories.cend(); ++l)
+		{
+			l_units.push_back(SearchUnit{ l->second.get(), l_strings, false, SearchResultList() });
+		}
+	}
+	if (l_units.size() < 2)
+		return false;
+		
+	// 0 - not finished, otherwise count of results + 1
+	std::unique_ptr<std::atomic<size_t>[]> l_done(new std::atomic<size_t>[l_units.size()]);
+	for (size_t i = 0; i < l_units.size(); ++i)
+	{
+		l_done[i] = 0;
+	}
+	const auto l_task = [&](size_t p_index)
+	{
+		// Early cancellation: the finished items before this one already have enough results.
+		size_t l_found = 0;
+		for (size_t i = 0; i < p_index; ++i)
+		{
+			const size_t l_count = l_done[i];
+			if (l_count == 0)
+				break;
+			l_found += l_count - 1;
+		}
+		SearchUnit& l_unit = l_units[p_index];
+		if (l_found < p_search_param.m_max_results)
+		{
+			if (l_unit.m_is_local)
+			{
+				unique_ptr<StringSearch::List> l_unused;
+				l_unit.m_dir->searchLocal(l_unit.m_results, *l_unit.m_strings, p_search_param, l_unused);
+			}
+			else
+			{
+				l_unit.m_dir->search(l_unit.m_results, *l_unit.m_strings, p_search_param);
+			}
+		}
+		l_done[p_index] = l_unit.m_results.size() + 1;
+	};
+	if (!g_search_pool.tryRunBatch(l_units.size(), l_task))
+		return false; // the pool is busy with a search from another hub
+		
+	// Merge in the item order - the result does not depend on the number of threads.
+	for (auto i = l_units.cbegin(); i != l_units.cend() && aResults.size() < p_search_param.m_max_results; ++i)
+	{
+		aResults.insert(aResults.end(), i->m_results.cbegin(), i->m_results.cend());
+	}
+	if (aResults.size() > p_search_param.m_max_results)
 	{
-		addCacheFile(l_raw_query, aResults);
+		aResults.resize(p_search_param.m_max_results);
 	}
+	return true;
 }
 
 inline static uint16_t toCode(char a, char b)
@@ -2933,7 +3098,9 @@ void ShareManager::search_max_result(SearchResultList& aResults, const StringLis
 {
 	if (ClientManager::isBeforeShutdown())
 		return;
-		
+	CFlyMetrics::inc(CFlyMetrics::SEARCH_COUNT);
+	CFlyMetrics::ScopedTimer l_metrics_timer(CFlyMetrics::SEARCH_LATENCY);
+	
 	AdcSearch srch(params);
 	reguest = srch.m_includeX; // [+] IRainman
 	if (srch.m_hasRoot)
@@ -3050,6 +3217,9 @@ void ShareManager::on(HashManagerListener::TTHDone, const string& fname, const T
                       int64_t aTimeStamp, const CFlyMediaInfo& p_out_media, int64_t p_size) noexcept
 {
 	dcassert(!ClientManager::isBeforeShutdown());
+	string l_low_virtual_path;
+	string l_low_adc_path;
+	bool l_is_new_file = false;
 	{
 		CFlyBusy l_busy(g_RebuildIndexes);
 #ifdef FLYLINKDC_USE_RW_LOCK_SHARE
@@ -3062,6 +3232,8 @@ void ShareManager::on(HashManagerListener::TTHDone, const string& fname, const T
 			if (Directory::Ptr d = getDirectoryL(fname)) // TODO  p_path_id    ?
 			{
 				const string l_file_name = Util::getFileName(fname);
+				l_low_virtual_path = Text::toLower(d->getFullName() + l_file_name);
+				l_low_adc_path = Text::toLower(d->getADCPathL());
 				const auto i = d->findFileIterL(l_file_name);
 				if (i != d->m_share_files.end())
 				{
@@ -3069,16 +3241,19 @@ void ShareManager::on(HashManagerListener::TTHDone, const string& fname, const T
 					if (p_root != i->getTTH())
 					{
 						g_tthIndex.erase(i->getTTH());
+						CFlyTTHBloomCache::removeL();
 					}
 					// Get rid of false constness...
 					Directory::ShareFile* f = const_cast<Directory::ShareFile*>(&(*i));
 					f->setTTH(p_root);
 					g_tthIndex.insert(make_pair(f->getTTH(), i));
+					CFlyTTHBloomCache::addL(p_root);
 					// TODO g_lastSharedDate =
 					g_isNeedsUpdateShareSize = true;
 				}
 				else
 				{
+					l_is_new_file = true;
 					const int64_t l_size = File::getSize(fname);
 					dcassert(p_size == l_size);
 					auto it = d->m_share_files.insert(Directory::ShareFile(l_file_name, l_size, d, p_root, 0, uint32_t(aTimeStamp), getFType(l_file_name)));
@@ -3105,38 +3280,98 @@ void ShareManager::on(HashManagerListener::TTHDone, const string& fname, const T
 		}
 	}
 	//   
-	clear_partial_cache(fname);
+	if (!l_low_adc_path.empty())
+	{
+		invalidate_partial_cache(l_low_adc_path);
+	}
 	clear_tth_path_cache();
-	internalClearCache(true);
+	if (!l_low_virtual_path.empty())
+	{
+		g_search_cache.invalidatePath(l_low_virtual_path, l_is_new_file);
+	}
 }
 
-void ShareManager::clear_partial_cache(string p_path)
+void ShareManager::updateMediainfo(const CFlyMediaInfoUpdateArray& p_items)
 {
-	CFlyFastLock(g_csPartialCache);
-	bool l_is_clear = true;
-	if (!p_path.empty())
+	if (ClientManager::isBeforeShutdown())
+		return;
+	StringList l_low_adc_paths;
 	{
-		boost::replace_all(p_path, "\\", "/");
-		for (auto i = g_partial_list_cache.begin(); i != g_partial_list_cache.end();)
+#ifdef FLYLINKDC_USE_RW_LOCK_SHARE
+		CFlyWriteLock(*g_csShare);
+#else
+		CFlyLock(g_csShare);
+#endif
+		for (auto i = p_items.cbegin(); i != p_items.cend(); ++i)
 		{
-			if (p_path.find(i->first) != string::npos)
+			if (Directory::Ptr d = getDirectoryL(i->m_file_name))
 			{
-				l_is_clear = false;
-				g_partial_list_cache.erase(i->first);
-				i = g_partial_list_cache.begin();
-				continue;
+				const auto j = d->findFileIterL(Util::getFileName(i->m_file_name));
+				if (j != d->m_share_files.end() && j->getTTH() == i->m_tth)
+				{
+					auto l_media_ptr = std::make_shared<CFlyMediaInfo>(i->m_media);
+					l_media_ptr->calcEscape();
+					// Get rid of false constness...
+					const_cast<Directory::ShareFile*>(&(*j))->m_media_ptr = l_media_ptr;
+					l_low_adc_paths.push_back(Text::toLower(d->getADCPathL()));
+				}
 			}
-			++i;
 		}
+		if (!l_low_adc_paths.empty())
+		{
+			setDirty();
+			m_is_forceXmlRefresh = true;
+		}
+	}
+	for (auto i = l_low_adc_paths.cbegin(); i != l_low_adc_paths.cend(); ++i)
+	{
+		invalidate_partial_cache(*i);
 	}
-	if (l_is_clear)
+}
+
+void ShareManager::clear_partial_cache()
+{
+	CFlyFastLock(g_csPartialCache);
+	g_partial_list_cache.clear();
+	g_partial_cache_size = 0;
+	++g_partial_cache_generation;
+}
+
+void ShareManager::invalidate_partial_cache(const string& p_low_adc_path)
+{
+	dcassert(!p_low_adc_path.empty() && p_low_adc_path.back() == '/');
+	CFlyFastLock(g_csPartialCache);
+	++g_partial_cache_generation;
+	const auto l_erase = [](const string & p_key)
 	{
-		g_partial_list_cache.clear();
+		const auto i = g_partial_list_cache.find(p_key);
+		if (i != g_partial_list_cache.end())
+		{
+			g_partial_cache_size -= i->second->size();
+			g_partial_list_cache.erase(i);
+		}
+	};
+	// "/a/b/" - the lists of "/a/b/" and "/a/" (Incomplete flag of "b")
+	// and the recursive lists of "/a/b/", "/a/" and "/"
+	l_erase(p_low_adc_path);
+	auto l_pos = p_low_adc_path.size() - 1;
+	for (bool l_is_parent = false;; l_is_parent = true)
+	{
+		const string l_dir = p_low_adc_path.substr(0, l_pos + 1);
+		if (l_is_parent && l_pos + 1 < p_low_adc_path.size() && p_low_adc_path.find('/', l_pos + 1) == p_low_adc_path.size() - 1)
+		{
+			l_erase(l_dir);
+		}
+		l_erase(l_dir + '*');
+		if (l_pos == 0)
+			break;
+		l_pos = p_low_adc_path.rfind('/', l_pos - 1);
 	}
 }
 
 void ShareManager::on(TimerManagerListener::Second, uint64_t tick) noexcept
 {
+	g_search_cache.flushInvalidations();
 	if ((++m_count_sec % 10) == 0)
 	{
 		CFlylinkDBManager::getInstance()->flush_hash();
@@ -3162,7 +3397,8 @@ void ShareManager::on(TimerManagerListener::Minute, uint64_t tick) noexcept
 		}
 	}
 	internalCalcShareSize(); // [+]IRainman opt.
-	internalClearCache(false);
+	updateSearchPool();
+	CFlyTTHBloomCache::rebuildStale(tick);
 #ifdef _DEBUG
 	ClientManager::flushRatio(5000);
 #endif
@@ -3170,13 +3406,14 @@ void ShareManager::on(TimerManagerListener::Minute, uint64_t tick) noexcept
 void ShareManager::tryFixBadAlloc()
 {
 	CFlylinkDBManager::tryFixBadAlloc();
-	g_cache_limit /= 2;
-	if (g_cache_limit < 10)
+	g_search_cache_max_bytes /= 2;
+	if (g_search_cache_max_bytes < 64 * 1024)
 	{
-		g_cache_limit = 10;
+		g_search_cache_max_bytes = 64 * 1024;
 	}
-	internalClearCache(true);
-	clear_partial_cache("");
+	g_search_cache.setMaxBytes(g_search_cache_max_bytes);
+	internalClearCache();
+	clear_partial_cache();
 	clear_tth_path_cache();
 	static bool g_is_send_report = false;
 	if (!g_is_send_report)
@@ -3185,31 +3422,9 @@ void ShareManager::tryFixBadAlloc()
 		CFlyServerJSON::pushError(74, "std::bad_alloc ShareManager::tryFixBadAlloc");
 	}
 }
-void ShareManager::internalClearCache(bool p_is_force)
+void ShareManager::internalClearCache()
 {
-	{
-		CFlyWriteLock(*g_csShareNotExists);
-#if 0
-		for (auto i = g_file_not_exists_set.begin(); i != g_file_not_exists_set.end(); ++i)
-		{
-			if (i->second > 1)
-			{
-				LogManager::message("[ShareManager] Fix dup-search: " + i->first + ", Count = " + Util::toString(i->second) + ")");
-			}
-		}
-#endif
-		if (p_is_force || g_file_not_exists_set.size() > g_cache_limit)
-		{
-			clear_and_reset_capacity(g_file_not_exists_set);
-		}
-	}
-	{
-		CFlyWriteLock(*g_csShareCache);
-		if (p_is_force || g_file_cache_map.size() > g_cache_limit * 2)
-		{
-			clear_and_reset_capacity(g_file_cache_map);
-		}
-	}
+	g_search_cache.clear();
 }
 
 bool ShareManager::isShareFolder(const string& path, bool thoroughCheck /* = false */)
@@ -31,6 +31,8 @@
 #include "BloomFilter.h"
 #include "Pointer.h"
 #include "CFlylinkDBManager.h"
+#include "CFlySearchCache.h"
+#include "CFlyWorkerPool.h"
 
 #define FLYLINKDC_USE_RW_LOCK_SHARE
 
@@ -44,9 +46,6 @@ class MemoryInputStream;
 class SearchResultBaseTTH;
 
 struct ShareLoader;
-typedef std::vector<SearchResultCore> SearchResultList;
-typedef boost::unordered_set<std::string> QueryNotExistsSet;
-typedef boost::unordered_map<std::string, SearchResultList> QueryCacheMap;
 
 class ShareManager : public Singleton<ShareManager>, private Thread, private TimerManagerListener,
 	private HashManagerListener, private QueueManagerListener
@@ -95,10 +94,7 @@ class ShareManager : public Singleton<ShareManager>, private Thread, private Tim
 		static bool   isUnknownTTH(const TTHValue& p_tth);
 		static unsigned  getCountSearchBot(const CFlySearchItemFile& p_search);
 		static unsigned  addSearchBot(const CFlySearchItemFile& p_search);
-		static bool   isUnknownFile(const string& p_search);
-		static void   addUnknownFile(const string& p_search);
-		static bool   isCacheFile(const string& p_search, SearchResultList& p_search_result);
-		static void   addCacheFile(const string& p_search, const SearchResultList& p_search_result);
+		static bool   isUnknownFile(const SearchParamBase& p_search_param);
 	private:
 		bool   search_tth(const TTHValue& p_tth, SearchResultList& aResults, bool p_is_check_parent);
 	public:
@@ -122,8 +118,8 @@ class ShareManager : public Singleton<ShareManager>, private Thread, private Tim
 		static int64_t getShareSize();
 	private:
 		void internalCalcShareSize();
-		static void internalClearCache(bool p_is_force);
-		static unsigned g_cache_limit;
+		static void internalClearCache();
+		static size_t g_search_cache_max_bytes;
 	public:
 		static void tryFixBadAlloc();
 		
@@ -151,6 +147,8 @@ class ShareManager : public Singleton<ShareManager>, private Thread, private Tim
 		}
 		
 		static void getBloom(ByteVector& v, size_t k, size_t m, size_t h);
+		/** All the TTHs of the share, the journal of CFlyTTHBloomCache is started under the same lock */
+		static void getTTHSnapshot(std::vector<TTHValue>& p_tths);
 		
 		static Search::TypeModes getFType(const string& p_fileName, bool p_include_flylinkdc_ext = false) noexcept;
 		static string validateVirtual(const string& aVirt) noexcept;
@@ -175,11 +173,18 @@ class ShareManager : public Singleton<ShareManager>, private Thread, private Tim
 		}
 		
 		static bool isTTHShared(const TTHValue& tth);
+		/** p_result[i] - p_tths[i] is shared; one lock for all the TTHs (file list loading) */
+		static void isTTHShared(const std::vector<TTHValue>& p_tths, std::vector<bool>& p_result);
+		/** Media info read after hashing (CFlyMediaInfoPool) goes to the files of the share */
+		void updateMediainfo(const CFlyMediaInfoUpdateArray& p_items);
+		
+		/** SHARE_SEARCH_THREADS: 0 - search on the hub thread only */
+		static void updateSearchPool();
 		
 		GETSET(string, bzXmlFile, BZXmlFile);
 		
 	private:
-		static size_t g_hits;
+		static std::atomic<size_t> g_hits; // incremented by the search pool threads
 		static int64_t g_lastSharedDate;
 		
 #ifdef IRAINMAN_INCLUDE_HIDE_SHARE_MOD
@@ -340,6 +345,9 @@ class ShareManager : public Singleton<ShareManager>, private Thread, private Tim
 				}
 				
 				void search(SearchResultList& aResults, StringSearch::List& aStrings, const SearchParamBase& p_search_param) const noexcept;
+				/** Only the directory itself and its files. Returns the terms left for subdirectories */
+				StringSearch::List* searchLocal(SearchResultList& aResults, StringSearch::List& aStrings, const SearchParamBase& p_search_param,
+				                                unique_ptr<StringSearch::List>& p_sub_strings) const noexcept;
 				void search(SearchResultList& aResults, AdcSearch& aStrings, StringList::size_type maxResults) const noexcept;
 				
 				void toXmlL(OutputStream& xmlFile, string& indent, string& tmp2, bool fullList) const;
@@ -417,9 +425,18 @@ class ShareManager : public Singleton<ShareManager>, private Thread, private Tim
 		static CriticalSection g_csTTHIndex;
 		static FastCriticalSection g_csBot;
 		
+		/**
+		 * Pre-serialized bodies of the partial lists by the lower-cased ADC path
+		 * of the directory ('*' is appended for the recursive ones).
+		 * A change of the directory drops only the entries that include it.
+		 */
 		static FastCriticalSection g_csPartialCache;
-		static std::unordered_map<string, std::pair<string, unsigned>> g_partial_list_cache;
-		static void clear_partial_cache(string p_path);
+		static std::unordered_map<string, std::shared_ptr<const string>> g_partial_list_cache;
+		static size_t g_partial_cache_size;
+		static uint64_t g_partial_cache_generation; // changed by every invalidation
+		static void clear_partial_cache();
+		static void invalidate_partial_cache(const string& p_low_adc_path);
+		static bool generatePartialListBody(const string& dir, bool recurse, string& p_body);
 		
 		static FastCriticalSection g_csTTHPathCache;
 		static std::unordered_map<TTHValue, std::pair<string, unsigned>> g_tth_path_cache;
@@ -436,8 +453,6 @@ class ShareManager : public Singleton<ShareManager>, private Thread, private Tim
 #endif
 		
 		static std::unique_ptr<webrtc::RWLockWrapper> g_csBloom;
-		static std::unique_ptr<webrtc::RWLockWrapper> g_csShareNotExists;
-		static std::unique_ptr<webrtc::RWLockWrapper> g_csShareCache;
 		
 		// List of root directory items
 		typedef std::list<Directory::Ptr> DirList; //  list - vector !
@@ -453,16 +468,22 @@ class ShareManager : public Singleton<ShareManager>, private Thread, private Tim
 		static HashFileMap g_tthIndex;
 		static std::unordered_map<string, unsigned> g_BotDetectMap;
 		static unsigned g_lastSharedFiles;
-		static QueryNotExistsSet g_file_not_exists_set;
-		static QueryCacheMap g_file_cache_map;
+		static CFlySearchCache g_search_cache;
+		static CFlyWorkerPool g_search_pool;
+		static bool searchParallelL(SearchResultList& aResults, StringSearch::List& aStrings, const SearchParamBase& p_search_param);
 	public:
+		static CFlySearchCache::Stat getSearchCacheStat()
+		{
+			return g_search_cache.getStat();
+		}
 		static unsigned get_cache_size_file_not_exists_set()
 		{
-			return g_file_not_exists_set.size();
+			return g_search_cache.getStat().m_negative_count;
 		}
 		static unsigned get_cache_file_map()
 		{
-			return g_file_cache_map.size();
+			const auto l_stat = g_search_cache.getStat();
+			return l_stat.m_count - l_stat.m_negative_count;
 		}
 		static int g_RebuildIndexes;
 		static tstring calc_status_file(const TTHValue& p_tth);
@@ -21,6 +21,7 @@
 #include "SharedFileStream.h"
 #include "LogManager.h"
 #include "ClientManager.h"
+#include "CFlyTaskPool.h"
 #include "../FlyFeatures/flyServer.h"
 
 FastCriticalSection SharedFileStream::g_shares_file_cs;
@@ -33,11 +34,159 @@ SharedFileStream::SharedFileHandleMap SharedFileStream::g_writepool;
 SharedFileStream::SharedFileHandleMap SharedFileStream::g_rwpool;
 std::unordered_set<std::string> SharedFileStream::g_shared_stream_errors;
 #endif
+std::unordered_map<std::string, std::string, noCaseStringHash, noCaseStringEq> SharedFileStream::g_write_errors;
+
+// Write-behind: the downloaded data is written to disk by a background thread
+// in large aligned blocks (neighbour segments of the file are merged).
+static CFlyTaskPool g_write_behind_pool;
+static CriticalSection g_write_behind_cs; // not g_shares_file_cs - the thread is started under it
+static bool g_is_write_behind_stopped = false;
+static const int64_t WRITE_BEHIND_ALIGN = 64 * 1024;
+static const size_t WRITE_BEHIND_QUEUE_SIZE = 1024 * 1024;     // start the background write
+static const size_t WRITE_BEHIND_MAX_SIZE = 16 * 1024 * 1024;  // the writer waits (writes itself)
+static const size_t WRITE_BEHIND_MAX_BLOCK = 4 * 1024 * 1024;
 
 SharedFileHandle::SharedFileHandle(const string& aPath, int aAccess, int aMode) :
 	m_ref_cnt(1), m_path(aPath), m_mode(aMode), m_access(aAccess), m_last_file_size(0),
-	m_map_file(INVALID_HANDLE_VALUE), m_map_file_ptr(nullptr), m_is_map_file_error(false)
+	m_map_file(INVALID_HANDLE_VALUE), m_map_file_ptr(nullptr), m_is_map_file_error(false),
+	m_pending_size(0), m_is_write_queued(false)
+{
+}
+
+bool SharedFileHandle::addPendingL(int64_t p_pos, const void* p_buf, size_t p_len)
 {
+	const uint8_t* l_buf = static_cast<const uint8_t*>(p_buf);
+	const int64_t l_end = p_pos + int64_t(p_len);
+	auto l_next = m_pending.upper_bound(p_pos);
+	if (l_next != m_pending.end() && l_next->first < l_end)
+		return false;
+	if (l_next != m_pending.begin())
+	{
+		auto l_prev = std::prev(l_next);
+		const int64_t l_prev_end = l_prev->first + int64_t(l_prev->second.size());
+		if (l_prev_end > p_pos)
+			return false;
+		if (l_prev_end == p_pos && l_prev->second.size() + p_len <= WRITE_BEHIND_MAX_BLOCK)
+		{
+			// next data of the segment
+			l_prev->second.insert(l_prev->second.end(), l_buf, l_buf + p_len);
+			if (l_next != m_pending.end() && l_next->first == l_end && l_prev->second.size() + l_next->second.size() <= WRITE_BEHIND_MAX_BLOCK)
+			{
+				// the segment has reached the next one
+				l_prev->second.insert(l_prev->second.end(), l_next->second.begin(), l_next->second.end());
+				m_pending.erase(l_next);
+			}
+			m_pending_size += p_len;
+			return true;
+		}
+	}
+	ByteVector& l_block = m_pending[p_pos];
+	if (l_next != m_pending.end() && l_next->first == l_end && l_next->second.size() + p_len <= WRITE_BEHIND_MAX_BLOCK)
+	{
+		l_block.reserve(p_len + l_next->second.size());
+		l_block.assign(l_buf, l_buf + p_len);
+		l_block.insert(l_block.end(), l_next->second.begin(), l_next->second.end());
+		m_pending.erase(l_next);
+	}
+	else
+	{
+		l_block.assign(l_buf, l_buf + p_len);
+	}
+	m_pending_size += p_len;
+	return true;
+}
+
+void SharedFileHandle::writePending(bool p_is_all)
+{
+	CFlyLock(m_cs_io);
+	PendingMap l_blocks;
+	{
+		CFlyFastLock(m_cs);
+		m_is_write_queued = false;
+		if (p_is_all)
+		{
+			l_blocks.swap(m_pending);
+			m_pending_size = 0;
+		}
+		else
+		{
+			// the tail of the block is left for the next data of the segment
+			for (auto i = m_pending.begin(); i != m_pending.end();)
+			{
+				const int64_t l_end = i->first + int64_t(i->second.size());
+				const int64_t l_aligned_end = l_end - l_end % WRITE_BEHIND_ALIGN;
+				if (l_aligned_end <= i->first)
+				{
+					++i;
+					continue;
+				}
+				ByteVector& l_block = l_blocks[i->first];
+				l_block.swap(i->second);
+				if (l_aligned_end < l_end)
+				{
+					const size_t l_size = size_t(l_aligned_end - i->first);
+					m_pending[l_aligned_end].assign(l_block.begin() + l_size, l_block.end());
+					l_block.resize(l_size);
+				}
+				m_pending_size -= l_block.size();
+				i = m_pending.erase(i);
+			}
+		}
+	}
+	writeBlocksL(l_blocks);
+}
+
+void SharedFileHandle::writePendingRange(int64_t p_pos, int64_t p_end)
+{
+	CFlyLock(m_cs_io);
+	PendingMap l_blocks;
+	{
+		CFlyFastLock(m_cs);
+		if (m_pending.empty())
+			return;
+		auto i = m_pending.upper_bound(p_pos);
+		if (i != m_pending.begin())
+		{
+			--i; // can cover p_pos
+		}
+		while (i != m_pending.end() && i->first < p_end)
+		{
+			if (i->first + int64_t(i->second.size()) > p_pos)
+			{
+				m_pending_size -= i->second.size();
+				l_blocks[i->first].swap(i->second);
+				i = m_pending.erase(i);
+			}
+			else
+			{
+				++i;
+			}
+		}
+	}
+	writeBlocksL(l_blocks);
+}
+
+void SharedFileHandle::writeBlocksL(const PendingMap& p_blocks)
+{
+	if (p_blocks.empty())
+		return;
+	try
+	{
+		for (auto i = p_blocks.cbegin(); i != p_blocks.cend(); ++i)
+		{
+			m_file.setPos(i->first);
+			m_file.write(i->second.data(), i->second.size());
+		}
+	}
+	catch (const FileException& e)
+	{
+		LogManager::message("SharedFileHandle::writePending " + m_path + " Error = " + e.getError());
+		CFlyFastLock(m_cs);
+		if (m_write_error.empty())
+		{
+			m_write_error = e.getError();
+		}
+	}
 }
 void SharedFileHandle::CloseMapFile()
 {
@@ -116,6 +265,14 @@ void SharedFileHandle::init(int64_t p_file_size)
 SharedFileStream::SharedFileStream(const string& aFileName, int aAccess, int aMode, int64_t p_file_size)
 {
 	dcassert(!aFileName.empty());
+	if (aAccess != File::READ)
+	{
+		CFlyLock(g_write_behind_cs);
+		if (!g_is_write_behind_stopped)
+		{
+			g_write_behind_pool.start(1, "SharedFileWriter");
+		}
+	}
 	CFlyFastLock(g_shares_file_cs);
 	m_pos = 0;
 #ifdef FLYLINKDC_USE_SHARED_FILE_STREAM_RW_POOL
@@ -164,11 +321,27 @@ SharedFileStream::SharedFileStream(const string& aFileName, int aAccess, int aMo
 			throw;
 		}
 		l_pool[aFileName] = m_sfh;
+		g_write_errors.erase(aFileName);
 	}
 }
 
+bool SharedFileStream::getWriteError(const string& p_file, string& p_error)
+{
+	CFlyFastLock(g_shares_file_cs);
+	const auto i = g_write_errors.find(p_file);
+	if (i == g_write_errors.end())
+		return false;
+	p_error = i->second;
+	return true;
+}
+
 void SharedFileStream::check_before_destoy()
 {
+	{
+		CFlyLock(g_write_behind_cs);
+		g_is_write_behind_stopped = true;
+	}
+	g_write_behind_pool.stop();
 	{
 		CFlyFastLock(g_shares_file_cs);
 #ifdef FLYLINKDC_USE_SHARED_FILE_STREAM_RW_POOL
@@ -245,7 +418,26 @@ void SharedFileStream::cleanup()
 }
 SharedFileStream::~SharedFileStream()
 {
+	try
+	{
+		// We must do this in order not to lose bytes of the file
+		m_sfh->writePending(true);
+	}
+	catch (const Exception& e)
+	{
+		LogManager::message("SharedFileStream::~SharedFileStream " + m_sfh->m_path + " Error = " + e.getError());
+	}
+	string l_write_error;
+	{
+		CFlyFastLock(m_sfh->m_cs);
+		l_write_error = m_sfh->m_write_error;
+	}
 	CFlyFastLock(g_shares_file_cs);
+	if (!l_write_error.empty())
+	{
+		// The destructor can't throw - QueueManager::putDownload doesn't mark the segment
+		g_write_errors[m_sfh->m_path] = l_write_error;
+	}
 	
 	m_sfh->m_ref_cnt--;
 	if (m_sfh->m_ref_cnt == 0)
@@ -268,44 +460,98 @@ size_t SharedFileStream::write(const void* p_buf, size_t p_len)
 #ifdef _DEBUG
 	//LogManager::message("SharedFileStream::write buf = " + Util::toString(int(buf)) + " len " + Util::toString(len));
 #endif
-	CFlyFastLock(m_sfh->m_cs);
-#ifdef _DEBUG
+	bool l_is_added = true;
+	bool l_is_queue = false;
+	bool l_is_write_all = false;
 	{
-		/*
-		static uint64_t g_count;
-		        File fy(m_sfh->m_path + "-" +  Util::toString(++g_count) +
-		            " - [" + Util::toString(m_pos) + " - " + Util::toString(p_len) + "]." + Util::toString(GetCurrentThreadId()), File::WRITE, File::OPEN | File::CREATE);
-		        fy.write(p_buf, p_len);
-		        fy.close();
-		*/
-	}
+		CFlyFastLock(m_sfh->m_cs);
+#ifdef _DEBUG
+		{
+			/*
+			static uint64_t g_count;
+			        File fy(m_sfh->m_path + "-" +  Util::toString(++g_count) +
+			            " - [" + Util::toString(m_pos) + " - " + Util::toString(p_len) + "]." + Util::toString(GetCurrentThreadId()), File::WRITE, File::OPEN | File::CREATE);
+			        fy.write(p_buf, p_len);
+			        fy.close();
+			*/
+		}
 #endif
-	if (m_sfh->m_map_file_ptr)
-	{
-		memcpy(m_sfh->m_map_file_ptr + m_pos, p_buf, p_len);
-		m_pos += p_len;
+		if (m_sfh->m_map_file_ptr)
+		{
+			memcpy(m_sfh->m_map_file_ptr + m_pos, p_buf, p_len);
+		}
+		else
+		{
+			if (!m_sfh->m_write_error.empty())
+			{
+				throw FileException(m_sfh->m_write_error);
+			}
+			l_is_added = m_sfh->addPendingL(m_pos, p_buf, p_len);
+			if (m_sfh->m_pending_size >= WRITE_BEHIND_MAX_SIZE)
+			{
+				l_is_write_all = true; // the disk is slower than the network
+			}
+			else if (m_sfh->m_pending_size >= WRITE_BEHIND_QUEUE_SIZE && !m_sfh->m_is_write_queued)
+			{
+				m_sfh->m_is_write_queued = l_is_queue = true;
+			}
+		}
+		if (m_sfh->m_last_file_size < m_pos + int64_t(p_len))
+		{
+			dcassert(0);
+			m_sfh->m_last_file_size = m_pos + p_len;
+		}
 	}
-	else
+	if (!l_is_added)
 	{
+		// overlapped segment - the pending data is written first
+		writePendingAll();
+		CFlyLock(m_sfh->m_cs_io);
 		m_sfh->m_file.setPos(m_pos);
 		m_sfh->m_file.write(p_buf, p_len);
-		m_pos += p_len;
 	}
-	if (m_sfh->m_last_file_size < m_pos)
+	else if (l_is_write_all)
 	{
-		dcassert(0);
-		m_sfh->m_last_file_size = m_pos;
+		writePendingAll();
+	}
+	else if (l_is_queue)
+	{
+		// weak - the closed file is not kept open by the queue (it is written by ~SharedFileStream)
+		const std::weak_ptr<SharedFileHandle> l_weak_sfh = m_sfh;
+		const CFlyTaskPool::Task l_task = [l_weak_sfh]()
+		{
+			if (const auto l_sfh = l_weak_sfh.lock())
+			{
+				l_sfh->writePending(false);
+			}
+		};
+		if (!g_write_behind_pool.addTask(l_task))
+		{
+			m_sfh->writePending(false);
+		}
 	}
+	m_pos += p_len;
 	return p_len;
 }
 
-size_t SharedFileStream::read(void* p_buf, size_t& p_len)
+void SharedFileStream::writePendingAll()
 {
+	m_sfh->writePending(true);
 	CFlyFastLock(m_sfh->m_cs);
+	if (!m_sfh->m_write_error.empty())
+	{
+		throw FileException(m_sfh->m_write_error);
+	}
+}
+
+size_t SharedFileStream::read(void* p_buf, size_t& p_len)
+{
 #ifdef _DEBUG
 	//LogManager::message("SharedFileStream::read buf = " + Util::toString(buf) + " len " + Util::toString(len));
 #endif
-	
+	// the partial file can be uploaded while it is downloaded - only the data to be read is written
+	m_sfh->writePendingRange(m_pos, m_pos + int64_t(p_len));
+	CFlyLock(m_sfh->m_cs_io);
 	m_sfh->m_file.setPos(m_pos);
 	p_len = m_sfh->m_file.read(p_buf, p_len);
 	m_pos += p_len;
@@ -336,22 +582,26 @@ int64_t SharedFileStream::getFastFileSize()
 
 void SharedFileStream::setSize(int64_t p_new_size)
 {
-	CFlyFastLock(m_sfh->m_cs);
 #ifdef _DEBUG
 	//LogManager::message("SharedFileStream::setSize size = " +  Util::toString(newSize));
 #endif
+	writePendingAll();
+	CFlyLock(m_sfh->m_cs_io);
 	m_sfh->m_file.setSize(p_new_size);
+	CFlyFastLock(m_sfh->m_cs);
 	m_sfh->m_last_file_size = p_new_size;
 }
 
 size_t SharedFileStream::flushBuffers(bool aForce)
 {
+	// The write-behind data is written always - the segment is finished after this call
+	writePendingAll();
 	if (!ClientManager::isBeforeShutdown()) // fix https://drdump.com/Problem.aspx?ProblemID=130529
 		//    -      .
 	{
 		try
 		{
-			CFlyFastLock(m_sfh->m_cs);
+			CFlyLock(m_sfh->m_cs_io);
 			if (m_sfh->m_map_file_ptr)
 			{
 				return 0;
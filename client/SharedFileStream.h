@@ -31,7 +31,15 @@ struct SharedFileHandle
 		~SharedFileHandle();
 		void init(int64_t p_file_size);
 		
+		/** Write-behind of the not mapped file: m_cs must be locked, false - the range overlaps the pending data */
+		bool addPendingL(int64_t p_pos, const void* p_buf, size_t p_len);
+		/** Writes the pending data (only aligned parts of the blocks if !p_is_all) */
+		void writePending(bool p_is_all);
+		/** Writes the pending blocks overlapping [p_pos, p_end) - the data to be read */
+		void writePendingRange(int64_t p_pos, int64_t p_end);
+		
 		FastCriticalSection m_cs;
+		CriticalSection m_cs_io; // m_file
 		File  m_file;
 		string m_path;
 		int m_ref_cnt;
@@ -41,7 +49,15 @@ struct SharedFileHandle
 		HANDLE m_map_file;
 		char* m_map_file_ptr;
 		bool m_is_map_file_error;
+		
+		typedef std::map<int64_t, ByteVector> PendingMap;
+		PendingMap m_pending; // by file position, neighbour ranges are merged
+		size_t m_pending_size;
+		bool m_is_write_queued;
+		string m_write_error;
 	private:
+		/** m_cs_io must be locked */
+		void writeBlocksL(const PendingMap& p_blocks);
 		void CloseMapFile();
 };
 
@@ -73,11 +89,15 @@ class SharedFileStream : public IOStream
 		static SharedFileHandleMap g_rwpool;
 #endif
 		static std::unordered_set<std::string> g_shared_stream_errors;
+		/** The write-behind of the closed file failed - the data of its segments may be lost (cleared when the file is opened again) */
+		static bool getWriteError(const string& p_file, string& p_error);
 		static void cleanup();
 		static void delete_file(const std::string& p_file);
 		static void check_before_destoy();
 		void setPos(int64_t aPos) override;
 	private:
+		static std::unordered_map<std::string, std::string, noCaseStringHash, noCaseStringEq> g_write_errors;
+		void writePendingAll();
 		std::shared_ptr<SharedFileHandle> m_sfh;
 		int64_t m_pos;
 };
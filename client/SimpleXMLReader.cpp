@@ -24,11 +24,90 @@
 #include "Text.h"
 #include "Streams.h"
 
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define FLYLINKDC_USE_SSE2_XML_SCAN
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
 inline static bool isSpace(int c)
 {
 	return c == 0x20 || c == 0x09 || c == 0x0d || c == 0x0a;
 }
 
+#ifdef FLYLINKDC_USE_SSE2_XML_SCAN
+inline static unsigned firstBit(unsigned p_mask)
+{
+#ifdef _MSC_VER
+	unsigned long l_index;
+	_BitScanForward(&l_index, p_mask);
+	return l_index;
+#else
+	return __builtin_ctz(p_mask);
+#endif
+}
+#endif
+
+/// Position of the first p_c1 or p_c2 in the data (16 bytes at a time) or p_len if not found
+static size_t findFirstOf(const char* p_data, size_t p_len, char p_c1, char p_c2)
+{
+	size_t i = 0;
+#ifdef FLYLINKDC_USE_SSE2_XML_SCAN
+	const __m128i l_c1 = _mm_set1_epi8(p_c1);
+	const __m128i l_c2 = _mm_set1_epi8(p_c2);
+	for (; i + 16 <= p_len; i += 16)
+	{
+		const __m128i l_chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_data + i));
+		const unsigned l_mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(l_chunk, l_c1), _mm_cmpeq_epi8(l_chunk, l_c2)));
+		if (l_mask)
+		{
+			return i + firstBit(l_mask);
+		}
+	}
+#endif
+	for (; i < p_len; ++i)
+	{
+		if (p_data[i] == p_c1 || p_data[i] == p_c2)
+		{
+			return i;
+		}
+	}
+	return p_len;
+}
+
+/// Position of the first non space character or p_len
+static size_t findNotSpace(const char* p_data, size_t p_len)
+{
+	size_t i = 0;
+#ifdef FLYLINKDC_USE_SSE2_XML_SCAN
+	const __m128i l_space = _mm_set1_epi8(0x20);
+	const __m128i l_tab = _mm_set1_epi8(0x09);
+	const __m128i l_cr = _mm_set1_epi8(0x0d);
+	const __m128i l_lf = _mm_set1_epi8(0x0a);
+	for (; i + 16 <= p_len; i += 16)
+	{
+		const __m128i l_chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_data + i));
+		const __m128i l_is_space = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(l_chunk, l_space), _mm_cmpeq_epi8(l_chunk, l_tab)),
+		                                        _mm_or_si128(_mm_cmpeq_epi8(l_chunk, l_cr), _mm_cmpeq_epi8(l_chunk, l_lf)));
+		const unsigned l_mask = ~unsigned(_mm_movemask_epi8(l_is_space)) & 0xFFFF;
+		if (l_mask)
+		{
+			return i + firstBit(l_mask);
+		}
+	}
+#endif
+	for (; i < p_len; ++i)
+	{
+		if (!isSpace(p_data[i]))
+		{
+			return i;
+		}
+	}
+	return p_len;
+}
+
 inline static bool inRange(int c, int a, int b)
 {
 	return c >= a && c <= b;
@@ -74,6 +153,33 @@ SimpleXMLReader::SimpleXMLReader(SimpleXMLReader::CallBack* callback) :
 {
 	elements.reserve(64);
 	attribs.reserve(4); // 16   void ListLoader::startTag  = 8
+	m_attribs_spare.reserve(16);
+}
+
+StringPair& SimpleXMLReader::addAttrib()
+{
+	if (m_attribs_spare.empty())
+	{
+		attribs.push_back(StringPair());
+	}
+	else
+	{
+		// Take the buffers of one of the previous attributes - no allocation for the typical file list tag.
+		attribs.push_back(std::move(m_attribs_spare.back()));
+		m_attribs_spare.pop_back();
+		attribs.back().first.clear();
+		attribs.back().second.clear();
+	}
+	return attribs.back();
+}
+
+void SimpleXMLReader::clearAttribs()
+{
+	for (auto i = attribs.begin(); i != attribs.end(); ++i)
+	{
+		m_attribs_spare.push_back(std::move(*i));
+	}
+	attribs.clear();
 }
 
 void SimpleXMLReader::append(std::string& str, size_t maxLen, int c)
@@ -204,7 +310,7 @@ bool SimpleXMLReader::elementName()
 			append(elements.back(), MAX_NAME_SIZE, buf.begin() + bufPos, buf.begin() + bufPos + i);
 			
 			cb->startTag(elements.back(), attribs, false);
-			attribs.clear();
+			clearAttribs();
 			
 			state = STATE_CONTENT;
 			advancePos(i + 1);
@@ -232,8 +338,7 @@ bool SimpleXMLReader::elementAttr()
 	int c = charAt(0);
 	if (isNameStartChar(c))
 	{
-		attribs.push_back(StringPair()); // Hot point - 10%
-		append(attribs.back().first, MAX_NAME_SIZE, c); // MAX_NAME_SIZE - 260
+		append(addAttrib().first, MAX_NAME_SIZE, c); // MAX_NAME_SIZE - 260
 		
 		state = STATE_ELEMENT_ATTR_NAME;
 		advancePos(1);
@@ -280,36 +385,32 @@ bool SimpleXMLReader::elementAttrName()
 
 bool SimpleXMLReader::elementAttrValue()
 {
-	size_t i = 0;
-	for (size_t iend = bufSize(); i < iend; ++i)
+	const char l_quote = state == STATE_ELEMENT_ATTR_VALUE_APOS ? '\'' : '"';
+	const size_t iend = bufSize();
+	const size_t i = findFirstOf(buf.data() + bufPos, iend, l_quote, '&');
+	
+	append(attribs.back().second, MAX_VALUE_SIZE, buf.begin() + bufPos, buf.begin() + bufPos + i);
+	if (i == iend)
 	{
-		const int c = charAt(i);
-		
-		if ((state == STATE_ELEMENT_ATTR_VALUE_APOS && c == '\'') || (state == STATE_ELEMENT_ATTR_VALUE_QUOT && c == '"'))
-		{
-			append(attribs.back().second, MAX_VALUE_SIZE, buf.begin() + bufPos, buf.begin() + bufPos + i);
-			
-			if (!encoding.empty() && encoding != Text::g_utf8)
-			{
-				attribs.back().second = Text::toUtf8(attribs.back().second, encoding);
-			}
-			
-			state = STATE_ELEMENT_ATTR;
-			advancePos(i + 1);
-			return true;
-		}
-		else if (c == '&')
+		advancePos(i);
+		return true;
+	}
+	
+	if (charAt(i) == l_quote)
+	{
+		if (!encoding.empty() && encoding != Text::g_utf8)
 		{
-			append(attribs.back().second, MAX_VALUE_SIZE, buf.begin() + bufPos, buf.begin() + bufPos + i);
-			advancePos(i);
-			return entref(attribs.back().second);
+			attribs.back().second = Text::toUtf8(attribs.back().second, encoding);
 		}
+		
+		state = STATE_ELEMENT_ATTR;
+		advancePos(i + 1);
+		return true;
 	}
 	
-	append(attribs.back().second, MAX_VALUE_SIZE, buf.begin() + bufPos, buf.begin() + bufPos + i);
+	// Entities are decoded only here - the rest of the value is copied by blocks
 	advancePos(i);
-	
-	return true;
+	return entref(attribs.back().second);
 }
 
 bool SimpleXMLReader::elementEndSimple()
@@ -323,7 +424,7 @@ bool SimpleXMLReader::elementEndSimple()
 	{
 		cb->startTag(elements.back(), attribs, true);
 		elements.pop_back();
-		attribs.clear();
+		clearAttribs();
 		
 		state = STATE_CONTENT;
 		advancePos(1);
@@ -343,7 +444,7 @@ bool SimpleXMLReader::elementEndComplex()
 	if (charAt(0) == '>')
 	{
 		cb->startTag(elements.back(), attribs, false);
-		attribs.clear();
+		clearAttribs();
 		
 		state = STATE_CONTENT;
 		advancePos(1);
@@ -444,21 +545,25 @@ bool SimpleXMLReader::comment()
 {
 	while (bufSize() > 0)
 	{
-		int c = charAt(0);
+		const char* l_start = buf.data() + bufPos;
+		const char* l_dash = static_cast<const char*>(memchr(l_start, '-', bufSize()));
+		if (!l_dash)
+		{
+			advancePos(bufSize());
+			return true;
+		}
+		advancePos(size_t(l_dash - l_start));
 		
 		// TODO We shouldn't allow ---> to end a comment
-		if (c == '-')
+		if (!needChars(3))
 		{
-			if (!needChars(3))
-			{
-				return true;
-			}
-			if (charAt(1) == '-' && charAt(2) == '>')
-			{
-				state = STATE_CONTENT;
-				advancePos(3);
-				return true;
-			}
+			return true;
+		}
+		if (charAt(1) == '-' && charAt(2) == '>')
+		{
+			state = STATE_CONTENT;
+			advancePos(3);
+			return true;
 		}
 		
 		advancePos(1);
@@ -471,21 +576,24 @@ bool SimpleXMLReader::cdata()
 {
 	while (bufSize() > 0)
 	{
-		int c = charAt(0);
+		const char* l_start = buf.data() + bufPos;
+		const char* l_bracket = static_cast<const char*>(memchr(l_start, ']', bufSize()));
+		if (!l_bracket)
+		{
+			advancePos(bufSize());
+			return true;
+		}
+		advancePos(size_t(l_bracket - l_start));
 		
-		// TODO We shouldn't allow ---> to end a comment
-		if (c == ']')
+		if (!needChars(2))
 		{
-			if (!needChars(2))
-			{
-				return true;
-			}
-			if (charAt(1) == ']')
-			{
-				state = STATE_CONTENT;
-				advancePos(2);
-				return true;
-			}
+			return true;
+		}
+		if (charAt(1) == ']')
+		{
+			state = STATE_CONTENT;
+			advancePos(2);
+			return true;
 		}
 		
 		advancePos(1);
@@ -611,9 +719,10 @@ bool SimpleXMLReader::content()
 		return entref(value);
 	}
 	
-	append(value, MAX_VALUE_SIZE, c);
+	const size_t i = findFirstOf(buf.data() + bufPos, bufSize(), '<', '&');
+	append(value, MAX_VALUE_SIZE, buf.begin() + bufPos, buf.begin() + bufPos + i);
 	
-	advancePos(1);
+	advancePos(i);
 	
 	return true;
 }
@@ -672,19 +781,18 @@ bool SimpleXMLReader::skipSpace(bool store)
 	{
 		return true;
 	}
-	bool skipped = false;
-	int c;
-	while (needChars(1) && isSpace(c = charAt(0)))
+	const size_t i = findNotSpace(buf.data() + bufPos, bufSize());
+	if (i == 0)
 	{
-		if (store)
-		{
-			append(value, MAX_VALUE_SIZE, c);
-		}
-		advancePos();
-		skipped = true;
+		return false;
+	}
+	if (store)
+	{
+		append(value, MAX_VALUE_SIZE, buf.begin() + bufPos, buf.begin() + bufPos + i);
 	}
+	advancePos(i);
 	
-	return skipped;
+	return true;
 }
 
 
@@ -133,6 +133,7 @@ class SimpleXMLReader
 		uint64_t pos;
 		
 		StringPairList attribs;
+		StringPairList m_attribs_spare; // string buffers of the attributes from previous tags (reused without allocation)
 		std::string value;
 		
 		CallBack* cb;
@@ -142,6 +143,9 @@ class SimpleXMLReader
 		
 		StringList elements;
 		
+		StringPair& addAttrib();
+		void clearAttribs();
+		
 		void append(std::string& str, size_t maxLen, int c);
 		void append(std::string& str, size_t maxLen, const std::string::const_iterator& begin, const std::string::const_iterator& end);
 		
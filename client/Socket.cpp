@@ -98,6 +98,10 @@ void Socket::create(SocketType aType /* = TYPE_TCP */)
 		default:
 			dcassert(0);
 	}
+	if (m_sock != INVALID_SOCKET)
+	{
+		CFlyMetrics::addGauge(CFlyMetrics::SOCKETS, 1);
+	}
 	m_type = aType;
 	setBlocking(false);
 }
@@ -118,6 +122,7 @@ uint16_t Socket::accept(const Socket& listeningSocket)
 	}
 	while (m_sock == SOCKET_ERROR && getLastError() == EINTR);
 	check(m_sock);
+	CFlyMetrics::addGauge(CFlyMetrics::SOCKETS, 1);
 	const string l_remote_ip = inet_ntoa(sock_addr.sin_addr);
 	IpGuard::check_ip_str(l_remote_ip, this);
 	// Make sure we disable any inherited windows message things for this socket.
@@ -1013,6 +1018,7 @@ void Socket::close() noexcept
 	if (m_sock != INVALID_SOCKET)
 	{
 		::closesocket(m_sock);
+		CFlyMetrics::addGauge(CFlyMetrics::SOCKETS, -1);
 		connected = false;
 		m_sock = INVALID_SOCKET;
 	}
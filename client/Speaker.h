@@ -60,39 +60,12 @@ class Speaker
 			dcassert(m_listeners.empty());
 		}
 		
-#ifdef FLYLINKDC_USE_PROFILER_CS
-		template<typename... ArgT>
-		void fire_log(const char* p_function, int p_line, ArgT && ... args)
-		{
-			const std::string l_f = p_function + std::string(" Line: ") + Util::toString(p_line);
-			CFlyLockLine(m_listenerCS, l_f.c_str());
-			ListenerList tmp = m_listeners;
-#ifdef _DEBUG
-			extern volatile bool g_isShutdown;
-			if (g_isShutdown && !tmp.empty())
-			{
-				log_listener_list(tmp, "fire-destroy!");
-			}
-#endif
-			for (auto i = tmp.cbegin(); i != tmp.cend(); ++i)
-			{
-				(*i)->on(std::forward<ArgT>(args)...);
-			}
-		}
-#define fly_fire(p_type) fire_log(__FUNCTION__,__LINE__,p_type);
-#define fly_fire1(p_type,p_arg_1) fire_log(__FUNCTION__,__LINE__,p_type,p_arg_1);
-#define fly_fire2(p_type,p_arg_1,p_arg_2) fire_log(__FUNCTION__,__LINE__,p_type,p_arg_1,p_arg_2);
-#define fly_fire3(p_type,p_arg_1,p_arg_2,p_arg_3) fire_log(__FUNCTION__,__LINE__,p_type,p_arg_1,p_arg_2,p_arg_3);
-#define fly_fire4(p_type,p_arg_1,p_arg_2,p_arg_3,p_arg_4) fire_log(__FUNCTION__,__LINE__,p_type,p_arg_1,p_arg_2,p_arg_3,p_arg_4);
-#define fly_fire5(p_type,p_arg_1,p_arg_2,p_arg_3,p_arg_4,p_arg_5) fire_log(__FUNCTION__,__LINE__,p_type,p_arg_1,p_arg_2,p_arg_3,p_arg_4,p_arg_5);
-#else
 #define fly_fire fire
 #define fly_fire1 fire
 #define fly_fire2 fire
 #define fly_fire3 fire
 #define fly_fire4 fire
 #define fly_fire5 fire
-#endif
 #if _MSC_VER > 1600 // > VC++2010
 		template<typename... ArgT>
 		void fire(ArgT && ... args)
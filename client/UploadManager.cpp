@@ -29,6 +29,7 @@
 #include "FinishedManager.h"
 #include "PGLoader.h"
 #include "SharedFileStream.h"
+#include "CFlyUploadCache.h"
 #include "IPGrant.h"
 #include "../FlyFeatures/flyServer.h"
 
@@ -37,11 +38,11 @@ boost::atomic_int UploadQueueItem::g_upload_queue_item_count(0);
 #endif
 uint32_t UploadManager::g_count_WaitingUsersFrame = 0;
 UploadManager::SlotMap UploadManager::g_reservedSlots;
-bool UploadManager::g_is_reservedSlotEmpty = true;
-int UploadManager::g_running = 0;
+std::atomic_bool UploadManager::g_is_reservedSlotEmpty(true);
+std::atomic<int> UploadManager::g_running(0);
 UploadList UploadManager::g_uploads;
 UploadList UploadManager::g_delayUploads;
-CurrentConnectionMap UploadManager::g_uploadsPerUser;
+UploadManager::UserConnectionShard UploadManager::g_uploadsPerUser[USER_CONNECTION_SHARDS];
 #ifdef IRAINMAN_ENABLE_AUTO_BAN
 UploadManager::BanMap UploadManager::g_lastBans;
 std::unique_ptr<webrtc::RWLockWrapper> UploadManager::g_csBans = std::unique_ptr<webrtc::RWLockWrapper>(webrtc::RWLockWrapper::CreateRWLock());
@@ -50,9 +51,12 @@ std::unique_ptr<webrtc::RWLockWrapper> UploadManager::g_csUploadsDelay = std::un
 std::unique_ptr<webrtc::RWLockWrapper> UploadManager::g_csReservedSlots = std::unique_ptr<webrtc::RWLockWrapper> (webrtc::RWLockWrapper::CreateRWLock());
 int64_t UploadManager::g_runningAverage;
 
+static const size_t g_max_pipelined_gets = 4; // GETs queued per connection while uploading
+static const uint64_t g_notified_user_timeout = 90 * 1000; // notified user must ask for a file within
+
 UploadManager::UploadManager() noexcept :
-	extra(0), lastGrant(0), m_lastFreeSlots(-1),
-	m_fireballStartTick(0), isFireball(false), isFileServer(false), extraPartial(0)
+	m_extra(0), lastGrant(0), m_lastFreeSlots(-1),
+	m_fireballStartTick(0), isFireball(false), isFileServer(false), m_extra_partial(0)
 {
 	ClientManager::getInstance()->addListener(this);
 	TimerManager::getInstance()->addListener(this);
@@ -64,6 +68,7 @@ UploadManager::~UploadManager()
 	ClientManager::getInstance()->removeListener(this);
 	{
 		CFlyLock(m_csQueue); // [!] IRainman opt.
+		m_slotQueueIndex.clear();
 		m_slotQueue.clear(); // TODO -      shutdown
 	}
 	while (true)
@@ -76,7 +81,12 @@ UploadManager::~UploadManager()
 		Thread::sleep(10);
 	}
 	//SharedFileStream::check_before_destoy();
-	dcassert(g_uploadsPerUser.empty());
+#ifdef _DEBUG
+	for (size_t i = 0; i < USER_CONNECTION_SHARDS; ++i)
+	{
+		dcassert(g_uploadsPerUser[i].m_map.empty());
+	}
+#endif
 }
 // !SMT!-S
 #ifdef IRAINMAN_ENABLE_AUTO_BAN
@@ -434,11 +444,19 @@ bool UploadManager::prepareFile(UserConnection* aSource, const string& aType, co
 				
 				l_is_free = l_is_free || (sz <= (int64_t)(SETTING(SET_MINISLOT_SIZE) * 1024));
 				
-				f->setPos(start);
-				is = f;
-				if ((start + size) < sz)
+				if (l_is_tth)
 				{
-					is = new LimitedInputStream<true>(is, size);
+					// popular files are served from the shared block cache
+					is = new CFlyCachedFileStream(f, l_tth, start, size);
+				}
+				else
+				{
+					f->setPos(start);
+					is = f;
+					if ((start + size) < sz)
+					{
+						is = new LimitedInputStream<true>(is, size);
+					}
 				}
 			}
 			type = l_is_userlist ? Transfer::TYPE_FULL_LIST : Transfer::TYPE_FILE;
@@ -566,7 +584,8 @@ ok: //[!] TODO 
 	auto slotType = aSource->getSlotType();
 	
 	//[!] IRainman autoban fix: please check this code after merge
-	bool hasReserved;
+	bool hasReserved = false;
+	if (!g_is_reservedSlotEmpty)
 	{
 		CFlyReadLock(*g_csReservedSlots); // [+] IRainman opt.
 		hasReserved = g_reservedSlots.find(aSource->getUser()) != g_reservedSlots.end();
@@ -636,7 +655,7 @@ ok: //[!] TODO 
 			                              || aSource->isSet(UserConnection::FLAG_OP)
 #endif
 			                              || getFreeExtraSlots() > 0;
-			bool l_is_partialFree = l_is_partial && ((slotType == UserConnection::PARTIALSLOT) || (extraPartial < SETTING(EXTRA_PARTIAL_SLOTS)));
+			bool l_is_partialFree = l_is_partial && ((slotType == UserConnection::PARTIALSLOT) || (m_extra_partial < SETTING(EXTRA_PARTIAL_SLOTS)));
 			
 			if (l_is_free && l_is_supportsFree && l_is_allowedFree)
 			{
@@ -721,8 +740,8 @@ ok: //[!] TODO 
 	{
 		CFlyWriteLock(*g_csUploadsDelay);
 		g_uploads.push_back(u);
-		increaseUserConnectionAmountL(u->getUser());// [+] IRainman SpeedLimiter
 	}
+	increaseUserConnectionAmount(u->getUser());// [+] IRainman SpeedLimiter
 	
 	if (aSource->getSlotType() != slotType)
 	{
@@ -743,7 +762,7 @@ bool UploadManager::getAutoSlot()
 	if (SETTING(MIN_UPLOAD_SPEED) == 0)
 		return false;
 	/** Max slots */
-	if (getSlots() + SETTING(AUTO_SLOTS) < g_running)
+	if (getSlots() + SETTING(AUTO_SLOTS) < g_running.load())
 		return false;
 	/** Only grant one slot per 30 sec */
 	if (GET_TICK() < getLastGrant() + 30 * 1000)
@@ -753,52 +772,60 @@ bool UploadManager::getAutoSlot()
 }
 void UploadManager::shutdown()
 {
+	for (size_t i = 0; i < USER_CONNECTION_SHARDS; ++i)
 	{
-		CFlyWriteLock(*g_csUploadsDelay);
-		g_uploadsPerUser.clear();
+		CFlyFastLock(g_uploadsPerUser[i].m_cs);
+		g_uploadsPerUser[i].m_map.clear();
 	}
 	{
 		CFlyWriteLock(*g_csReservedSlots);
 		g_reservedSlots.clear();
 		g_is_reservedSlotEmpty = g_reservedSlots.empty();
 	}
+	CFlyUploadCache::clear();
 }
-void UploadManager::increaseUserConnectionAmountL(const UserPtr& p_user)
+void UploadManager::increaseUserConnectionAmount(const UserPtr& p_user)
 {
 	if (!ClientManager::isBeforeShutdown())
 	{
-		const auto i = g_uploadsPerUser.find(p_user);
-		if (i != g_uploadsPerUser.end())
+		auto& l_shard = getUserConnectionShard(p_user);
+		CFlyFastLock(l_shard.m_cs);
+		const auto i = l_shard.m_map.find(p_user);
+		if (i != l_shard.m_map.end())
 		{
 			i->second++;
 		}
 		else
 		{
-			g_uploadsPerUser.insert(CurrentConnectionPair(p_user, 1));
+			l_shard.m_map.insert(CurrentConnectionPair(p_user, 1));
 		}
 	}
 }
-void UploadManager::decreaseUserConnectionAmountL(const UserPtr& p_user)
+void UploadManager::decreaseUserConnectionAmount(const UserPtr& p_user)
 {
 	if (!ClientManager::isBeforeShutdown())
 	{
-		const auto i = g_uploadsPerUser.find(p_user);
-		//dcassert(i != g_uploadsPerUser.end());
-		if (i != g_uploadsPerUser.end())
+		auto& l_shard = getUserConnectionShard(p_user);
+		CFlyFastLock(l_shard.m_cs);
+		const auto i = l_shard.m_map.find(p_user);
+		//dcassert(i != l_shard.m_map.end());
+		if (i != l_shard.m_map.end())
 		{
 			i->second--;
 			if (i->second == 0)
 			{
-				g_uploadsPerUser.erase(p_user);
+				l_shard.m_map.erase(i);
 			}
 		}
 	}
 }
-unsigned int UploadManager::getUserConnectionAmountL(const UserPtr& p_user)
+unsigned int UploadManager::getUserConnectionAmount(const UserPtr& p_user)
 {
 	dcassert(!ClientManager::isBeforeShutdown());
-	const auto i = g_uploadsPerUser.find(p_user);
-	if (i != g_uploadsPerUser.end())
+	auto& l_shard = getUserConnectionShard(p_user);
+	CFlyFastLock(l_shard.m_cs);
+	const auto i = l_shard.m_map.find(p_user);
+	if (i != l_shard.m_map.end())
 	{
 		return i->second;
 	}
@@ -810,13 +837,13 @@ unsigned int UploadManager::getUserConnectionAmountL(const UserPtr& p_user)
 void UploadManager::removeUpload(UploadPtr& aUpload, bool delay)
 {
 	//dcassert(!ClientManager::isBeforeShutdown());
+	decreaseUserConnectionAmount(aUpload->getUser());// [+] IRainman SpeedLimiter
 	CFlyWriteLock(*g_csUploadsDelay);
 	//dcassert(find(g_uploads.begin(), g_uploads.end(), aUpload) != g_uploads.end());
 	if (!g_uploads.empty())
 	{
 		g_uploads.erase(remove(g_uploads.begin(), g_uploads.end(), aUpload), g_uploads.end());
 	}
-	decreaseUserConnectionAmountL(aUpload->getUser());// [+] IRainman SpeedLimiter
 	
 	if (delay)
 	{
@@ -841,14 +868,11 @@ void UploadManager::reserveSlot(const HintedUser& hintedUser, uint64_t aTime)
 	{
 		CFlyLock(m_csQueue); // [+] IRainman opt.
 		// find user in uploadqueue to connect with correct token
-		auto it = std::find_if(m_slotQueue.cbegin(), m_slotQueue.cend(), [&](const UserPtr & u)
-		{
-			return u == hintedUser.user;
-		});
-		if (it != m_slotQueue.cend())
+		const auto it = m_slotQueueIndex.find(hintedUser.user);
+		if (it != m_slotQueueIndex.end())
 		{
 			bool l_is_active_client;
-			ClientManager::getInstance()->connect(hintedUser, it->getToken(), false, l_is_active_client);
+			ClientManager::getInstance()->connect(hintedUser, it->second->getToken(), false, l_is_active_client);
 		}/* else {
             token = Util::toString(Util::rand());
         }*/
@@ -927,6 +951,20 @@ void UploadManager::on(AdcCommand::GET, UserConnection* aSource, const AdcComman
 	}
 	if (aSource->getState() != UserConnection::STATE_GET)
 	{
+		if (aSource->getState() == UserConnection::STATE_RUNNING && aSource->isSet(UserConnection::FLAG_SUPPORTS_PIPELINE))
+		{
+			// Pipelined request - answered when the current transfer is done (see TransmitDone)
+			auto& l_gets = aSource->getPipelinedGets();
+			if (l_gets.size() < g_max_pipelined_gets)
+			{
+				l_gets.push_back(c);
+				return;
+			}
+			// The peer would wait for the SND forever
+			aSource->send(AdcCommand(AdcCommand::SEV_FATAL, AdcCommand::ERROR_PROTOCOL_GENERIC, "Too many pipelined requests"));
+			aSource->disconnect();
+			return;
+		}
 		dcassert(0);
 		dcdebug("UM::onGET Bad state, ignoring\n");
 		return;
@@ -1037,6 +1075,14 @@ void UploadManager::on(UserConnectionListener::TransmitDone, UserConnection* aSo
 	{
 		removeUpload(u, true);
 	}
+	
+	auto& l_gets = aSource->getPipelinedGets();
+	while (!l_gets.empty() && aSource->getState() == UserConnection::STATE_GET)
+	{
+		const AdcCommand l_cmd = l_gets.front();
+		l_gets.pop_front();
+		on(AdcCommand::GET(), aSource, l_cmd);
+	}
 }
 
 void UploadManager::logUpload(const UploadPtr& aUpload)
@@ -1056,13 +1102,14 @@ void UploadManager::logUpload(const UploadPtr& aUpload)
 size_t UploadManager::addFailedUpload(const UserConnection* aSource, const string& file, int64_t pos, int64_t size)
 {
 	dcassert(!ClientManager::isBeforeShutdown());
-	size_t queue_position = 0;
-	
 	CFlyLock(m_csQueue); // [+] IRainman opt.
 	
-	auto it = std::find_if(m_slotQueue.begin(), m_slotQueue.end(), [&](const UserPtr & u) -> bool { ++queue_position; return u == aSource->getUser(); });
+	const auto l_index = m_slotQueueIndex.find(aSource->getUser());
+	auto it = l_index != m_slotQueueIndex.end() ? l_index->second : m_slotQueue.end();
+	size_t queue_position = m_slotQueue.size() + 1;
 	if (it != m_slotQueue.end())
 	{
+		queue_position = std::distance(m_slotQueue.begin(), it) + 1;
 		it->setToken(aSource->getUserConnectionToken());
 		// https://crash-server.com/DumpGroup.aspx?ClientID=guest&DumpGroupID=130703
 		for (auto i = it->m_waiting_files.cbegin(); i != it->m_waiting_files.cend(); ++i) //TODO https://crash-server.com/DumpGroup.aspx?ClientID=guest&DumpGroupID=128318
@@ -1077,8 +1124,8 @@ size_t UploadManager::addFailedUpload(const UserConnection* aSource, const strin
 	UploadQueueItemPtr uqi(new UploadQueueItem(aSource->getHintedUser(), file, pos, size));
 	if (it == m_slotQueue.end())
 	{
-		++queue_position;
 		m_slotQueue.push_back(WaitingUser(aSource->getHintedUser(), aSource->getUserConnectionToken(), uqi));
+		m_slotQueueIndex[aSource->getUser()] = std::prev(m_slotQueue.end());
 	}
 	else
 	{
@@ -1105,18 +1152,31 @@ void UploadManager::clearWaitingFilesL(const WaitingUser& p_wu)
 void UploadManager::clearUserFilesL(const UserPtr& aUser)
 {
 	//dcassert(!ClientManager::isBeforeShutdown());
-	auto it = std::find_if(m_slotQueue.cbegin(), m_slotQueue.cend(), [&](const UserPtr & u)
+	const auto it = m_slotQueueIndex.find(aUser);
+	if (it != m_slotQueueIndex.end())
 	{
-		return u == aUser;
-	});
-	if (it != m_slotQueue.end())
-	{
-		clearWaitingFilesL(*it);
+		clearWaitingFilesL(*it->second);
 		if (g_count_WaitingUsersFrame && !ClientManager::isBeforeShutdown())
 		{
 			fly_fire1(UploadManagerListener::QueueRemove(), aUser);
 		}
-		m_slotQueue.erase(it);
+		m_slotQueue.erase(it->second);
+		m_slotQueueIndex.erase(it);
+	}
+}
+void UploadManager::expireNotifiedUsersL(uint64_t p_tick)
+{
+	while (!m_notifiedExpiry.empty() && m_notifiedExpiry.front().first + g_notified_user_timeout < p_tick)
+	{
+		const auto& l_expired = m_notifiedExpiry.front();
+		const auto i = m_notifiedUsers.find(l_expired.second);
+		// the user could be notified again later or has already asked for a file
+		if (i != m_notifiedUsers.end() && i->second == l_expired.first)
+		{
+			clearUserFilesL(i->first);
+			m_notifiedUsers.erase(i);
+		}
+		m_notifiedExpiry.pop_front();
 	}
 }
 
@@ -1160,10 +1220,10 @@ void UploadManager::process_slot(UserConnection::SlotTypes p_slot_type, int p_de
 			g_running += p_delta;
 			break;
 		case UserConnection::EXTRASLOT:
-			extra += p_delta;
+			m_extra += p_delta;
 			break;
 		case UserConnection::PARTIALSLOT:
-			extraPartial += p_delta;
+			m_extra_partial += p_delta;
 			break;
 	}
 }
@@ -1205,9 +1265,11 @@ void UploadManager::notifyQueuedUsers(int64_t p_tick)
 				if (wu.getUser()->isOnline())
 				{
 					m_notifiedUsers[wu.getUser()] = p_tick;
+					m_notifiedExpiry.push_back(std::make_pair(uint64_t(p_tick), wu.getUser()));
 					l_notifyList.push_back(wu);
 					freeslots--;
 				}
+				m_slotQueueIndex.erase(wu.getUser());
 				m_slotQueue.pop_front();
 			}
 		}
@@ -1236,17 +1298,7 @@ void UploadManager::on(TimerManagerListener::Minute, uint64_t aTick) noexcept
 		
 		{
 			CFlyLock(m_csQueue); // [+] IRainman opt.
-			
-			for (auto i = m_notifiedUsers.cbegin(); i != m_notifiedUsers.cend();)
-			{
-				if ((i->second + (90 * 1000)) < aTick)
-				{
-					clearUserFilesL(i->first);
-					m_notifiedUsers.erase(i++);
-				}
-				else
-					++i;
-			}
+			expireNotifiedUsersL(aTick);
 		}
 		
 		if (BOOLSETTING(AUTO_KICK))
@@ -1419,7 +1471,7 @@ void UploadManager::on(TimerManagerListener::Second, uint64_t aTick) noexcept
 					l_tickList.push_back(l_td);
 					u->tick(aTick);
 				}
-				u->getUserConnection()->getSocket()->updateSocketBucket(getUserConnectionAmountL(u->getUser()));// [+] IRainman SpeedLimiter
+				u->getUserConnection()->getSocket()->updateSocketBucket(getUserConnectionAmount(u->getUser()));// [+] IRainman SpeedLimiter
 				l_currentSpeed += u->getRunningAverage();//[+] IRainman refactoring transfer mechanism
 			}
 			g_runningAverage = l_currentSpeed; // [+] IRainman refactoring transfer mechanism
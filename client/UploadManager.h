@@ -151,7 +151,7 @@ class UploadManager : private ClientManagerListener, private UserConnectionListe
 		/** @return Number of free slots. */
 		static int getFreeSlots()
 		{
-			return max((getSlots() - g_running), 0);
+			return max((getSlots() - g_running.load()), 0);
 		}
 		
 		/** @internal */
@@ -159,6 +159,14 @@ class UploadManager : private ClientManagerListener, private UserConnectionListe
 		{
 			return max(SETTING(EXTRA_SLOTS) - getExtra(), 0);
 		}
+		int getExtra() const
+		{
+			return m_extra;
+		}
+		int getExtraPartial() const
+		{
+			return m_extra_partial;
+		}
 		
 		/** @param aUser Reserve an upload slot for this user and connect. */
 		void reserveSlot(const HintedUser& hintedUser, uint64_t aTime);
@@ -184,7 +192,7 @@ class UploadManager : private ClientManagerListener, private UserConnectionListe
 				}
 		};
 		
-		typedef std::list<WaitingUser> SlotQueue;
+		typedef std::list<WaitingUser> SlotQueue; // in the order of arrival, granted from the front
 		const SlotQueue& getUploadQueueL() const
 		{
 			return m_slotQueue;
@@ -203,8 +211,6 @@ class UploadManager : private ClientManagerListener, private UserConnectionListe
 		static void removeDelayUpload(const UserPtr& aUser);
 		static void abortUpload(const string& aFile, bool waiting = true);
 		
-		GETSET(int, extraPartial, ExtraPartial);
-		GETSET(int, extra, Extra);
 		GETSET(uint64_t, lastGrant, LastGrant);
 		
 		void load(); // !SMT!-S
@@ -219,20 +225,38 @@ class UploadManager : private ClientManagerListener, private UserConnectionListe
 	private:
 		bool isFireball;
 		bool isFileServer;
-		static int  g_running;
+		// Slot counters are changed without locks (prepareFile, removeConnection)
+		static std::atomic<int> g_running;
+		std::atomic<int> m_extra;
+		std::atomic<int> m_extra_partial;
 		static int64_t g_runningAverage;//[+] IRainman refactoring transfer mechanism
 		uint64_t m_fireballStartTick;
 		
 		static UploadList g_uploads;
 		static UploadList g_delayUploads;
-		static CurrentConnectionMap g_uploadsPerUser;
 		static std::unique_ptr<webrtc::RWLockWrapper> g_csUploadsDelay;
 		
 		void process_slot(UserConnection::SlotTypes p_slot_type, int p_delta);
 		
-		static void increaseUserConnectionAmountL(const UserPtr& p_user);
-		static void decreaseUserConnectionAmountL(const UserPtr& p_user);
-		static unsigned int getUserConnectionAmountL(const UserPtr& p_user);
+		/**
+		 * Upload connections per user, split by the user hash into shards with own locks:
+		 * the counters are updated from the connection threads and read for every upload
+		 * in the second tick, they don't need g_csUploadsDelay.
+		 */
+		struct UserConnectionShard
+		{
+			FastCriticalSection m_cs;
+			CurrentConnectionMap m_map;
+		};
+		enum { USER_CONNECTION_SHARDS = 16 };
+		static UserConnectionShard g_uploadsPerUser[USER_CONNECTION_SHARDS];
+		static UserConnectionShard& getUserConnectionShard(const UserPtr& p_user)
+		{
+			return g_uploadsPerUser[User::Hash()(p_user) % USER_CONNECTION_SHARDS];
+		}
+		static void increaseUserConnectionAmount(const UserPtr& p_user);
+		static void decreaseUserConnectionAmount(const UserPtr& p_user);
+		static unsigned int getUserConnectionAmount(const UserPtr& p_user);
 		// [~] IRainman SpeedLimiter
 		
 		int m_lastFreeSlots; /// amount of free slots at the previous minute
@@ -240,13 +264,21 @@ class UploadManager : private ClientManagerListener, private UserConnectionListe
 		typedef boost::unordered_map<UserPtr, uint64_t, User::Hash> SlotMap;
 		
 		static SlotMap g_reservedSlots;
-		static bool g_is_reservedSlotEmpty;
+		static std::atomic_bool g_is_reservedSlotEmpty;
 		static std::unique_ptr<webrtc::RWLockWrapper> g_csReservedSlots;
 		
+		// All under m_csQueue
 		SlotMap m_notifiedUsers;
+		/** Notified users in the order of the notify tick - expired from the front */
+		std::deque<std::pair<uint64_t, UserPtr>> m_notifiedExpiry;
 		SlotQueue m_slotQueue;
+		/** Position of the user in m_slotQueue - no scans of the queue for the user */
+		typedef boost::unordered_map<UserPtr, SlotQueue::iterator, User::Hash> SlotQueueIndex;
+		SlotQueueIndex m_slotQueueIndex;
 		mutable CriticalSection m_csQueue; // [+] IRainman opt.
 		
+		void expireNotifiedUsersL(uint64_t p_tick);
+		
 		size_t addFailedUpload(const UserConnection* aSource, const string& file, int64_t pos, int64_t size);
 		void notifyQueuedUsers(int64_t p_tick);//[!]IRainman refactoring transfer mechanism add int64_t tick
 		
@@ -737,10 +737,6 @@ string Identity::getStringParam(const char* name) const // [!] IRainman fix.
 	{
 		CFlyFastLock(m_si_fcs);
 		const auto i = m_stringInfo.find(*(short*)name);
-#ifdef FLYLINKDC_USE_PROFILER_CS
-		l_lock.m_add_log_info = "[get] name = ";
-		l_lock.m_add_log_info += string(name) + string(i == m_stringInfo.end() ? " [ not_found! ]" : "[ " + i->second + " ]" + " Nick = " + getNick());
-#endif
 		if (i != m_stringInfo.end())
 		{
 #ifdef FLYLINKDC_USE_GATHER_IDENTITY_STAT
@@ -757,10 +753,6 @@ uint32_t Identity::mergeDicId(const string& p_val)
 		return 0;
 	{
 		CFlyReadLock(*g_rw_cs);
-#ifdef FLYLINKDC_USE_PROFILER_CS
-		l_lock.m_add_log_info = "p_val = ";
-		l_lock.m_add_log_info += p_val + " Nick = " + getNick();
-#endif
 		auto l_find_ro = g_infoDicIndex.find(p_val);
 		if (l_find_ro != g_infoDicIndex.end())
 		{
@@ -870,10 +862,6 @@ void Identity::setStringParam(const char* name, const string& val) // [!] IRainm
 		if (l_is_skip_string_map == false)
 		{
 			CFlyFastLock(m_si_fcs);
-#ifdef FLYLINKDC_USE_PROFILER_CS
-			l_lock.m_add_log_info = "[set] name = ";
-			l_lock.m_add_log_info += string(name) + string(val.empty() ? " val.empty()" : val);
-#endif
 			if (val.empty())
 			{
 				m_stringInfo.erase(*(short*)name);
@@ -37,6 +37,7 @@ const string UserConnection::FEATURE_ADC_BAS0 = "BAS0";
 const string UserConnection::FEATURE_ADC_BASE = "BASE";
 const string UserConnection::FEATURE_ADC_BZIP = "BZIP";
 const string UserConnection::FEATURE_ADC_TIGR = "TIGR";
+const string UserConnection::FEATURE_PIPELINE = "PIPE";
 #ifdef SMT_ENABLE_FEATURE_BAN_MSG
 const string UserConnection::FEATURE_BANMSG = "BanMsg"; // !SMT!-B
 #endif
@@ -491,6 +492,7 @@ void UserConnection::fireBytesSent(size_t p_Bytes, size_t p_Actual)
 #endif
 	dcassert(getState() == UserConnection::STATE_RUNNING);
 	getUpload()->addPos(p_Bytes, p_Actual);
+	CFlyMetrics::inc(CFlyMetrics::UPLOAD_BYTES, p_Actual);
 	// getUpload()->tick(l_tick); // -     
 	//fly_fire3(UserConnectionListener::UserBytesSent(), this, p_Bytes, p_Actual);
 }
@@ -590,6 +592,14 @@ void UserConnection::send(const string& aString)
 	socket->write(aString);
 }
 
+void UserConnection::send(const AdcCommand& c)
+{
+	// the socket copies the line - the buffer of the thread is reused
+	static thread_local string g_buffer;
+	c.toString(0, isSet(FLAG_NMDC), g_buffer);
+	send(g_buffer);
+}
+
 // !SMT!-S
 void UserConnection::setUser(const UserPtr& aUser)
 {
@@ -48,6 +48,7 @@ class UserConnection : public Speaker<UserConnectionListener>,
 		static const string FEATURE_ADC_BASE;
 		static const string FEATURE_ADC_BZIP;
 		static const string FEATURE_ADC_TIGR;
+		static const string FEATURE_PIPELINE;
 #ifdef SMT_ENABLE_FEATURE_BAN_MSG
 		static const string FEATURE_BANMSG; // !SMT!-B
 #endif
@@ -66,7 +67,8 @@ class UserConnection : public Speaker<UserConnectionListener>,
 			FLAG_SUPPORTS_TTHL          = 1 << 4,
 			FLAG_SUPPORTS_TTHF          = 1 << 5,
 			FLAG_SUPPORTS_BANMSG        = 1 << 6, // !SMT!-S
-			FLAG_SUPPORTS_LAST = FLAG_SUPPORTS_BANMSG
+			FLAG_SUPPORTS_PIPELINE      = 1 << 7, // GET may be sent before the previous transfer is finished
+			FLAG_SUPPORTS_LAST = FLAG_SUPPORTS_PIPELINE
 		};
 		
 		enum Flags // [!] IRainman fix
@@ -172,10 +174,7 @@ class UserConnection : public Speaker<UserConnectionListener>,
 		            send(AdcCommand(AdcCommand::CMD_SND).addParam(aType).addParam(aName).addParam(Util::toString(aStart)).addParam(Util::toString(aBytes)));
 		        }
 		        */
-		void send(const AdcCommand& c)
-		{
-			send(c.toString(0, isSet(FLAG_NMDC)));
-		}
+		void send(const AdcCommand& c);
 		
 		void setDataMode(int64_t aBytes = -1)
 		{
@@ -297,6 +296,18 @@ class UserConnection : public Speaker<UserConnectionListener>,
 			dcassert(isSet(FLAG_DOWNLOAD));
 			m_download = d;
 		}
+		/** Downloads requested ahead of the current one (FLAG_SUPPORTS_PIPELINE), in the request order */
+		std::deque<DownloadPtr>& getPipelinedDownloads()
+		{
+			dcassert(isSet(FLAG_DOWNLOAD));
+			return m_pipelined_downloads;
+		}
+		/** GET commands received while the previous upload is running (FLAG_SUPPORTS_PIPELINE) */
+		std::deque<AdcCommand>& getPipelinedGets()
+		{
+			dcassert(isSet(FLAG_UPLOAD));
+			return m_pipelined_gets;
+		}
 		UploadPtr& getUpload()
 		{
 			dcassert(isSet(FLAG_UPLOAD));
@@ -401,6 +412,8 @@ class UserConnection : public Speaker<UserConnectionListener>,
 		
 		DownloadPtr m_download;
 		UploadPtr m_upload;
+		std::deque<DownloadPtr> m_pipelined_downloads;
+		std::deque<AdcCommand> m_pipelined_gets;
 		
 #ifdef FLYLINKDC_USE_BLOCK_ERROR_CMD
 		static FastCriticalSection g_error_cs;
@@ -445,6 +458,7 @@ class UcSupports // [+] IRainman fix.
 						else CHECK_FEAT(ZLIB_GET)
 							else CHECK_FEAT(TTHL)
 								else CHECK_FEAT(TTHF)
+									else CHECK_FEAT(PIPELINE)
 #ifdef SMT_ENABLE_FEATURE_BAN_MSG
 									else CHECK_FEAT(BANMSG) // !SMT!-S
 #endif
@@ -472,6 +486,7 @@ class UcSupports // [+] IRainman fix.
 			CHECK_FEAT(ZLIB_GET);
 			CHECK_FEAT(TTHL);
 			CHECK_FEAT(TTHF);
+			CHECK_FEAT(PIPELINE);
 #ifdef SMT_ENABLE_FEATURE_BAN_MSG
 			CHECK_FEAT(BANMSG); // !SMT!-S
 #endif
@@ -30,13 +30,17 @@
 #include "StringTokenizer.h"
 #include "SearchResult.h"
 #include "Socket.h"
+#include "CFlyMetrics.h"
+#include "CFlyWebApi.h"
 #include <boost/algorithm/string.hpp>
 
-static const string NotFoundHeader = "HTTP/1.0 404 Not Found\r\n";
-
 WebServerManager* Singleton<WebServerManager>::instance = nullptr;
 
-WebServerManager::WebServerManager(void) : started(false), page404(nullptr), sended_search(false), m_search_token(0)
+WebServerManager::WebServerManager(void) : started(false), page404(nullptr), sended_search(false), m_search_token(0),
+	m_http([this](const CFlyHttpServer::Request & p_request, CFlyHttpServer::Response & p_response)
+{
+	handleRequest(p_request, p_response);
+})
 {
 	SettingsManager::getInstance()->addListener(this);
 }
@@ -75,6 +79,8 @@ void WebServerManager::Start() noexcept
 	freopen("con:", "w", stdout);
 	printf("WebServer debug log:\n");
 #endif
+	m_api = std::make_unique<CFlyWebApi>(m_http);
+	m_http.start();
 	try
 	{
 		socket.listen(static_cast<uint16_t>(SETTING(WEBSERVER_PORT)), SETTING(WEBSERVER_BIND_ADDRESS));
@@ -101,6 +107,8 @@ void WebServerManager::Stop()
 		socket.disconnect();
 	}
 	catch (const SocketException&) {} //-V565
+	m_http.stop();
+	m_api.reset();
 	safe_delete(page404);
 	for (auto p = pages.begin(); p != pages.end(); ++p)
 	{
@@ -116,12 +124,17 @@ void WebServerManager::Stop()
 
 void WebServerManager::on(ServerSocketListener::IncomingConnection) noexcept
 {
-	WebServerSocket *wss = new WebServerSocket();
-	wss->accept(&socket);
-	wss->start(64);
+	sockaddr_in l_from;
+	memzero(&l_from, sizeof(l_from));
+	int l_from_len = sizeof(l_from);
+	const SOCKET l_sock = ::accept(socket.getSock(), (struct sockaddr*) &l_from, &l_from_len);
+	if (l_sock != INVALID_SOCKET)
+	{
+		m_http.addConnection(l_sock, inet_ntoa(l_from.sin_addr));
+	}
 }
 
-void WebServerManager::getLoginPage(string& p_out)
+void WebServerManager::getLoginPage(CFlyHttpServer::Response& p_response)
 {
 	const string& l_webserver = STRING(WEBSERVER);
 	string pagehtml = GetTplFile("header.html");
@@ -135,8 +148,8 @@ void WebServerManager::getLoginPage(string& p_out)
 	TplSetParam(pagehtml, "LANG_PASSWORD", STRING(PASSWORD));
 	TplSetParam(pagehtml, "LANG_LOGIN", STRING(LOG_IN));
 	
-	p_out = "HTTP/1.0 200 OK\r\nContent-Type: text/html\r\nContent-Length: " + Util::toString(pagehtml.length()) + "\r\n\r\n";
-	p_out += pagehtml;
+	p_response.m_content_type = "text/html";
+	p_response.m_body = pagehtml;
 }
 
 void WebServerManager::on(SettingsManagerListener::Repaint)
@@ -155,15 +168,13 @@ void WebServerManager::on(SettingsManagerListener::Repaint)
 	}
 }
 
-void WebServerManager::getPage(string& p_InOut, const string& IP, UserStatus CurrentUser)
+void WebServerManager::getPage(CFlyHttpServer::Response& p_response, const string& p_page, const string& IP, UserStatus CurrentUser)
 {
 #ifdef _DEBUG_WEB_SERVER_
-	printf("requested: '%s'\n", p_InOut.c_str());
+	printf("requested: '%s'\n", p_page.c_str());
 #endif
-	string header = "HTTP/1.0 200 OK\r\n";
-	
 	WebPageInfo *page = page404;
-	WebPages::const_iterator f = pages.find(p_InOut);
+	WebPages::const_iterator f = pages.find(p_page);
 	if (f != pages.end())
 		page = f->second;
 		
@@ -268,20 +279,20 @@ void WebServerManager::getPage(string& p_InOut, const string& IP, UserStatus Cur
 			if (i != LoggedIn.cend()) // [1] https://www.box.net/shared/75d5cd705f7609438910
 				LoggedIn.erase(i);
 				
-			getLoginPage(p_InOut);
+			getLoginPage(p_response);
 			return;
 		}
 		case PAGE_404:
 		default:
 			int action = -1; // system  managment
-			if (p_InOut == "/shutdown.htm") action = 0;
-			else if (p_InOut == "/reboot.htm") action = 2;
-			else if (p_InOut == "/suspend.htm") action = 3;
-			else if (p_InOut == "/logoff.htm") action = 1;
-			else if (p_InOut == "/switch.htm") action = 5;
+			if (p_page == "/shutdown.htm") action = 0;
+			else if (p_page == "/reboot.htm") action = 2;
+			else if (p_page == "/suspend.htm") action = 3;
+			else if (p_page == "/logoff.htm") action = 1;
+			else if (p_page == "/switch.htm") action = 5;
 			else    // system  managment
 			{
-				header = NotFoundHeader;
+				p_response.m_status = 404;
 				pagehtml += STRING(WEBSERVER_PAGE_NOT_FOUND);
 				break;
 			} // system  managment
@@ -307,12 +318,11 @@ void WebServerManager::getPage(string& p_InOut, const string& IP, UserStatus Cur
 	TplSetParam(pagehtml, "THEME_PATH", "FlylinkDC");
 	TplSetParam(pagehtml, "I_SEARCH_DELAY", search_delay);
 	
-	header += "Content-Type: text/html\r\nContent-Length: " + Util::toString(pagehtml.length()) + "\r\n\r\n";
-	
 #ifdef _DEBUG_WEB_SERVER_
-	printf("sending: %s\n", (header + pagehtml).c_str());
+	printf("sending: %s\n", pagehtml.c_str());
 #endif
-	p_InOut = header + pagehtml;
+	p_response.m_content_type = "text/html";
+	p_response.m_body = pagehtml;
 }
 
 static const string checked_checked = "checked=checked";
@@ -705,28 +715,6 @@ string WebServerManager::getULQueue()
 	return ret;
 }
 
-StringMap getArgs(const string& arguments)
-{
-	StringMap args;
-	string::size_type i = 0;
-	string::size_type j = 0;
-	while ((i = arguments.find('=', j)) != string::npos)
-	{
-		const string key = arguments.substr(j, i - j);
-		string value = arguments.substr(i + 1);
-		
-		j = i + 1;
-		if ((i = arguments.find('&', j)) != string::npos)
-		{
-			value = arguments.substr(j, i - j);
-			j = i + 1;
-		}
-		
-		args[key] = value;
-	}
-	return args;
-}
-
 static bool getFile(string& p_InOutData)
 {
 	ReplaceAllUriSeparatorToPathSeparator(p_InOutData);
@@ -742,6 +730,41 @@ static bool getFile(string& p_InOutData)
 	return true;
 }
 
+static const char* getContentType(const string& p_file)
+{
+	const string l_ext = Text::toLower(Util::getFileExt(p_file));
+	if (l_ext == ".htm" || l_ext == ".html")
+		return "text/html";
+	if (l_ext == ".css")
+		return "text/css";
+	if (l_ext == ".js")
+		return "application/javascript";
+	if (l_ext == ".png")
+		return "image/png";
+	if (l_ext == ".gif")
+		return "image/gif";
+	if (l_ext == ".jpg" || l_ext == ".jpeg")
+		return "image/jpeg";
+	if (l_ext == ".ico")
+		return "image/x-icon";
+	if (l_ext == ".txt")
+		return "text/plain";
+	return "application/octet-stream";
+}
+
+// DNS rebinding: a foreign page resolved to our address comes with its own host name
+static bool isValidHost(const string& p_host)
+{
+	if (p_host.empty()) // HTTP/1.0 client, browsers always send Host
+		return true;
+	if (p_host[0] == '[') // IPv6 literal
+		return p_host.find(']') != string::npos;
+	const string l_host = p_host.substr(0, p_host.rfind(':'));
+	if (stricmp(l_host, "localhost") == 0)
+		return true;
+	return !l_host.empty() && l_host.find_first_not_of("0123456789.") == string::npos;
+}
+
 bool WebServerManager::noPage(const string& for_find)
 {
 	if (pages.find(for_find) != pages.end() || for_find == "/shutdown.htm" || for_find == "/reboot.htm" || for_find == "/suspend.htm" || for_find == "/logoff.htm" || for_find == "/switch.htm")
@@ -754,241 +777,235 @@ bool WebServerManager::noPage(const string& for_find)
 	return true;
 }
 
-int WebServerSocket::run()
+void WebServerManager::handleRequest(const CFlyHttpServer::Request& p_request, CFlyHttpServer::Response& p_response)
 {
-	const size_t g_size_buf = 8192;
-	string header(g_size_buf, 0);
-	int test = 0;
-	while (++test < 10000)
+	const string& IP = p_request.m_ip;
+	dcdebug("Webserver incoming: %s from IP %s\n", p_request.m_header.c_str(), IP.c_str()); //-V111
+	if (p_request.m_method != "GET" && p_request.m_method != "HEAD")
 	{
-		const int size = recv(m_www_sock, &header[0], g_size_buf, 0);
-		if (size == -1)
-			continue;
-			
-		header.resize(static_cast<size_t>(size));
-		
-		const string IP = inet_ntoa(m_from.sin_addr);
-		
-		dcdebug("Webserver incoming: %s from IP %s\n", header.c_str(), IP.c_str()); //-V111
-		
-		string::size_type start = 0, end = 0;
+		p_response.m_status = 400;
+		return;
+	}
+	if (BOOLSETTING(LOG_WEBSERVER) && !p_request.m_is_retry && p_request.m_query.compare(0, 4, "user") != 0 && p_request.m_path != "/robots.txt")
+	{
+		StringMap params;
+		params["file"] = p_request.m_query.empty() ? p_request.m_path : p_request.m_path + '?' + p_request.m_query;
+		params["ip"] = IP;
+		LOG(WEBSERVER, params);
+	}
+	const string& l_path = p_request.m_path;
+	const bool l_is_api = CFlyWebApi::isApi(l_path);
+	if (l_is_api || l_path == "/metrics" || l_path == "/locks")
+	{
+		// JSON API - a logged in user only, runtime counters for the monitoring (Prometheus text format)
+		// and the lock contention report - also the local host.
+		// The host name is an address or localhost - the page of a foreign site can't read them by DNS rebinding.
+		const bool l_is_allowed = GetUserStatus(IP).isloggedin() || (!l_is_api && IP == "127.0.0.1");
+		if (!l_is_allowed || !isValidHost(CFlyHttpServer::getHeaderValue(p_request.m_header, "Host")))
+		{
+			p_response.m_status = 403;
+		}
+		else if (l_is_api)
+		{
+			m_api->handle(p_request, p_response);
+		}
+		else if (l_path == "/metrics")
+		{
+			p_response.m_content_type = "text/plain; version=0.0.4";
+			p_response.m_body = CFlyMetrics::format();
+		}
+		else
+		{
+			p_response.m_content_type = "text/plain";
+			p_response.m_body = CFlyLockProfiler::getReport();
+		}
+		return;
+	}
+	if (noPage(l_path))
+	{
+#ifdef _DEBUG_WEB_SERVER_
+		printf("requested: '%s'\n", l_path.c_str());
+#endif
+		string l_file = l_path.substr(1);
+		if (getFile(l_file))
+		{
+			p_response.m_content_type = getContentType(l_path);
+			p_response.m_body.swap(l_file);
+		}
+		else
+		{
+			p_response.m_status = 404;
+			p_response.m_content_type = "text/html";
+			p_response.m_body = STRING(WEBSERVER_PAGE_NOT_FOUND);
+		}
+		return;
+	}
+	
+	UserStatus CurrentUser = GetUserStatus(IP);
+	if (!p_request.m_query.empty())
+	{
+		StringMap m = CFlyHttpServer::parseQuery(p_request.m_query);
+		if (!m["user"].empty())
+		{
+			if (m["user"] == SETTING(WEBSERVER_USER) && m["pass"] == SETTING(WEBSERVER_PASS))
+			{
+				login(IP);
+				CurrentUser = GetUserStatus(IP);
+			}
+			else if (m["user"] == SETTING(WEBSERVER_POWER_USER) && m["pass"] == SETTING(WEBSERVER_POWER_PASS))
+			{
+				login(IP, true);
+				CurrentUser = GetUserStatus(IP);
+			}
+		}
 		
-		if (((start = header.find("GET ")) != string::npos) && (end = header.substr(start + 4).find(' ')) != string::npos) //-V112
+		if (CurrentUser.isloggedin())
 		{
-			if (BOOLSETTING(LOG_WEBSERVER) && (header.find("?user") == string::npos))
+			if (!m["search"].empty())
+			{
+				search(Util::encodeURI(m["search"], true), Search::TypeModes(Util::toInt(m["type"])));
+			} /*else {
+                        searchstarted(m["search_started"].empty()); // TODO
+                    }*/
+			if (!m["stop"].empty())
 			{
-				StringMap params;
-				const string file = header.substr(start + 4, end); //-V112
-				params["file"] = file;
-				params["ip"] = IP;
-				if (file != "/robots.txt")
-					LOG(WEBSERVER, params);
+				reset();
 			}
-			string headerF = header.substr(start + 5, end - 1);
-			const string::size_type endF = header.find('?');
-			const string::size_type bs = header.substr(start + 5).find(' ');
-			if ((endF != string::npos) && (endF < bs))
+			if (!m["pagenum"].empty())
 			{
-				headerF = header.substr(start + 5, endF - 5);
+				ChangePage(Util::toInt(m["pagenum"]));
 			}
-			if (WebServerManager::getInstance()->noPage('/' + headerF))
+			
+			string dir;
+			if (SETTING(WEBSERVER_ALLOW_CHANGE_DOWNLOAD_DIR))
 			{
-#ifdef _DEBUG_WEB_SERVER_
-				printf("requested: '%s'\n", headerF.c_str());
-#endif
-				if (!getFile(headerF))
+				if (!m["dir"].empty())
 				{
-					const string& l_pageNotFoundStr = STRING(WEBSERVER_PAGE_NOT_FOUND);
-					string l_header = NotFoundHeader;
-					l_header += "Content-Type: text/html\r\nContent-Length: " + Util::toString(l_pageNotFoundStr.length()) + "\r\n\r\n";
-					headerF = l_header + l_pageNotFoundStr;
+					dir = Util::encodeURI(m["dir"], true);
 				}
-#ifdef _DEBUG_WEB_SERVER_
-				printf("sending: %s\n", (headerF).c_str());
-#endif
-				::send(m_www_sock, headerF.c_str(), static_cast<int>(headerF.size()), 0);
-				break;
 			}
 			
-			header = header.substr(start + 4, end); //-V112
-#ifdef _DEBUG_WEB_SERVER_
-			dcdebug("%s\n", header.c_str());
-#endif
-			WebServerManager::UserStatus CurrentUser = WebServerManager::getInstance()->GetUserStatus(IP);
-			
-			if ((start = header.find('?')) != string::npos)
+			if (!m["name"].empty())
 			{
-				const string arguments(header.substr(start + 1));
-				header = header.substr(0, start);
-				StringMap m = getArgs(arguments);
-				if (!m["user"].empty())
-				{
-					if (m["user"] == SETTING(WEBSERVER_USER) && m["pass"] == SETTING(WEBSERVER_PASS))
-					{
-						WebServerManager::getInstance()->login(IP);
-						CurrentUser = WebServerManager::getInstance()->GetUserStatus(IP);
-					}
-					else if (m["user"] == SETTING(WEBSERVER_POWER_USER) && m["pass"] == SETTING(WEBSERVER_POWER_PASS))
-					{
-						WebServerManager::getInstance()->login(IP, true);
-						CurrentUser = WebServerManager::getInstance()->GetUserStatus(IP);
-					}
-				}
-				
-				if (CurrentUser.isloggedin())
+				const WebServerManager::searchresult toAdd = GetSearchResult(Util::toInt(m["number"]));
+				switch (Util::toInt(m["type"]))
 				{
-					if (!m["search"].empty())
-					{
-						WebServerManager::getInstance()->search(Util::encodeURI(m["search"], true), Search::TypeModes(Util::toInt(m["type"])));
-					} /*else {
-                        WebServerManager::getInstance()->searchstarted(m["search_started"].empty()); // TODO
-                    }*/
-					if (!m["stop"].empty())
-					{
-						WebServerManager::getInstance()->reset();
-					}
-					if (!m["pagenum"].empty())
-					{
-						WebServerManager::getInstance()->ChangePage(Util::toInt(m["pagenum"]));
-					}
-					
-					string dir;
-					if (SETTING(WEBSERVER_ALLOW_CHANGE_DOWNLOAD_DIR))
-					{
-						if (!m["dir"].empty())
+					case SearchResult::TYPE_DIRECTORY:
+						QueueManager::getInstance()->addDirectory(Util::encodeURI(m["file"], true), HintedUser(toAdd.User, toAdd.HubURL), dir);
+						break;
+					case SearchResult::TYPE_FILE:
+						const string name = Util::encodeURI(m["name"], true);
+						const string DownloadName = !dir.empty() ? SETTING(DOWNLOAD_DIRECTORY) + name : name;
+						try
 						{
-							dir = Util::encodeURI(m["dir"], true);
+							QueueManager::getInstance()->add(0, DownloadName, Util::toInt64(m["size"]), TTHValue(m["tth"]), HintedUser(toAdd.User, toAdd.HubURL));
 						}
-					}
-					
-					if (!m["name"].empty())
-					{
-						const WebServerManager::searchresult toAdd = WebServerManager::getInstance()->GetSearchResult(Util::toInt(m["number"]));
-						switch (Util::toInt(m["type"]))
+						catch (const Exception& e)
 						{
-							case SearchResult::TYPE_DIRECTORY:
-								QueueManager::getInstance()->addDirectory(Util::encodeURI(m["file"], true), HintedUser(toAdd.User, toAdd.HubURL), dir);
-								break;
-							case SearchResult::TYPE_FILE:
-								const string name = Util::encodeURI(m["name"], true);
-								const string DownloadName = !dir.empty() ? SETTING(DOWNLOAD_DIRECTORY) + name : name;
-								try
-								{
-									QueueManager::getInstance()->add(0, DownloadName, Util::toInt64(m["size"]), TTHValue(m["tth"]), HintedUser(toAdd.User, toAdd.HubURL));
-								}
-								catch (const Exception& e)
-								{
-									LogManager::message("QueueManager::getInstance()->add Error = " + e.getError());
-								}
-								
-								break;
+							LogManager::message("QueueManager::getInstance()->add Error = " + e.getError());
 						}
-					}
-					if (!m["link"].empty())
+						
+						break;
+				}
+			}
+			if (!m["link"].empty())
+			{
+				string tmpL = Util::encodeURI(m["link"], true);
+				const string::size_type start = tmpL.find('?');
+			if (start != string::npos)
+				{
+					// IRainman TODO: please refactoring me after rewrite magnet parsing mechanism.
+					string arg = tmpL.substr(start + 1);
+					tmpL = tmpL.substr(0, start);
+					StringMap Link = CFlyHttpServer::parseQuery(arg);
+					if (Link["xt"].length() == 54)
 					{
-						string tmpL = Util::encodeURI(m["link"], true);
-						if ((start = tmpL.find('?')) != string::npos)
+						TTHValue tth = TTHValue(Link["xt"].substr(15));
+						
+						string DownloadName = Link["dn"];
+						if (!DownloadName.empty())
 						{
-							// IRainman TODO: please refactoring me after rewrite magnet parsing mechanism.
-							string arg = tmpL.substr(start + 1);
-							tmpL = tmpL.substr(0, start);
-							StringMap Link = getArgs(arg);
-							if (Link["xt"].length() == 54)
+							DownloadName = Util::encodeURI(DownloadName, true);
+							if (!dir.empty())
 							{
-								TTHValue tth = TTHValue(Link["xt"].substr(15));
-								
-								string DownloadName = Link["dn"];
-								if (!DownloadName.empty())
-								{
-									DownloadName = Util::encodeURI(DownloadName, true);
-									if (!dir.empty())
-									{
-										File::addTrailingSlash(dir);
-										File::ensureDirectory(dir);
-										DownloadName = dir + DownloadName;
-									}
-									QueueManager::getInstance()->addFromWebServer(DownloadName, Util::toInt64(Link["xl"]), tth);
-								}
+								File::addTrailingSlash(dir);
+								File::ensureDirectory(dir);
+								DownloadName = dir + DownloadName;
 							}
+							QueueManager::getInstance()->addFromWebServer(DownloadName, Util::toInt64(Link["xl"]), tth);
 						}
 					}
-					if (!m["dqueue"].empty())
-					{
-						const string dqueue = Util::encodeURI(m["dqueue"], true);
-						const string qfile = Util::encodeURI(m["qfile"], true);
-						if (dqueue == STRING(REMOVE2))
-						{
-							QueueManager::getInstance()->removeTarget(qfile, false);
-						}
-						if (dqueue == STRING(SET_PRIORITY))
-						{
-							const string dp = Util::encodeURI(m["dp"], true);
-							if (dp == STRING(AUTO))
-								QueueManager::getInstance()->setAutoPriority(qfile, true);
-							else if (dp == STRING(PAUSED))
-								QueueManager::getInstance()->setPriority(qfile, QueueItem::PAUSED);
-							else if (dp == STRING(LOWEST))
-								QueueManager::getInstance()->setPriority(qfile, QueueItem::LOWEST);
-							else if (dp == STRING(LOW))
-								QueueManager::getInstance()->setPriority(qfile, QueueItem::LOW);
-							else if (dp == STRING(NORMAL))
-								QueueManager::getInstance()->setPriority(qfile, QueueItem::NORMAL);
-							else if (dp == STRING(HIGH))
-								QueueManager::getInstance()->setPriority(qfile, QueueItem::HIGH);
-							else if (dp == STRING(HIGHEST))
-								QueueManager::getInstance()->setPriority(qfile, QueueItem::HIGHEST);
-						}
-					}
-					if (!m["refresh"].empty())
-					{
-						ShareManager::getInstance()->setDirty();
-						ShareManager::getInstance()->refresh_share(true);
-					}
-					if (!m["purgetth"].empty())
-					{
-						ShareManager::getInstance()->setDirty();
-						ShareManager::getInstance()->setPurgeTTH();
-						ShareManager::getInstance()->refresh_share(true);
-						LogManager::message(STRING(PURGE_TTH_DATABASE)); //[!]NightOrion(translate)
-					}
-					if (!m["webss"].empty() && !m["websps"].empty() &&
-					        !m["upspeed"].empty() && !m["downspeed"].empty() &&
-					        !m["upspeedt"].empty() && !m["downspeedt"].empty())
-					{
-						// [!] IRainman SpeedLimiter: to work correctly, you must first set the upload speed, and only then download speed!
-						SET_SETTING(MAX_UPLOAD_SPEED_LIMIT_NORMAL, Util::toInt(m["upspeed"]));
-						SET_SETTING(MAX_UPLOAD_SPEED_LIMIT_TIME, Util::toInt(m["upspeedt"]));
-						SET_SETTING(MAX_DOWNLOAD_SPEED_LIMIT_NORMAL, Util::toInt(m["downspeed"]));
-						SET_SETTING(MAX_DOWNLOAD_SPEED_LIMIT_TIME, Util::toInt(m["downspeedt"]));
-						SET_SETTING(THROTTLE_ENABLE, !(m["speedlimit"].empty()));
-						SET_SETTING(TIME_DEPENDENT_THROTTLE, !(m["speedlimitalt"].empty()));
-						if (CurrentUser.ispower())
-						{
-							SET_SETTING(WEBSERVER_ALLOW_CHANGE_DOWNLOAD_DIR, !(m["alch_d_d"].empty()));
-						}
-						SET_SETTING(BANDWIDTH_LIMIT_START, Util::toInt(m["altspeedtimestart"]));
-						SET_SETTING(BANDWIDTH_LIMIT_END, Util::toInt(m["altspeedtimestop"]));
-						SET_SETTING(WEBSERVER_SEARCHSIZE, Util::toInt(m["webss"]));
-						SET_SETTING(WEBSERVER_SEARCHPAGESIZE, Util::toInt(m["websps"]));
-					}
 				}
 			}
-			if (CurrentUser.isloggedin())
+			if (!m["dqueue"].empty())
+			{
+				const string dqueue = Util::encodeURI(m["dqueue"], true);
+				const string qfile = Util::encodeURI(m["qfile"], true);
+				if (dqueue == STRING(REMOVE2))
+				{
+					QueueManager::getInstance()->removeTarget(qfile, false);
+				}
+				if (dqueue == STRING(SET_PRIORITY))
+				{
+					const string dp = Util::encodeURI(m["dp"], true);
+					if (dp == STRING(AUTO))
+						QueueManager::getInstance()->setAutoPriority(qfile, true);
+					else if (dp == STRING(PAUSED))
+						QueueManager::getInstance()->setPriority(qfile, QueueItem::PAUSED);
+					else if (dp == STRING(LOWEST))
+						QueueManager::getInstance()->setPriority(qfile, QueueItem::LOWEST);
+					else if (dp == STRING(LOW))
+						QueueManager::getInstance()->setPriority(qfile, QueueItem::LOW);
+					else if (dp == STRING(NORMAL))
+						QueueManager::getInstance()->setPriority(qfile, QueueItem::NORMAL);
+					else if (dp == STRING(HIGH))
+						QueueManager::getInstance()->setPriority(qfile, QueueItem::HIGH);
+					else if (dp == STRING(HIGHEST))
+						QueueManager::getInstance()->setPriority(qfile, QueueItem::HIGHEST);
+				}
+			}
+			if (!m["refresh"].empty())
 			{
-				WebServerManager::getInstance()->getPage(header, IP, CurrentUser);
+				ShareManager::getInstance()->setDirty();
+				ShareManager::getInstance()->refresh_share(true);
 			}
-			else
+			if (!m["purgetth"].empty())
 			{
-				WebServerManager::getInstance()->getLoginPage(header);
+				ShareManager::getInstance()->setDirty();
+				ShareManager::getInstance()->setPurgeTTH();
+				ShareManager::getInstance()->refresh_share(true);
+				LogManager::message(STRING(PURGE_TTH_DATABASE)); //[!]NightOrion(translate)
+			}
+			if (!m["webss"].empty() && !m["websps"].empty() &&
+			        !m["upspeed"].empty() && !m["downspeed"].empty() &&
+			        !m["upspeedt"].empty() && !m["downspeedt"].empty())
+			{
+				// [!] IRainman SpeedLimiter: to work correctly, you must first set the upload speed, and only then download speed!
+				SET_SETTING(MAX_UPLOAD_SPEED_LIMIT_NORMAL, Util::toInt(m["upspeed"]));
+				SET_SETTING(MAX_UPLOAD_SPEED_LIMIT_TIME, Util::toInt(m["upspeedt"]));
+				SET_SETTING(MAX_DOWNLOAD_SPEED_LIMIT_NORMAL, Util::toInt(m["downspeed"]));
+				SET_SETTING(MAX_DOWNLOAD_SPEED_LIMIT_TIME, Util::toInt(m["downspeedt"]));
+				SET_SETTING(THROTTLE_ENABLE, !(m["speedlimit"].empty()));
+				SET_SETTING(TIME_DEPENDENT_THROTTLE, !(m["speedlimitalt"].empty()));
+				if (CurrentUser.ispower())
+				{
+					SET_SETTING(WEBSERVER_ALLOW_CHANGE_DOWNLOAD_DIR, !(m["alch_d_d"].empty()));
+				}
+				SET_SETTING(BANDWIDTH_LIMIT_START, Util::toInt(m["altspeedtimestart"]));
+				SET_SETTING(BANDWIDTH_LIMIT_END, Util::toInt(m["altspeedtimestop"]));
+				SET_SETTING(WEBSERVER_SEARCHSIZE, Util::toInt(m["webss"]));
+				SET_SETTING(WEBSERVER_SEARCHPAGESIZE, Util::toInt(m["websps"]));
 			}
-			::send(m_www_sock, header.c_str(), static_cast<int>(header.size()), 0);
-			break;
 		}
 	}
-	::closesocket(m_www_sock); // TOOD           ++ ?   ::shutdown(m_www_sock, SD_BOTH);?
-	m_www_sock = INVALID_SOCKET;
-	delete this;// Cleanup the thread object
-	return 0;
+	if (CurrentUser.isloggedin())
+	{
+		getPage(p_response, l_path, IP, CurrentUser);
+	}
+	else
+	{
+		getLoginPage(p_response);
+	}
 }
 
 void WebServerManager::search(string p_search_str, Search::TypeModes p_search_type)
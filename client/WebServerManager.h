@@ -24,6 +24,9 @@
 #include "DCPlusPlus.h"
 #include "ServerSocket.h"
 #include "SearchManager.h"
+#include "CFlyHttpServer.h"
+
+class CFlyWebApi;
 
 static const uint64_t WEB_SERVER_USER_SESSION_TIMEOUT = 300;
 
@@ -112,6 +115,10 @@ class WebServerManager : public Singleton<WebServerManager>, public ServerSocket
 		void on(ServerSocketListener::IncomingConnection) noexcept override;
 		
 		ServerSocket socket;
+		CFlyHttpServer m_http;
+		std::unique_ptr<CFlyWebApi> m_api;
+		
+		void handleRequest(const CFlyHttpServer::Request& p_request, CFlyHttpServer::Response& p_response);
 		
 		struct user_login
 		{
@@ -160,8 +167,8 @@ class WebServerManager : public Singleton<WebServerManager>, public ServerSocket
 				}
 		};
 		
-		void getPage(string& p_InOut, const string& IP, UserStatus CurrentUser);
-		void getLoginPage(string& p_out);
+		void getPage(CFlyHttpServer::Response& p_response, const string& p_page, const string& IP, UserStatus CurrentUser);
+		void getLoginPage(CFlyHttpServer::Response& p_response);
 		
 		// SettingsManagerListener
 		void on(SettingsManagerListener::Repaint) override;
@@ -318,28 +325,3 @@ class WebServerManager : public Singleton<WebServerManager>, public ServerSocket
 		// Теперь надо обработать include - подгрузить ещё один файл в тело переменной
 		// END HTML Templates injection
 };
-
-class WebServerSocket : public Thread
-{
-	public:
-		WebServerSocket() : m_www_sock(INVALID_SOCKET)
-		{
-			memzero(&m_from, sizeof(m_from));
-		}
-		void accept(ServerSocket *s)
-		{
-			int fromlen = sizeof(m_from);
-#ifdef _DEBUG_WEB_SERVER_
-			printf("accepting\n");
-#endif
-			m_www_sock = ::accept(s->getSock(), (struct sockaddr*) & m_from, &fromlen); // http://msdn.microsoft.com/en-us/library/windows/desktop/ms737526(v=vs.85).aspx
-			u_long b = 1;
-			ioctlsocket(m_www_sock, FIONBIO, &b);
-		}
-		
-		int run();
-		
-	private:
-		sockaddr_in m_from;
-		SOCKET m_www_sock;
-};
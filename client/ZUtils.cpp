@@ -25,10 +25,14 @@
 
 bool ZFilter::g_is_disable_compression = false;
 
-ZFilter::ZFilter() : totalIn(0), totalOut(0), compressing(true)
+static const int64_t g_window_size = 128 * 1024; // the level is chosen for each window of the input
+static const int g_skip_windows = 8; // stored without sampling after a window with the bad ratio
+
+ZFilter::ZFilter() : totalIn(0), totalOut(0), m_next_check(0), m_window_in(0), m_window_out(0),
+	m_max_level(SETTING(MAX_COMPRESSION)), m_level(SETTING(MAX_COMPRESSION)), m_wanted_level(SETTING(MAX_COMPRESSION)), m_window_level(-1), m_skip_windows(0)
 {
 	memzero(&zs, sizeof(zs));
-	const auto l_result = deflateInit(&zs, SETTING(MAX_COMPRESSION));
+	const auto l_result = deflateInit(&zs, m_level);
 	if (l_result != Z_OK)
 	{
 		if (l_result == Z_MEM_ERROR)
@@ -48,6 +52,31 @@ ZFilter::~ZFilter()
 	deflateEnd(&zs);
 }
 
+int ZFilter::chooseLevel(const void* in, size_t insize)
+{
+	if (m_max_level == 0)
+		return 0;
+	const int64_t l_window_in = totalIn - m_window_in;
+	const int64_t l_window_out = totalOut - m_window_out;
+	m_window_in = totalIn;
+	m_window_out = totalOut;
+	// The output lags behind the input kept in the current deflate block (up to a block of literals
+	// for the data that doesn't compress). deflateParams flushes the block, so the lag is the same at both ends
+	// of the window (and the ratio is right) only when the whole window was compressed at the same level.
+	const bool l_is_same_level = m_window_level == m_level;
+	m_window_level = m_level;
+	if (m_level > 0 && l_is_same_level && l_window_in > 0 && static_cast<double>(l_window_out) / l_window_in > 0.95)
+	{
+		m_skip_windows = g_skip_windows;
+	}
+	if (m_skip_windows > 0)
+	{
+		--m_skip_windows;
+		return 0;
+	}
+	return getLevelByEntropy(getSampleEntropy(in, insize), m_max_level);
+}
+
 bool ZFilter::operator()(const void* in, size_t& insize, void* out, size_t& outsize)
 {
 	if (outsize == 0)
@@ -61,13 +90,18 @@ bool ZFilter::operator()(const void* in, size_t& insize, void* out, size_t& outs
 #endif
 	
 	// Check if there's any use compressing; if not, save some cpu...
-	if (compressing && insize > 0 && outsize > 16 && (totalIn > (64 * 1024)) && ((static_cast<double>(totalOut) / totalIn) > 0.95))
+	if (insize > 0 && totalIn >= m_next_check)
+	{
+		m_next_check = totalIn + g_window_size;
+		m_wanted_level = chooseLevel(in, insize);
+	}
+	if (insize > 0 && outsize > 16 && m_wanted_level != m_level)
 	{
 		zs.avail_in = 0;
 		zs.avail_out = outsize;
 		
 		// Starting with zlib 1.2.9, the deflateParams API has changed.
-		auto err = ::deflateParams(&zs, 0, Z_DEFAULT_STRATEGY);
+		auto err = ::deflateParams(&zs, m_wanted_level, Z_DEFAULT_STRATEGY);
 #if ZLIB_VERNUM >= 0x1290
 		if (err == Z_STREAM_ERROR)
 		{
@@ -79,8 +113,6 @@ bool ZFilter::operator()(const void* in, size_t& insize, void* out, size_t& outs
 		}
 		
 		zs.avail_in = insize;
-		compressing = false;
-		dcdebug("ZFilter: Dynamically disabled compression\n");
 		
 		// Check if we ate all space already...
 #if ZLIB_VERNUM >= 0x1290
@@ -90,12 +122,15 @@ bool ZFilter::operator()(const void* in, size_t& insize, void* out, size_t& outs
 		if (zs.avail_out == 0)
 		{
 #endif
+			// The level is not changed yet (the pending data is flushed), try again with the next call
 			outsize = outsize - zs.avail_out;
 			insize = insize - zs.avail_in;
 			totalOut += outsize;
 			totalIn += insize;
 			return true;
 		}
+		m_level = m_wanted_level;
+		dcdebug("ZFilter: compression level %d\n", m_level);
 	}
 	else
 	{
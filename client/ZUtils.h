@@ -40,11 +40,71 @@ class ZFilter
 		bool operator()(const void* in, size_t& insize, void* out, size_t& outsize);
 	public:
 		static bool g_is_disable_compression;
+		/** Order-0 entropy (bits per byte) of a sample (64 runs of 64 bytes spread over the data) */
+		static double getSampleEntropy(const void* p_data, size_t p_size)
+		{
+			if (p_size == 0)
+				return 0;
+			const uint8_t* l_data = static_cast<const uint8_t*>(p_data);
+			const size_t l_run = 64;
+			const size_t l_runs = std::max<size_t>(1, std::min<size_t>(p_size, 4 * 1024) / l_run);
+			const size_t l_step = p_size / l_runs;
+			unsigned l_count[256] = { 0 };
+			size_t l_total = 0;
+			for (size_t i = 0; i < l_runs; ++i)
+			{
+				const uint8_t* l_pos = l_data + i * l_step;
+				const size_t l_len = std::min(l_run, p_size - i * l_step);
+				for (size_t j = 0; j < l_len; ++j)
+				{
+					++l_count[l_pos[j]];
+				}
+				l_total += l_len;
+			}
+			double l_entropy = 0;
+			for (int i = 0; i < 256; ++i)
+			{
+				if (l_count[i])
+				{
+					const double l_p = double(l_count[i]) / l_total;
+					l_entropy -= l_p * log(l_p);
+				}
+			}
+			return l_entropy / log(2.0);
+		}
+		/**
+		 * Level by the sample entropy: text, sources, XML, executables (about 4-6 bits) - p_max_level,
+		 * raw audio and images (6-7.5 bits) - Z_BEST_SPEED, compressed data (near 8 bits) - stored
+		 */
+		static int getLevelByEntropy(double p_entropy, int p_max_level)
+		{
+			if (p_entropy > 7.5)
+				return 0;
+			if (p_entropy > 6.0)
+				return std::min(p_max_level, int(Z_BEST_SPEED));
+			return p_max_level;
+		}
 	private:
+		/**
+		 * The compression level is chosen for each window of the input (adaptive):
+		 * - incompressible data (by the entropy of a sample or by the ratio of the previous window) is stored
+		 * - data of the medium entropy is compressed by the fastest level
+		 * - text-like data is compressed by the configured level
+		 * The output is a normal deflate stream (ZLIG compatible).
+		 */
+		int chooseLevel(const void* in, size_t insize);
+		
 		z_stream zs;
 		int64_t totalIn;
 		int64_t totalOut;
-		bool compressing;
+		int64_t m_next_check;
+		int64_t m_window_in;
+		int64_t m_window_out;
+		int m_max_level;
+		int m_level;
+		int m_wanted_level;
+		int m_window_level; // level of the previous window, -1 - not known (start)
+		int m_skip_windows;
 };
 
 class UnZFilter
@@ -186,7 +186,7 @@ OnlineUserPtr NmdcHub::getUser(const string& aNick, bool p_hub, bool p_first_loa
 
 
 #endif
-OnlineUserPtr NmdcHub::getUser(const string& aNick, bool p_hub, bool p_first_load)
+OnlineUserPtr NmdcHub::getUser(const string& aNick, bool p_hub, bool p_first_load, OnlineUserList* p_new_users /*= nullptr*/)
 {
 	OnlineUserPtr ou;
 	{
@@ -232,6 +232,12 @@ OnlineUserPtr NmdcHub::getUser(const string& aNick, bool p_hub, bool p_first_loa
 	}
 	if (!ou->getUser()->getCID().isZero())
 	{
+		if (p_new_users)
+		{
+			// the caller puts all the new users online at once
+			p_new_users->push_back(ou);
+			return ou;
+		}
 		ClientManager::getInstance()->putOnline(ou, true);
 		//  is_all_my_info_loaded()  true     
 		//  https://github.com/pavel-pimenov/flylinkdc-r5xx/issues/1682
@@ -251,9 +257,6 @@ OnlineUserPtr NmdcHub::findUser(const string& aNick) const
 {
 	CFlyReadLock(*m_cs);
 	const auto& i = m_users.find(aNick);
-#ifdef FLYLINKDC_USE_PROFILER_CS
-	//l_lock.m_add_log_info = " User = " + aNick;
-#endif
 	return i == m_users.end() ? OnlineUserPtr() : i->second;
 }
 
@@ -285,11 +288,13 @@ void NmdcHub::putUser(const string& aNick)
 		ClientManager::getInstance()->putOffline(ou); // [2] https://www.box.net/shared/7b796492a460fe528961
 	}
 	
+	removeUserUpdate(ou);
 	fly_fire2(ClientListener::UserRemoved(), this, ou); // [+] IRainman fix.
 }
 
 void NmdcHub::clearUsers()
 {
+	clearUserUpdates();
 	if (ClientManager::isBeforeShutdown())
 	{
 		CFlyWriteLock(*m_cs);
@@ -310,22 +315,21 @@ void NmdcHub::clearUsers()
 #endif
 			clearAvailableBytesL();
 		}
+		OnlineUserList l_users;
+		l_users.reserve(u2.size());
 		for (auto i = u2.cbegin(); i != u2.cend(); ++i)
 		{
 			//i->second->getIdentity().setBytesShared(0);
 			if (!i->second->getUser()->getCID().isZero()) // [+] IRainman fix.
 			{
-				ClientManager::getInstance()->putOffline(i->second);
+				l_users.push_back(i->second);
 			}
 			else
 			{
 				dcassert(0);
 			}
-			// 
-			// -   
-			// -         
-			// -         
 		}
+		ClientManager::getInstance()->putOffline(l_users);
 	}
 }
 //==========================================================================================
@@ -1492,13 +1496,15 @@ void NmdcHub::nickListParse(const string& param)
 			
 			// CFlyLock(cs); [-] IRainman fix: no needs lock here!
 			
+			OnlineUserList l_new_users;
 			for (auto it = sl.cbegin(); it != sl.cend(); ++it)
 			{
 				if (it->empty())
 					continue;
-				OnlineUserPtr ou = getUser(*it, false, false);
+				OnlineUserPtr ou = getUser(*it, false, false, &l_new_users);
 				v.push_back(ou);// [!] IRainman fix: use OnlineUserPtr
 			}
+			putOnline(l_new_users);
 			
 			if (!(m_supportFlags & SUPPORTS_NOGETINFO))
 			{
@@ -1543,12 +1549,13 @@ void NmdcHub::opListParse(const string& param)
 			
 			// CFlyLock(cs); [-] IRainman fix: no needs any lock here!
 			
+			OnlineUserList l_new_users;
 			for (auto it = sl.cbegin(); it != sl.cend(); ++it) // fix copy-paste
 			{
 				if (it->empty())
 					continue;
 					
-				OnlineUserPtr ou = getUser(*it, false, false);
+				OnlineUserPtr ou = getUser(*it, false, false, &l_new_users);
 				if (ou)
 				{
 					ou->getUser()->setFlag(User::IS_OPERATOR);
@@ -1556,6 +1563,7 @@ void NmdcHub::opListParse(const string& param)
 					v.push_back(ou);
 				}
 			}
+			putOnline(l_new_users);
 		}
 		fire_user_updated(v); //   -     ""
 		updateCounts(false);
@@ -1566,6 +1574,19 @@ void NmdcHub::opListParse(const string& param)
 	}
 }
 //==========================================================================================
+void NmdcHub::putOnline(const OnlineUserList& p_new_users)
+{
+	if (p_new_users.empty())
+		return;
+	ClientManager::getInstance()->putOnline(p_new_users, true);
+#ifdef IRAINMAN_INCLUDE_USER_CHECK
+	for (auto i = p_new_users.cbegin(); i != p_new_users.cend(); ++i)
+	{
+		UserManager::checkUser(*i);
+	}
+#endif
+}
+//==========================================================================================
 void NmdcHub::getUserList(OnlineUserList& p_list) const
 {
 	CFlyReadLock(*m_cs);
@@ -3089,7 +3110,7 @@ void NmdcHub::myInfoParse(const string& param)
 	}
 	if (!l_ext_json_param.empty())
 	{
-		extJSONParse(l_ext_json_param, true); // true -   ClientListener::UserUpdatedMyINFO
+		extJSONParse(l_ext_json_param, true); // true -   ClientListener::UsersUpdatedMyINFO
 		{
 			CFlyWriteLock(*m_cs);
 			m_ext_json_deferred.erase(l_nick);
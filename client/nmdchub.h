@@ -200,9 +200,12 @@ class NmdcHub : public Client, private Flags
 		static void logPM(const UserPtr& p_user, const string& p_msg, const string& p_hub_url);
 		void resetAntivirusInfo();
 		
-		OnlineUserPtr getUser(const string& aNick, bool p_hub, bool p_first_load); // [!] IRainman fix: return OnlineUserPtr and add hub
+		/** p_new_users - if set, the new users are added to it instead of putOnline (see putOnline) */
+		OnlineUserPtr getUser(const string& aNick, bool p_hub, bool p_first_load, OnlineUserList* p_new_users = nullptr); // [!] IRainman fix: return OnlineUserPtr and add hub
 		OnlineUserPtr findUser(const string& aNick) const;
 		void putUser(const string& aNick);
+		/** Puts the users collected by getUser online with one lock per ClientManager shard ($NickList, $OpList) */
+		void putOnline(const OnlineUserList& p_new_users);
 		
 		string getMyNickFromUtf8() const
 		{
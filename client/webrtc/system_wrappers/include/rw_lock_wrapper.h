@@ -31,86 +31,71 @@ class LOCKABLE RWLockWrapper {
 
   virtual void AcquireLockShared() SHARED_LOCK_FUNCTION() = 0;
   virtual void ReleaseLockShared() UNLOCK_FUNCTION() = 0;
+
+  // FlylinkDC++: false - the lock is busy (used by the contention profiler).
+  // Implementations without a try operation acquire the lock and return true.
+  virtual bool TryAcquireLockExclusive() {
+    AcquireLockExclusive();
+    return true;
+  }
+  virtual bool TryAcquireLockShared() {
+    AcquireLockShared();
+    return true;
+  }
 };
 
 // RAII extensions of the RW lock. Prevents Acquire/Release missmatches and
 // provides more compact locking syntax.
-class SCOPED_LOCKABLE ReadLockScoped
-#ifdef FLYLINKDC_USE_PROFILER_CS
-	: public CFlyLockProfiler
-#endif
-{
+class SCOPED_LOCKABLE ReadLockScoped {
  public:
   explicit ReadLockScoped(RWLockWrapper& rw_lock
-#ifdef FLYLINKDC_USE_PROFILER_CS
 	  , const char* p_function = nullptr
 	  , int p_line = 0
-#endif
 	  ) SHARED_LOCK_FUNCTION(rw_lock)
       : rw_lock_(rw_lock)
-#ifdef FLYLINKDC_USE_PROFILER_CS
-	  , CFlyLockProfiler(p_function, p_line)
-#endif
+	  , profiler_(p_function, p_line)
   {
-    rw_lock_.AcquireLockShared();
-#ifdef FLYLINKDC_USE_PROFILER_CS
-	log("D:\\ReadSectionLog-lock.txt", 0);
-#endif
+    profiler_.enter(rw_lock_.TryAcquireLockShared(), [this] {
+      rw_lock_.AcquireLockShared();
+    });
   }
 
   ~ReadLockScoped() UNLOCK_FUNCTION() {
+    profiler_.leave();
     rw_lock_.ReleaseLockShared();
-#ifdef FLYLINKDC_USE_PROFILER_CS
-	log("D:\\ReadSectionLog-unlock.txt", 0);
-#endif
   }
 
  private:
   RWLockWrapper& rw_lock_;
+  CFlyLockProfiler::Scope profiler_;
 };
 
-class SCOPED_LOCKABLE WriteLockScoped 
-#ifdef FLYLINKDC_USE_PROFILER_CS
-	: public CFlyLockProfiler
-#endif
-{
+class SCOPED_LOCKABLE WriteLockScoped {
  public:
   explicit WriteLockScoped(RWLockWrapper& rw_lock
-#ifdef FLYLINKDC_USE_PROFILER_CS
 	  , const char* p_function = nullptr
 	  , int p_line = 0
-#endif
 	  ) EXCLUSIVE_LOCK_FUNCTION(rw_lock)
-      : rw_lock_(rw_lock) 
-#ifdef FLYLINKDC_USE_PROFILER_CS
-	  , CFlyLockProfiler(p_function,p_line)
-#endif
+      : rw_lock_(rw_lock)
+	  , profiler_(p_function, p_line)
   {
-    rw_lock_.AcquireLockExclusive();
-#ifdef FLYLINKDC_USE_PROFILER_CS
-	log("D:\\WriteSectionLog-lock.txt", 0);
-#endif
-
+    profiler_.enter(rw_lock_.TryAcquireLockExclusive(), [this] {
+      rw_lock_.AcquireLockExclusive();
+    });
   }
 
   ~WriteLockScoped() UNLOCK_FUNCTION() {
+    profiler_.leave();
     rw_lock_.ReleaseLockExclusive();
-#ifdef FLYLINKDC_USE_PROFILER_CS
-	log("D:\\WriteSectionLog-unlock.txt", 0);
-#endif
   }
 
  private:
   RWLockWrapper& rw_lock_;
+  CFlyLockProfiler::Scope profiler_;
 };
 
-#ifdef FLYLINKDC_USE_PROFILER_CS
 #define CFlyReadLock(cs) webrtc::ReadLockScoped l_lock(cs,__FUNCTION__, __LINE__);
 #define CFlyWriteLock(cs) webrtc::WriteLockScoped l_lock(cs,__FUNCTION__, __LINE__);
-#else
-#define CFlyReadLock(cs) webrtc::ReadLockScoped l_lock(cs);
-#define CFlyWriteLock(cs) webrtc::WriteLockScoped l_lock(cs);
-#endif
 
 }  // namespace webrtc
 
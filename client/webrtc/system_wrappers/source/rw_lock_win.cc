@@ -30,11 +30,17 @@ typedef void (WINAPI* ReleaseSRWLockExclusive)(PSRWLOCK);
 typedef void (WINAPI* AcquireSRWLockShared)(PSRWLOCK);
 typedef void (WINAPI* ReleaseSRWLockShared)(PSRWLOCK);
 
+// Windows 7+ (optional)
+typedef BOOLEAN (WINAPI* TryAcquireSRWLockExclusive)(PSRWLOCK);
+typedef BOOLEAN (WINAPI* TryAcquireSRWLockShared)(PSRWLOCK);
+
 InitializeSRWLock       initialize_srw_lock;
 AcquireSRWLockExclusive acquire_srw_lock_exclusive;
 AcquireSRWLockShared    acquire_srw_lock_shared;
 ReleaseSRWLockShared    release_srw_lock_shared;
 ReleaseSRWLockExclusive release_srw_lock_exclusive;
+TryAcquireSRWLockExclusive try_acquire_srw_lock_exclusive;
+TryAcquireSRWLockShared try_acquire_srw_lock_shared;
 
 RWLockWin::RWLockWin() {
   initialize_srw_lock(&lock_);
@@ -63,6 +69,22 @@ void RWLockWin::ReleaseLockShared() {
   release_srw_lock_shared(&lock_);
 }
 
+bool RWLockWin::TryAcquireLockExclusive() {
+  if (!try_acquire_srw_lock_exclusive) {
+    acquire_srw_lock_exclusive(&lock_);
+    return true;
+  }
+  return try_acquire_srw_lock_exclusive(&lock_) != 0;
+}
+
+bool RWLockWin::TryAcquireLockShared() {
+  if (!try_acquire_srw_lock_shared) {
+    acquire_srw_lock_shared(&lock_);
+    return true;
+  }
+  return try_acquire_srw_lock_shared(&lock_) != 0;
+}
+
 bool RWLockWin::LoadModule() {
   if (module_load_attempted) {
     return native_rw_locks_supported;
@@ -92,6 +114,11 @@ bool RWLockWin::LoadModule() {
     (AcquireSRWLockShared)GetProcAddress(library, "AcquireSRWLockShared");
   release_srw_lock_shared =
     (ReleaseSRWLockShared)GetProcAddress(library, "ReleaseSRWLockShared");
+  try_acquire_srw_lock_exclusive =
+    (TryAcquireSRWLockExclusive)GetProcAddress(library,
+                                               "TryAcquireSRWLockExclusive");
+  try_acquire_srw_lock_shared =
+    (TryAcquireSRWLockShared)GetProcAddress(library, "TryAcquireSRWLockShared");
 
   if (initialize_srw_lock && acquire_srw_lock_exclusive &&
       release_srw_lock_exclusive && acquire_srw_lock_shared &&
@@ -28,6 +28,9 @@ class RWLockWin : public RWLockWrapper {
   virtual void AcquireLockShared();
   virtual void ReleaseLockShared();
 
+  virtual bool TryAcquireLockExclusive();
+  virtual bool TryAcquireLockShared();
+
  private:
   RWLockWin();
   static bool LoadModule();
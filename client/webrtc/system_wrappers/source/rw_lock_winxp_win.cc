@@ -78,4 +78,22 @@ void RWLockWinXP::ReleaseLockShared() {
   }
 }
 
+bool RWLockWinXP::TryAcquireLockExclusive() {
+  ScopedLock cs(&critical_section_);
+  if (writer_active_ || readers_active_ > 0) {
+    return false;
+  }
+  writer_active_ = true;
+  return true;
+}
+
+bool RWLockWinXP::TryAcquireLockShared() {
+  ScopedLock cs(&critical_section_);
+  if (writer_active_ || writers_waiting_ > 0) {
+    return false;
+  }
+  ++readers_active_;
+  return true;
+}
+
 }  // namespace webrtc
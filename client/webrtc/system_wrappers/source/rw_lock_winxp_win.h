@@ -28,6 +28,9 @@ class RWLockWinXP : public RWLockWrapper {
   void AcquireLockShared() override;
   void ReleaseLockShared() override;
 
+  bool TryAcquireLockExclusive() override;
+  bool TryAcquireLockShared() override;
+
  private:
   CRITICAL_SECTION critical_section_;
   ConditionVariableEventWin read_condition_;
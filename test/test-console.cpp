@@ -21,6 +21,12 @@
 #include <limits>
 #include "../client/CFlyProfiler.h"
 #include "../client/CFlyThread.h"
+#include "../client/CFlyADLRule.h"
+#include "../client/CFlyAdcCommandView.h"
+#include "../client/AdcCommand.h"
+#include "../client/ZUtils.h"
+#include "../client/SimpleXML.h"
+#include "../client/Util.h"
 #include "cperformance.h"
 #include "cycle.h"
 
@@ -726,6 +732,369 @@ int verlihub_1()
     return 1;
 }
 
+// ADLSearch: regex built for every name (old ADLSearch::searchAll) vs rules compiled once (CFlyADLRule)
+// test-console.exe adl [count_rules] [count_files]
+static string toLowerASCII(const string& p_str)
+{
+	string l_result = p_str;
+	std::transform(l_result.begin(), l_result.end(), l_result.begin(), ::tolower);
+	return l_result;
+}
+void test_adl_search_rules(size_t p_count_rules, size_t p_count_files)
+{
+	static const char* g_words[] = { "movie", "Music", "flac", "Season", "x264", "1080p", "Album", "book", "setup", "SAMPLE" };
+	const size_t l_count_words = sizeof(g_words) / sizeof(g_words[0]);
+	std::vector<string> l_rules;
+	for (size_t i = 0; i < p_count_rules; ++i)
+	{
+		switch (i % 4)
+		{
+			case 0: // literal
+				l_rules.push_back(string(g_words[i % l_count_words]) + std::to_string(i));
+				break;
+			case 1: // regex
+				l_rules.push_back("^" + string(g_words[i % l_count_words]) + ".*\\.(mkv|avi)$");
+				break;
+			case 2: // invalid regex - substrings
+				l_rules.push_back(string(g_words[(i + 1) % l_count_words]) + " (" + std::to_string(i));
+				break;
+			default: // regex with alternation
+				l_rules.push_back(string(g_words[i % l_count_words]) + "|" + g_words[(i + 3) % l_count_words] + std::to_string(i));
+				break;
+		}
+	}
+	std::vector<string> l_names;
+	std::vector<string> l_low_names;
+	for (size_t i = 0; i < p_count_files; ++i)
+	{
+		l_names.push_back(string(g_words[i % l_count_words]) + "." + std::to_string(i) + "." + g_words[(i * 7) % l_count_words] + (i % 3 ? ".mkv" : ".mp3"));
+		l_low_names.push_back(toLowerASCII(l_names.back()));
+	}
+	
+	size_t l_old_matches = 0;
+	ticks start = getticks();
+	for (size_t j = 0; j < l_names.size(); ++j)
+	{
+		for (size_t r = 0; r < l_rules.size(); ++r)
+		{
+			bool l_match = false;
+			try
+			{
+				std::regex reg(l_rules[r], std::regex_constants::icase);
+				l_match = std::regex_search(l_names[j], reg);
+			}
+			catch (...)
+			{
+				std::vector<string> l_terms;
+				const string l_low_rule = toLowerASCII(l_rules[r]);
+				boost::split(l_terms, l_low_rule, boost::is_any_of(" "));
+				l_match = !l_low_rule.empty();
+				for (auto t = l_terms.cbegin(); t != l_terms.cend(); ++t)
+				{
+					if (!t->empty() && l_low_names[j].find(*t) == string::npos)
+						l_match = false;
+				}
+			}
+			l_old_matches += l_match;
+		}
+	}
+	const double l_old_time = elapsed(getticks(), start);
+	
+	start = getticks();
+	std::vector<CFlyADLRule> l_compiled(l_rules.size());
+	for (size_t r = 0; r < l_rules.size(); ++r)
+	{
+		std::vector<string> l_terms;
+		const string l_low_rule = toLowerASCII(l_rules[r]);
+		boost::split(l_terms, l_low_rule, boost::is_any_of(" "));
+		l_compiled[r].compile(l_rules[r], l_low_rule, l_terms);
+	}
+	size_t l_new_matches = 0;
+	for (size_t j = 0; j < l_names.size(); ++j)
+	{
+		for (size_t r = 0; r < l_compiled.size(); ++r)
+		{
+			l_new_matches += l_compiled[r].match(l_names[j], l_low_names[j]);
+		}
+	}
+	const double l_new_time = elapsed(getticks(), start);
+	printf("ADLSearch rules = %u files = %u\r\n", unsigned(p_count_rules), unsigned(p_count_files));
+	printf("regex per name = %f matches = %u\r\n", l_old_time, unsigned(l_old_matches));
+	printf("compiled rules = %f matches = %u\r\n", l_new_time, unsigned(l_new_matches));
+}
+
+// ADC commands: AdcCommand (StringList of unescaped copies, a new string per toString)
+// vs in place parsing (CFlyAdcCommandView) + AdcCommand::toString into a reused buffer
+// test-console.exe adc [file with captured commands, one per line] [count_passes]
+void test_adc_command(const char* p_file, size_t p_count_passes)
+{
+	std::vector<string> l_lines;
+	if (p_file)
+	{
+		std::ifstream l_in(p_file);
+		string l_line;
+		while (std::getline(l_in, l_line))
+		{
+			if (!l_line.empty() && l_line[l_line.length() - 1] == '\r')
+				l_line.erase(l_line.length() - 1);
+			if (l_line.length() > 4)
+				l_lines.push_back(l_line);
+		}
+	}
+	if (l_lines.empty())
+	{
+		// Typical hub and UDP traffic
+		static const char* g_lines[] =
+		{
+			"BINF AAB7 IDHMQPIV2X4XFN7DPXC4LG4BZG5BYOSQ5GRJ7HI3I PDQ5KWLIZ2TA3TZT3UIHWB4F6QRG5OGUNBM4GW4CQ NIsome\\suser SL3 FS3 SS1099511627776 SF123456 HN5 HR0 HO0 VEFlylinkDC++\\sr600 US13107200 I4192.168.1.10 U412345 SUTCP4,UDP4,ADC0,SEGA KPSHA256/3UPRH6IFWHFVAQ7KSHPHUPXNV4YDLHYAOTCLLK2GCJBQOJP2ZBXA DEfiles\\sand\\smovies AW1",
+			"BINF AAB7 SS1099511627812 SF123457",
+			"BINF ABCD NIuser2 SL10 FS10 SS5000000 SF100 HN1 HR0 HO0 I4172.16.0.5 U46250 SUTCP4,UDP4",
+			"BMSG AAB7 hello\\severybody,\\show\\sare\\syou?\\nsecond\\sline",
+			"BSCH AAB7 TRLWPNACQDBZRYXW3VHJVCJ64QBZNGHOHHHZWCLNQ TOauto12345",
+			"BSCH AAB7 ANmovie ANmkv NOsample EX.mkv EX.avi TO8421 GR32",
+			"DRES AAB7 ABCD FN/Movies/Some\\sMovie\\s(2017)/movie.mkv SI1468006400 SL2 TRLWPNACQDBZRYXW3VHJVCJ64QBZNGHOHHHZWCLNQ TO8421",
+			"URES HMQPIV2X4XFN7DPXC4LG4BZG5BYOSQ5GRJ7HI3I FN/Music/Album/01\\s-\\sTrack.flac SI31457280 SL3 TRLWPNACQDBZRYXW3VHJVCJ64QBZNGHOHHHZWCLNQ TO5",
+			"UPSR HMQPIV2X4XFN7DPXC4LG4BZG5BYOSQ5GRJ7HI3I U412345 NIsome\\suser HI10.0.0.1:411 TRLWPNACQDBZRYXW3VHJVCJ64QBZNGHOHHHZWCLNQ PC4 PI0,10,20,30,40,50,60,70",
+			"DCTM AAB7 ABCD ADC/1.0 41234 1234567890",
+			"IQUI AAB7 DI1",
+			"ISTA 000 Welcome\\sto\\sthe\\shub"
+		};
+		for (size_t i = 0; i < sizeof(g_lines) / sizeof(g_lines[0]); ++i)
+		{
+			l_lines.push_back(g_lines[i]);
+		}
+	}
+	// the commands to send - the same for both passes
+	std::vector<std::unique_ptr<AdcCommand>> l_commands;
+	for (auto i = l_lines.cbegin(); i != l_lines.cend();)
+	{
+		try
+		{
+			l_commands.push_back(std::make_unique<AdcCommand>(*i));
+			++i;
+		}
+		catch (const ParseException&)
+		{
+			i = l_lines.erase(i);
+		}
+	}
+	size_t l_old_size = 0;
+	ticks start = getticks();
+	for (size_t k = 0; k < p_count_passes; ++k)
+	{
+		for (size_t i = 0; i < l_lines.size(); ++i)
+		{
+			const AdcCommand l_cmd(l_lines[i]);
+			string l_nick;
+			l_cmd.getParam("NI", 0, l_nick);
+			const string l_out = l_commands[i]->toString(l_commands[i]->getFrom());
+			l_old_size += l_out.size() + l_nick.size();
+		}
+	}
+	const double l_old_time = elapsed(getticks(), start);
+	
+	size_t l_new_size = 0;
+	start = getticks();
+	CFlyAdcCommandView l_view;
+	string l_out;
+	string l_nick;
+	for (size_t k = 0; k < p_count_passes; ++k)
+	{
+		for (size_t i = 0; i < l_lines.size(); ++i)
+		{
+			if (l_view.parse(l_lines[i].c_str(), l_lines[i].length()) != nullptr)
+				continue;
+			l_nick.clear();
+			l_view.getParam("NI", 0, l_nick);
+			l_commands[i]->toString(l_commands[i]->getFrom(), false, l_out);
+			l_new_size += l_out.size() + l_nick.size();
+		}
+	}
+	const double l_new_time = elapsed(getticks(), start);
+	printf("ADC commands = %u passes = %u\r\n", unsigned(l_lines.size()), unsigned(p_count_passes));
+	printf("AdcCommand + toString()     = %f size = %u\r\n", l_old_time, unsigned(l_old_size));
+	printf("view + toString(buffer)     = %f size = %u\r\n", l_new_time, unsigned(l_new_size));
+}
+
+// ZFilter level by the sample entropy: text keeps MAX_COMPRESSION, medium entropy data - the fastest level,
+// random (compressed) data is stored
+// test-console.exe zlib
+bool test_zfilter_entropy()
+{
+	static const char* g_words[] = { "the ", "upload ", "queue ", "of ", "FlylinkDC++ ", "keeps ", "segments, ", "and ", "hubs. ", "Search\r\n" };
+	const size_t l_size = 128 * 1024;
+	std::vector<uint8_t> l_text;
+	for (size_t i = 0; l_text.size() < l_size; ++i)
+	{
+		const char* l_word = g_words[(i * 7 + i / 3) % _countof(g_words)];
+		l_text.insert(l_text.end(), l_word, l_word + strlen(l_word));
+	}
+	l_text.resize(l_size);
+	std::vector<uint8_t> l_medium(l_size);
+	std::vector<uint8_t> l_random(l_size);
+	srand(1);
+	for (size_t i = 0; i < l_size; ++i)
+	{
+		const unsigned l_value = (unsigned(rand()) << 15) ^ unsigned(rand());
+		l_medium[i] = uint8_t(l_value & 0x7F); // 7 bits per byte
+		l_random[i] = uint8_t(l_value >> 7);
+	}
+	const std::vector<uint8_t> l_zero(l_size);
+	const int l_max_level = 9;
+	const struct
+	{
+		const char* m_name;
+		const std::vector<uint8_t>& m_data;
+		int m_level;
+	} l_cases[] =
+	{
+		{ "text", l_text, l_max_level },
+		{ "zero", l_zero, l_max_level },
+		{ "medium", l_medium, Z_BEST_SPEED },
+		{ "random", l_random, 0 }
+	};
+	bool l_is_ok = true;
+	for (size_t i = 0; i < _countof(l_cases); ++i)
+	{
+		const double l_entropy = ZFilter::getSampleEntropy(l_cases[i].m_data.data(), l_cases[i].m_data.size());
+		const int l_level = ZFilter::getLevelByEntropy(l_entropy, l_max_level);
+		const bool l_is_case_ok = l_level == l_cases[i].m_level;
+		printf("%-6s entropy = %f level = %d (expected %d) %s\r\n", l_cases[i].m_name, l_entropy, l_level, l_cases[i].m_level, l_is_case_ok ? "OK" : "FAIL");
+		l_is_ok &= l_is_case_ok;
+	}
+	if (ZFilter::getSampleEntropy(l_text.data(), 0) != 0 || ZFilter::getSampleEntropy(l_text.data(), 10) <= 0)
+	{
+		printf("short sample FAIL\r\n");
+		l_is_ok = false;
+	}
+	return l_is_ok;
+}
+
+// SimpleXMLReader: the same document fed at once and in 1, 3, 7, 17 and 64K byte chunks
+// must give the same callbacks (block scanning of attribute values, content, spaces, comments and CDATA)
+// test-console.exe xml [file list xml] [count_passes]
+
+// Util.cpp is not linked - only the empty strings used by SimpleXMLReader.cpp and Text.cpp
+const string Util::emptyString;
+const wstring Util::emptyStringW;
+const tstring Util::emptyStringT;
+
+class CFlyXMLRecorder : public SimpleXMLReader::CallBack
+{
+	public:
+		string m_log;
+		size_t m_count_tags;
+		const bool m_is_log; // false - only count the tags (benchmark)
+		explicit CFlyXMLRecorder(bool p_is_log = true) : m_count_tags(0), m_is_log(p_is_log)
+		{
+		}
+		void startTag(const string& p_name, StringPairList& p_attribs, bool p_simple)
+		{
+			++m_count_tags;
+			if (!m_is_log)
+				return;
+			m_log += '<';
+			m_log += p_name;
+			for (auto i = p_attribs.cbegin(); i != p_attribs.cend(); ++i)
+			{
+				m_log += ' ';
+				m_log += i->first;
+				m_log += "=[";
+				m_log += i->second;
+				m_log += ']';
+			}
+			m_log += p_simple ? "/>\n" : ">\n";
+		}
+		void endTag(const string& p_name, const string& p_data)
+		{
+			if (!m_is_log)
+				return;
+			m_log += "</";
+			m_log += p_name;
+			m_log += ">[";
+			m_log += p_data;
+			m_log += "]\n";
+		}
+};
+
+static string makeXMLTestDocument(size_t p_size)
+{
+	string l_xml = "\xef\xbb\xbf<?xml version=\"1.0\" encoding=\"utf-8\" standalone=\"yes\"?>\r\n"
+	               "<!-- test-console xml -->\r\n"
+	               "<FileListing Version=\"1\" CID=\"HMQPIV2X4XFN7DPXC4LG4BZG5BYOSQ5GRJ7HI3I\" Base=\"/\" Generator=\"FlylinkDC++ r600\">\r\n";
+	for (size_t i = 0; l_xml.size() < p_size; ++i)
+	{
+		const string l_index = std::to_string(i);
+		l_xml += "\t<Directory Name=\"Movies &amp; TV shows " + l_index + "\">\r\n";
+		l_xml += "\t\t<File Name=\"Some &quot;long&quot; movie name (2017) - part " + l_index + ".mkv\" Size=\"1468006400\" TTH=\"LWPNACQDBZRYXW3VHJVCJ64QBZNGHOHHHZWCLNQ\"/>\r\n";
+		l_xml += "\t\t<File  Name = '&lt;tag&gt; &apos;quoted&apos; &#65;&#x42;&#1049; " + l_index + ".flac'   Size='31457280' TTH='TRLWPNACQDBZRYXW3VHJVCJ64QBZNGHOHHHZWCLNQ' />\r\n";
+		l_xml += "\t\t<!-- a comment longer than sixteen bytes " + l_index + " -->\r\n";
+		l_xml += "\t\t<Description>   text content &amp; more text, longer than sixteen bytes " + l_index + "   </Description>\r\n";
+		l_xml += "\t\t<Data><![CDATA[<not a tag> & raw data " + l_index + "]]></Data>\r\n";
+		l_xml += "\t\t<Empty></Empty>\r\n";
+		l_xml += "\t</Directory>\r\n";
+	}
+	l_xml += "</FileListing>\r\n";
+	return l_xml;
+}
+
+static bool parseXMLByChunks(const string& p_xml, size_t p_chunk, CFlyXMLRecorder& p_recorder)
+{
+	try
+	{
+		SimpleXMLReader l_reader(&p_recorder);
+		for (size_t i = 0; i < p_xml.size(); i += p_chunk)
+		{
+			const size_t l_len = std::min(p_chunk, p_xml.size() - i);
+			if (!l_reader.parse(p_xml.data() + i, l_len, i + l_len < p_xml.size()))
+				break;
+		}
+		return true;
+	}
+	catch (const SimpleXMLException& e)
+	{
+		printf("chunk = %u error: %s\r\n", unsigned(p_chunk), e.getError().c_str());
+		return false;
+	}
+}
+
+bool test_xml_reader(const char* p_file, size_t p_count_passes)
+{
+	string l_xml;
+	if (p_file)
+	{
+		std::ifstream l_in(p_file, std::ios::binary);
+		l_xml.assign(std::istreambuf_iterator<char>(l_in), std::istreambuf_iterator<char>());
+	}
+	if (l_xml.empty())
+	{
+		l_xml = makeXMLTestDocument(4 * 1024 * 1024);
+	}
+	CFlyXMLRecorder l_reference;
+	if (!parseXMLByChunks(l_xml, l_xml.size(), l_reference))
+		return false;
+	printf("XML size = %u tags = %u\r\n", unsigned(l_xml.size()), unsigned(l_reference.m_count_tags));
+	
+	bool l_is_ok = true;
+	static const size_t g_chunks[] = { 1, 3, 7, 17, 64 * 1024 };
+	for (size_t i = 0; i < _countof(g_chunks); ++i)
+	{
+		CFlyXMLRecorder l_recorder;
+		const bool l_is_chunk_ok = parseXMLByChunks(l_xml, g_chunks[i], l_recorder) && l_recorder.m_log == l_reference.m_log;
+		printf("chunk = %-6u %s\r\n", unsigned(g_chunks[i]), l_is_chunk_ok ? "OK" : "FAIL");
+		l_is_ok &= l_is_chunk_ok;
+	}
+	
+	ticks start = getticks();
+	for (size_t k = 0; k < p_count_passes; ++k)
+	{
+		CFlyXMLRecorder l_recorder(false);
+		parseXMLByChunks(l_xml, 64 * 1024, l_recorder);
+	}
+	printf("parse by 64K chunks passes = %u time = %f\r\n", unsigned(p_count_passes), elapsed(getticks(), start));
+	return l_is_ok;
+}
+
 unsigned long Ip2Num_verli(const string &ip)
 {
     int i;
@@ -752,6 +1121,36 @@ unsigned long Ip2Num_fly(const string &ip)
 
 int _tmain(int argc, _TCHAR* argv[])
 {
+	if (argc > 1 && _tcscmp(argv[1], _T("adl")) == 0)
+	{
+		const size_t l_count_rules = argc > 2 ? _ttoi(argv[2]) : 200;
+		const size_t l_count_files = argc > 3 ? _ttoi(argv[3]) : 10000;
+		for (size_t l_rules = 25; l_rules <= l_count_rules; l_rules *= 2)
+		{
+			for (size_t l_files = 1000; l_files <= l_count_files; l_files *= 10)
+			{
+				test_adl_search_rules(l_rules, l_files);
+			}
+		}
+		return 0;
+	}
+	if (argc > 1 && _tcscmp(argv[1], _T("zlib")) == 0)
+	{
+		return test_zfilter_entropy() ? 0 : 1;
+	}
+	if (argc > 1 && _tcscmp(argv[1], _T("adc")) == 0)
+	{
+		const string l_file = argc > 2 ? string(argv[2], argv[2] + _tcslen(argv[2])) : string();
+		const size_t l_count_passes = argc > 3 ? _ttoi(argv[3]) : 100000;
+		test_adc_command(l_file.empty() ? nullptr : l_file.c_str(), l_count_passes);
+		return 0;
+	}
+	if (argc > 1 && _tcscmp(argv[1], _T("xml")) == 0)
+	{
+		const string l_file = argc > 2 ? string(argv[2], argv[2] + _tcslen(argv[2])) : string();
+		const size_t l_count_passes = argc > 3 ? _ttoi(argv[3]) : 10;
+		return test_xml_reader(l_file.empty() ? nullptr : l_file.c_str(), l_count_passes) ? 0 : 1;
+	}
     string aa = "xxxxxx";
     aa += 'a';
     auto l = aa.find("a");
@@ -3620,24 +3620,26 @@ void HubFrame::on(ClientListener::UserShareUpdated, const OnlineUserPtr& user) n
 	}
 }
 #endif
-void HubFrame::on(ClientListener::UserUpdatedMyINFO, const OnlineUserPtr& user) noexcept   // !SMT!-fix
+void HubFrame::on(ClientListener::UsersUpdatedMyINFO, const Client*, const OnlineUserList& aList) noexcept   // !SMT!-fix
 {
-	if (!isClosedOrShutdown())
+	if (isClosedOrShutdown())
+		return;
+	for (auto i = aList.cbegin(); i != aList.cend(); ++i)
 	{
 #ifdef FLYLINKDC_UPDATE_USER_JOIN_USE_WIN_MESSAGES_Q
-		const auto l_ou_ptr = new OnlineUserPtr(user);
+		const auto l_ou_ptr = new OnlineUserPtr(*i);
 		if (PostMessage(WM_SPEAKER_UPDATE_USER_JOIN, WPARAM(l_ou_ptr)) == FALSE)
 		{
 			dcassert(0);
 			delete l_ou_ptr;
 		}
 #else
-		speak(UPDATE_USER_JOIN, user);
+		speak(UPDATE_USER_JOIN, *i);
 #endif
+	}
 #ifdef _DEBUG
-//		LogManager::message("[single OnlineUserPtr] void HubFrame::on(ClientListener::UserUpdatedMyINFO nick = " + user->getUser()->getLastNick() + " this = " + Util::toString(__int64(this)));
+//	LogManager::message("[array OnlineUserPtr] void HubFrame::on(ClientListener::UsersUpdatedMyINFO count = " + Util::toString(aList.size()) + " this = " + Util::toString(__int64(this)));
 #endif
-	}
 }
 
 void HubFrame::on(ClientListener::StatusMessage, const Client*, const string& line, int statusFlags) noexcept
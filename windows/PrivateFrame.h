@@ -185,9 +185,16 @@ class PrivateFrame : public MDITabChildWindowImpl < PrivateFrame, RGB(0, 255, 25
 		void updateTitle();
 		
 		// ClientManagerListener
-		void on(ClientManagerListener::UserUpdated, const OnlineUserPtr& aUser) noexcept override   // !SMT!-fix
+		void on(ClientManagerListener::UsersUpdated, const OnlineUserList& p_list) noexcept override   // !SMT!-fix
 		{
-			on(ClientManagerListener::UserDisconnected(), aUser->getUser()); // !SMT!-fix
+			for (auto i = p_list.cbegin(); i != p_list.cend(); ++i)
+			{
+				if ((*i)->getUser() == m_replyTo.user)
+				{
+					PostMessage(WM_SPEAKER, PM_USER_UPDATED);
+					break;
+				}
+			}
 		}
 		void on(ClientManagerListener::UserConnected, const UserPtr& aUser) noexcept override
 		{
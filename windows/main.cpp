@@ -555,9 +555,6 @@ static int Run(LPTSTR /*lpstrCmdLine*/ = NULL, int nCmdShow = SW_SHOWDEFAULT)
 #endif
 #ifdef FLYLINKDC_USE_GATHER_STATISTICS
 	// TODO - flush file
-#endif
-#ifdef FLYLINKDC_USE_PROFILER_CS
-	CFlyLockProfiler::print_stat();
 #endif
 	DirectoryListing::print_stat();
 	return nRet;